@@ -3,6 +3,9 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 SRCS = common.c \
+	   ulog.c \
+	   ftrace.c \
+	   rt.c \
 	   pwm.c \
 	   analog.c \
 	   thermistor.c \
@@ -13,11 +16,18 @@ SRCS = common.c \
 	   lmsw.c \
 	   stepper.c \
 	   stepper_pruss.c \
+	   stepper_sched.c \
+	   stepcompress.c \
 	   pruss.c \
 	   unicorn.c \
 	   planner.c \
+	   latency.c \
+	   estimate.c \
 	   motion.c \
 	   gcode.c \
+	   delta.c \
+	   kinematics.c \
+	   mesh.c \
 	   eeprom.c \
 	   sdcard.c \
 	   parameter.c \
@@ -42,6 +52,7 @@ LOCAL_C_INCLUDES += ../unicorn/. \
 
 
 DEBUG_FLAGS ?= 0x0000
+LOCAL_ARM_NEON := true
 LOCAL_CFLAGS += -O3 -DD_INIT="$(DEBUG_FLAGS)" 
 LOCAL_LDLIBS :=  -lm   -lprussdrv
 #LOCAL_SHARED_LIBRARIES += libprussdrv
@@ -185,13 +185,14 @@ int main(int argc, char *argv[])
     if( argc<2 )
     {
 USAGE:
-        printf("Usage: %s [-V#EBbcmLldz] [-Idir] [-Dname=value] [-Cname] InFile [OutFileBase]\n\n",argv[0]);
+        printf("Usage: %s [-V#EBbcmaLldz] [-Idir] [-Dname=value] [-Cname] InFile [OutFileBase]\n\n",argv[0]);
         printf("    V# - Specify core version (V0,V1,V2,V3). (Default is V1)\n");
         printf("    E  - Assemble for big endian core\n");
         printf("    B  - Create big endian binary output (*.bib)\n");
         printf("    b  - Create little endian binary output (*.bin)\n");
         printf("    c  - Create 'C array' binary output (*_bin.h)\n");
         printf("    m  - Create 'image' binary output (*.img)\n");
+        printf("    a  - Create static cycle analysis (*.cyc)\n");
         printf("    L  - Create annotated source file style listing (*.txt)\n");
         printf("    l  - Create raw listing file (*.lst)\n");
         printf("    d  - Create pView debug file (*.dbg)\n");
@@ -326,6 +327,8 @@ USAGE:
                     Options |= OPTION_CARRAY;
                 else if( *flags == 'm' )
                     Options |= OPTION_IMGFILE;
+                else if( *flags == 'a' )
+                    Options |= OPTION_CYCLES;
                 else if( *flags == 'l' )
                     Options |= OPTION_LISTING;
                 else if( *flags == 'L' )
@@ -389,7 +392,7 @@ USAGE:
     CloseSourceFile( mainsource );
 
     /* If no output specified, default to 'C' array */
-    if( !(Options & (OPTION_BINARY|OPTION_CARRAY|OPTION_BINARYBIG|OPTION_IMGFILE|OPTION_DBGFILE)) )
+    if( !(Options & (OPTION_BINARY|OPTION_CARRAY|OPTION_BINARYBIG|OPTION_IMGFILE|OPTION_DBGFILE|OPTION_CYCLES)) )
     {
         printf("Note: Using default output '-c' (C array *_bin.h)\n\n");
         Options |= OPTION_CARRAY;
@@ -501,6 +504,21 @@ USAGE:
             fclose( Outfile );
         }
     }
+    if( Options & OPTION_CYCLES )
+    {
+        FILE *Outfile;
+
+        strcpy( outfilename, outbase );
+        strcat( outfilename, ".cyc" );
+        if (!(Outfile = fopen(outfilename,"wb")))
+            Report(0,REP_ERROR,"Unable to open output file: %s",outfilename);
+        else
+        {
+            if( CycleAnalysis( Outfile, ProgramImage, CodeOffset, EntryPoint, pLabelList ) < 0 )
+                Report(0,REP_ERROR,"Cycle analysis failed");
+            fclose( Outfile );
+        }
+    }
     if( Options & OPTION_DBGFILE )
     {
         FILE *Outfile;
@@ -124,6 +124,7 @@ extern unsigned int Options;
 #define OPTION_BIGENDIAN            (1<<7)
 #define OPTION_RETREGSET            (1<<8)
 #define OPTION_SOURCELISTING        (1<<9)
+#define OPTION_CYCLES               (1<<10)
 extern unsigned int Core;
 #define CORE_NONE                   0
 #define CORE_V0                     1
@@ -230,6 +231,32 @@ int ProcessOp( SOURCEFILE *ps, int TermCnt, char **pTerms );
 int GetRegister( SOURCEFILE *ps, int num, char *src, PRU_ARG *pa, int fBitOk, char termC );
 
 
+/*=====================================================================
+//
+// Functions Implemented by the Cycle Analysis Module
+//
+//====================================================================*/
+
+/*
+// CycleAnalysis
+//
+// Static cycle report of the assembled image: best and worst case
+// cycles per label and per loop iteration, and the memory accesses
+// on the worst path.
+//
+// pfOut     - Report file
+// pImage    - Program image
+// CodeCount - Instruction count
+// Entry     - Entry point, -1 for 0
+// pLabels   - Label list
+//
+// Returns:
+//      0 : Success
+//     -1 : Error
+*/
+int CycleAnalysis( FILE *pfOut, CODEGEN *pImage, int CodeCount, int Entry, LABEL *pLabels );
+
+
 /*=====================================================================
 //
 // Functions Implemented by the DotCommand Module
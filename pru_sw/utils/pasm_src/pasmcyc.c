@@ -0,0 +1,1239 @@
+/*===========================================================================
+// PASM - PRU Assembler
+//---------------------------------------------------------------------------
+//
+// File     : pasmcyc.c
+//
+// Description:
+//     Static cycle analysis of the assembled image (-a, *.cyc)
+//         - Decodes the code words of the program image
+//         - Splits the code in basic blocks and builds the flow graph
+//         - Tracks register constants to classify LBBO/SBBO targets
+//         - Finds the natural loops of the flow graph
+//         - Reports best/worst cycles per label and per loop iteration,
+//           the worst path and its local/L4/DDR accesses
+//
+//     Cost model: one cycle per instruction, a load or store adds the
+//     latency of the memory it touches plus one cycle per further word
+//     of the burst. The L4 and DDR numbers are estimates of the OCP
+//     master port latency, not data sheet values.
+//
+//---------------------------------------------------------------------------
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "pasm.h"
+
+/* Memory classes */
+#define MEM_LOCAL       0   /* PRU data RAM, shared RAM, PRU-ICSS registers */
+#define MEM_L4          1   /* L3/L4 peripherals, GPIO */
+#define MEM_DDR         2   /* External memory, C31 */
+#define MEM_UNKNOWN     3   /* Base register not known, costed as DDR */
+#define MEM_CLASSES     4
+
+static char *MemClassName[MEM_CLASSES] = { "local", "l4", "ddr", "unknown" };
+static int  MemReadCycles[MEM_CLASSES]  = { 3, 40, 70, 70 };
+static int  MemWriteCycles[MEM_CLASSES] = { 2,  8,  8,  8 };
+
+/* AM335x constant table, C24-C28 as set up by CTBIR/CTPPR0, C31 is DDR */
+static unsigned char ConstClass[32] = {
+    MEM_LOCAL, MEM_L4,    MEM_L4,    MEM_LOCAL,     /* C0-C3   */
+    MEM_LOCAL, MEM_L4,    MEM_L4,    MEM_LOCAL,     /* C4-C7   */
+    MEM_L4,    MEM_L4,    MEM_L4,    MEM_L4,        /* C8-C11  */
+    MEM_L4,    MEM_L4,    MEM_L4,    MEM_L4,        /* C12-C15 */
+    MEM_L4,    MEM_L4,    MEM_L4,    MEM_L4,        /* C16-C19 */
+    MEM_L4,    MEM_LOCAL, MEM_L4,    MEM_L4,        /* C20-C23 */
+    MEM_LOCAL, MEM_LOCAL, MEM_LOCAL, MEM_LOCAL,     /* C24-C27 */
+    MEM_LOCAL, MEM_L4,    MEM_L4,    MEM_DDR,       /* C28-C31 */
+};
+
+/* Decoded instruction kinds */
+#define KIND_ALU        0   /* ADD ... SET, NOPx */
+#define KIND_LDI        1
+#define KIND_CLOBBER    2   /* LMBD, SCAN, MVI: destination unknown */
+#define KIND_BRANCH     3   /* QBxx, QBBx */
+#define KIND_JUMP       4   /* JMP imm, QBA */
+#define KIND_RET        5   /* JMP reg */
+#define KIND_CALL       6   /* JAL */
+#define KIND_LOOP       7
+#define KIND_HALT       8   /* HALT, SLP */
+#define KIND_LOAD       9
+#define KIND_STORE      10
+#define KIND_XFR        11  /* XIN, XOUT, XCHG, ZERO, FILL */
+
+typedef struct _CYCOP {
+    int     Kind;
+    uint    AluOp;          /* ADD=0 ... SET=15 */
+    int     Target;         /* Branch/jump/call target, -1 if not known */
+    uint    Dst, DstField;
+    uint    Src, SrcField;
+    int     Op2Imm;
+    uint    Op2, Op2Field;
+    int     Const;          /* LBCO/SBCO constant, -1 for LBBO/SBBO */
+    uint    RegByte;        /* First register file byte of a transfer */
+    uint    Bytes;          /* Transfer length, 0 if taken from R0 */
+    uint    XfrDev;         /* XFR device, 254 FILL, 255 ZERO */
+    int     Class;          /* Memory class of a load/store */
+    int     Cycles;
+} CYCOP;
+
+typedef struct _CYCBLOCK {
+    int     Start;          /* First instruction */
+    int     End;            /* One past the last instruction */
+    int     Succ[3];        /* Flow successors, calls excluded */
+    int     SuccCnt;
+    int     CallTarget;     /* Block called by JAL, -1 if none */
+    int     Cycles;
+    int     Reads[MEM_CLASSES];
+    int     Writes[MEM_CLASSES];
+    int     PostOrder;      /* -1 when not reachable */
+    int     Idom;
+    int     InState;        /* Register state seen at entry */
+} CYCBLOCK;
+
+typedef struct _CYCLOOP {
+    int     Header;
+    char    *Body;          /* Block membership */
+    int     Blocks;
+    int     Depth;
+} CYCLOOP;
+
+typedef struct _REGSTATE {
+    uint    Val[32];
+    uint    Known[32];      /* Known bits of Val */
+} REGSTATE;
+
+typedef struct _CYCLABEL {
+    int     Offset;
+    char    *Name;
+} CYCLABEL;
+
+static uint FieldShift[8] = { 0, 8, 16, 24, 0, 8, 16, 0 };
+static uint FieldMask[8]  = { 0xff, 0xff, 0xff, 0xff, 0xffff, 0xffff, 0xffff, 0xffffffff };
+
+static CODEGEN   *cImage;
+static CYCOP     *cOps;
+static int       cCount;
+static CYCBLOCK  *cBlocks;
+static int       cBlockCnt;
+static int       *cBlockOf;     /* Instruction to block */
+static CYCLOOP   *cLoops;
+static int       cLoopCnt;
+static CYCLABEL  *cLabels;
+static int       cLabelCnt;
+static REGSTATE  *cStates;
+static int       *cPostOrder;   /* Blocks in post order */
+static int       cReached;
+
+static int  DecodeOp( int addr, uint word, CYCOP *op );
+static void RegAnalysis( int entry );
+static int  ClassifyAddr( REGSTATE *rs, CYCOP *op );
+static void TransferOp( REGSTATE *rs, CYCOP *op, int addr );
+static void FindLoops( int root );
+static int  LabelIndex( int addr );
+static void PrintPlace( FILE *pfOut, int addr );
+static void PrintLoops( FILE *pfOut );
+static void PrintLabels( FILE *pfOut );
+
+
+/*
+// CycleAnalysis
+//
+// Write the static cycle report of the assembled image
+//
+// pfOut     - Report file
+// pImage    - Program image
+// CodeCount - Instruction count
+// Entry     - Entry point, -1 for 0
+// pLabels   - Label list
+//
+// Returns:
+//      0 : Success
+//     -1 : Error
+*/
+int CycleAnalysis( FILE *pfOut, CODEGEN *pImage, int CodeCount, int Entry, LABEL *pLabels )
+{
+    LABEL *pl;
+    int   i, j, b, ret = -1;
+    char  *leader = 0;
+    int   totalReads[MEM_CLASSES], totalWrites[MEM_CLASSES];
+
+    cImage    = pImage;
+    cCount    = CodeCount;
+    cOps      = calloc( CodeCount, sizeof(CYCOP) );
+    cBlockOf  = calloc( CodeCount, sizeof(int) );
+    leader    = calloc( CodeCount+1, 1 );
+    cBlocks   = calloc( CodeCount+1, sizeof(CYCBLOCK) );
+    for( i=0, pl=pLabels; pl; pl=pl->pNext )
+        i++;
+    cLabels   = calloc( i+1, sizeof(CYCLABEL) );
+    if( !cOps || !cBlockOf || !leader || !cBlocks || !cLabels )
+        goto CLEANUP;
+
+    if( Entry<0 || Entry>=CodeCount )
+        Entry = 0;
+
+    /* Labels in address order */
+    cLabelCnt = 0;
+    for( pl=pLabels; pl; pl=pl->pNext )
+    {
+        if( pl->Offset<0 || pl->Offset>=CodeCount )
+            continue;
+        for( i=cLabelCnt; i>0 && cLabels[i-1].Offset>pl->Offset; i-- )
+            cLabels[i] = cLabels[i-1];
+        cLabels[i].Offset = pl->Offset;
+        cLabels[i].Name   = pl->Name;
+        cLabelCnt++;
+    }
+
+    /* Decode, mark block leaders */
+    leader[Entry] = 1;
+    for( i=0; i<CodeCount; i++ )
+    {
+        if( DecodeOp( i, pImage[i].CodeWord, &cOps[i] ) < 0 )
+        {
+            fprintf(pfOut,"Unknown instruction 0x%08x at 0x%04x\n",pImage[i].CodeWord,i);
+            goto CLEANUP;
+        }
+        switch( cOps[i].Kind )
+        {
+        case KIND_BRANCH:
+        case KIND_JUMP:
+        case KIND_CALL:
+        case KIND_LOOP:
+            if( cOps[i].Target>=0 && cOps[i].Target<=CodeCount )
+                leader[cOps[i].Target] = 1;
+            leader[i+1] = 1;
+            break;
+        case KIND_RET:
+        case KIND_HALT:
+            leader[i+1] = 1;
+            break;
+        }
+    }
+    for( i=0; i<cLabelCnt; i++ )
+        leader[cLabels[i].Offset] = 1;
+
+    /* Basic blocks */
+    cBlockCnt = 0;
+    for( i=0; i<CodeCount; i++ )
+    {
+        if( leader[i] || i==0 )
+        {
+            if( cBlockCnt )
+                cBlocks[cBlockCnt-1].End = i;
+            cBlocks[cBlockCnt].Start = i;
+            cBlocks[cBlockCnt].CallTarget = -1;
+            cBlockCnt++;
+        }
+        cBlockOf[i] = cBlockCnt-1;
+    }
+    cBlocks[cBlockCnt-1].End = CodeCount;
+
+    /* Flow edges, a LOOP body end also goes back to the body start */
+    for( b=0; b<cBlockCnt; b++ )
+    {
+        CYCBLOCK *pb = &cBlocks[b];
+        CYCOP    *op = &cOps[pb->End-1];
+
+        switch( op->Kind )
+        {
+        case KIND_BRANCH:
+            if( op->Target>=0 && op->Target<CodeCount )
+                pb->Succ[pb->SuccCnt++] = cBlockOf[op->Target];
+            if( pb->End<CodeCount )
+                pb->Succ[pb->SuccCnt++] = cBlockOf[pb->End];
+            break;
+        case KIND_JUMP:
+            if( op->Target>=0 && op->Target<CodeCount )
+                pb->Succ[pb->SuccCnt++] = cBlockOf[op->Target];
+            break;
+        case KIND_CALL:
+            if( op->Target>=0 && op->Target<CodeCount )
+                pb->CallTarget = cBlockOf[op->Target];
+            if( pb->End<CodeCount )
+                pb->Succ[pb->SuccCnt++] = cBlockOf[pb->End];
+            break;
+        case KIND_RET:
+        case KIND_HALT:
+            break;
+        default:
+            if( pb->End<CodeCount )
+                pb->Succ[pb->SuccCnt++] = cBlockOf[pb->End];
+            break;
+        }
+    }
+    for( i=0; i<CodeCount; i++ )
+    {
+        if( cOps[i].Kind==KIND_LOOP && cOps[i].Target>i+1 && cOps[i].Target<=CodeCount )
+        {
+            CYCBLOCK *pb = &cBlocks[cBlockOf[cOps[i].Target-1]];
+            if( pb->SuccCnt<3 )
+                pb->Succ[pb->SuccCnt++] = cBlockOf[i+1];
+        }
+    }
+
+    /* Register constants, then block costs */
+    cStates = calloc( cBlockCnt, sizeof(REGSTATE) );
+    if( !cStates )
+        goto CLEANUP;
+    RegAnalysis( cBlockOf[Entry] );
+
+    for( i=0; i<MEM_CLASSES; i++ )
+        totalReads[i] = totalWrites[i] = 0;
+    for( b=0; b<cBlockCnt; b++ )
+    {
+        CYCBLOCK *pb = &cBlocks[b];
+        REGSTATE rs = cStates[b];
+
+        if( !pb->InState )
+            memset( &rs, 0, sizeof(REGSTATE) );
+        for( i=pb->Start; i<pb->End; i++ )
+        {
+            CYCOP *op = &cOps[i];
+            int   words;
+
+            op->Cycles = 1;
+            if( op->Kind==KIND_LOAD || op->Kind==KIND_STORE )
+            {
+                op->Class = ClassifyAddr( &rs, op );
+                words = op->Bytes ? (op->Bytes+3)/4 : 1;
+                if( op->Kind==KIND_LOAD )
+                {
+                    op->Cycles = MemReadCycles[op->Class] + words - 1;
+                    pb->Reads[op->Class]++;
+                    totalReads[op->Class]++;
+                }
+                else
+                {
+                    op->Cycles = MemWriteCycles[op->Class] + words - 1;
+                    pb->Writes[op->Class]++;
+                    totalWrites[op->Class]++;
+                }
+            }
+            pb->Cycles += op->Cycles;
+            TransferOp( &rs, op, i );
+        }
+    }
+
+    /* Dominators over the blocks reached from the entry and call targets */
+    FindLoops( cBlockOf[Entry] );
+
+    fprintf(pfOut,"PRU static cycle analysis, %d instruction(s), %d block(s), %d loop(s)\n",
+            CodeCount, cBlockCnt, cLoopCnt);
+    fprintf(pfOut,"Clock 200MHz (5ns/cycle), 1 cycle per instruction\n");
+    fprintf(pfOut,"Load  cycles:");
+    for( i=0; i<MEM_CLASSES; i++ )
+        fprintf(pfOut," %s %d",MemClassName[i],MemReadCycles[i]);
+    fprintf(pfOut,"\nStore cycles:");
+    for( i=0; i<MEM_CLASSES; i++ )
+        fprintf(pfOut," %s %d",MemClassName[i],MemWriteCycles[i]);
+    fprintf(pfOut,"\nBursts add 1 cycle per further word, a R0 length counts as one word\n");
+    fprintf(pfOut,"Static loads :");
+    for( i=0; i<MEM_CLASSES; i++ )
+        fprintf(pfOut," %s %d",MemClassName[i],totalReads[i]);
+    fprintf(pfOut,"\nStatic stores:");
+    for( i=0; i<MEM_CLASSES; i++ )
+        fprintf(pfOut," %s %d",MemClassName[i],totalWrites[i]);
+    fprintf(pfOut,"\n");
+    for( i=0; i<CodeCount; i++ )
+    {
+        if( cOps[i].Kind==KIND_CALL && cBlocks[cBlockOf[i]].PostOrder>=0 )
+        {
+            fprintf(pfOut,"Note: call at ");
+            PrintPlace( pfOut, i );
+            fprintf(pfOut," not included in the path cycles\n");
+        }
+    }
+    j = 0;
+    for( b=0; b<cBlockCnt; b++ )
+        if( cBlocks[b].PostOrder<0 )
+            j += cBlocks[b].End - cBlocks[b].Start;
+    if( j )
+        fprintf(pfOut,"Note: %d instruction(s) not reachable from the entry point\n",j);
+
+    PrintLoops( pfOut );
+    PrintLabels( pfOut );
+    ret = 0;
+
+CLEANUP:
+    for( i=0; i<cLoopCnt; i++ )
+        free( cLoops[i].Body );
+    free( cLoops );
+    free( cPostOrder );
+    free( cStates );
+    free( cLabels );
+    free( cBlocks );
+    free( leader );
+    free( cBlockOf );
+    free( cOps );
+    cLoops = 0;
+    cLoopCnt = 0;
+    cPostOrder = 0;
+    cStates = 0;
+    cLabels = 0;
+    cBlocks = 0;
+    cBlockOf = 0;
+    cOps = 0;
+    cImage = 0;
+    return(ret);
+}
+
+
+/*
+// DecodeOp
+//
+// Decode a code word, the reverse of the encoding in pasmop.c
+//
+// Returns 0 on success, -1 on an unknown opcode
+*/
+static int DecodeOp( int addr, uint word, CYCOP *op )
+{
+    uint tmp;
+    int  offset;
+
+    memset( op, 0, sizeof(CYCOP) );
+    op->Target = -1;
+    op->Const  = -1;
+    op->Dst      = word & 0x1f;
+    op->DstField = (word>>5) & 7;
+    op->Src      = (word>>8) & 0x1f;
+    op->SrcField = (word>>13) & 7;
+    op->Op2Imm   = (word>>24) & 1;
+    op->Op2      = op->Op2Imm ? (word>>16) & 0xff : (word>>16) & 0x1f;
+    op->Op2Field = (word>>21) & 7;
+
+    /* 10 bit branch offset */
+    offset = (word & 0xff) | ((word>>17) & 0x300);
+    if( offset & 0x200 )
+        offset -= 0x400;
+
+    switch( word>>29 )
+    {
+    case 0:
+        op->Kind  = KIND_ALU;
+        op->AluOp = (word>>25) & 0xf;
+        return(0);
+
+    case 1:
+        tmp = (word>>25) & 0x7f;
+        switch( tmp )
+        {
+        case 0x10:
+            if( word & (1<<24) )
+            {
+                op->Kind   = KIND_JUMP;
+                op->Target = (word>>8) & 0xffff;
+            }
+            else
+                op->Kind = KIND_RET;
+            return(0);
+        case 0x11:
+            op->Kind = KIND_CALL;
+            if( word & (1<<24) )
+                op->Target = (word>>8) & 0xffff;
+            return(0);
+        case 0x12:
+            op->Kind = KIND_LDI;
+            op->Op2  = (word>>8) & 0xffff;
+            return(0);
+        case 0x13:
+        case 0x14:
+            op->Kind = KIND_CLOBBER;
+            return(0);
+        case 0x15:
+        case 0x1f:
+            op->Kind = KIND_HALT;
+            return(0);
+        case 0x16:
+            /* MVI may write through a register pointer */
+            op->Kind = KIND_CLOBBER;
+            op->Dst  = 0xff;
+            return(0);
+        case 0x17:
+            op->Kind    = KIND_XFR;
+            op->AluOp   = (word>>23) & 3;
+            op->XfrDev  = (word>>15) & 0xff;
+            op->RegByte = (word & 0x1f)*4 + ((word>>5) & 3);
+            tmp = (word>>7) & 0x7f;
+            op->Bytes = (tmp>=124) ? 0 : tmp+1;
+            return(0);
+        case 0x18:
+        case 0x19:
+        case 0x1a:
+        case 0x1b:
+            op->Kind   = KIND_LOOP;
+            op->Target = addr + (word & 0xff);
+            return(0);
+        }
+        return(-1);
+
+    case 2:
+    case 3:
+        op->Target = addr + offset;
+        op->Kind   = (((word>>27) & 7)==7) ? KIND_JUMP : KIND_BRANCH;
+        return(0);
+
+    case 4:
+    case 7:
+        op->Kind    = (word & (1<<28)) ? KIND_LOAD : KIND_STORE;
+        op->RegByte = (word & 0x1f)*4 + ((word>>5) & 3);
+        tmp = ((word>>21) & 0x70) | ((word>>12) & 0x0e) | ((word>>7) & 0x1);
+        op->Bytes = (tmp>=124) ? 0 : tmp+1;
+        if( (word>>29)==4 )
+            op->Const = (word>>8) & 0x1f;
+        return(0);
+
+    case 5:
+        tmp = (word>>25) & 0x7f;
+        if( tmp<0x50 || tmp>0x5f )
+            return(-1);
+        op->Kind  = KIND_ALU;
+        op->AluOp = 0xff;
+        return(0);
+
+    case 6:
+        tmp = (word>>27) & 0x1f;
+        if( tmp!=0x19 && tmp!=0x1a )
+            return(-1);
+        op->Target = addr + offset;
+        op->Kind   = KIND_BRANCH;
+        return(0);
+    }
+    return(-1);
+}
+
+
+/*
+// Register state helpers
+*/
+static int RegGet( REGSTATE *rs, uint reg, uint field, uint *pVal )
+{
+    uint mask = FieldMask[field] << FieldShift[field];
+
+    if( (rs->Known[reg] & mask) != mask )
+        return(0);
+    *pVal = (rs->Val[reg] & mask) >> FieldShift[field];
+    return(1);
+}
+
+static void RegSet( REGSTATE *rs, uint reg, uint field, uint val, int known )
+{
+    uint mask = FieldMask[field] << FieldShift[field];
+
+    rs->Val[reg] = (rs->Val[reg] & ~mask) | ((val << FieldShift[field]) & mask);
+    if( known )
+        rs->Known[reg] |= mask;
+    else
+        rs->Known[reg] &= ~mask;
+}
+
+static void RegBytes( REGSTATE *rs, uint first, uint count, int known, uint val )
+{
+    uint i, reg, shift;
+
+    for( i=first; i<first+count && i<128; i++ )
+    {
+        reg   = i/4;
+        shift = (i%4)*8;
+        rs->Val[reg] = (rs->Val[reg] & ~(0xffu<<shift)) | ((val & 0xff)<<shift);
+        if( known )
+            rs->Known[reg] |= 0xffu<<shift;
+        else
+            rs->Known[reg] &= ~(0xffu<<shift);
+    }
+}
+
+/*
+// TransferOp
+//
+// Apply the register effect of one instruction
+*/
+static void TransferOp( REGSTATE *rs, CYCOP *op, int addr )
+{
+    uint a, b, r = 0;
+    int  known;
+
+    switch( op->Kind )
+    {
+    case KIND_ALU:
+        if( op->AluOp==0xff )
+            return;
+        known = RegGet( rs, op->Src, op->SrcField, &a );
+        if( op->Op2Imm )
+            b = op->Op2;
+        else if( !RegGet( rs, op->Op2, op->Op2Field, &b ) )
+            known = 0;
+        if( known )
+        {
+            switch( op->AluOp+OP_ADD )
+            {
+            case OP_ADD: r = a + b; break;
+            case OP_SUB: r = a - b; break;
+            case OP_RSB: r = b - a; break;
+            case OP_LSL: r = a << (b & 0x1f); break;
+            case OP_LSR: r = a >> (b & 0x1f); break;
+            case OP_AND: r = a & b; break;
+            case OP_OR:  r = a | b; break;
+            case OP_XOR: r = a ^ b; break;
+            case OP_NOT: r = ~a; break;
+            case OP_MIN: r = (a<b) ? a : b; break;
+            case OP_MAX: r = (a>b) ? a : b; break;
+            case OP_CLR: r = a & ~(1u << (b & 0x1f)); break;
+            case OP_SET: r = a | (1u << (b & 0x1f)); break;
+            default:     known = 0; break;   /* carry in */
+            }
+        }
+        RegSet( rs, op->Dst, op->DstField, r, known );
+        return;
+
+    case KIND_LDI:
+        RegSet( rs, op->Dst, op->DstField, op->Op2, 1 );
+        return;
+
+    case KIND_CALL:
+        RegSet( rs, op->Dst, op->DstField, addr+1, 1 );
+        return;
+
+    case KIND_CLOBBER:
+        if( op->Dst==0xff )
+            memset( rs, 0, sizeof(REGSTATE) );
+        else
+            RegSet( rs, op->Dst, op->DstField, 0, 0 );
+        return;
+
+    case KIND_LOAD:
+        if( op->Bytes )
+            RegBytes( rs, op->RegByte, op->Bytes, 0, 0 );
+        else
+            RegBytes( rs, op->RegByte, 128, 0, 0 );
+        return;
+
+    case KIND_XFR:
+        if( op->AluOp==2 )
+            return;             /* XOUT */
+        if( !op->Bytes )
+            RegBytes( rs, op->RegByte, 128, 0, 0 );
+        else if( op->AluOp==1 && op->XfrDev==255 )
+            RegBytes( rs, op->RegByte, op->Bytes, 1, 0 );
+        else if( op->AluOp==1 && op->XfrDev==254 )
+            RegBytes( rs, op->RegByte, op->Bytes, 1, 0xff );
+        else
+            RegBytes( rs, op->RegByte, op->Bytes, 0, 0 );
+        return;
+    }
+}
+
+/*
+// ClassifyAddr
+//
+// Memory class of a load or store with the register state before it
+*/
+static int ClassifyAddr( REGSTATE *rs, CYCOP *op )
+{
+    uint base, off, addr;
+
+    if( op->Const>=0 )
+        return( ConstClass[op->Const] );
+
+    if( !RegGet( rs, op->Src, FIELDTYPE_31_0, &base ) )
+    {
+        /* The top byte alone tells L4 from DDR */
+        if( (rs->Known[op->Src] & 0xff000000)!=0xff000000 )
+            return(MEM_UNKNOWN);
+        base = rs->Val[op->Src] & 0xff000000;
+        if( !base )
+            return(MEM_UNKNOWN);
+        return( (base>=0x80000000) ? MEM_DDR : MEM_L4 );
+    }
+    if( op->Op2Imm )
+        off = op->Op2;
+    else if( !RegGet( rs, op->Op2, op->Op2Field, &off ) )
+        off = 0;
+    addr = base + off;
+    if( addr<0x80000 )
+        return(MEM_LOCAL);
+    if( addr>=0x80000000 )
+        return(MEM_DDR);
+    return(MEM_L4);
+}
+
+/*
+// RegAnalysis
+//
+// Forward propagation of register constants over the flow graph,
+// a join keeps the bits both sides agree on.
+*/
+static void RegAnalysis( int entry )
+{
+    int      *work, head = 0, tail = 0, *queued;
+    int      b, i, s;
+    REGSTATE rs;
+
+    work   = calloc( cBlockCnt+1, sizeof(int) );
+    queued = calloc( cBlockCnt, sizeof(int) );
+    if( !work || !queued )
+        { free(work); free(queued); return; }
+
+    cBlocks[entry].InState = 1;
+    work[tail++] = entry;
+    queued[entry] = 1;
+
+    while( head!=tail )
+    {
+        b = work[head];
+        head = (head+1) % (cBlockCnt+1);
+        queued[b] = 0;
+
+        rs = cStates[b];
+        for( i=cBlocks[b].Start; i<cBlocks[b].End; i++ )
+            TransferOp( &rs, &cOps[i], i );
+
+        for( i=0; i<=cBlocks[b].SuccCnt; i++ )
+        {
+            REGSTATE *ps;
+            int      changed = 0, r;
+
+            if( i==cBlocks[b].SuccCnt )
+            {
+                /* Called code sees the state at the JAL */
+                s = cBlocks[b].CallTarget;
+                if( s<0 )
+                    break;
+            }
+            else
+                s = cBlocks[b].Succ[i];
+
+            ps = &cStates[s];
+            if( !cBlocks[s].InState )
+            {
+                *ps = rs;
+                cBlocks[s].InState = 1;
+                changed = 1;
+            }
+            else
+            {
+                for( r=0; r<32; r++ )
+                {
+                    uint known = ps->Known[r] & rs.Known[r] & ~(ps->Val[r] ^ rs.Val[r]);
+                    if( known!=ps->Known[r] )
+                    {
+                        ps->Known[r] = known;
+                        changed = 1;
+                    }
+                }
+            }
+            if( changed && !queued[s] )
+            {
+                work[tail] = s;
+                tail = (tail+1) % (cBlockCnt+1);
+                queued[s] = 1;
+            }
+        }
+    }
+
+    free( work );
+    free( queued );
+}
+
+
+/*
+// Dominators (Cooper, Harvey, Kennedy) and natural loops
+*/
+static int PostVisit( int b, int n )
+{
+    int i;
+
+    cBlocks[b].PostOrder = -2;     /* On the way */
+    for( i=0; i<cBlocks[b].SuccCnt; i++ )
+        if( cBlocks[cBlocks[b].Succ[i]].PostOrder==-1 )
+            n = PostVisit( cBlocks[b].Succ[i], n );
+    if( cBlocks[b].CallTarget>=0 && cBlocks[cBlocks[b].CallTarget].PostOrder==-1 )
+        n = PostVisit( cBlocks[b].CallTarget, n );
+    cBlocks[b].PostOrder = n;
+    cPostOrder[n] = b;
+    return(n+1);
+}
+
+static int Intersect( int a, int b )
+{
+    while( a!=b )
+    {
+        while( cBlocks[a].PostOrder < cBlocks[b].PostOrder )
+            a = cBlocks[a].Idom;
+        while( cBlocks[b].PostOrder < cBlocks[a].PostOrder )
+            b = cBlocks[b].Idom;
+    }
+    return(a);
+}
+
+static int Dominates( int a, int b )
+{
+    while( 1 )
+    {
+        if( a==b )
+            return(1);
+        if( cBlocks[b].Idom==b )
+            return(0);
+        b = cBlocks[b].Idom;
+    }
+}
+
+static void FindLoops( int root )
+{
+    int i, j, k, b, p, changed, idom;
+    int *stack, sp;
+
+    cPostOrder = calloc( cBlockCnt, sizeof(int) );
+    cLoops     = calloc( cBlockCnt, sizeof(CYCLOOP) );
+    stack      = calloc( cBlockCnt, sizeof(int) );
+    if( !cPostOrder || !cLoops || !stack )
+        { free(stack); return; }
+
+    for( b=0; b<cBlockCnt; b++ )
+    {
+        cBlocks[b].PostOrder = -1;
+        cBlocks[b].Idom = -1;
+    }
+
+    /* Called code is walked through the JAL edges */
+    cReached = PostVisit( root, 0 );
+    cBlocks[root].Idom = root;
+    changed = 1;
+    while( changed )
+    {
+        changed = 0;
+        for( k=cReached-1; k>=0; k-- )
+        {
+            b = cPostOrder[k];
+            if( b==root )
+                continue;
+            idom = -1;
+            for( p=0; p<cBlockCnt; p++ )
+            {
+                int pred = 0;
+                if( cBlocks[p].PostOrder<0 || cBlocks[p].Idom<0 )
+                    continue;
+                for( j=0; j<cBlocks[p].SuccCnt; j++ )
+                    if( cBlocks[p].Succ[j]==b )
+                        pred = 1;
+                if( cBlocks[p].CallTarget==b )
+                    pred = 1;
+                if( !pred )
+                    continue;
+                idom = (idom<0) ? p : Intersect( p, idom );
+            }
+            if( idom>=0 && cBlocks[b].Idom!=idom )
+            {
+                cBlocks[b].Idom = idom;
+                changed = 1;
+            }
+        }
+    }
+
+    /* Back edges u->h with h dominating u, one loop per header */
+    cLoopCnt = 0;
+    for( b=0; b<cBlockCnt; b++ )
+    {
+        if( cBlocks[b].PostOrder<0 )
+            continue;
+        for( j=0; j<cBlocks[b].SuccCnt; j++ )
+        {
+            int     h = cBlocks[b].Succ[j];
+            CYCLOOP *pl = 0;
+
+            if( !Dominates( h, b ) )
+                continue;
+            for( i=0; i<cLoopCnt; i++ )
+                if( cLoops[i].Header==h )
+                    pl = &cLoops[i];
+            if( !pl )
+            {
+                pl = &cLoops[cLoopCnt++];
+                pl->Header = h;
+                pl->Body = calloc( cBlockCnt, 1 );
+                if( !pl->Body )
+                    { cLoopCnt--; continue; }
+                pl->Body[h] = 1;
+                pl->Blocks = 1;
+            }
+
+            /* Walk the predecessors back to the header */
+            sp = 0;
+            if( !pl->Body[b] )
+            {
+                pl->Body[b] = 1;
+                pl->Blocks++;
+                stack[sp++] = b;
+            }
+            while( sp )
+            {
+                int n = stack[--sp];
+                for( p=0; p<cBlockCnt; p++ )
+                {
+                    if( cBlocks[p].PostOrder<0 || pl->Body[p] )
+                        continue;
+                    for( k=0; k<cBlocks[p].SuccCnt; k++ )
+                        if( cBlocks[p].Succ[k]==n )
+                        {
+                            pl->Body[p] = 1;
+                            pl->Blocks++;
+                            stack[sp++] = p;
+                            break;
+                        }
+                }
+            }
+        }
+    }
+
+    /* Report in address order */
+    for( i=1; i<cLoopCnt; i++ )
+    {
+        CYCLOOP tmp = cLoops[i];
+        for( j=i; j>0 && cLoops[j-1].Header>tmp.Header; j-- )
+            cLoops[j] = cLoops[j-1];
+        cLoops[j] = tmp;
+    }
+
+    /* Nesting depth */
+    for( i=0; i<cLoopCnt; i++ )
+    {
+        cLoops[i].Depth = 0;
+        for( j=0; j<cLoopCnt; j++ )
+            if( j!=i && cLoops[j].Body[cLoops[i].Header] && cLoops[j].Blocks>cLoops[i].Blocks )
+                cLoops[i].Depth++;
+    }
+
+    free( stack );
+}
+
+
+/*
+// LabelIndex
+//
+// Last label at or before addr, -1 if none
+*/
+static int LabelIndex( int addr )
+{
+    int lo = 0, hi = cLabelCnt-1, mid, found = -1;
+
+    while( lo<=hi )
+    {
+        mid = (lo+hi)/2;
+        if( cLabels[mid].Offset<=addr )
+        {
+            found = mid;
+            lo = mid+1;
+        }
+        else
+            hi = mid-1;
+    }
+    /* First of several labels on the same address */
+    while( found>0 && cLabels[found-1].Offset==cLabels[found].Offset )
+        found--;
+    return(found);
+}
+
+static void PrintPlace( FILE *pfOut, int addr )
+{
+    int l = LabelIndex( addr );
+
+    if( l<0 )
+        fprintf(pfOut,"0x%04x",addr);
+    else if( cLabels[l].Offset==addr )
+        fprintf(pfOut,"%s",cLabels[l].Name);
+    else
+        fprintf(pfOut,"%s+%d",cLabels[l].Name,addr-cLabels[l].Offset);
+}
+
+
+/*
+// PathCycles
+//
+// Longest and shortest path through the blocks in pSet from block
+// start, edges accepted by pEdge only. Fills pMax/pMin/pPrev, returns
+// -1 if the remaining graph still has a cycle.
+*/
+typedef int (*EDGEFUNC)( int from, int to, void *arg );
+
+static int PathCycles( char *pSet, int start, EDGEFUNC pEdge, void *arg,
+                       int *pMax, int *pMin, int *pPrev )
+{
+    int *indeg, *queue, head = 0, tail = 0;
+    int b, j, s, n = 0, done = 0;
+
+    indeg = calloc( cBlockCnt, sizeof(int) );
+    queue = calloc( cBlockCnt, sizeof(int) );
+    if( !indeg || !queue )
+        { free(indeg); free(queue); return(-1); }
+
+    for( b=0; b<cBlockCnt; b++ )
+    {
+        pMax[b]  = -1;
+        pMin[b]  = -1;
+        pPrev[b] = -1;
+        if( !pSet[b] )
+            continue;
+        n++;
+        for( j=0; j<cBlocks[b].SuccCnt; j++ )
+        {
+            s = cBlocks[b].Succ[j];
+            if( pSet[s] && pEdge( b, s, arg ) )
+                indeg[s]++;
+        }
+    }
+
+    for( b=0; b<cBlockCnt; b++ )
+        if( pSet[b] && !indeg[b] )
+            queue[tail++] = b;
+
+    pMax[start] = pMin[start] = cBlocks[start].Cycles;
+    while( head<tail )
+    {
+        b = queue[head++];
+        done++;
+        for( j=0; j<cBlocks[b].SuccCnt; j++ )
+        {
+            s = cBlocks[b].Succ[j];
+            if( !pSet[s] || !pEdge( b, s, arg ) )
+                continue;
+            if( pMax[b]>=0 )
+            {
+                if( pMax[b]+cBlocks[s].Cycles > pMax[s] )
+                {
+                    pMax[s]  = pMax[b]+cBlocks[s].Cycles;
+                    pPrev[s] = b;
+                }
+                if( pMin[s]<0 || pMin[b]+cBlocks[s].Cycles < pMin[s] )
+                    pMin[s] = pMin[b]+cBlocks[s].Cycles;
+            }
+            if( --indeg[s]==0 )
+                queue[tail++] = s;
+        }
+    }
+
+    free( indeg );
+    free( queue );
+    return( (done==n) ? 0 : -1 );
+}
+
+/* Loop iteration: no back edges of this or any inner loop */
+static int LoopEdge( int from, int to, void *arg )
+{
+    return( !Dominates( to, from ) );
+}
+
+/* Label region: forward edges only */
+static int ForwardEdge( int from, int to, void *arg )
+{
+    return( cBlocks[to].Start > cBlocks[from].Start );
+}
+
+static void PathAccesses( int *pPrev, int last, int *reads, int *writes )
+{
+    int b, i;
+
+    for( i=0; i<MEM_CLASSES; i++ )
+        reads[i] = writes[i] = 0;
+    for( b=last; b>=0; b=pPrev[b] )
+    {
+        for( i=0; i<MEM_CLASSES; i++ )
+        {
+            reads[i]  += cBlocks[b].Reads[i];
+            writes[i] += cBlocks[b].Writes[i];
+        }
+    }
+}
+
+static void PrintPath( FILE *pfOut, int *pPrev, int last )
+{
+    int *path, n = 0, b, i, l, lastLabel = -2;
+
+    path = calloc( cBlockCnt, sizeof(int) );
+    if( !path )
+        return;
+    for( b=last; b>=0 && n<cBlockCnt; b=pPrev[b] )
+        path[n++] = b;
+
+    fprintf(pfOut,"    worst path:");
+    for( i=n-1; i>=0; i-- )
+    {
+        l = LabelIndex( cBlocks[path[i]].Start );
+        if( l==lastLabel )
+            continue;
+        lastLabel = l;
+        fprintf(pfOut," ");
+        PrintPlace( pfOut, cBlocks[path[i]].Start );
+    }
+    fprintf(pfOut,"\n");
+    free( path );
+}
+
+static void PrintAccesses( FILE *pfOut, int *reads, int *writes )
+{
+    int i;
+
+    fprintf(pfOut,"    loads:");
+    for( i=0; i<MEM_CLASSES; i++ )
+        fprintf(pfOut," %s %d",MemClassName[i],reads[i]);
+    fprintf(pfOut,"  stores:");
+    for( i=0; i<MEM_CLASSES; i++ )
+        fprintf(pfOut," %s %d",MemClassName[i],writes[i]);
+    fprintf(pfOut,"\n");
+}
+
+/*
+// PrintLoops
+//
+// One iteration of every loop, from the header back to the header.
+// Inner loops are passed once.
+*/
+static void PrintLoops( FILE *pfOut )
+{
+    int *pMax, *pMin, *pPrev;
+    int i, b, j, worst, best, last;
+    int reads[MEM_CLASSES], writes[MEM_CLASSES];
+
+    pMax  = calloc( cBlockCnt, sizeof(int) );
+    pMin  = calloc( cBlockCnt, sizeof(int) );
+    pPrev = calloc( cBlockCnt, sizeof(int) );
+    if( !pMax || !pMin || !pPrev )
+        goto DONE;
+
+    fprintf(pfOut,"\nLoops, one iteration, inner loops passed once\n");
+    fprintf(pfOut,"%-40s %6s %5s %6s %6s %9s %12s  %s\n",
+            "header","addr","depth","best","worst","worst_ns","max_rate_hz","source");
+
+    for( i=0; i<cLoopCnt; i++ )
+    {
+        CYCLOOP *pl = &cLoops[i];
+        int     h = pl->Header;
+        char    name[LABEL_NAME_LEN+16];
+        int     l = LabelIndex( cBlocks[h].Start );
+
+        if( l<0 )
+            sprintf(name,"0x%04x",cBlocks[h].Start);
+        else if( cLabels[l].Offset==cBlocks[h].Start )
+            sprintf(name,"%s",cLabels[l].Name);
+        else
+            sprintf(name,"%s+%d",cLabels[l].Name,cBlocks[h].Start-cLabels[l].Offset);
+
+        if( PathCycles( pl->Body, h, LoopEdge, 0, pMax, pMin, pPrev ) < 0 )
+        {
+            fprintf(pfOut,"%-40s 0x%04x %5d  irreducible\n",name,cBlocks[h].Start,pl->Depth);
+            continue;
+        }
+
+        /* Back edge sources close the iteration */
+        worst = -1;
+        best  = -1;
+        last  = -1;
+        for( b=0; b<cBlockCnt; b++ )
+        {
+            if( !pl->Body[b] || pMax[b]<0 )
+                continue;
+            for( j=0; j<cBlocks[b].SuccCnt; j++ )
+            {
+                if( cBlocks[b].Succ[j]!=h )
+                    continue;
+                if( pMax[b]>worst )
+                    { worst = pMax[b]; last = b; }
+                if( best<0 || pMin[b]<best )
+                    best = pMin[b];
+            }
+        }
+        if( last<0 )
+            continue;
+
+        fprintf(pfOut,"%-40s 0x%04x %5d %6d %6d %9d %12d  %s:%d\n",
+                name, cBlocks[h].Start, pl->Depth, best, worst, worst*5,
+                200000000/worst,
+                sfArray[cImage[cBlocks[h].Start].FileIndex].SourceName,
+                cImage[cBlocks[h].Start].Line);
+        PrintPath( pfOut, pPrev, last );
+        PathAccesses( pPrev, last, reads, writes );
+        PrintAccesses( pfOut, reads, writes );
+    }
+
+DONE:
+    free( pMax );
+    free( pMin );
+    free( pPrev );
+}
+
+/*
+// PrintLabels
+//
+// Code from each label to the next one, entered at the label
+*/
+static void PrintLabels( FILE *pfOut )
+{
+    int  *pMax, *pMin, *pPrev;
+    char *pSet;
+    int  i, b, j, start, end, worst, best, last;
+    int  reads[MEM_CLASSES], writes[MEM_CLASSES];
+
+    pMax  = calloc( cBlockCnt, sizeof(int) );
+    pMin  = calloc( cBlockCnt, sizeof(int) );
+    pPrev = calloc( cBlockCnt, sizeof(int) );
+    pSet  = calloc( cBlockCnt, 1 );
+    if( !pMax || !pMin || !pPrev || !pSet )
+        goto DONE;
+
+    fprintf(pfOut,"\nLabels, label to the next label\n");
+    fprintf(pfOut,"%-40s %6s %5s %6s %6s %8s %8s %8s %8s\n",
+            "label","addr","words","best","worst","ld_local","ld_l4","ld_ddr","ld_unkn");
+
+    for( i=0; i<cLabelCnt; i++ )
+    {
+        start = cLabels[i].Offset;
+        end   = cCount;
+        for( j=i+1; j<cLabelCnt; j++ )
+            if( cLabels[j].Offset>start )
+                { end = cLabels[j].Offset; break; }
+        if( i>0 && cLabels[i-1].Offset==start )
+            continue;
+
+        memset( pSet, 0, cBlockCnt );
+        for( b=cBlockOf[start]; b<cBlockCnt && cBlocks[b].Start<end; b++ )
+            pSet[b] = 1;
+        if( PathCycles( pSet, cBlockOf[start], ForwardEdge, 0, pMax, pMin, pPrev ) < 0 )
+            continue;
+
+        /* Paths end where the flow leaves the region */
+        worst = -1;
+        best  = -1;
+        last  = -1;
+        for( b=cBlockOf[start]; b<cBlockCnt && cBlocks[b].Start<end; b++ )
+        {
+            int exit = (cBlocks[b].SuccCnt==0);
+
+            if( pMax[b]<0 )
+                continue;
+            for( j=0; j<cBlocks[b].SuccCnt; j++ )
+                if( !pSet[cBlocks[b].Succ[j]] || !ForwardEdge( b, cBlocks[b].Succ[j], 0 ) )
+                    exit = 1;
+            if( !exit )
+                continue;
+            if( pMax[b]>worst )
+                { worst = pMax[b]; last = b; }
+            if( best<0 || pMin[b]<best )
+                best = pMin[b];
+        }
+        if( last<0 )
+            continue;
+
+        PathAccesses( pPrev, last, reads, writes );
+        fprintf(pfOut,"%-40s 0x%04x %5d %6d %6d %8d %8d %8d %8d\n",
+                cLabels[i].Name, start, end-start, best, worst,
+                reads[MEM_LOCAL], reads[MEM_L4], reads[MEM_DDR], reads[MEM_UNKNOWN]);
+    }
+
+DONE:
+    free( pMax );
+    free( pMin );
+    free( pPrev );
+    free( pSet );
+}
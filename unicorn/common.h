@@ -13,6 +13,8 @@
 
 #include "list.h"
 #include "mcode_list.h"
+#include "ulog.h"
+#include "ftrace.h"
 
 /* EEPROM */
 #define EEPROM_DEV          		"/sys/bus/i2c/devices/1-0057/eeprom"
@@ -74,80 +76,25 @@
 
 #endif
 
-#define MIN_DBG(x, ...)                 \
-        if (DBG(D_MIN)) {               \
-            printf("[MIN]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define COMM_DBG(x, ...)                 \
-        if (DBG(D_COMM)) {               \
-            printf("[COMM]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define GCODE_DBG(x, ...)                 \
-        if (DBG(D_GCODE)) {               \
-            printf("[GCODE]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define STEPPER_DBG(x, ...)                 \
-        if (DBG(D_STEPPER)) {               \
-            printf("[STEPPER]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define PID_DBG(x, ...)                 \
-        if (DBG(D_PID)) {               \
-            printf("[PID]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define HEATER_DBG(x, ...)                 \
-        if (DBG(D_HEATER)) {               \
-            printf("[HEATER]:" x, ##__VA_ARGS__);   \
-        }                   
-
-#define PWM_DBG(x, ...)                 \
-        if (DBG(D_PWM)) {               \
-            printf("[PWM]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define TEMP_DBG(x, ...)                 \
-        if (DBG(D_TEMP)) {               \
-            printf("[TEMP]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define ANALOG_DBG(x, ...)                 \
-        if (DBG(D_ANALOG)) {               \
-            printf("[ANALOG]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define FAN_DBG(x, ...)                 \
-        if (DBG(D_FAN)) {               \
-            printf("[FAN]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define LMSW_DBG(x, ...)                 \
-        if (DBG(D_LMSW)) {               \
-            printf("[LMSW]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define HOME_DBG(x, ...)                 \
-        if (DBG(D_HOME)) {               \
-            printf("[HOME]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define PRUSS_DBG(x, ...)                 \
-        if (DBG(D_PRUSS)) {               \
-            printf("[PRUSS]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define SERVO_DBG(x, ...)                 \
-        if (DBG(D_SERVO)) {               \
-            printf("[SERVO]:"x, ##__VA_ARGS__);   \
-        }                   
-
-#define PLAN_DBG(x, ...)                 \
-        if (DBG(D_PLAN)) {               \
-            printf("[PLAN]:"x, ##__VA_ARGS__);   \
-        }                   
+/*
+ * Debug records of the modules go through ulog, the thread writing
+ * one does not wait for stdout. Rate limited per call site.
+ */
+#define MIN_DBG(x, ...)      ULOG_DBG(D_MIN, "[MIN]:"x, ##__VA_ARGS__)
+#define COMM_DBG(x, ...)     ULOG_DBG(D_COMM, "[COMM]:"x, ##__VA_ARGS__)
+#define GCODE_DBG(x, ...)    ULOG_DBG(D_GCODE, "[GCODE]:"x, ##__VA_ARGS__)
+#define STEPPER_DBG(x, ...)  ULOG_DBG(D_STEPPER, "[STEPPER]:"x, ##__VA_ARGS__)
+#define PID_DBG(x, ...)      ULOG_DBG(D_PID, "[PID]:"x, ##__VA_ARGS__)
+#define HEATER_DBG(x, ...)   ULOG_DBG(D_HEATER, "[HEATER]:"x, ##__VA_ARGS__)
+#define PWM_DBG(x, ...)      ULOG_DBG(D_PWM, "[PWM]:"x, ##__VA_ARGS__)
+#define TEMP_DBG(x, ...)     ULOG_DBG(D_TEMP, "[TEMP]:"x, ##__VA_ARGS__)
+#define ANALOG_DBG(x, ...)   ULOG_DBG(D_ANALOG, "[ANALOG]:"x, ##__VA_ARGS__)
+#define FAN_DBG(x, ...)      ULOG_DBG(D_FAN, "[FAN]:"x, ##__VA_ARGS__)
+#define LMSW_DBG(x, ...)     ULOG_DBG(D_LMSW, "[LMSW]:"x, ##__VA_ARGS__)
+#define HOME_DBG(x, ...)     ULOG_DBG(D_HOME, "[HOME]:"x, ##__VA_ARGS__)
+#define PRUSS_DBG(x, ...)    ULOG_DBG(D_PRUSS, "[PRUSS]:"x, ##__VA_ARGS__)
+#define SERVO_DBG(x, ...)    ULOG_DBG(D_SERVO, "[SERVO]:"x, ##__VA_ARGS__)
+#define PLAN_DBG(x, ...)     ULOG_DBG(D_PLAN, "[PLAN]:"x, ##__VA_ARGS__)
 
 extern volatile uint32_t debug;
 
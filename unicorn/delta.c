@@ -0,0 +1,274 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * delta.c
+ * batch delta kinematics
+ *
+ * Computes the tower heights of many segment end points in one call,
+ * 4 points at a time with NEON on the Cortex-A8, or with gcc vector
+ * extensions elsewhere. The bed level offset is added in the same pass.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "common.h"
+#include "delta.h"
+
+/*
+ * Bilinear interpolation over the bed level grid, the z offset
+ * added to the towers of each point
+ */
+float delta_level_offset(const delta_level_t *level, float x, float y)
+{
+    int half = level->half;
+    float grid_x = max(0.001 - half, min(half - 0.001, x * level->inv_x_num));
+    float grid_y = max(0.001 - half, min(half - 0.001, y * level->inv_y_num));
+    int floor_x = floorf(grid_x);
+    int floor_y = floorf(grid_y);
+    float ratio_x = grid_x - floor_x;
+    float ratio_y = grid_y - floor_y;
+    float z1 = level->z[floor_x + half][floor_y + half];
+    float z2 = level->z[floor_x + half][floor_y + half + 1];
+    float z3 = level->z[floor_x + half + 1][floor_y + half];
+    float z4 = level->z[floor_x + half + 1][floor_y + half + 1];
+    float left  = (1 - ratio_y) * z1 + ratio_y * z2;
+    float right = (1 - ratio_y) * z3 + ratio_y * z4;
+
+    return (1 - ratio_x) * left + ratio_x * right;
+}
+
+void delta_calculate_batch_scalar(const delta_geometry_t *geo,
+                                  const delta_level_t *level,
+                                  int n,
+                                  const float *x, const float *y, const float *z,
+                                  float *a, float *b, float *c)
+{
+    int i;
+    float dx, dy, off;
+
+    for (i = 0; i < n; i++) {
+        off = z[i];
+        if (level) {
+            off += delta_level_offset(level, x[i], y[i]);
+        }
+
+        dx = geo->tower_x[0] - x[i];
+        dy = geo->tower_y[0] - y[i];
+        a[i] = sqrtf(geo->rod_2[0] - dx * dx - dy * dy) + off;
+
+        dx = geo->tower_x[1] - x[i];
+        dy = geo->tower_y[1] - y[i];
+        b[i] = sqrtf(geo->rod_2[1] - dx * dx - dy * dy) + off;
+
+        dx = geo->tower_x[2] - x[i];
+        dy = geo->tower_y[2] - y[i];
+        c[i] = sqrtf(geo->rod_2[2] - dx * dx - dy * dy) + off;
+    }
+}
+
+#if defined(__ARM_NEON__)
+/*
+ * Cortex-A8 NEON has no vector sqrt, use the reciprocal square root
+ * estimate with two Newton steps, about 1e-7 relative error.
+ */
+static inline float32x4_t delta_sqrt_f32x4(float32x4_t v)
+{
+    float32x4_t r = vrsqrteq_f32(v);
+    uint32x4_t zero = vceqq_f32(v, vdupq_n_f32(0.0f));
+
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(v, r), r));
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(v, r), r));
+
+    /* 0 * inf is NaN, sqrt(0) is 0 */
+    return vbslq_f32(zero, v, vmulq_f32(v, r));
+}
+
+static inline float32x4_t delta_tower_f32x4(float32x4_t px, float32x4_t py,
+                                            float tx, float ty, float rod_2)
+{
+    float32x4_t dx = vsubq_f32(vdupq_n_f32(tx), px);
+    float32x4_t dy = vsubq_f32(vdupq_n_f32(ty), py);
+    float32x4_t r  = vdupq_n_f32(rod_2);
+
+    r = vmlsq_f32(r, dx, dx);
+    r = vmlsq_f32(r, dy, dy);
+
+    return delta_sqrt_f32x4(r);
+}
+
+static int delta_calculate_batch4(const delta_geometry_t *geo,
+                                  const delta_level_t *level,
+                                  int n,
+                                  const float *x, const float *y, const float *z,
+                                  float *a, float *b, float *c)
+{
+    int i, j;
+    float off[4];
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4_t px = vld1q_f32(x + i);
+        float32x4_t py = vld1q_f32(y + i);
+        float32x4_t pz = vld1q_f32(z + i);
+
+        if (level) {
+            for (j = 0; j < 4; j++) {
+                off[j] = delta_level_offset(level, x[i + j], y[i + j]);
+            }
+            pz = vaddq_f32(pz, vld1q_f32(off));
+        }
+
+        vst1q_f32(a + i, vaddq_f32(delta_tower_f32x4(px, py, geo->tower_x[0],
+                                   geo->tower_y[0], geo->rod_2[0]), pz));
+        vst1q_f32(b + i, vaddq_f32(delta_tower_f32x4(px, py, geo->tower_x[1],
+                                   geo->tower_y[1], geo->rod_2[1]), pz));
+        vst1q_f32(c + i, vaddq_f32(delta_tower_f32x4(px, py, geo->tower_x[2],
+                                   geo->tower_y[2], geo->rod_2[2]), pz));
+    }
+
+    return i;
+}
+#elif defined(__GNUC__)
+/*
+ * Portable 4 wide version with gcc vector extensions,
+ * sqrt is done per lane.
+ */
+typedef float v4sf __attribute__ ((vector_size (16)));
+
+static inline v4sf delta_load_v4sf(const float *p)
+{
+    v4sf v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void delta_store_v4sf(float *p, v4sf v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline v4sf delta_tower_v4sf(v4sf px, v4sf py, float tx, float ty, float rod_2)
+{
+    v4sf dx = (v4sf){tx, tx, tx, tx} - px;
+    v4sf dy = (v4sf){ty, ty, ty, ty} - py;
+    v4sf r  = (v4sf){rod_2, rod_2, rod_2, rod_2} - dx * dx - dy * dy;
+
+    return (v4sf){sqrtf(r[0]), sqrtf(r[1]), sqrtf(r[2]), sqrtf(r[3])};
+}
+
+static int delta_calculate_batch4(const delta_geometry_t *geo,
+                                  const delta_level_t *level,
+                                  int n,
+                                  const float *x, const float *y, const float *z,
+                                  float *a, float *b, float *c)
+{
+    int i, j;
+    float off[4];
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        v4sf px = delta_load_v4sf(x + i);
+        v4sf py = delta_load_v4sf(y + i);
+        v4sf pz = delta_load_v4sf(z + i);
+
+        if (level) {
+            for (j = 0; j < 4; j++) {
+                off[j] = delta_level_offset(level, x[i + j], y[i + j]);
+            }
+            pz += delta_load_v4sf(off);
+        }
+
+        delta_store_v4sf(a + i, delta_tower_v4sf(px, py, geo->tower_x[0],
+                                geo->tower_y[0], geo->rod_2[0]) + pz);
+        delta_store_v4sf(b + i, delta_tower_v4sf(px, py, geo->tower_x[1],
+                                geo->tower_y[1], geo->rod_2[1]) + pz);
+        delta_store_v4sf(c + i, delta_tower_v4sf(px, py, geo->tower_x[2],
+                                geo->tower_y[2], geo->rod_2[2]) + pz);
+    }
+
+    return i;
+}
+#else
+static int delta_calculate_batch4(const delta_geometry_t *geo,
+                                  const delta_level_t *level,
+                                  int n,
+                                  const float *x, const float *y, const float *z,
+                                  float *a, float *b, float *c)
+{
+    return 0;
+}
+#endif
+
+void delta_calculate_batch(const delta_geometry_t *geo,
+                           const delta_level_t *level,
+                           int n,
+                           const float *x, const float *y, const float *z,
+                           float *a, float *b, float *c)
+{
+    int done = delta_calculate_batch4(geo, level, n, x, y, z, a, b, c);
+
+    /* the remaining 0~3 points */
+    if (done < n) {
+        delta_calculate_batch_scalar(geo, level, n - done,
+                                     x + done, y + done, z + done,
+                                     a + done, b + done, c + done);
+    }
+}
+
+/*
+ * Nozzle position of the carriage heights a, b, c, the point below
+ * the carriages at rod length from all three (trilateration).
+ * Return -1 if the rods do not meet.
+ */
+int delta_forward(const delta_geometry_t *geo, float a, float b, float c,
+                  float *x, float *y, float *z)
+{
+    double p1[3] = { geo->tower_x[0], geo->tower_y[0], a };
+    double p2[3] = { geo->tower_x[1], geo->tower_y[1], b };
+    double p3[3] = { geo->tower_x[2], geo->tower_y[2], c };
+    double ex[3], ey[3], ez[3];
+    double d, i, j, px, py, pz2;
+    int k;
+
+    /* unit vectors of a frame with p1 at the origin, p2 on ex */
+    for (k = 0; k < 3; k++) {
+        ex[k] = p2[k] - p1[k];
+    }
+    d = sqrt(ex[0] * ex[0] + ex[1] * ex[1] + ex[2] * ex[2]);
+    for (k = 0; k < 3; k++) {
+        ex[k] /= d;
+    }
+
+    i = 0.0;
+    for (k = 0; k < 3; k++) {
+        i += ex[k] * (p3[k] - p1[k]);
+    }
+    for (k = 0; k < 3; k++) {
+        ey[k] = p3[k] - p1[k] - i * ex[k];
+    }
+    j = sqrt(ey[0] * ey[0] + ey[1] * ey[1] + ey[2] * ey[2]);
+    for (k = 0; k < 3; k++) {
+        ey[k] /= j;
+    }
+
+    ez[0] = ex[1] * ey[2] - ex[2] * ey[1];
+    ez[1] = ex[2] * ey[0] - ex[0] * ey[2];
+    ez[2] = ex[0] * ey[1] - ex[1] * ey[0];
+
+    px = (geo->rod_2[0] - geo->rod_2[1] + d * d) / (2 * d);
+    py = (geo->rod_2[0] - geo->rod_2[2] + i * i + j * j) / (2 * j) - i * px / j;
+    pz2 = geo->rod_2[0] - px * px - py * py;
+    if (pz2 < 0.0) {
+        return -1;
+    }
+
+    /* the nozzle hangs below the carriages, ez points up */
+    *x = p1[0] + px * ex[0] + py * ey[0] - sqrt(pz2) * ez[0];
+    *y = p1[1] + px * ex[1] + py * ey[1] - sqrt(pz2) * ez[1];
+    *z = p1[2] + px * ex[2] + py * ey[2] - sqrt(pz2) * ez[2];
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * delta.h
+ * batch delta kinematics
+*/
+#ifndef _DELTA_H
+#define _DELTA_H
+
+/* Points computed per call by the segmentation code */
+#define DELTA_BATCH_SIZE    (32)
+
+/*
+ * Tower geometry, filled by set_delta_constants()
+ */
+typedef struct {
+    float tower_x[3];
+    float tower_y[3];
+    float rod_2[3];     /* diagonal rod length squared */
+} delta_geometry_t;
+
+/*
+ * Bed level grid for the bilinear z offset,
+ * same layout as bed_level[100][100] in gcode.c
+ */
+typedef struct {
+    float (*z)[100];
+    int half;           /* (grid points - 1) / 2 */
+    float inv_x_num;    /* 1 / grid spacing */
+    float inv_y_num;
+} delta_level_t;
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Tower heights a, b, c of n cartesian points x, y, z,
+ * level may be NULL when auto leveling is off.
+ */
+extern void delta_calculate_batch(const delta_geometry_t *geo,
+                                  const delta_level_t *level,
+                                  int n,
+                                  const float *x, const float *y, const float *z,
+                                  float *a, float *b, float *c);
+
+extern void delta_calculate_batch_scalar(const delta_geometry_t *geo,
+                                         const delta_level_t *level,
+                                         int n,
+                                         const float *x, const float *y, const float *z,
+                                         float *a, float *b, float *c);
+
+extern float delta_level_offset(const delta_level_t *level, float x, float y);
+
+/* Nozzle x, y, z of the tower heights a, b, c, -1 if out of reach */
+extern int delta_forward(const delta_geometry_t *geo, float a, float b, float c,
+                         float *x, float *y, float *z);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
@@ -212,6 +212,8 @@ static void parameter_default(void)
 	g_param.invert_y_dir = INVERT_Y_DIR;
 	g_param.invert_z_dir = INVERT_Z_DIR;
 	g_param.invert_e_dir = INVERT_E_DIR;
+
+	g_param.delta_segment_error = DELTA_SEGMENT_ERROR;
 	
 	unsigned int uc_temp1[MAX_AXIS] = AXIS_CURRENT;
 	unsigned char uc_temp2[MAX_AXIS] = AXIS_USTEP;
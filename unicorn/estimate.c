@@ -0,0 +1,451 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * estimate.c
+ * Offline print time estimate. The gcode file goes through the real
+ * gcode_process_line() and plan_buffer_line(), without the planner and
+ * stepper threads: where the gcode thread would wait for a free block,
+ * the oldest block is taken and timed as pruss_queue_move() splits it,
+ * so the planner buffer runs full as it does during a print.
+ *
+ * The time of a block is virtual, the PRU ramps the step delay
+ * linearly from one rate to the next. The time the parser and the
+ * planner spend on it is measured, scaled to the target board, and a
+ * block reaching the queue after the previous one is done is a stall.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "parameter.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper.h"
+#include "stepper_pruss.h"
+#include "gcode.h"
+#include "estimate.h"
+
+#define LINE_LEN            (256)
+
+/* Blocks produced and not yet taken, above BLOCK_BUFFER_SIZE of planner.c */
+#define ESTIMATE_RING       (256)
+
+/* Blocks buffered ahead of the PRU, the queue and STEPPER_BLOCK_SIZE of stepper.c */
+#define ESTIMATE_DEPTH      (QUEUE_LEN + 8192)
+#define ESTIMATE_DEPTH_RING (32768)
+
+/* Blocks the demand rate is taken over */
+#define ESTIMATE_WINDOW     (64)
+
+/* Runs of stalls printed with their lines */
+#define ESTIMATE_STALLS     (10)
+
+typedef struct {
+    float z;
+    int line;               /* first printing move */
+    int blocks;
+    double motion;          /* s */
+    double stall;           /* s */
+    double peak_rate;       /* blocks/s */
+} layer_t;
+
+static struct {
+    float cpu_scale;
+
+    /* Parser, planner and the line a block came from */
+    uint32_t produced;
+    uint32_t taken;
+    double prod_time[ESTIMATE_RING];
+    int prod_line[ESTIMATE_RING];
+    int prod_layer[ESTIMATE_RING];
+    uint64_t cpu_start;
+    uint64_t cpu_excluded;
+    double delay;           /* s the parser waited for a free queue entry */
+
+    /* Virtual time of the PRU */
+    double end[ESTIMATE_DEPTH_RING];
+    double window[ESTIMATE_WINDOW];
+    double exec_end;
+    double motion;
+    double stall;
+    int nr_stalls;
+    int nr_runs;
+    int run_first;          /* lines of the stalls in a row */
+    int run_last;
+    int run_layer;
+    double run_time;
+    double peak_rate;
+    int peak_line;
+
+    /* gcode file */
+    int line;
+    int layer;
+    bool relative;
+    float z;
+    int skipped;
+    int heat_waits;
+
+    layer_t *layers;
+    int nr_layers;
+    int size_layers;
+} est;
+
+static uint64_t cpu_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Time the parser and the planner spent so far, s on the target board
+ */
+static double producer_now(void)
+{
+    return (cpu_now() - est.cpu_start - est.cpu_excluded) * 1e-9 * est.cpu_scale;
+}
+
+static int layer_add(float z, int line)
+{
+    layer_t *l;
+
+    if (est.nr_layers == est.size_layers) {
+        est.size_layers = est.size_layers ? est.size_layers * 2 : 256;
+        l = realloc(est.layers, est.size_layers * sizeof(layer_t));
+        if (!l) {
+            return -1;
+        }
+        est.layers = l;
+    }
+
+    l = &est.layers[est.nr_layers];
+    memset(l, 0, sizeof(layer_t));
+    l->z = z;
+    l->line = line;
+    return est.nr_layers++;
+}
+
+/*
+ * Blocks buffered since the last stamp are done now
+ */
+static void estimate_stamp(void)
+{
+    uint32_t produced = est.taken + plan_get_block_size();
+    double now = producer_now();
+    int i;
+
+    while (est.produced != produced) {
+        i = est.produced & (ESTIMATE_RING - 1);
+        est.prod_time[i]  = now;
+        est.prod_line[i]  = est.line;
+        est.prod_layer[i] = est.layer;
+        est.produced++;
+    }
+}
+
+static double rate_delay(unsigned long rate)
+{
+    return 1.0 / max(rate, 1UL);
+}
+
+/*
+ * Seconds the PRU takes for a block, the phases of pruss_queue_move()
+ */
+static double block_time(const block_t *block)
+{
+    long accel = block->accelerate_until;
+    long travel, decel;
+    double t;
+
+    if (block->nominal_rate == block->final_rate
+            || (long)block->step_event_count < block->decelerate_after) {
+        travel = block->step_event_count - block->accelerate_until;
+        decel  = 0;
+    } else {
+        travel = block->decelerate_after - block->accelerate_until;
+        decel  = block->step_event_count - block->decelerate_after;
+    }
+
+    t  = accel * (rate_delay(block->initial_rate) + rate_delay(block->nominal_rate)) / 2;
+    t += travel * rate_delay(block->nominal_rate);
+    t += decel * (rate_delay(block->nominal_rate) + rate_delay(block->final_rate)) / 2;
+    return t;
+}
+
+/*
+ * Stalls of blocks in a row are one run
+ */
+static void estimate_run_end(void)
+{
+    if (est.run_time > 0 && est.nr_runs++ < ESTIMATE_STALLS) {
+        printf("[estimate]: queue dry %.3f s, lines %d-%d, layer %d\n",
+                est.run_time, est.run_first, est.run_last, est.run_layer);
+    }
+    est.run_time = 0;
+}
+
+static void estimate_block(const block_t *block)
+{
+    uint32_t seq = est.taken++;
+    int i = seq & (ESTIMATE_RING - 1);
+    layer_t *l = &est.layers[est.prod_layer[i]];
+    double ready = est.prod_time[i] + est.delay;
+    double t = block_time(block);
+    double start, span, rate;
+
+    /* The parser waits while the queue is full */
+    if (seq >= ESTIMATE_DEPTH) {
+        start = est.end[(seq - ESTIMATE_DEPTH) & (ESTIMATE_DEPTH_RING - 1)];
+        if (ready < start) {
+            est.delay += start - ready;
+            ready = start;
+        }
+    }
+
+    /* The queue ran dry */
+    if (seq > 0 && ready > est.exec_end) {
+        if (est.run_time == 0) {
+            est.run_first = est.prod_line[i];
+            est.run_layer = est.prod_layer[i];
+        }
+        est.run_last = est.prod_line[i];
+        est.run_time += ready - est.exec_end;
+        est.nr_stalls++;
+        est.stall += ready - est.exec_end;
+        l->stall += ready - est.exec_end;
+        est.exec_end = ready;
+    } else {
+        estimate_run_end();
+        if (seq == 0) {
+            est.exec_end = ready;
+        }
+    }
+
+    est.exec_end += t;
+    est.end[seq & (ESTIMATE_DEPTH_RING - 1)] = est.exec_end;
+    est.motion += t;
+    l->motion += t;
+    l->blocks++;
+
+    /* Blocks per second the PRU asks for */
+    span = est.motion - est.window[seq & (ESTIMATE_WINDOW - 1)];
+    est.window[seq & (ESTIMATE_WINDOW - 1)] = est.motion;
+    if (seq >= ESTIMATE_WINDOW && span > 0) {
+        rate = ESTIMATE_WINDOW / span;
+        if (rate > l->peak_rate) {
+            l->peak_rate = rate;
+        }
+        if (rate > est.peak_rate) {
+            est.peak_rate = rate;
+            est.peak_line = est.prod_line[i];
+        }
+    }
+}
+
+/*
+ * Called by plan_buffer_line() instead of waiting for the planner thread
+ */
+static void estimate_take(void)
+{
+    uint64_t t0 = cpu_now();
+    block_t *block;
+
+    estimate_stamp();
+    block = plan_get_current_block();
+    if (block) {
+        estimate_block(block);
+        plan_discard_current_block();
+    }
+    est.cpu_excluded += cpu_now() - t0;
+}
+
+static bool line_float(const char *line, char chr, float *v)
+{
+    const char *p = strchr(line, chr);
+
+    if (!p) {
+        return false;
+    }
+    *v = strtof(p + 1, NULL);
+    return true;
+}
+
+/*
+ * Whether the firmware would run the line, commands waiting for
+ * hardware or talking to it are left out of the estimate
+ */
+static bool line_supported(const char *line)
+{
+    int code = atoi(line + 1);
+
+    switch (line[0]) {
+        case 'G':
+            switch (code) {
+                case 0: case 1: case 2: case 3: case 4:
+                case 20: case 21: case 90: case 91: case 92:
+                    return true;
+            }
+            return false;
+        case 'M':
+            if (strchr(line, 'V')) {
+                return false;
+            }
+            switch (code) {
+                case 82: case 83: case 220: case 221:
+                    return true;
+                case 109: case 190: case 116:
+                    est.heat_waits++;
+                    break;
+            }
+            return false;
+    }
+    return false;
+}
+
+/*
+ * A new layer starts with the first printing move at another height
+ */
+static void estimate_track(const char *line)
+{
+    int code = atoi(line + 1);
+    float v;
+    int layer;
+
+    if (line[0] != 'G') {
+        return;
+    }
+
+    if (code == 90 || code == 91) {
+        est.relative = (code == 91);
+    } else if (code == 92 && line_float(line, 'Z', &v)) {
+        est.z = v;
+    } else if (code <= 3 && line_float(line, 'Z', &v)) {
+        est.z = est.relative ? est.z + v : v;
+    }
+
+    if (code >= 1 && code <= 3 && strchr(line, 'E')
+            && (strchr(line, 'X') || strchr(line, 'Y'))) {
+        if (est.layers[est.layer].z != est.z) {
+            layer = layer_add(est.z, est.line);
+            if (layer > 0) {
+                est.layer = layer;
+            }
+        }
+    }
+}
+
+static void print_time(const char *name, double t)
+{
+    long s = lround(t);
+
+    printf("[estimate]: %-14s %ld:%02ld:%02ld  (%.1f s)\n",
+            name, s / 3600, (s / 60) % 60, s % 60, t);
+}
+
+static void estimate_report(const char *file)
+{
+    double cpu = producer_now();
+    layer_t *l;
+    int i;
+
+    printf("[estimate]: %s, %d lines, %u blocks, %d layers\n",
+            file, est.line, est.taken, est.nr_layers - 1);
+    printf("[estimate]:  layer       z    line  blocks   motion s    stall s  peak blocks/s\n");
+    for (i = 0; i < est.nr_layers; i++) {
+        l = &est.layers[i];
+        if (i == 0 && l->blocks == 0) {
+            continue;
+        }
+        if (i == 0) {
+            printf("[estimate]:  start       -       -");
+        } else {
+            printf("[estimate]: %6d %7.3f %7d", i, l->z, l->line);
+        }
+        printf(" %7d %10.2f %10.3f %14.0f\n", l->blocks, l->motion, l->stall, l->peak_rate);
+    }
+
+    print_time("print time", est.exec_end);
+    print_time("motion", est.motion);
+    print_time("queue dry", est.stall);
+
+    if (est.taken > 0) {
+        printf("[estimate]: parser and planner %.1f us per block (x%.2f), %.0f blocks/s\n",
+                cpu * 1e6 / est.taken, est.cpu_scale, cpu > 0 ? est.taken / cpu : 0.0);
+    }
+    printf("[estimate]: peak demand %.0f blocks/s at line %d\n", est.peak_rate, est.peak_line);
+    printf("[estimate]: queue dry %d times in %d runs\n", est.nr_stalls, est.nr_runs);
+    if (est.skipped) {
+        printf("[estimate]: %d lines left out, %d heater waits not timed\n",
+                est.skipped, est.heat_waits);
+    }
+}
+
+int estimate_file(const char *file, float cpu_scale)
+{
+    char buf[LINE_LEN];
+    char *p;
+    FILE *fp;
+
+    fp = fopen(file, "r");
+    if (!fp) {
+        printf("[estimate]: can not open %s\n", file);
+        return -1;
+    }
+
+    memset(&est, 0, sizeof(est));
+    est.cpu_scale = cpu_scale > 0 ? cpu_scale : 1.0;
+    if (layer_add(NAN, 0) < 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    /* The defaults if the eeprom can not be read, off the board */
+    parameter_init(EEPROM_DEV);
+
+    if (kinematics_init() < 0
+            || stepper_offline_init() < 0
+            || plan_init_offline(estimate_take) < 0
+            || gcode_init() < 0) {
+        printf("[estimate]: init failed\n");
+        fclose(fp);
+        return -1;
+    }
+
+    est.cpu_start = cpu_now();
+    while (fgets(buf, sizeof(buf), fp)) {
+        est.line++;
+        p = strchr(buf, ';');
+        if (p) {
+            *p = '\0';
+        }
+        buf[strcspn(buf, "\r\n")] = '\0';
+        p = buf + strspn(buf, " \t");
+        if (*p == '\0') {
+            continue;
+        }
+
+        if (!line_supported(p)) {
+            est.skipped++;
+            continue;
+        }
+        estimate_track(p);
+        gcode_process_line(p, false);
+        estimate_stamp();
+    }
+    fclose(fp);
+
+    /* The end of the file, the planner buffer empties */
+    while (plan_get_block_size() > 0) {
+        estimate_take();
+    }
+    estimate_run_end();
+
+    estimate_report(file);
+    free(est.layers);
+    return 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * estimate.h
+ * offline print time estimate, a gcode file goes through gcode.c and
+ * planner.c and the moves are timed as the PRU executes them
+*/
+#ifndef _ESTIMATE_H
+#define _ESTIMATE_H
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Print the total time, the time per layer and where the queue would
+ * run dry. cpu_scale is how much slower the target board parses and
+ * plans than this cpu, 1.0 when it runs on the board.
+ */
+extern int estimate_file(const char *file, float cpu_scale);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
@@ -250,3 +250,46 @@ int fan_get_level(channel_tag fan, unsigned int *level)
 
     return 0;
 }
+/*
+ * PWM channel of a fan, NULL if it has none
+ */
+channel_tag fan_get_pwm(channel_tag fan)
+{
+    int idx = fan_index_lookup(fan);
+
+    if (idx < 0) {
+        return NULL;
+    }
+    return fans[idx].pwm;
+}
+/*
+ * Level the PRU writes from the motion queue, [0, 100].
+ * Starts the pwm at zero duty so nothing changes before then,
+ * level 0 leaves an off fan off.
+ */
+int fan_set_queued_level(channel_tag fan, unsigned int level)
+{
+    int idx = -1;
+    fan_t *pd = NULL;
+
+	FAN_DBG("fan_set_queued_level: %s -> %d\n", fan, level);
+
+    idx = fan_index_lookup(fan);
+    if (idx < 0 || level > 100 || !fans[idx].pwm) {
+        return -1;
+    }
+
+    pd = &fans[idx];
+    if (level > 0) {
+        if (pwm_get_state(pd->pwm) == PWM_STATE_OFF) {
+            pwm_enable(pd->pwm);
+            pwm_set_output(pd->pwm, 0);
+        }
+        if (pd->gpio) {
+            gpio_write_sysfs(pd->gpio, "value", "1");
+        }
+    }
+    pd->level = level;
+
+    return 0;
+}
@@ -31,6 +31,9 @@ extern int fan_disable(channel_tag fan);
 extern int fan_set_level(channel_tag fan, unsigned int level);
 extern int fan_get_level(channel_tag fan, unsigned int *level);
 
+extern channel_tag fan_get_pwm(channel_tag fan);
+extern int fan_set_queued_level(channel_tag fan, unsigned int level);
+
 #if defined (__cplusplus)
 }
 #endif
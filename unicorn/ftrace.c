@@ -0,0 +1,139 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * ftrace.c
+ * timeline markers to the trace_marker of ftrace,
+ * one write() of a stack buffer per marker
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/prctl.h>
+
+#include "ftrace.h"
+
+#define FTRACE_LEN      (64)
+
+int ftrace_fd = -1;
+
+/* "B|pid|", "C|pid|" and "E|pid", the pid of the process groups the threads */
+static char prefix_begin[16];
+static char prefix_counter[16];
+static char marker_end[16];
+static int prefix_len;
+static int end_len;
+
+static int put_str(char *buf, int pos, const char *s)
+{
+    while (*s && pos < FTRACE_LEN) {
+        buf[pos++] = *s++;
+    }
+    return pos;
+}
+
+static int put_int(char *buf, int pos, int32_t value)
+{
+    char tmp[12];
+    int n = 0;
+    uint32_t v = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    if (value < 0) {
+        tmp[n++] = '-';
+    }
+
+    while (n && pos < FTRACE_LEN) {
+        buf[pos++] = tmp[--n];
+    }
+    return pos;
+}
+
+static void marker_write(const char *buf, int len)
+{
+    /* Lost while tracing is stopped, nothing to do about it */
+    if (write(ftrace_fd, buf, len) < 0) {
+        return;
+    }
+}
+
+void ftrace_begin(const char *name)
+{
+    char buf[FTRACE_LEN];
+    int pos;
+
+    memcpy(buf, prefix_begin, prefix_len);
+    pos = put_str(buf, prefix_len, name);
+    marker_write(buf, pos);
+}
+
+void ftrace_end(void)
+{
+    marker_write(marker_end, end_len);
+}
+
+void ftrace_counter(const char *name, int32_t value)
+{
+    char buf[FTRACE_LEN];
+    int pos;
+
+    memcpy(buf, prefix_counter, prefix_len);
+    pos = put_str(buf, prefix_len, name);
+    pos = put_str(buf, pos, "|");
+    pos = put_int(buf, pos, value);
+    marker_write(buf, pos);
+}
+
+void ftrace_thread_name(const char *name)
+{
+    /* comm is 15 chars, the kernel cuts it */
+    prctl(PR_SET_NAME, name, 0, 0, 0);
+}
+
+int ftrace_init(void)
+{
+#ifdef WITH_FTRACE
+    int fd;
+    int pid = getpid();
+
+    fd = open(FTRACE_MARKER, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fd = open(FTRACE_MARKER_DEBUGFS, O_WRONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        printf("[ftrace]: open trace_marker failed, %s\n", strerror(errno));
+        return -1;
+    }
+
+    prefix_len = snprintf(prefix_begin, sizeof(prefix_begin), "B|%d|", pid);
+    snprintf(prefix_counter, sizeof(prefix_counter), "C|%d|", pid);
+    end_len = snprintf(marker_end, sizeof(marker_end), "E|%d", pid);
+
+    /* The prefixes are set before the markers see the fd */
+    __sync_synchronize();
+    ftrace_fd = fd;
+
+    printf("[ftrace]: markers to trace_marker, pid %d\n", pid);
+    return 0;
+#else
+    printf("[ftrace]: built without WITH_FTRACE\n");
+    return -1;
+#endif
+}
+
+void ftrace_exit(void)
+{
+    int fd = ftrace_fd;
+
+    if (fd >= 0) {
+        ftrace_fd = -1;
+        __sync_synchronize();
+        close(fd);
+    }
+}
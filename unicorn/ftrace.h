@@ -0,0 +1,77 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * ftrace.h
+ * timeline markers of the firmware threads, written to the
+ * trace_marker of ftrace in the systrace format:
+ *   B|pid|name  begin of a slice of the calling thread
+ *   E|pid       end of the innermost slice
+ *   C|pid|name|value  counter
+ * trace-cmd, kernelshark, catapult and perfetto show them
+ * next to the sched_switch events of the kernel.
+*/
+#ifndef _FTRACE_H
+#define _FTRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FTRACE_MARKER       "/sys/kernel/tracing/trace_marker"
+#define FTRACE_MARKER_DEBUGFS "/sys/kernel/debug/tracing/trace_marker"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/* trace_marker, -1 while tracing is off */
+extern int ftrace_fd;
+
+extern void ftrace_begin(const char *name);
+extern void ftrace_end(void);
+extern void ftrace_counter(const char *name, int32_t value);
+
+/* Name the calling thread, the viewers show the comm of a tid */
+extern void ftrace_thread_name(const char *name);
+
+/* Open the trace_marker, tracing is off if it fails */
+extern int ftrace_init(void);
+extern void ftrace_exit(void);
+
+#if defined (__cplusplus)
+}
+#endif
+
+/*
+ * Built without WITH_FTRACE the markers are gone,
+ * built with it and not enabled they cost a load and a branch.
+ */
+#ifdef WITH_FTRACE
+#define FTRACE_BEGIN(name)                                  \
+        do {                                                \
+            if (ftrace_fd >= 0) {                           \
+                ftrace_begin(name);                         \
+            }                                               \
+        } while (0)
+
+#define FTRACE_END()                                        \
+        do {                                                \
+            if (ftrace_fd >= 0) {                           \
+                ftrace_end();                               \
+            }                                               \
+        } while (0)
+
+#define FTRACE_COUNTER(name, value)                         \
+        do {                                                \
+            if (ftrace_fd >= 0) {                           \
+                ftrace_counter(name, value);                \
+            }                                               \
+        } while (0)
+
+#define FTRACE_THREAD(name)     ftrace_thread_name(name)
+#else
+#define FTRACE_BEGIN(name)          do { } while (0)
+#define FTRACE_END()                do { } while (0)
+#define FTRACE_COUNTER(name, value) do { } while (0)
+#define FTRACE_THREAD(name)         do { } while (0)
+#endif
+
+#endif
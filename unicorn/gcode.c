@@ -44,9 +44,14 @@
 #include "motion.h"
 #include "stepper.h"
 #include "planner.h"
+#include "latency.h"
+#include "rt.h"
 #include "sdcard.h"
 #include "unicorn.h"
 #include "gcode.h"
+#include "delta.h"
+#include "kinematics.h"
+#include "mesh.h"
 
 #include "util/Pause.h"
 
@@ -86,6 +91,8 @@ static bool relative_mode = false;
 char axis_codes[NUM_AXIS] = {'X', 'Y', 'Z', 'E'};
 
 volatile signed short feedmultiply = 100; 
+/* Part of feedmultiply the PRU applies to the queued moves, percent */
+static int feed_live = 100;
 
 /* 0 --> Exteruder 1 
  * 1 --> Extruder 2
@@ -112,7 +119,6 @@ static bool retracted_swap[MAX_EXTRUDER] = {false, false, false};
 static const float home_retract_mm[3] = 
 			{ X_HOME_RETRACT_MM, Y_HOME_RETRACT_MM, Z_HOME_RETRACT_MM };     
 static float safe_servo_retract_distance = 5;
-static void adjust_delta(float cartesian[3]);
 static void reset_bed_level();
 static void engage_z_probe(void);
 static void retract_z_probe(void);
@@ -444,6 +450,35 @@ void calculate_delta(float cartesian[4])
 }
 
 
+/*
+ * Factor new moves are planned with for a net multiply,
+ * the PRU slows them by feed_live
+ */
+static int plan_feedmultiply(int multiply)
+{
+    return multiply * 100 / feed_live;
+}
+
+/* Slow the queued moves to percent, feed_live is what the PRU applies */
+static void set_feed_live(int percent)
+{
+    int live = stepper_set_rate_scale(percent);
+
+    feed_live = (live > 0) ? live : 100;
+}
+
+/*
+ * Homing and probing run at their planned rate,
+ * the moves queued before them finish at the live factor
+ */
+static void feed_live_off(void)
+{
+    if (feed_live != 100) {
+        stepper_sync();
+        set_feed_live(100);
+    }
+}
+
 static void prepare_move_raw(void)
 {
 #if 0 
@@ -503,7 +538,7 @@ static void prepare_move_raw(void)
                      delta[Y_AXIS],
                      delta[Z_AXIS],
                      destination[E_AXIS],
-                     feedrate * feedmultiply / 60 / 100,
+                     feedrate * plan_feedmultiply(feedmultiply) / 60 / 100,
                      active_extruder);
 #endif
 
@@ -532,10 +567,10 @@ static void prepare_move(void)
 #if 1
     if (destination[E_AXIS] > current_position[E_AXIS]) {
         /* print speed */
-        help_feedrate = (feedrate * feedmultiply);
+        help_feedrate = (feedrate * plan_feedmultiply(feedmultiply));
     } else {
-        /* travel speed */
-        help_feedrate = (feedrate * 100);
+        /* travel speed, M220 does not apply */
+        help_feedrate = (feedrate * plan_feedmultiply(100));
     }
 
 #else
@@ -548,189 +583,10 @@ static void prepare_move(void)
     }
 #endif
 
-    if (pa.machine_type == MACHINE_DELTA) {
-		float distance_from_center = destination[X_AXIS] * destination[X_AXIS]  + destination[Y_AXIS] * destination[Y_AXIS];
-		if (distance_from_center > pa.delta_print_radius * pa.delta_print_radius) {
-			if ((abs(destination[X_AXIS]) != 0) && (abs(destination[Y_AXIS]) != 0)) { 
-				printf("lkj debug, delta out of range !!!!\n");
-				float scale = fabs(destination[X_AXIS] / destination[Y_AXIS]);
-				int x_direction = 1, y_direction = 1; 
-				if (destination[X_AXIS] < 0)
-					x_direction = -1; 
-				if (destination[Y_AXIS] < 0)
-					y_direction = -1; 
-				destination[Y_AXIS] = y_direction * pa.delta_print_radius / sqrt(1+scale * scale);
-				destination[X_AXIS] = x_direction * fabs(destination[Y_AXIS]) * scale;
-			}
-		}
-
-        if (pa.min_software_endstops) {
-            if (destination[X_AXIS] < -pa.delta_print_radius) {
-                destination[X_AXIS] =  -pa.delta_print_radius;
-            }
-            if (destination[Y_AXIS] <  -pa.delta_print_radius) {
-                destination[Y_AXIS] = -pa.delta_print_radius;
-            }
-        }
-            
-        if (pa.max_software_endstops) {
-            if (destination[X_AXIS] > pa.delta_print_radius) {
-                destination[X_AXIS] = pa.delta_print_radius;
-            }
-            if (destination[Y_AXIS] > pa.delta_print_radius) {
-                destination[Y_AXIS] = pa.delta_print_radius;
-            }
-        }
-
-        /* Delta */
-        float difference[NUM_AXIS];
-        for (i = 0; i < NUM_AXIS; i++) {
-            difference[i] = destination[i] - current_position[i];
-        }
-        float cartesian_mm = sqrt(powf(difference[X_AXIS], 2) +
-                                  powf(difference[Y_AXIS], 2) +
-                                  powf(difference[Z_AXIS], 2));
-
-        if (cartesian_mm < 0.000001) {
-            cartesian_mm = abs(difference[E_AXIS]);
-        }
-
-        if (cartesian_mm < 0.000001) {
-            printf("cartesian_mm < 0.000001!!!!!!!!!!\n");
-            return;
-        }
-
-        float seconds = 6000 * cartesian_mm / help_feedrate;
-        int steps = max(1, (int)(pa.segments_per_second * seconds));
-		
-		if (abs(difference[Z_AXIS]) >= 10.0) {
-        	steps = 1;
-		}
-
-        int s;
-        for (s = 1; s <= steps; s++) {
-            float fraction = (float)(s) / (float)(steps);     
-            for (i = 0; i < NUM_AXIS; i++) {
-                destination[i] = current_position[i] + difference[i] * fraction;
-            }
-
-            calculate_delta(destination);
-			if (pa.autoLeveling) {
-				adjust_delta(destination);
-			}
-#if 0
-         PLAN_DBG("[%5d] POS -> X%3.2f Y%3.2f Z%3.2f E%3.2f F%d\n\r",
-                    ++counter,
-                    delta[0] * 200,
-                    delta[1] * 200,
-                    delta[2] * 200,
-                    delta[3],
-                    (int)feedrate);
-#endif        
-            plan_buffer_line(delta[X_AXIS], 
-                             delta[Y_AXIS], 
-                             delta[Z_AXIS],
-                             destination[E_AXIS], 
-                             help_feedrate / 6000.0,
-                             active_extruder);
-        }
-    } else {
-        /* xyz & corexy,  min endstop  in PRU 
-        if (pa.min_software_endstops) { 
-            if (destination[X_AXIS] < 0) {
-                destination[X_AXIS] = 0.0;
-            }
-            if (destination[Y_AXIS] < 0) {
-                destination[Y_AXIS] = 0.0;
-            }
-            if (destination[Z_AXIS] < 0) {
-                destination[Z_AXIS] = 0.0;
-            }
-        }*/
-            
-        if (pa.max_software_endstops) {
-            if (destination[X_AXIS] > pa.x_max_length) {
-                destination[X_AXIS] = pa.x_max_length;
-            }
-            if (destination[Y_AXIS] > pa.y_max_length) {
-                destination[Y_AXIS] = pa.y_max_length;
-            }
-            if (destination[Z_AXIS] > pa.z_max_length) {
-                destination[Z_AXIS] = pa.z_max_length;
-            }
-        }
-        
-#if 0
-        float difference[NUM_AXIS];
-        for (i = 0; i < NUM_AXIS; i++) {
-            difference[i] = destination[i] - current_position[i];
-        }
-        float cartesian_mm = sqrt(powf(difference[X_AXIS], 2) +
-                                  powf(difference[Y_AXIS], 2) +
-                                  powf(difference[Z_AXIS], 2));
-        float max_move_xy_mm = 65535 / max(pa.axis_steps_per_unit[X_AXIS], pa.axis_steps_per_unit[Y_AXIS]);
-        float max_move_z_mm = 65535  / pa.axis_steps_per_unit[Z_AXIS];
-
-        //printf("diff_x:%f, diff_y:%f, diff_z:%f, cartesian_mm:%f\n", 
-         //       difference[X_AXIS], difference[Y_AXIS], difference[Z_AXIS], cartesian_mm);
-        //printf("max_move_xy_mm:%f,max_move_z_mm:%f \n", max_move_xy_mm, max_move_z_mm);
-
-        //if (((difference[X_AXIS] == difference[Y_AXIS] && difference[Y_AXIS] == 0.0f) && fabsf(difference[Z_AXIS]) > max_move_z_mm)
-        if ((fabsf(difference[Z_AXIS]) > max_move_z_mm)
-            || (cartesian_mm > max_move_xy_mm )) { 
-                float max_move = max_move_xy_mm;
-                //if ((difference[X_AXIS] == difference[Y_AXIS] && difference[Y_AXIS] == 0.0f) && fabsf(difference[Z_AXIS]) > max_move_z_mm){
-                if (fabsf(difference[Z_AXIS]) > max_move_z_mm){
-                    max_move = max_move_z_mm;
-                } 
-                int segments = ceilf(cartesian_mm / max_move);
-                //printf("segments:%d, cartesian_mm:%f, max_move:%f \n", segments, cartesian_mm, max_move);
-                float fraction = 0.0f;
-                while (segments >0) {
-                    printf("segments:%d\n", segments);
-                    if (segments == 1){
-                        fraction = 1;
-                    } else {
-                        fraction += max_move / cartesian_mm;
-                    }
-                    for (i = 0; i < NUM_AXIS; i++) {
-                        destination[i] = current_position[i] + difference[i] * fraction;
-                        //printf("destination[%d]:%f, fraction:%f\n", i, destination[i], fraction);
-                    }
-                    plan_buffer_line(destination[X_AXIS], 
-                                     destination[Y_AXIS], 
-                                     destination[Z_AXIS],
-                                     destination[E_AXIS], 
-                                     help_feedrate / 6000.0,
-                                     active_extruder);
-                    segments--;
-                }
-         } else {
-            plan_buffer_line(destination[X_AXIS], 
-                    destination[Y_AXIS], 
-                    destination[Z_AXIS],
-                    destination[E_AXIS],
-                    help_feedrate / 6000.0,
-                    active_extruder);
-        }
-#endif
-#if 1
-
-        PLAN_DBG("[%5d] POS -> X%3.2f Y%3.2f Z%3.2f E%3.2f F%f\n\r",
-                    ++counter,
-                    destination[0],
-                    destination[1],
-                    destination[2],
-                    destination[3],
-                    feedrate);
-
-        plan_buffer_line(destination[X_AXIS], 
-                         destination[Y_AXIS], 
-                         destination[Z_AXIS],
-                         destination[E_AXIS],
-                         help_feedrate / 6000.0,
-                         active_extruder);
-#endif
+    kinematics->limits(destination);
+    if (kinematics->buffer_move(current_position, destination, 
+                                help_feedrate / 6000.0, active_extruder) < 0) {
+        return;
     }
 
     /* Save destination as current position */
@@ -749,9 +605,9 @@ static void prepare_arc_move(char isclockwise)
     r = hypot(offset[X_AXIS], offset[Y_AXIS]);
     
     if (destination[E_AXIS] > current_position[E_AXIS]) {
-        help_feedrate = (feedrate * feedmultiply);
+        help_feedrate = (feedrate * plan_feedmultiply(feedmultiply));
     } else {
-        help_feedrate = (feedrate * 100);
+        help_feedrate = (feedrate * plan_feedmultiply(100));
     }
 
     /* Trace the arc */
@@ -919,6 +775,7 @@ static void homing_axis_plan_buffer(char *line)
 
     if (pa.autoLeveling) {
 		matrix_set_to_identity(&plan_bed_level_matrix);
+		plan_update_transform();
 		reset_bed_level();
 debug_matrix(&plan_bed_level_matrix);
 	}
@@ -1095,6 +952,7 @@ static void homing_axis(char *line)
 
 	if (pa.autoLeveling) {
 		matrix_set_to_identity(&plan_bed_level_matrix);
+		plan_update_transform();
 	}
 
 	if (pa.machine_type == MACHINE_COREXY) {
@@ -1213,21 +1071,7 @@ static void homing_axis(char *line)
         current_position[Y_AXIS] = destination[Y_AXIS];
         current_position[Z_AXIS] = destination[Z_AXIS];
 
-        calculate_delta(current_position);
-
-        printf("delta[X_AXIS]: %f\n", delta[X_AXIS]);
-        printf("delta[Y_AXIS]: %f\n", delta[Y_AXIS]);
-        printf("delta[Z_AXIS]: %f\n", delta[Z_AXIS]);
-        plan_set_position(delta[X_AXIS], 
-                          delta[Y_AXIS], 
-                          delta[Z_AXIS], 
-                          current_position[E_AXIS]);
-
-        /* Set the current position for PRU */
-        stepper_set_position(lround(delta[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]),
-                             lround(delta[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]),
-                             lround(delta[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]),
-                             lround(current_position[E_AXIS] * pa.axis_steps_per_unit[E_AXIS]));
+        kinematics->set_position(current_position);
     } else {
         /* xyz & corexy */
         if (has_code(line, axis_codes[X_AXIS])) {
@@ -1377,12 +1221,7 @@ static void run_z_probe(void)
 	  printf("lkj start_step:%ld, stop_steps:%ld \n", start_steps, stop_steps); 
  	  printf("lkj current_z :%fmm, new_current_z:%fmm \n",start_z, mm);
       current_position[Z_AXIS] = mm;
-      calculate_delta(current_position);
-      plan_set_position(delta[X_AXIS], delta[Y_AXIS], delta[Z_AXIS], current_position[E_AXIS]);
-	  stepper_set_position(lround(delta[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]),
-			  lround(delta[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]),
-			  lround(delta[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]),
-			  lround(current_position[E_AXIS] * pa.axis_steps_per_unit[E_AXIS]));
+      kinematics->set_position(current_position);
 	} else {
         feedrate = pa.autolevel_down_rate;
 
@@ -1542,6 +1381,7 @@ static void single_z_probe(void)
     	engage_z_probe(); 
     
     stepper_sync();
+    set_feed_live(100);
 
     feedrate = pa.autolevel_down_rate;
 
@@ -1553,6 +1393,7 @@ static void single_z_probe(void)
 
     feedrate = old_feedrate;
     feedmultiply = old_feedmultiply;
+    set_feed_live(feedmultiply);
 }
 
 
@@ -1597,6 +1438,16 @@ static void set_delta_constants()
   delta_diagonal_rod_2_tower1 = pow(pa.diagonal_rod + pa.diagonal_rod_adj[0], 2);
   delta_diagonal_rod_2_tower2 = pow(pa.diagonal_rod + pa.diagonal_rod_adj[1], 2);
   delta_diagonal_rod_2_tower3 = pow(pa.diagonal_rod + pa.diagonal_rod_adj[2], 2);
+
+  delta_geo.tower_x[0] = delta_tower1_x;
+  delta_geo.tower_y[0] = delta_tower1_y;
+  delta_geo.tower_x[1] = delta_tower2_x;
+  delta_geo.tower_y[1] = delta_tower2_y;
+  delta_geo.tower_x[2] = delta_tower3_x;
+  delta_geo.tower_y[2] = delta_tower3_y;
+  delta_geo.rod_2[0] = delta_diagonal_rod_2_tower1;
+  delta_geo.rod_2[1] = delta_diagonal_rod_2_tower2;
+  delta_geo.rod_2[2] = delta_diagonal_rod_2_tower3;
 #if 0
   delta_tower1_x = (pa.radius + pa.tower_adj[3]) * cos((210 + pa.tower_adj[0]) * M_PI/180); // front left tower
   delta_tower1_y = (pa.radius + pa.tower_adj[3]) * sin((210 + pa.tower_adj[0]) * M_PI/180); 
@@ -1607,6 +1458,17 @@ static void set_delta_constants()
 #endif
 }
 
+/*
+ * The settings changed under the machine, pick the kinematics of
+ * pa.machine_type again, with its tower geometry and planner transform
+ */
+static void reload_kinematics(void)
+{
+    kinematics_init();
+    set_delta_constants();
+    plan_update_transform();
+}
+
 
 #ifdef AUTO_LEVELING_GRID
 static void set_bed_level_equation_lsq(double *plane_equation_coefficients)
@@ -1619,6 +1481,7 @@ static void set_bed_level_equation_lsq(double *plane_equation_coefficients)
     plane_normal.z = 1;
 
     plan_bed_level_matrix = matrix_create_look_at(plane_normal);
+    plan_update_transform();
     /* if (!plan_bed_level_matrix) {
         printf("[gcode]: matrix create look at err\n");
     } */
@@ -1671,6 +1534,7 @@ static void set_bed_level_equation_3pts(float z_at_pt_1, float z_at_pt_2, float
     plane_normal.z = abs(plane_normal.z);
     
     plan_bed_level_matrix = matrix_create_look_at(plane_normal);
+    plan_update_transform();
      
 	vector_t corrected_position;
     plan_get_position(&corrected_position, plan_bed_level_matrix);
@@ -1844,35 +1708,62 @@ static void reset_bed_level()  //for delta
       bed_level[x][y] = 0.0;
     }
   }
+  mesh_clear();
 }
 
-// Adjust print surface height by linear interpolation over the bed_level array.
-static void adjust_delta(float cartesian[3])
+/*
+ * Where the bed is probed when the saved leveling is loaded,
+ * PROBE_REF_MARGIN inside the probe offset from the endstops.
+ * The loaded mesh is zero there.
+ */
+#define PROBE_REF_MARGIN    (1.0)
+
+static void probe_reference_point(float *x, float *y)
 {
-  int half = (pa.probeGridPoints- 1) / 2;
-  float x_num = (pa.probeRightPos - pa.probeLeftPos) / (pa.probeGridPoints- 1);
-  float y_num = (pa.probeBackPos - pa.probeFrontPos) / (pa.probeGridPoints- 1);
-  float grid_x = max(0.001-half, min(half-0.001, cartesian[X_AXIS] / x_num));
-  float grid_y = max(0.001-half, min(half-0.001, cartesian[Y_AXIS] / y_num));
-  int floor_x = floor(grid_x);
-  int floor_y = floor(grid_y);
-  float ratio_x = grid_x - floor_x;
-  float ratio_y = grid_y - floor_y;
-  float z1 = bed_level[floor_x+half][floor_y+half];
-  float z2 = bed_level[floor_x+half][floor_y+half+1];
-  float z3 = bed_level[floor_x+half+1][floor_y+half];
-  float z4 = bed_level[floor_x+half+1][floor_y+half+1];
-  float left = (1-ratio_y)*z1 + ratio_y*z2;
-  float right = (1-ratio_y)*z3 + ratio_y*z4;
-  float offset = (1-ratio_x)*left + ratio_x*right;
-
-  //printf("grid_x:%f, grid_y:%f, half-0.01:%f\n", grid_x, grid_y, half-0.01);
-  //printf("z1:%f, z2:%f, z3:%f,z4:%f\n", z1, z2, z3, z4);
-  //printf("cartesian x:%f, y:%f, z:%f\n", cartesian[X_AXIS], cartesian[Y_AXIS], cartesian[Z_AXIS]);
-  //printf("delta  x:%f, y:%f, z:%f, offset:%f\n", delta[X_AXIS], delta[Y_AXIS],delta[Z_AXIS], offset);
-  delta[X_AXIS] += offset;
-  delta[Y_AXIS] += offset;
-  delta[Z_AXIS] += offset;
+    *x = fabs(pa.endstopOffset[X_AXIS]) + PROBE_REF_MARGIN;
+    *y = fabs(pa.endstopOffset[Y_AXIS]) + PROBE_REF_MARGIN;
+}
+
+/*
+ * Build the xyz/corexy bed mesh from bed_level,
+ * with zero offset at the probe position x, y.
+ */
+static int build_bed_mesh(float x, float y)
+{
+    int i, j;
+    float z0;
+
+    if (mesh_build(bed_level, pa.probeGridPoints,
+                   pa.probeLeftPos, pa.probeRightPos,
+                   pa.probeFrontPos, pa.probeBackPos) < 0) {
+        return -1;
+    }
+
+    z0 = mesh_z_offset(x, y);
+    for (j = 0; j < pa.probeGridPoints; j++) {
+        for (i = 0; i < pa.probeGridPoints; i++) {
+            bed_level[i][j] -= z0;
+        }
+    }
+
+    return mesh_build(bed_level, pa.probeGridPoints,
+                      pa.probeLeftPos, pa.probeRightPos,
+                      pa.probeFrontPos, pa.probeBackPos);
+}
+
+/*
+ * Planner position for the nozzle at current_position,
+ * the mesh z offset is added when mesh leveling.
+ */
+static void set_leveling_position(void)
+{
+    float motor[3];
+
+    kinematics->inverse(current_position, motor);
+    plan_set_position_no_delta_autolevel(motor[X_AXIS],
+                                         motor[Y_AXIS],
+                                         motor[Z_AXIS],
+                                         current_position[E_AXIS]);
 }
 
 static void auto_bed_leveling(bool mult_point)
@@ -1897,6 +1788,7 @@ static void auto_bed_leveling(bool mult_point)
     
     /* Make sure the bed level rotation matrix is identity */
     matrix_set_to_identity(&plan_bed_level_matrix);
+    plan_update_transform();
 	reset_bed_level();
 
 	if (pa.machine_type != MACHINE_DELTA) {
@@ -2051,6 +1943,7 @@ debug_matrix(&plan_bed_level_matrix);
   	float y_num = (pa.probeBackPos - pa.probeFrontPos) / (pa.probeGridPoints- 1);
     int probePointCounter = 0;
     int yCount = 0, xCount = 0; 
+    float last_x = 0.0, last_y = 0.0;
 	for (yCount=0; yCount < pa.probeGridPoints; yCount++) {
 		float yProbe = pa.probeFrontPos + y_num * yCount;
 		int xStart, xStop, xInc;
@@ -2094,15 +1987,26 @@ debug_matrix(&plan_bed_level_matrix);
 			eqn_a_matrix[probePointCounter+ 0 * pa.probeGridPoints * pa.probeGridPoints] = xProbe;
 			eqn_a_matrix[probePointCounter+ 1 * pa.probeGridPoints * pa.probeGridPoints] = yProbe;
 			eqn_a_matrix[probePointCounter+ 2 * pa.probeGridPoints * pa.probeGridPoints] = 1;
+			bed_level[xCount][yCount] = measured_z;
+			last_x = xProbe;
+			last_y = yProbe;
 			probePointCounter++;
 		}
 	}
 
-	/* Solve lsq problem */
-	double *plane_equation_coefficients = qr_solve(pa.probeGridPoints * pa.probeGridPoints, 3, 	eqn_a_matrix, eqn_b_matrix); 
-	set_bed_level_equation_lsq(plane_equation_coefficients);
+	if (pa.autoLeveling == AUTO_LEVELING_MODE_MESH) {
+		/* Mesh offsets relative to the last probed point, matrix stays identity */
+		if (build_bed_mesh(last_x, last_y) < 0) {
+			reset_bed_level();
+		}
+		print_bed_level(bed_level);
+	} else {
+		/* Solve lsq problem */
+		double *plane_equation_coefficients = qr_solve(pa.probeGridPoints * pa.probeGridPoints, 3, 	eqn_a_matrix, eqn_b_matrix); 
+		set_bed_level_equation_lsq(plane_equation_coefficients);
 
-	free(plane_equation_coefficients);
+		free(plane_equation_coefficients);
+	}
 #else
     /* "3-point" mode Auto bed leveling : probe 3 arbitrary points */
     /* probe point 1 */
@@ -2151,10 +2055,7 @@ debug_matrix(&plan_bed_level_matrix);
 		/* The difference is added to current position and send to planner */
 		current_position[Z_AXIS] = z - real_z + fabs(pa.endstopOffset[Z_AXIS]);
 printf("lkj G29 new x:%f, y:%f, z:%f\n", current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS]);
-		plan_set_position_no_delta_autolevel(current_position[X_AXIS],
-				current_position[Y_AXIS],
-				current_position[Z_AXIS],
-				current_position[E_AXIS]);
+		set_leveling_position();
 		debug_matrix(&plan_bed_level_matrix);
 	}
 
@@ -2308,7 +2209,7 @@ printf("lkj G29 new x:%f, y:%f, z:%f\n", current_position[X_AXIS], current_posit
  * M600 - Printing pause
  * M601 - Printing resume
  *
- * M665 - Set delta configurations
+ * M665 - Set delta configurations, T<um> max segment error
  * M666 - Set delta endstop adjustment
  *
  * M906 - Set motor current (mA) 
@@ -2400,6 +2301,7 @@ static int gcode_process_g(char *line, int value, bool send_ok)
 #endif
         case 28:
             /* G28: Home all axis one at a time */
+            feed_live_off();
     #if 0
             homing_axis(line);
     #else 
@@ -2423,7 +2325,8 @@ static int gcode_process_g(char *line, int value, bool send_ok)
 						struct stat st;
 						if (stat(AUTO_LEVEL_BIN, &st) != 0) {
 							auto_bed_leveling(true);
-							if (pa.machine_type == MACHINE_DELTA) {
+							if (pa.machine_type == MACHINE_DELTA
+									|| pa.autoLeveling == AUTO_LEVELING_MODE_MESH) {
 								save_autolevel((float *)bed_level, sizeof(bed_level));
 							} else {
 								save_autolevel((float *)plan_bed_level_matrix.matrix, sizeof(plan_bed_level_matrix.matrix));
@@ -2433,24 +2336,33 @@ static int gcode_process_g(char *line, int value, bool send_ok)
 								load_autolevel((float *)bed_level, sizeof(bed_level));
 							} else {
 								matrix_set_to_identity(&plan_bed_level_matrix);
+								plan_update_transform();
 								if (pa.probeDeviceType == PROBE_DEVICE_PROXIMIRY)
 									dock_sled(false, 0);
 								stepper_sync();
 
+								float ref_x, ref_y;
+
+								probe_reference_point(&ref_x, &ref_y);
 								//float measured_z1 = probe_bed_height(140, 180 
 								//							, current_position[Z_AXIS] + pa.zRaiseBeforeProbing);
-								float measured_z1 =	probe_bed_height(fabs(pa.endstopOffset[X_AXIS]) + 1, 
-												fabs(pa.endstopOffset[Y_AXIS]) + 1, current_position[Z_AXIS] + pa.zRaiseBeforeProbing);
-								float measured_z2 =	probe_bed_height(fabs(pa.endstopOffset[X_AXIS]) + 1, 
-												fabs(pa.endstopOffset[Y_AXIS]) + 1, current_position[Z_AXIS] + pa.zRaiseBeforeProbing);
-								float measured_z3 =	probe_bed_height(fabs(pa.endstopOffset[X_AXIS]) + 1, 
-												fabs(pa.endstopOffset[Y_AXIS]) + 1, current_position[Z_AXIS] + pa.zRaiseBeforeProbing);
+								float measured_z1 =	probe_bed_height(ref_x, ref_y, current_position[Z_AXIS] + pa.zRaiseBeforeProbing);
+								float measured_z2 =	probe_bed_height(ref_x, ref_y, current_position[Z_AXIS] + pa.zRaiseBeforeProbing);
+								float measured_z3 =	probe_bed_height(ref_x, ref_y, current_position[Z_AXIS] + pa.zRaiseBeforeProbing);
 								float measured_z = (measured_z1 + measured_z2 + measured_z3) /3.0;
     							current_position[Z_AXIS] = measured_z;
 
 								printf("lkj 0 new x:%f, y:%f, z:%f\n", current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS]);
-								load_autolevel((float *)plan_bed_level_matrix.matrix, 
-										sizeof(plan_bed_level_matrix.matrix));
+								if (pa.autoLeveling == AUTO_LEVELING_MODE_MESH) {
+									load_autolevel((float *)bed_level, sizeof(bed_level));
+									if (build_bed_mesh(ref_x, ref_y) < 0) {
+										reset_bed_level();
+									}
+								} else {
+									load_autolevel((float *)plan_bed_level_matrix.matrix, 
+											sizeof(plan_bed_level_matrix.matrix));
+								}
+								plan_update_transform();
 								plan_set_position_no_delta_autolevel(current_position[X_AXIS],
 										current_position[Y_AXIS],
 										current_position[Z_AXIS],
@@ -2463,10 +2375,7 @@ static int gcode_process_g(char *line, int value, bool send_ok)
 								apply_rotation_xyz(plan_bed_level_matrix, &x, &y, &z);  
 								current_position[Z_AXIS] = z - real_z + fabs(pa.endstopOffset[Z_AXIS]);
 								printf("lkj new x:%f, y:%f, z:%f\n", current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS]);
-								plan_set_position_no_delta_autolevel(current_position[X_AXIS],
-										current_position[Y_AXIS],
-										current_position[Z_AXIS],
-										current_position[E_AXIS]);
+								set_leveling_position();
 
 								if (pa.probeDeviceType == PROBE_DEVICE_PROXIMIRY)
 									dock_sled(true, 0);
@@ -2521,23 +2430,7 @@ static int gcode_process_g(char *line, int value, bool send_ok)
 						plan_set_e_position(current_position[E_AXIS]);
 					} else if (i == X_AXIS || i == Y_AXIS || i == Z_AXIS) {
                     	current_position[i] = get_float(line, axis_codes[i]);
-						if (pa.machine_type == MACHINE_DELTA) {
-							calculate_delta(current_position);
-							plan_set_position(delta[X_AXIS],
-									delta[Y_AXIS],
-									delta[Z_AXIS],
-									current_position[E_AXIS]);
-
-							stepper_set_position(lround(delta[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]),
-									lround(delta[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]),
-									lround(delta[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]),
-									lround(current_position[E_AXIS] * pa.axis_steps_per_unit[E_AXIS]));
-						} else {
-							plan_set_position(current_position[X_AXIS], 
-									current_position[Y_AXIS],
-									current_position[Z_AXIS],
-									current_position[E_AXIS]);
-						}
+						kinematics->set_position(current_position);
 					}
                 }
             }
@@ -2554,6 +2447,59 @@ static int gcode_process_g(char *line, int value, bool send_ok)
     return SEND_REPLY;
 }
 
+/*
+ * Fan of P as M106 picks it, NULL if the board has none
+ */
+static channel_tag gcode_fan_lookup(char *line)
+{
+    if (has_code(line, 'P') && get_uint(line, 'P') != 1) {
+        return fan_lookup_by_name("fan_ext2");
+    }
+    if (bbp_board_type == BOARD_BBP1) {
+        return NULL;
+    }
+    return fan_lookup_by_name("fan_ext");
+}
+
+/*
+ * M106/M107 with V and M3/M4/M5: the PRU writes the fan pwm
+ * at its place between the moves, M4 follows the step rate.
+ * Return -1 if the pwm of the fan can not be queued.
+ */
+static int gcode_queue_fan(char *line, int value)
+{
+    channel_tag fan = gcode_fan_lookup(line);
+    unsigned int level = 0;
+    int out;
+
+    if (!fan || stepper_is_stop()) {
+        return -1;
+    }
+    out = stepper_pwm_out(fan_get_pwm(fan));
+    if (out < 0) {
+        return -1;
+    }
+
+    if (value == 106 || value == 3 || value == 4) {
+        level = DEFAULT_FAN_LEVEL;
+        if (has_code(line, 'S')) {
+            level = get_uint(line, 'S');
+            if (level > 255) {
+                level = level / 255;
+            }
+            level = constrain(level, 0, 255);
+            level = level * 100 / 255;
+            if (value == 106 && level >= 100) {
+                level = 99;
+            }
+        }
+    }
+
+    fan_set_queued_level(fan, level);
+    plan_queue_pwm(out, level, value == 4);
+    return 0;
+}
+
 static unsigned int mcode_index = 0;
 static char mountPath[1024] = {0};
 static int gcode_process_m(char *line, int value, bool send_ok)
@@ -2573,7 +2519,7 @@ static int gcode_process_m(char *line, int value, bool send_ok)
     int temp_bed_reached = 0;
     char buf[150] = {0};
 	int buf_pos = 0;
-	float pos_x, pos_y, pos_z, pos_e;
+	float motor[3], pos[3], pos_e;
 
     channel_tag heater, fan;//,fan2;
 #ifdef SERVO
@@ -2721,18 +2667,7 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 				current_position[Y_AXIS] = destination[Y_AXIS];
 				current_position[Z_AXIS] = destination[Z_AXIS];
 
-				calculate_delta(current_position);
-
-				plan_set_position(delta[X_AXIS], 
-								  delta[Y_AXIS], 
-								  delta[Z_AXIS], 
-								  current_position[E_AXIS]);
-
-				/* Set the current position for PRU */
-				stepper_set_position(lround(delta[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]),
-									 lround(delta[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]),
-									 lround(delta[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]),
-									 lround(current_position[E_AXIS] * pa.axis_steps_per_unit[E_AXIS]));
+				kinematics->set_position(current_position);
 			}
 			GCODE_DBG("M80 Done...\n");
             break;
@@ -2761,6 +2696,8 @@ static int gcode_process_m(char *line, int value, bool send_ok)
             }
 
     		matrix_set_to_identity(&plan_bed_level_matrix);
+    		plan_update_transform();
+    		mesh_clear();
 
     		destroy_MCode_list();
            	GCODE_DBG("M84 Done...\n");
@@ -2797,6 +2734,7 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 			}
 
 			axis_steps_per_sqr_second[E_AXIS] = min_E_axis_steps_per_sqr_second;
+            plan_update_transform();
             break;
         case 93:
             /* M93: Send current axis_steps_per_unit to host */
@@ -2939,6 +2877,24 @@ static int gcode_process_m(char *line, int value, bool send_ok)
                 }
             }
             break;
+        case 3:
+        case 4:
+        case 5:
+            /* 
+             * M3/M4 S<power> P<fan>: laser on a fan output, M4 scaled with the speed
+             * M5: laser off
+             */
+            if (gcode_queue_fan(line, value) < 0) {
+                fan = gcode_fan_lookup(line);
+                if (fan && value == 5) {
+                    fan_disable(fan);
+                } else if (fan) {
+                    level = has_code(line, 'S') ? constrain(get_uint(line, 'S'), 0, 255) * 100 / 255 : 100;
+                    fan_enable(fan);
+                    fan_set_level(fan, level);
+                }
+            }
+            break;
         case 107:
             /* M107: Fan 1,2 off */
 			if (has_code(line, 'P')) {
@@ -3019,13 +2975,18 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 
         case 114:
             /* M114: Display current position */
-            pos_x = stepper_get_position_mm(X_AXIS);
-            pos_y = stepper_get_position_mm(Y_AXIS);
-            pos_z = stepper_get_position_mm(Z_AXIS);
+            motor[X_AXIS] = stepper_get_position_mm(X_AXIS);
+            motor[Y_AXIS] = stepper_get_position_mm(Y_AXIS);
+            motor[Z_AXIS] = stepper_get_position_mm(Z_AXIS);
             pos_e = stepper_get_position_mm(E_AXIS);
 
+            /* the PRU counts motor steps, towers for delta */
+            if (kinematics->forward(motor, pos) < 0) {
+                memcpy(pos, motor, sizeof(pos));
+            }
+
 			STEPPER_DBG("X:%f Y:%f Z:%f E:%f ", 
-                         pos_x, pos_y, pos_z, pos_e);
+                         pos[X_AXIS], pos[Y_AXIS], pos[Z_AXIS], pos_e);
 
             if (unicorn_get_mode() == FW_MODE_REMOTE) {
                 memset(buf, 0, sizeof(buf));
@@ -3461,9 +3422,16 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 						pid.I_limit = get_float(line, 'W');
 						//TODO
 					}
+					/* thermal model of M306, H0 turns it off */
+					if (has_code(line,'H')) { 
+						pid.heat_gain = get_float(line, 'H');
+					}
+					if (has_code(line,'L')) { 
+						pid.lag = get_float(line, 'L');
+					}
 					//lkj
-					printf("pid.P:%f, pid.I:%f, pid.D:%f, pid.I_limit:%f, pid.FF_factor:%f, pid.FF_offset:%f \n",
-							pid.P, pid.I, pid.D, pid.I_limit, pid.FF_factor, pid.FF_offset);
+					printf("pid.P:%f, pid.I:%f, pid.D:%f, pid.I_limit:%f, pid.FF_factor:%f, pid.FF_offset:%f, heat_gain:%f, lag:%f\n",
+							pid.P, pid.I, pid.D, pid.I_limit, pid.FF_factor, pid.FF_offset, pid.heat_gain, pid.lag);
 					heater_set_pid_values(heater, &pid);
 				}
 			}
@@ -3523,6 +3491,20 @@ static int gcode_process_m(char *line, int value, bool send_ok)
             }
             break;
 
+        case 306:
+            /* M306: Thermal model calibration E<n> (E-1 bed) S<temperature>, from ambient */
+			{
+				float temp = 200.0;
+				int e = 0;
+				if (has_code(line,'E')) e = get_int(line, 'E');
+				if (e < 0)
+					temp = 80;
+				if (has_code(line,'S')) temp = get_float(line, 'S');
+        		gcode_send_response_remote("ok\n");
+				heater_model_calibrate(temp, e, gcode_send_response_remote);
+			}
+			return 1;
+
         case 350:
             break;
 
@@ -3574,6 +3556,7 @@ static int gcode_process_m(char *line, int value, bool send_ok)
              *       If you need to reset them after you changed them temporarily.
              */
             parameter_load_from_eeprom();
+            reload_kinematics();
             break;
         case 502:
             /*
@@ -3581,6 +3564,7 @@ static int gcode_process_m(char *line, int value, bool send_ok)
              *       You still need to store them in EEPROM afterwards if you want to.
              */
             parameter_restore_default();
+            reload_kinematics();
             break;
 		case 503:
 			/* M503: show settings */
@@ -3591,8 +3575,10 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 					unlink(AUTO_LEVEL_BIN);
 					reset_bed_level();
 					matrix_set_to_identity(&plan_bed_level_matrix);
+					plan_update_transform();
 				} else if (a_val == 1) { //print parameters 
-					if (pa.machine_type == MACHINE_DELTA) {
+					if (pa.machine_type == MACHINE_DELTA
+							|| pa.autoLeveling == AUTO_LEVELING_MODE_MESH) {
 						float tmp_bed_level[100][100];
 						memset(tmp_bed_level, 0, sizeof(tmp_bed_level));
 						load_autolevel((float *)tmp_bed_level, sizeof(tmp_bed_level));
@@ -3845,6 +3831,9 @@ static int gcode_process_m(char *line, int value, bool send_ok)
             if (has_code(line,'S')) {
                 pa.segments_per_second = get_float(line, 'S');
             }
+            if (has_code(line,'T')) {
+                pa.delta_segment_error = get_float(line, 'T');
+            }
             if (has_code(line,'Z')) {
                 pa.z_home_pos = get_float(line, 'Z');
             }
@@ -4211,18 +4200,7 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 				current_position[Y_AXIS] = destination[Y_AXIS];
 				current_position[Z_AXIS] = destination[Z_AXIS];
 
-				calculate_delta(current_position);
-
-				plan_set_position(delta[X_AXIS], 
-								  delta[Y_AXIS], 
-								  delta[Z_AXIS], 
-								  current_position[E_AXIS]);
-
-				/* Set the current position for PRU */
-				stepper_set_position(lround(delta[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]),
-									 lround(delta[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]),
-									 lround(delta[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]),
-									 lround(current_position[E_AXIS] * pa.axis_steps_per_unit[E_AXIS]));
+				kinematics->set_position(current_position);
 			}
 
 			GCODE_DBG("M910 finish sending parameter \n");
@@ -4260,6 +4238,9 @@ static int gcode_process_m(char *line, int value, bool send_ok)
             if (has_code(line,'A')) {
                 pa.autoLeveling = get_int(line, 'A');
             }
+            if (has_code(line,'S') || has_code(line,'A')) {
+                reload_kinematics();
+            }
             if (has_code(line,'L')) {
                 pa.probeDeviceType = get_int(line, 'L');
             }
@@ -4322,7 +4303,9 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 			} else if (pa.autoLeveling && pa.probeDeviceType == PROBE_DEVICE_PROXIMIRY) {
 				stepper_autoLevel_gpio_turn(false);
 			}
-            
+
+            /* machine type or auto leveling may have changed */
+            plan_update_transform();
             break;
 
         case 914:
@@ -4435,6 +4418,77 @@ static int gcode_process_m(char *line, int value, bool send_ok)
 			}
 
 			break;
+
+        case 930:
+            /* M930: Motion latency histograms, S0 resets them */
+            if (has_code(line, 'S') && get_int(line, 'S') == 0) {
+                latency_reset();
+                break;
+            }
+            {
+                char lat[1024] = {0};
+
+                latency_dump(lat, sizeof(lat), false);
+                printf("%s", lat);
+                if (unicorn_get_mode() == FW_MODE_REMOTE) {
+                    if (send_ok) {
+                        gcode_send_response_remote("ok\n");
+                    }
+                    gcode_send_response_remote(lat);
+                }
+            }
+            return SEND_REPLY;
+
+        case 931:
+            /* M931: PRU performance counters */
+            {
+                char stats[256] = {0};
+
+                pruss_stats_dump(stats, sizeof(stats));
+                printf("%s", stats);
+                if (unicorn_get_mode() == FW_MODE_REMOTE) {
+                    if (send_ok) {
+                        gcode_send_response_remote("ok\n");
+                    }
+                    gcode_send_response_remote(stats);
+                }
+            }
+            return SEND_REPLY;
+
+        case 932:
+            /* M932: Heater PID step timing, S0 resets it, T<n> or B with R<hz> sets a rate */
+            if (has_code(line, 'S') && get_int(line, 'S') == 0) {
+                heater_jitter_reset();
+                break;
+            }
+            if (has_code(line, 'R')) {
+                if (has_code(line, 'B')) {
+                    heater = heater_lookup_by_name("heater_bed");
+                } else if (has_code(line, 'T')) {
+                    idx = get_int(line, 'T');
+                    heater = (idx >= 0 && idx < pa.ext_count) ? heater_lookup_by_index(idx) : NULL;
+                } else {
+                    heater = heater_lookup_by_index(0);
+                }
+                if (!heater || heater_set_rate(heater, get_int(line, 'R')) < 0) {
+                    printf("[gcode]: M932 rate 1..%d Hz of a heater\n", HEATER_RATE_MAX);
+                }
+                break;
+            }
+            {
+                char jitter[512] = {0};
+
+                heater_jitter_dump(jitter, sizeof(jitter));
+                printf("%s", jitter);
+                if (unicorn_get_mode() == FW_MODE_REMOTE) {
+                    if (send_ok) {
+                        gcode_send_response_remote("ok\n");
+                    }
+                    gcode_send_response_remote(jitter);
+                }
+            }
+            return SEND_REPLY;
+
 			case 1009: //M1009
 			{
 				int gpio = -1;
@@ -4520,13 +4574,7 @@ static int gcode_process_t(char *line, int t, bool send_ok)
 			active_extruder = tmp_extruder;
 			#endif 
 
-			if (pa.machine_type == MACHINE_DELTA) {
-				calculate_delta(current_position); // change cartesian kinematic  to  delta kinematic;
-				//sent position to plan_set_position();
-				plan_set_position(delta[X_AXIS], delta[Y_AXIS], delta[Z_AXIS],current_position[E_AXIS]);
-			} else {
-				plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
-			}
+			kinematics->set_position(current_position);
 			// Move to the old position if 'F' was in the parameters
 			if(make_move) {
 				prepare_move();
@@ -4603,7 +4651,7 @@ int gcode_process_line(char *buf_line, bool send_ok)
 				if (has_code(buf_line, 'V')) {
 					gcode_send_response_remote("ok\n");
 					remove_str(buf_line, "V99999.0");
-					append_list(buf_line, ++mcode_index);
+					append_list(buf_line, val, ++mcode_index);
 					put_mcode_to_fifo();
 					break;
 				}
@@ -4619,7 +4667,19 @@ int gcode_process_line(char *buf_line, bool send_ok)
             if (has_code(buf_line, 'V') && !stepper_is_stop()) {
                 gcode_send_response_remote("ok\n");
                 remove_str(buf_line, "V99999.0");
-                append_list(buf_line, ++mcode_index);
+                /* fans the PRU writes itself */
+                if ((val == 106 || val == 107) && gcode_queue_fan(buf_line, val) == 0) {
+                    break;
+                }
+                /* full until the PRU reached the oldest pending M code */
+                while (append_list(buf_line, val, mcode_index + 1) < 0) {
+                    if (stop) {
+                        /* no ring entry, no marker for it either */
+                        return 0;
+                    }
+                    usleep(10000);
+                }
+                ++mcode_index;
 				put_mcode_to_fifo();
                 break;
             } else if (has_code(buf_line, 'V') && stepper_is_stop()) {
@@ -4668,6 +4728,14 @@ void gcode_set_feed(int multiply)
         feedmultiply = 2000;
 		COMM_DBG("max multiply %d\n", feedmultiply);
     }
+
+    /*
+     * The PRU slows the moves already queued, it applies at most
+     * RATE_LIVE_MAX. A faster print is planned, so the acceleration
+     * limits hold.
+     * feedmultiply stays what M220 set.
+     */
+    set_feed_live(feedmultiply);
 }
 
 void gcode_set_extruder_feed(int multiply)
@@ -4725,28 +4793,39 @@ extern int write_fd;
 extern int read_emerg_fd;
 extern Pause_Handle hPause_printing;
 
-extern struct queue *pru_queue;
 static void *mcode_thread_worker(void *arg)
 {
     struct M_list *item;
 
+    FTRACE_THREAD("mcode");
     printf("start mcode thread\n");
     while (!stop) {
-        //prussdrv_pru_wait_event(PRU_EVTOUT_1);
-        //prussdrv_pru_clear_event(PRU_EVTOUT_1, PRU1_ARM_INTERRUPT);
-        item = get_list_item();
-        if (item) {
-            if ((item->no <= pru_queue->mcode_count) && (item->no != 0)){
-				char buf[1024] = {0};
-        		COMM_DBG("exec mcode:%s, number:%d pru_code:%d \n", item->MCode, item->no, pru_queue->mcode_count);
+        /* run every M code the PRU has passed */
+        while ((item = get_list_item()) != NULL) {
+            uint32_t mcode_count = stepper_get_mcode_count();
+            if ((item->no <= mcode_count) && (item->no != 0)){
+				char buf[MCodeArrayMaxSize];
+                int code = item->code;
+        		COMM_DBG("exec mcode:%s, number:%d pru_code:%d \n", item->MCode, item->no, mcode_count);
 				strcpy(buf, item->MCode);
                 del_list_item(item);
-                gcode_process_line(buf, false);
+                FTRACE_BEGIN("mcode");
+                if (gcode_process_m(buf, code, false) == NO_REPLY) {
+                    printf("gcode_process_m [M%d] NO_REPLY\n", code);
+                }
+                FTRACE_END();
+            } else {
+                break;
             }
         } 
 
-       	usleep(100000);
-        //usleep(1);
+        /* woken by the PRU at M code markers */
+        FTRACE_BEGIN("pru_mcode_wait");
+        if (stepper_wait_event(100) < 0) {
+            /* the queue is being stopped, no events until the next start */
+            usleep(100 * 1000);
+        }
+        FTRACE_END();
     }
     printf("exit mcode thread\n");
 	return NULL;
@@ -4762,6 +4841,8 @@ static void *gcode_thread_worker(void *arg)
     struct timeval timeout;
 	fd_set fds;
 
+    FTRACE_THREAD("gcode");
+
     if (hPause_printing) {
         Pause_test(hPause_printing);
     }
@@ -4772,6 +4853,7 @@ static void *gcode_thread_worker(void *arg)
         if (unicorn_get_mode() == FW_MODE_REMOTE) {
 
 			memset(&parser.buffer, 0, sizeof(parser.buffer));
+			FTRACE_BEGIN("socket_read");
 
 			int rc;
 			int max_fd;
@@ -4808,6 +4890,7 @@ static void *gcode_thread_worker(void *arg)
 						} else {
 							ret = read(parser.fd_rd, &parser.buffer, BUFFER_SIZE);
 						}
+						latency_line_read();
 						GCODE_DBG("[gcode]: ret=%d, read buf:%s\n", ret, (char *)parser.buffer);
 						if (ret == BUFFER_SIZE) { //
                         	if (parser.buffer[BUFFER_SIZE - 1] == '\n') {
@@ -4849,8 +4932,12 @@ static void *gcode_thread_worker(void *arg)
 						continue;
 					}
 			}
+			FTRACE_END();
 		}
+	    FTRACE_BEGIN("gcode_line");
 	    gcode_process_multi_line(parser.buffer);
+	    FTRACE_END();
+	    latency_line_done();
 	}
 
 	if (unicorn_get_mode() == FW_MODE_REMOTE) {
@@ -4885,6 +4972,8 @@ static void *emerg_gcode_thread_worker(void *arg)
 	fd_set fds;
 	unsigned char buf_emerg[150];
 
+    FTRACE_THREAD("gcode_emerg");
+
     if (hPause_printing) {
         Pause_test(hPause_printing);
     }
@@ -4914,7 +5003,9 @@ static void *emerg_gcode_thread_worker(void *arg)
 						printf("select err, break \n");
 						break;
 					} else if (rc >0 && FD_ISSET(parser.fd_rd_emerg, &fds)) {
+							FTRACE_BEGIN("emerg_read");
 							ret = read(parser.fd_rd_emerg, buf_emerg, sizeof(buf_emerg));
+							FTRACE_END();
 							printf("[gcode emergency]: ret=%d, read buf:%s\n", ret, (char *)buf_emerg);
 							break;
 					} else {
@@ -4928,8 +5019,11 @@ static void *emerg_gcode_thread_worker(void *arg)
 					}
 			}
 		}
-		if (strlen((const char *)buf_emerg) > 0)
+		if (strlen((const char *)buf_emerg) > 0) {
+			FTRACE_BEGIN("emerg_line");
         	gcode_process_multi_line((char *)buf_emerg);
+			FTRACE_END();
+		}
 	}
 
 	if (unicorn_get_mode() == FW_MODE_REMOTE) {
@@ -4951,8 +5045,6 @@ static void *emerg_gcode_thread_worker(void *arg)
 int gcode_start(int fd_rd, int fd_wr, int fd_rd_emerg)
 {
     int ret, i;
-    pthread_attr_t attr;
-    //struct sched_param sched;
 
     if (stop) {
         stop = false;
@@ -4976,18 +5068,7 @@ int gcode_start(int fd_rd, int fd_wr, int fd_rd_emerg)
 		current_position[Y_AXIS] = destination[Y_AXIS];
 		current_position[Z_AXIS] = destination[Z_AXIS];
 
-		calculate_delta(current_position);
-
-		plan_set_position(delta[X_AXIS], 
-				delta[Y_AXIS], 
-				delta[Z_AXIS], 
-				current_position[E_AXIS]);
-
-		/* Set the current position for PRU */
-		stepper_set_position(lround(delta[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]),
-				lround(delta[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]),
-				lround(delta[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]),
-				lround(current_position[E_AXIS] * pa.axis_steps_per_unit[E_AXIS]));
+		kinematics->set_position(current_position);
 	}
 
     counter = 0;
@@ -4999,23 +5080,8 @@ int gcode_start(int fd_rd, int fd_wr, int fd_rd_emerg)
     memset(&parser, 0, sizeof(parser_t));
 
     if (unicorn_get_mode() == FW_MODE_REMOTE) {
-        if (pthread_attr_init(&attr)) {
-            return -1;
-        }
-
-		#if 0 //for android
-        if (pthread_attr_setschedpolicy(&attr, PTHREAD_EXPLICIT_SCHED)) {
-            return -1;
-        }
-        sched.sched_priority = sched_get_priority_max(SCHED_FIFO);
-
-        if (pthread_attr_setschedparam(&attr, &sched)) {
-            return -1;
-        }
-		#endif
-
         COMM_DBG("--- Creating gcode_thread..."); 
-        ret = pthread_create(&gcode_thread, &attr, gcode_thread_worker, NULL);
+        ret = rt_thread_create(RT_GCODE, &gcode_thread, gcode_thread_worker, NULL);
         if (ret) {
             printf("create gcode thread failed with ret %d\n", ret);
             return -1;
@@ -5023,7 +5089,7 @@ int gcode_start(int fd_rd, int fd_wr, int fd_rd_emerg)
             COMM_DBG("done ---\n");
         }
         COMM_DBG("--- Creating emerg_gcode_thread..."); 
-        ret = pthread_create(&emerg_gcode_thread, &attr, emerg_gcode_thread_worker, NULL);
+        ret = rt_thread_create(RT_GCODE_EMERG, &emerg_gcode_thread, emerg_gcode_thread_worker, NULL);
         if (ret) {
             printf("create emerg gcode thread failed with ret %d\n", ret);
             return -1;
@@ -5032,7 +5098,7 @@ int gcode_start(int fd_rd, int fd_wr, int fd_rd_emerg)
         }
 
         COMM_DBG("--- Creating mcode_thread..."); 
-        ret = pthread_create(&mcode_thread, NULL, mcode_thread_worker, NULL);
+        ret = rt_thread_create(RT_MCODE, &mcode_thread, mcode_thread_worker, NULL);
         if (ret) {
             printf("create mcode thread failed with ret %d\n", ret);
             return -1;
@@ -5074,6 +5140,9 @@ void gcode_stop(void)
 int gcode_init(void)
 {
     init_MCode_list();
+
+    kinematics_set_bed_level(bed_level);
+    set_delta_constants();
     return 0;
 }
 /*
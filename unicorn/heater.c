@@ -11,7 +11,9 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <math.h>
+#include <poll.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 
 #include "common.h"
 #include "unicorn.h"
@@ -20,6 +22,17 @@
 #include "gcode.h"
 #include "heater.h"
 #include "parameter.h"
+#include "rt.h"
+
+/* Timing of the PID steps of a heater */
+typedef struct {
+    uint32_t     ticks;
+    uint32_t     overruns;      /* deadlines passed without a step */
+    uint32_t     late_max_us;   /* wake up after the deadline */
+    uint64_t     late_sum_us;
+    double       dt_min;
+    double       dt_max;
+} heater_jitter_t;
 
 typedef struct {
     channel_tag  id;
@@ -32,6 +45,14 @@ typedef struct {
     //lkj double       celsius_history[8];
     unsigned int history_idx;
     int          log_fd;
+    unsigned int rate_hz;           /* PID steps a second */
+    bool         rearm;             /* rate changed */
+    long long    period_ns;         /* of the armed timer */
+    struct timespec deadline;       /* last expiry of the timer */
+    struct timespec last;           /* last step, for the measured dt */
+    heater_jitter_t jitter;
+    bool         boost;             /* full power to the switch point */
+    double       boost_setpoint;
 } heater_t;
 
 static heater_t *heaters = NULL;
@@ -139,33 +160,121 @@ static void log_entry(const char* name, int fd, time_t time,
     }
 }
 
-#define PID_LOOP_FREQ 2                 /* HZ */
 #define TIMER_CLOCK   CLOCK_MONOTONIC
 #define NS_PER_SEC    (1000 * 1000 * 1000)
+#define HEATER_DT_MAX       (4)                 /* periods, dt of the PID at most */
+#define HEATER_PHASE_NS     (10 * 1000 * 1000)  /* between the heaters */
+#define HEATER_REPORT_MS    (3000)              /* temperatures to remote */
+
+static void ts_add_ns(struct timespec *ts, long long ns)
+{
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / NS_PER_SEC;
+    ts->tv_nsec = ns % NS_PER_SEC;
+}
+
+static long long ts_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+    return (long long)(a->tv_sec - b->tv_sec) * NS_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+/* A MAX6675 converts for 220ms, the AD597 inputs are slow as well */
+static bool heater_is_thermocouple(heater_t *p)
+{
+    channel_tag input = p->input;
+
+    return (pa.thermocouple_max6675_cnnection == 1 && strncmp(tag_name(p->id), "heater_ext1", 11) == 0)
+        || (pa.thermocouple_max6675_cnnection == 2 && strncmp(tag_name(p->id), "heater_ext2", 11) == 0)
+        || (pa.thermocouple_max6675_cnnection == 3 && strncmp(tag_name(p->id), "heater_ext3", 11) == 0)
+        || (pa.thermocouple_ad597_cnnection == 1 && strncmp(tag_name(p->id), "heater_ext1", 11) == 0)
+        || (pa.thermocouple_ad597_cnnection == 2 && strncmp(tag_name(p->id), "heater_ext2", 11) == 0)
+        || (!strcmp(input, "temp_ext3"))
+        || (!strcmp(input, "temp_ext4"))
+        || (!strcmp(input, "temp_ext5"))
+        || (!strcmp(input, "temp_ext6"))
+        || (pa.thermocouple_ad597_cnnection == 3 && strncmp(tag_name(p->id), "heater_ext3", 11) == 0);
+}
 
-static void ns_sleep(struct timespec *ts, unsigned int ns)
+static unsigned int heater_rate(heater_t *p)
 {
-    struct timespec tso;
+    unsigned int rate = p->rate_hz;
 
-    ts->tv_nsec += ns;
-    if (ts->tv_nsec >= NS_PER_SEC) {
-        ts->tv_nsec -= NS_PER_SEC;
-        ts->tv_sec  += 1;
+    if (heater_is_thermocouple(p) && rate > HEATER_TC_RATE_HZ) {
+        rate = HEATER_TC_RATE_HZ;
     }
+    return rate;
+}
 
-    for (;;) {
-        if (clock_nanosleep( TIMER_CLOCK, TIMER_ABSTIME, ts, &tso) == -1) {
-            if (errno == EINTR) {
-                printf( "  sleep interrupted, tso = %ld.%09ld\n", tso.tv_sec, tso.tv_nsec);
-                *ts = tso;
-            } else {
-                perror( "clock_nanoslaap failed");
-                break;
-            }
-        } else {
-            break;
-        }
+/*
+ * Periodic timer with an absolute first expiry, the kernel keeps
+ * the following deadlines on the grid, a late step does not shift them.
+ * The heaters are spread by phase_ns to not sample at once.
+ */
+static int heater_timer_arm(heater_t *p, int fd, long long phase_ns)
+{
+    struct itimerspec its;
+    long long period = NS_PER_SEC / heater_rate(p);
+
+    p->period_ns = period;
+    memset(&its, 0, sizeof(its));
+    clock_gettime(TIMER_CLOCK, &its.it_value);
+    ts_add_ns(&its.it_value, period + phase_ns);
+    its.it_interval.tv_sec  = period / NS_PER_SEC;
+    its.it_interval.tv_nsec = period % NS_PER_SEC;
+
+    p->deadline = its.it_value;
+    ts_add_ns(&p->deadline, -period);
+    p->last.tv_sec = 0;
+    p->rearm = false;
+
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        printf("[heater]: timerfd_settime %s failed, %s\n", tag_name(p->id), strerror(errno));
+        return -1;
     }
+    return 0;
+}
+
+/*
+ * Account the expiries of the timer, return the measured dt
+ * since the last step in seconds
+ */
+static double heater_timer_step(heater_t *p, uint64_t expired, struct timespec *now)
+{
+    heater_jitter_t *j = &p->jitter;
+    long long period = p->period_ns;
+    long long late;
+    double dt;
+
+    clock_gettime(TIMER_CLOCK, now);
+
+    ts_add_ns(&p->deadline, period * expired);
+    late = ts_diff_ns(now, &p->deadline) / 1000;
+    if (late < 0) {
+        late = 0;
+    }
+
+    if (p->last.tv_sec == 0) {
+        dt = (double)period / NS_PER_SEC;
+    } else {
+        dt = (double)ts_diff_ns(now, &p->last) / NS_PER_SEC;
+    }
+    p->last = *now;
+
+    j->ticks++;
+    j->overruns += expired - 1;
+    j->late_sum_us += late;
+    if (late > j->late_max_us) {
+        j->late_max_us = late;
+    }
+    if (j->ticks == 1 || dt < j->dt_min) {
+        j->dt_min = dt;
+    }
+    if (dt > j->dt_max) {
+        j->dt_max = dt;
+    }
+
+    /* A stall does not dump seconds of error into the integral */
+    return min(dt, (double)HEATER_DT_MAX * period / NS_PER_SEC);
 }
 
 static unsigned long millis()
@@ -179,6 +288,39 @@ static unsigned long millis()
 
 #define constrain(val,low,high) ((val)<(low)?(low):((val)>(high)?(high):(val)))
 
+/*
+ * Thermal model of a heater, u the duty in %:
+ *   dT/dt = heat_gain * u - loss * (T - FF_offset)
+ * and FF_factor = loss / heat_gain holds T with u = (T - FF_offset) * FF_factor.
+ */
+#define HEATER_BOOST_MIN    (10.0)      /* C below the setpoint to boost */
+
+static bool heater_model_valid(heater_t *p)
+{
+    return p->pid.heat_gain > 0.0 && p->pid.FF_factor > 0.0;
+}
+
+static int heater_max_duty(heater_t *p)
+{
+    if (strncmp(tag_name(p->id), "heater_bed", 10) == 0) {
+        return pa.max_heat_pwm_bed;
+    }
+    return pa.max_heat_pwm_hotend;
+}
+
+/*
+ * Full power until the rise left is what the sensor lag still adds
+ * at the heating rate of the model, then PID with feed-forward
+ */
+static bool heater_boost_done(heater_t *p, double celsius)
+{
+    double left = p->setpoint - celsius;
+    double rate = p->pid.heat_gain
+                  * (heater_max_duty(p) - p->pid.FF_factor * (celsius - p->pid.FF_offset));
+
+    return left <= 0.0 || rate <= 0.0 || left <= rate * p->pid.lag;
+}
+
 
 static bool auto_tune_pid = false;
 void pid_autotune(float target_temp, int extruder, int ncycles, int w, int (*gcode_send_response_remote)(char *))
@@ -457,13 +599,179 @@ void pid_autotune(float target_temp, int extruder, int ncycles, int w, int (*gco
 }
 
 
+#define MODEL_RISE_START    (0.3)       /* of the rise, the sensor lag is over */
+#define MODEL_COOL_FIT      (0.03)      /* of the rise below the peak, the fit starts */
+#define MODEL_COOL_DROP     (0.2)       /* of the rise, cooling ends */
+#define MODEL_COOL_MS       (180 * 1000)
+#define MODEL_TIMEOUT_MS    (15 * 60 * 1000)
+
+/*
+ * M306: identify the thermal model of a heater, from ambient.
+ * Full power up to target_temp gives the heat gain, the cooling after
+ * gives the loss, the overshoot after switching off gives the lag.
+ */
+int heater_model_calibrate(float target_temp, int extruder, int (*gcode_send_response_remote)(char *))
+{
+    char *all_heater_name[] = {"heater_ext", "heater_ext2", "heater_ext3", "heater_bed"};
+    char send_buf[200] = {0};
+    channel_tag heater;
+    heater_t *p;
+    pid_settings pid;
+    int idx;
+    int duty;
+    unsigned long sample_ms;
+    unsigned long t_start, t_now;
+    double celsius, last = 0.0, t_last = 0.0;
+    double ambient, rise;
+    double t1 = 0.0, c1 = 0.0, area = 0.0;  /* heating, from MODEL_RISE_START */
+    double t2 = 0.0, c2 = 0.0;              /* switched off */
+    double peak, t_peak;
+    double c_fit = 0.0, t_fit = 0.0;        /* cooling, past the sensor lag */
+    double loss, gain, rate;
+
+    if (extruder < 0) {
+        heater = heater_lookup_by_name(all_heater_name[3]);
+    } else if (extruder < 3) {
+        heater = heater_lookup_by_name(all_heater_name[extruder]);
+    } else {
+        heater = NULL;
+    }
+    idx = heater ? heater_index_lookup(heater) : -1;
+    if (idx < 0) {
+        gcode_send_response_remote("Model calibration failed! No heater\n");
+        return -1;
+    }
+    p = &heaters[idx];
+    duty = heater_max_duty(p);
+    sample_ms = heater_is_thermocouple(p) ? 500 : 100;
+
+    heater_set_setpoint(heater, 0.0);
+    if (heater_get_celsius(heater, &ambient) < 0 || ambient <= 0.0) {
+        gcode_send_response_remote("Model calibration failed! Temperature problem\n");
+        return -1;
+    }
+    rise = target_temp - ambient;
+    if (target_temp >= (heater_is_thermocouple(p) ? pa.dangerousThermocouple : pa.dangerousThermistor)) {
+        gcode_send_response_remote("Model calibration failed! Temperature too high\n");
+        return -1;
+    }
+    if (rise < 3 * HEATER_BOOST_MIN) {
+        gcode_send_response_remote("Model calibration failed! Cool down the heater or set a higher S\n");
+        return -1;
+    }
+
+    sprintf(send_buf, "M306 %s from %.1f to %.1f, pwm %d\n", tag_name(p->id), ambient, target_temp, duty);
+    printf("%s", send_buf);
+    gcode_send_response_remote(send_buf);
+
+    /* The heater thread keeps off this pwm */
+    auto_tune_pid = true;
+    if (pwm_get_state(p->output) == PWM_STATE_OFF) {
+        pwm_enable(p->output);
+    }
+    pwm_set_output(p->output, duty);
+
+    /* Heating at full power */
+    t_start = millis();
+    for (;;) {
+        usleep(sample_ms * 1000);
+        t_now = millis();
+        if (heater_get_celsius(heater, &celsius) < 0 || celsius <= 0.0) {
+            goto failed;
+        }
+        if (t_now - t_start > MODEL_TIMEOUT_MS) {
+            goto failed;
+        }
+
+        double t = (t_now - t_start) / 1000.0;
+        if (t1 == 0.0) {
+            if (celsius >= ambient + MODEL_RISE_START * rise) {
+                t1 = t;
+                c1 = celsius;
+            }
+        } else {
+            area += ((celsius + last) / 2.0 - ambient) * (t - t_last);
+        }
+        last = celsius;
+        t_last = t;
+
+        if (celsius >= target_temp) {
+            t2 = t;
+            c2 = celsius;
+            break;
+        }
+    }
+    pwm_set_output(p->output, 0);
+
+    /* Cooling, the peak comes late by the lag of the sensor */
+    peak = c2;
+    t_peak = t2;
+    for (;;) {
+        usleep(sample_ms * 1000);
+        t_now = millis();
+        if (heater_get_celsius(heater, &celsius) < 0 || celsius <= 0.0) {
+            goto failed;
+        }
+
+        double t = (t_now - t_start) / 1000.0;
+        if (celsius > peak) {
+            peak = celsius;
+            t_peak = t;
+        }
+        if (t_fit == 0.0 && celsius <= peak - MODEL_COOL_FIT * rise) {
+            t_fit = t;
+            c_fit = celsius;
+        }
+        if (celsius <= peak - MODEL_COOL_DROP * rise || t - t_peak > MODEL_COOL_MS / 1000.0) {
+            break;
+        }
+    }
+    if (t_fit == 0.0 || celsius >= c_fit || t1 == 0.0 || t2 <= t1) {
+        goto failed;
+    }
+
+    /* Exponential decay towards ambient */
+    loss = log((c_fit - ambient) / (celsius - ambient)) / ((t_now - t_start) / 1000.0 - t_fit);
+    /* gain * duty * (t2 - t1) = (c2 - c1) + loss * integral of (T - ambient) */
+    gain = ((c2 - c1) + loss * area) / (duty * (t2 - t1));
+    if (!(loss > 0.0) || !(gain > 0.0)) {
+        goto failed;
+    }
+    rate = gain * duty - loss * (c2 - ambient);
+
+    heater_get_pid_values(heater, &pid);
+    pid.heat_gain = gain;
+    pid.FF_factor = loss / gain;
+    pid.FF_offset = ambient;
+    pid.lag = (rate > 0.0) ? (peak - c2) / rate : 0.0;
+    heater_set_pid_values(heater, &pid);
+    auto_tune_pid = false;
+
+    sprintf(send_buf, "Model calibration finished!\n"
+                      "gain %.4f C/s/%%, loss %.5f /s, lag %.1f s\n"
+                      "M301 T%d S%.4f B%.1f H%.4f L%.1f\n",
+                      gain, loss, pid.lag, extruder < 0 ? 3 : extruder,
+                      pid.FF_factor, pid.FF_offset, pid.heat_gain, pid.lag);
+    printf("%s", send_buf);
+    gcode_send_response_remote(send_buf);
+    return 0;
+
+failed:
+    pwm_set_output(p->output, 0);
+    auto_tune_pid = false;
+    printf("Model calibration failed!\n");
+    gcode_send_response_remote("Model calibration failed!\n");
+    return -1;
+}
+
 void *heater_thread_worker(void *arg)
 {
     int i;
+    int ret;
     struct timespec ts;
-    unsigned int timer_period;
-
-    int log_scaler;
+    struct pollfd pfd[nr_heaters > 0 ? nr_heaters : 1];
+    uint64_t expired;
+    unsigned long report_ms;
 
     int temp_ext_respond = 0;
     int temp_bed_respond = 0;            
@@ -472,37 +780,65 @@ void *heater_thread_worker(void *arg)
     double setpoint_ext[MAX_EXTRUDER] = {0.0};
     double setpoint_bed = 0.0;            
     char buf[150];
-	struct timeval start;
-	struct timeval end;
-	unsigned long timeuse;
+
+    for (i = 0; i < NR_ITEMS(pfd); i++) {
+        pfd[i].fd = -1;
+    }
 
     if (nr_heaters < 1) {
         goto out;
     }
     
+    FTRACE_THREAD("heater");
 	HEATER_DBG("heater_thread: started\n");
 
-    timer_period = NS_PER_SEC / (PID_LOOP_FREQ * nr_heaters);
-    clock_getres(TIMER_CLOCK, &ts);
-    clock_gettime(TIMER_CLOCK, &ts);
+    /* A timer per heater, each steps at its own rate */
+    for (i = 0; i < nr_heaters; i++) {
+        pfd[i].fd = timerfd_create(TIMER_CLOCK, TFD_NONBLOCK | TFD_CLOEXEC);
+        pfd[i].events = POLLIN;
+        if (pfd[i].fd < 0 || heater_timer_arm(&heaters[i], pfd[i].fd, i * HEATER_PHASE_NS) < 0) {
+            printf("[heater]: timer of %s failed\n", tag_name(heaters[i].id));
+            goto out;
+        }
+    }
+    report_ms = millis() + HEATER_REPORT_MS;
 
     while (!thread_quit) 
     {
+        /* The timeout only covers thread_quit */
+        ret = poll(pfd, nr_heaters, 100);
+        if (ret < 0 && errno != EINTR) {
+            printf("[heater]: poll failed, %s\n", strerror(errno));
+            break;
+        }
+
         for (i = 0; i < nr_heaters; i++) { 
             
             if (thread_quit) {
                 goto out;
             }
 
-			gettimeofday(&start, NULL);
             heater_t *p   = &heaters[i];
             channel_tag input  = p->input; 
             channel_tag output = p->output;
             double celsius;
+            double dt;
+
+            if (p->rearm) {
+                heater_timer_arm(p, pfd[i].fd, 0);
+                continue;
+            }
+
+            if (!(pfd[i].revents & POLLIN)
+                    || read(pfd[i].fd, &expired, sizeof(expired)) != sizeof(expired)) {
+                continue;
+            }
+            dt = heater_timer_step(p, expired, &ts);
 
             if ((i>=pa.ext_count) && strncmp(input, "temp_bed", 8)) { //at most 3
                 continue;
             }
+            FTRACE_BEGIN("heater_tick");
 //printf("lkj i=%d, input=%s\n", i, input);
             if (temp_get_celsius(input, &celsius) < 0) {
 				if (pwm_get_state(output) == PWM_STATE_ON && auto_tune_pid == false) {
@@ -517,6 +853,8 @@ void *heater_thread_worker(void *arg)
                 TEMP_DBG("heater_thread: failed to read temp '%s'\n", tag_name(input));
 			} else {
                 if (p->setpoint == 0.0) { 
+                    p->boost = false;
+                    p->boost_setpoint = 0.0;
                     if (pwm_get_state(output) == PWM_STATE_ON && auto_tune_pid == false) {
                         pwm_set_output(output, 0);
             			pwm_disable(output);
@@ -554,13 +892,26 @@ void *heater_thread_worker(void *arg)
                     }
 
                     double t_error = p->setpoint - celsius;
-                    const double dt = 1.0 / PID_LOOP_FREQ * nr_heaters;
+
+                    /* thermal model, a setpoint well above starts at full power */
+                    if (heater_model_valid(p) && p->setpoint != p->boost_setpoint) {
+                        p->boost_setpoint = p->setpoint;
+                        p->boost = t_error > HEATER_BOOST_MIN;
+                        if (p->boost) {
+                            HEATER_DBG("%s boost to %.1f\n", tag_name(p->id), p->setpoint);
+                        }
+                    }
+                    if (p->boost && heater_boost_done(p, celsius)) {
+                        p->boost = false;
+                        p->pid_integral = 0.0;
+                        HEATER_DBG("%s boost done at %.1f\n", tag_name(p->id), celsius);
+                    }
 
                     /* proportional part */
                     double heater_p = t_error;
 
-                    /* integral part, prevent integrator wind-up */
-                    double heater_i = clip(-p->pid.I_limit, 
+                    /* integral part, prevent integrator wind-up, none while boosting */
+                    double heater_i = p->boost ? 0.0 : clip(-p->pid.I_limit, 
                                             p->pid_integral + t_error * dt,
                                             p->pid.I_limit);
                     p->pid_integral = heater_i;
@@ -583,8 +934,12 @@ void *heater_thread_worker(void *arg)
                     double out_p = heater_p * p->pid.P;
                     double out_i = heater_i * p->pid.I;
                     double out_d = heater_d * p->pid.D;
-                    double out_ff = 0 ;	//(p->setpoint - p->pid.FF_offset) * p->pid.FF_factor;
-                    double out   = out_p + out_i - out_d + out_ff;
+                    /* feed-forward, the duty holding the setpoint, the PID trims it */
+                    double out_ff = 0.0;
+                    if (heater_model_valid(p)) {
+                        out_ff = max(0.0, (p->setpoint - p->pid.FF_offset) * p->pid.FF_factor);
+                    }
+                    double out   = p->boost ? 100.0 : out_p + out_i - out_d + out_ff;
 
                     int duty = (int) clip(0.0, out, 100.0);
                     
@@ -620,23 +975,14 @@ void *heater_thread_worker(void *arg)
                         }
                     }
 
-                    if (log_scaler == 0) {
+                    if (p->jitter.ticks % (NS_PER_SEC / p->period_ns * 3) == 0) {
                         if (DBG(D_HEATER)) {
                             log_entry(tag_name(input), p->log_fd, ts.tv_sec, p->setpoint,
                                     celsius, t_error, out_ff, out_p, out_i, out_d, duty);
                         }
                     }
 
-					if ((pa.thermocouple_max6675_cnnection == 1 && strncmp(tag_name(p->id), "heater_ext1", 11) == 0)
-						   || (pa.thermocouple_max6675_cnnection == 2 && strncmp(tag_name(p->id), "heater_ext2", 11) == 0)
-						   || (pa.thermocouple_max6675_cnnection == 3 && strncmp(tag_name(p->id), "heater_ext3", 11) == 0) 
-					       || (pa.thermocouple_ad597_cnnection == 1 && strncmp(tag_name(p->id), "heater_ext1", 11) == 0)
-						   || (pa.thermocouple_ad597_cnnection == 2 && strncmp(tag_name(p->id), "heater_ext2", 11) == 0)
-						   || (!strcmp(input, "temp_ext3"))
-						   || (!strcmp(input, "temp_ext4"))
-						   || (!strcmp(input, "temp_ext5"))
-						   || (!strcmp(input, "temp_ext6"))
-						   || (pa.thermocouple_ad597_cnnection == 3 && strncmp(tag_name(p->id), "heater_ext3", 11) == 0) ) {
+					if (heater_is_thermocouple(p)) {
 						if ( celsius >= pa.dangerousThermocouple) {
 							printf("thermocouple temp >=%d !\n", pa.dangerousThermocouple);
 							pwm_set_output(output, 0);
@@ -654,22 +1000,12 @@ void *heater_thread_worker(void *arg)
 					}
                 }
             }
-
-            ns_sleep(&ts, timer_period);
-
-			gettimeofday(&end, NULL);
-			timeuse = 1000000 * (end.tv_sec - start.tv_sec) + end.tv_usec - start.tv_usec;
-			//#define HEATE_100_MS (100000)	
-			#define HEATE_100_MS (200000)	
-			if ( timeuse < HEATE_100_MS) { //us
-				//printf("usleep: %ld us\n", (HEATE_100_MS - timeuse));
-            	usleep(HEATE_100_MS - timeuse);
-			}
+            FTRACE_END();
         }
 
         if (!thread_quit) {
-            if (++log_scaler >= 3 * PID_LOOP_FREQ) {
-                log_scaler = 0;
+            if ((long)(millis() - report_ms) >= 0) {
+                report_ms += HEATER_REPORT_MS;
 
                 if (unicorn_get_mode() == FW_MODE_REMOTE) {
                     /* Send respond to remote when temp not rearch */
@@ -758,6 +1094,11 @@ void *heater_thread_worker(void *arg)
     }
 
 out:
+    for (i = 0; i < NR_ITEMS(pfd); i++) {
+        if (pfd[i].fd >= 0) {
+            close(pfd[i].fd);
+        }
+    }
     thread_quit = false;
     printf("Leaving heater thread!\n");
     pthread_exit(NULL);
@@ -801,12 +1142,19 @@ int heater_config(heater_config_t *pcfgs, int nr_cfgs)
         pd->pid.FF_factor = ps->pid.FF_factor;
         pd->pid.FF_offset = ps->pid.FF_offset;
         pd->pid.I_limit   = ps->pid.I_limit;
+        pd->pid.heat_gain = ps->pid.heat_gain;
+        pd->pid.lag       = ps->pid.lag;
 
         pd->setpoint     = 0.0;
         pd->history_idx  = 0;
         pd->pid_integral = 0.0;
         
         pd->log_fd = -1;
+        if (strncmp(tag_name(pd->id), "heater_bed", 10) == 0) {
+            pd->rate_hz = HEATER_BED_RATE_HZ;
+        } else {
+            pd->rate_hz = HEATER_RATE_HZ;
+        }
         nr_heaters++;
     }
 
@@ -827,13 +1175,16 @@ void heater_reconfig()
 
 	heaters[2].input = normal_input_measure[pa.measure_ext3];
 	COMM_DBG("heaters[2].input=%s\n", heaters[2].input);
+
+    /* A thermocouple input steps slower */
+    heaters[0].rearm = true;
+    heaters[1].rearm = true;
+    heaters[2].rearm = true;
 }
 
 int heater_init(void)
 {
     int ret = 0;
-    pthread_attr_t attr;
-    //struct sched_param sched;
 
 	HEATER_DBG("heater_init called.\n");
 
@@ -841,28 +1192,8 @@ int heater_init(void)
         ret = -1;
     }
 
-    /* Initial the pthread attribute */
-    if (pthread_attr_init(&attr)) {
-        return -1;
-    }
-
-	#if 0 //for android
-    /* Force the thread to use custom scheduling attributes  */
-    if (pthread_attr_setschedpolicy(&attr, PTHREAD_EXPLICIT_SCHED)) {
-        return -1;
-    }
-    sched.sched_priority = sched_get_priority_max(SCHED_FIFO);
-
-    printf("sched_priority max: %d, min %d\n", 
-            sched.sched_priority,
-            sched_get_priority_min(SCHED_FIFO));
-    if (pthread_attr_setschedparam(&attr, &sched)) {
-        return -1;
-    }
-	#endif
-
     printf("--- Creating heater_thread..."); 
-    ret = pthread_create(&heater_thread, &attr, heater_thread_worker, NULL);
+    ret = rt_thread_create(RT_HEATER, &heater_thread, heater_thread_worker, NULL);
     if (ret) {
         printf("create heater thread failed with ret %d\n", ret);
         return -1;
@@ -1074,3 +1405,47 @@ int heater_get_pid_values(channel_tag heater, pid_settings *pid)
 
     return 0;
 }
+/*
+ *  PID steps a second of a heater, from the next step on
+ */
+int heater_set_rate(channel_tag heater, int hz)
+{
+    int idx = heater_index_lookup(heater);
+    if (idx < 0 || hz < 1 || hz > HEATER_RATE_MAX) {
+        return -1;
+    }
+
+    heaters[idx].rate_hz = hz;
+    heaters[idx].rearm = true;
+    return 0;
+}
+
+void heater_jitter_reset(void)
+{
+    int i;
+
+    for (i = 0; i < nr_heaters; i++) {
+        memset(&heaters[i].jitter, 0, sizeof(heater_jitter_t));
+    }
+}
+/*
+ *  rate and step timing of every heater, return the length written
+ */
+int heater_jitter_dump(char *buf, int len)
+{
+    int i;
+    int pos = 0;
+
+    for (i = 0; i < nr_heaters && pos < len; i++) {
+        heater_t *p = &heaters[i];
+        heater_jitter_t j = p->jitter;
+
+        pos += snprintf(buf + pos, len - pos,
+                        "%s: %dHz steps %u overruns %u late avg %uus max %uus dt %.4f..%.4fs\n",
+                        tag_name(p->id), heater_rate(p), j.ticks, j.overruns,
+                        j.ticks ? (unsigned int)(j.late_sum_us / j.ticks) : 0,
+                        j.late_max_us, j.dt_min, j.dt_max);
+    }
+
+    return min(pos, len);
+}
@@ -7,13 +7,20 @@
 
 #include "common.h"
 
+#define HEATER_RATE_HZ      (8)     /* PID steps a second of a hotend */
+#define HEATER_BED_RATE_HZ  (2)
+#define HEATER_TC_RATE_HZ   (4)     /* of a thermocouple input at most */
+#define HEATER_RATE_MAX     (50)
+
 typedef struct {
     double P;
     double I;
     double D;
     double I_limit;
-    double FF_factor;
-    double FF_offset;
+    double FF_factor;       /* duty % per C above FF_offset to hold a temperature */
+    double FF_offset;       /* ambient */
+    double heat_gain;       /* C/s per duty % at ambient, thermal model on if > 0 */
+    double lag;             /* s, the sensor trails the heater */
 } pid_settings;
 
 typedef const struct {
@@ -53,8 +60,13 @@ extern void heater_enable(channel_tag heater);
 extern void heater_disable(channel_tag heater);
 
 extern void pid_autotune(float target_temp, int extruder, int ncycles, int w, int (*gcode_send_response_remote)(char *));
+extern int heater_model_calibrate(float target_temp, int extruder, int (*gcode_send_response_remote)(char *));
 extern int heater_set_raw_pwm(channel_tag heater, int percentage);
 
+extern int heater_set_rate(channel_tag heater, int hz);
+extern void heater_jitter_reset(void);
+extern int heater_jitter_dump(char *buf, int len);
+
 #if defined (__cplusplus)
 }
 #endif
@@ -0,0 +1,472 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * kinematics.c
+ * machine kinematics: xyz, delta, corexy
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "parameter.h"
+#include "planner.h"
+#include "stepper.h"
+#include "delta.h"
+#include "mesh.h"
+#include "kinematics.h"
+
+delta_geometry_t delta_geo;
+
+static float (*bed_level)[100] = NULL;
+
+/*------------------------------------------------------------------------
+ * Common
+ *-----------------------------------------------------------------------*/
+static void direct_motor_steps(long dx, long dy, long *da, long *db)
+{
+    *da = dx;
+    *db = dy;
+}
+
+static uint8_t single_homing_axes(uint8_t axis)
+{
+    return 1 << axis;
+}
+
+/*
+ * Homing to max for xyz and corexy, to min for delta
+ */
+static uint32_t homing_dir(bool to_min)
+{
+    uint32_t dir = 0;
+
+    if (!!pa.invert_x_dir ^ to_min) {
+        dir &= ~(1 << X_AXIS);
+    } else {
+        dir |=  (1 << X_AXIS);
+    }
+
+    if (!!pa.invert_y_dir ^ to_min) {
+        dir &= ~(1 << Y_AXIS);
+    } else {
+        dir |=  (1 << Y_AXIS);
+    }
+
+    if (!!pa.invert_z_dir ^ to_min) {
+        dir &= ~(1 << Z_AXIS);
+    } else {
+        dir |=  (1 << Z_AXIS);
+    }
+
+    if (pa.invert_e_dir) {
+        dir &= ~(1 << E_AXIS);
+    } else {
+        dir |=  (1 << E_AXIS);
+    }
+
+    return dir;
+}
+
+static uint32_t cartesian_homing_dir(void)
+{
+    return homing_dir(false);
+}
+
+/* The mesh z offset is in the planner position, as mesh_buffer_line() adds it */
+static void cartesian_inverse(const float cartesian[3], float motor[3])
+{
+    motor[X_AXIS] = cartesian[X_AXIS];
+    motor[Y_AXIS] = cartesian[Y_AXIS];
+    motor[Z_AXIS] = cartesian[Z_AXIS];
+
+    if (mesh_active()) {
+        motor[Z_AXIS] += mesh_z_offset(cartesian[X_AXIS], cartesian[Y_AXIS]);
+    }
+}
+
+static int cartesian_forward(const float motor[3], float cartesian[3])
+{
+    cartesian[X_AXIS] = motor[X_AXIS];
+    cartesian[Y_AXIS] = motor[Y_AXIS];
+    cartesian[Z_AXIS] = motor[Z_AXIS];
+
+    if (mesh_active()) {
+        cartesian[Z_AXIS] -= mesh_z_offset(motor[X_AXIS], motor[Y_AXIS]);
+    }
+    return 0;
+}
+
+static void cartesian_set_position(const float cartesian[NUM_AXIS])
+{
+    float motor[3];
+
+    cartesian_inverse(cartesian, motor);
+    plan_set_position(motor[X_AXIS], motor[Y_AXIS], motor[Z_AXIS], cartesian[E_AXIS]);
+}
+
+static void cartesian_limits(float destination[NUM_AXIS])
+{
+    /* min endstop in PRU */
+    if (pa.max_software_endstops) {
+        if (destination[X_AXIS] > pa.x_max_length) {
+            destination[X_AXIS] = pa.x_max_length;
+        }
+        if (destination[Y_AXIS] > pa.y_max_length) {
+            destination[Y_AXIS] = pa.y_max_length;
+        }
+        if (destination[Z_AXIS] > pa.z_max_length) {
+            destination[Z_AXIS] = pa.z_max_length;
+        }
+    }
+}
+
+static int cartesian_buffer_move(float current[NUM_AXIS], float destination[NUM_AXIS],
+                                 float feed_rate, uint8_t extruder)
+{
+    PLAN_DBG("POS -> X%3.2f Y%3.2f Z%3.2f E%3.2f F%f\n\r",
+                destination[0],
+                destination[1],
+                destination[2],
+                destination[3],
+                feed_rate);
+
+    if (mesh_active()) {
+        mesh_buffer_line(current, destination, feed_rate, extruder);
+        return 0;
+    }
+
+    plan_buffer_line(destination[X_AXIS],
+                     destination[Y_AXIS],
+                     destination[Z_AXIS],
+                     destination[E_AXIS],
+                     feed_rate,
+                     extruder);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+ * XYZ
+ *-----------------------------------------------------------------------*/
+static int xyz_pause_position(long pos[3])
+{
+    pos[X_AXIS] = (int32_t)stepper_get_position(X_AXIS);
+    pos[Y_AXIS] = (int32_t)stepper_get_position(Y_AXIS);
+    pos[Z_AXIS] = (int32_t)stepper_get_position(Z_AXIS);
+    return 0;
+}
+
+static const kinematics_t xyz_kinematics = {
+    .name           = "xyz",
+    .type           = MACHINE_XYZ,
+    .bed_rotation   = true,
+    .motor_steps    = direct_motor_steps,
+    .inverse        = cartesian_inverse,
+    .forward        = cartesian_forward,
+    .limits         = cartesian_limits,
+    .set_position   = cartesian_set_position,
+    .buffer_move    = cartesian_buffer_move,
+    .homing_dir     = cartesian_homing_dir,
+    .homing_axes    = single_homing_axes,
+    .pause_position = xyz_pause_position,
+};
+
+/*------------------------------------------------------------------------
+ * CoreXY
+ *-----------------------------------------------------------------------*/
+static void corexy_motor_steps(long dx, long dy, long *da, long *db)
+{
+    *da = dx + dy;
+    *db = dx - dy;
+}
+
+/* resume x,y,z is calculated in pru code */
+static int corexy_pause_position(long pos[3])
+{
+    return -1;
+}
+
+static const kinematics_t corexy_kinematics = {
+    .name           = "corexy",
+    .type           = MACHINE_COREXY,
+    .bed_rotation   = true,
+    .motor_steps    = corexy_motor_steps,
+    .inverse        = cartesian_inverse,
+    .forward        = cartesian_forward,
+    .limits         = cartesian_limits,
+    .set_position   = cartesian_set_position,
+    .buffer_move    = cartesian_buffer_move,
+    .homing_dir     = cartesian_homing_dir,
+    .homing_axes    = single_homing_axes,
+    .pause_position = corexy_pause_position,
+};
+
+/*------------------------------------------------------------------------
+ * Delta
+ *-----------------------------------------------------------------------*/
+/*
+ * Bed level grid for delta_calculate_batch, NULL if auto leveling is off
+ */
+static const delta_level_t *delta_get_level(delta_level_t *level)
+{
+    if (!pa.autoLeveling || !bed_level) {
+        return NULL;
+    }
+
+    level->z = bed_level;
+    level->half = (pa.probeGridPoints - 1) / 2;
+    level->inv_x_num = (pa.probeGridPoints - 1) / (pa.probeRightPos - pa.probeLeftPos);
+    level->inv_y_num = (pa.probeGridPoints - 1) / (pa.probeBackPos - pa.probeFrontPos);
+
+    return level;
+}
+
+/*
+ * Number of segments needed to move from current by difference
+ * with the tower error of linear interpolation below pa.delta_segment_error.
+ *
+ * Along the move p(t) = p0 + t * d, t in [0, 1], a tower height is
+ * f(t) = sqrt(q(t)) + z(t) with q(t) = rod^2 - |p(t) - T|^2, and
+ * |f''(t)| = |d|^2 / sqrt(q) + ((p(t) - T) . d)^2 / q^(3/2).
+ * |p(t) - T|^2 is convex and (p(t) - T) . d is linear in t, so both
+ * terms are largest with q and the dot product taken at their worst
+ * end point. A chord over 1/n of the move is off by at most
+ * max|f''| / (8 * n^2), which gives n.
+ * The bed level offset is the same for the three towers and is not
+ * part of the bound.
+ */
+static int delta_segment_count(float current[NUM_AXIS], float difference[NUM_AXIS])
+{
+    int i;
+    float dd = difference[X_AXIS] * difference[X_AXIS]
+             + difference[Y_AXIS] * difference[Y_AXIS];
+    float tolerance = pa.delta_segment_error / 1000.0;
+    float bound = 0.0;
+    float x0, y0, x1, y1, q, dot;
+    int steps;
+
+    /* Z is linear in tower space */
+    if (dd == 0.0) {
+        return 1;
+    }
+
+    for (i = 0; i < 3; i++) {
+        x0 = current[X_AXIS] - delta_geo.tower_x[i];
+        y0 = current[Y_AXIS] - delta_geo.tower_y[i];
+        x1 = x0 + difference[X_AXIS];
+        y1 = y0 + difference[Y_AXIS];
+
+        q = delta_geo.rod_2[i] - max(x0 * x0 + y0 * y0, x1 * x1 + y1 * y1);
+        if (q <= 0.0) {
+            return DELTA_MAX_SEGMENTS;
+        }
+        dot = max(fabs(x0 * difference[X_AXIS] + y0 * difference[Y_AXIS]),
+                  fabs(x1 * difference[X_AXIS] + y1 * difference[Y_AXIS]));
+
+        bound = max(bound, dd / sqrtf(q) + dot * dot / (q * sqrtf(q)));
+    }
+
+    steps = (int)ceil(sqrt(bound / (8 * tolerance)));
+
+    return max(1, min(steps, DELTA_MAX_SEGMENTS));
+}
+
+static void delta_inverse(const float cartesian[3], float motor[3])
+{
+    delta_calculate_batch_scalar(&delta_geo, NULL, 1,
+                                 &cartesian[X_AXIS], &cartesian[Y_AXIS], &cartesian[Z_AXIS],
+                                 &motor[X_AXIS], &motor[Y_AXIS], &motor[Z_AXIS]);
+}
+
+static int delta_forward_position(const float motor[3], float cartesian[3])
+{
+    return delta_forward(&delta_geo, motor[X_AXIS], motor[Y_AXIS], motor[Z_AXIS],
+                         &cartesian[X_AXIS], &cartesian[Y_AXIS], &cartesian[Z_AXIS]);
+}
+
+/* The PRU works in tower steps, it gets the position too */
+static void delta_set_position(const float cartesian[NUM_AXIS])
+{
+    float motor[3];
+
+    delta_inverse(cartesian, motor);
+    plan_set_position(motor[X_AXIS], motor[Y_AXIS], motor[Z_AXIS], cartesian[E_AXIS]);
+
+    stepper_set_position(lround(motor[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]),
+                         lround(motor[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]),
+                         lround(motor[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]),
+                         lround(cartesian[E_AXIS] * pa.axis_steps_per_unit[E_AXIS]));
+}
+
+static void delta_limits(float destination[NUM_AXIS])
+{
+	float distance_from_center = destination[X_AXIS] * destination[X_AXIS]  + destination[Y_AXIS] * destination[Y_AXIS];
+	if (distance_from_center > pa.delta_print_radius * pa.delta_print_radius) {
+		if ((abs(destination[X_AXIS]) != 0) && (abs(destination[Y_AXIS]) != 0)) {
+			float scale = fabs(destination[X_AXIS] / destination[Y_AXIS]);
+			int x_direction = 1, y_direction = 1;
+			if (destination[X_AXIS] < 0)
+				x_direction = -1;
+			if (destination[Y_AXIS] < 0)
+				y_direction = -1;
+			destination[Y_AXIS] = y_direction * pa.delta_print_radius / sqrt(1+scale * scale);
+			destination[X_AXIS] = x_direction * fabs(destination[Y_AXIS]) * scale;
+		}
+	}
+
+    if (pa.min_software_endstops) {
+        if (destination[X_AXIS] < -pa.delta_print_radius) {
+            destination[X_AXIS] =  -pa.delta_print_radius;
+        }
+        if (destination[Y_AXIS] <  -pa.delta_print_radius) {
+            destination[Y_AXIS] = -pa.delta_print_radius;
+        }
+    }
+
+    if (pa.max_software_endstops) {
+        if (destination[X_AXIS] > pa.delta_print_radius) {
+            destination[X_AXIS] = pa.delta_print_radius;
+        }
+        if (destination[Y_AXIS] > pa.delta_print_radius) {
+            destination[Y_AXIS] = pa.delta_print_radius;
+        }
+    }
+}
+
+static int delta_buffer_move(float current[NUM_AXIS], float destination[NUM_AXIS],
+                             float feed_rate, uint8_t extruder)
+{
+    int i;
+    float difference[NUM_AXIS];
+    for (i = 0; i < NUM_AXIS; i++) {
+        difference[i] = destination[i] - current[i];
+    }
+    float cartesian_mm = sqrt(powf(difference[X_AXIS], 2) +
+                              powf(difference[Y_AXIS], 2) +
+                              powf(difference[Z_AXIS], 2));
+
+    if (cartesian_mm < 0.000001) {
+        cartesian_mm = abs(difference[E_AXIS]);
+    }
+
+    if (cartesian_mm < 0.000001) {
+        printf("cartesian_mm < 0.000001!!!!!!!!!!\n");
+        return -1;
+    }
+
+    delta_level_t level;
+    const delta_level_t *lv = delta_get_level(&level);
+    int steps = 1;
+    if (pa.delta_segment_error > 0) {
+        steps = delta_segment_count(current, difference);
+    } else {
+        float seconds = cartesian_mm / feed_rate;
+        steps = max(1, (int)(pa.segments_per_second * seconds));
+    }
+
+    /* Tower positions are computed DELTA_BATCH_SIZE segments at a time */
+    float px[DELTA_BATCH_SIZE], py[DELTA_BATCH_SIZE];
+    float pz[DELTA_BATCH_SIZE], pe[DELTA_BATCH_SIZE];
+    float ta[DELTA_BATCH_SIZE], tb[DELTA_BATCH_SIZE], tc[DELTA_BATCH_SIZE];
+    int s, k, n;
+    for (s = 1; s <= steps; s += n) {
+        n = min(DELTA_BATCH_SIZE, steps - s + 1);
+        for (k = 0; k < n; k++) {
+            float fraction = (float)(s + k) / (float)(steps);
+            px[k] = current[X_AXIS] + difference[X_AXIS] * fraction;
+            py[k] = current[Y_AXIS] + difference[Y_AXIS] * fraction;
+            pz[k] = current[Z_AXIS] + difference[Z_AXIS] * fraction;
+            pe[k] = current[E_AXIS] + difference[E_AXIS] * fraction;
+        }
+
+        delta_calculate_batch(&delta_geo, lv, n, px, py, pz, ta, tb, tc);
+
+        for (k = 0; k < n; k++) {
+            plan_buffer_line(ta[k],
+                             tb[k],
+                             tc[k],
+                             pe[k],
+                             feed_rate,
+                             extruder);
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t delta_homing_dir(void)
+{
+    return homing_dir(true);
+}
+
+/* All carriages home together */
+static uint8_t delta_homing_axes(uint8_t axis)
+{
+    return (1 << X_AXIS) | (1 << Y_AXIS) | (1 << Z_AXIS);
+}
+
+/*
+ * Distance from the current position to the tower positions at home
+ */
+static int delta_pause_position(long pos[3])
+{
+    float home[3] = { 0.0, 0.0, pa.z_home_pos };
+    float motor[3];
+
+    stepper_wait_for_lmsw(Z_AXIS);
+
+    delta_inverse(home, motor);
+
+    pos[X_AXIS] = lround(motor[X_AXIS] * pa.axis_steps_per_unit[X_AXIS]) - (int32_t)stepper_get_position(X_AXIS);
+    pos[Y_AXIS] = lround(motor[Y_AXIS] * pa.axis_steps_per_unit[Y_AXIS]) - (int32_t)stepper_get_position(Y_AXIS);
+    pos[Z_AXIS] = lround(motor[Z_AXIS] * pa.axis_steps_per_unit[Z_AXIS]) - (int32_t)stepper_get_position(Z_AXIS);
+    return 0;
+}
+
+static const kinematics_t delta_kinematics = {
+    .name           = "delta",
+    .type           = MACHINE_DELTA,
+    .bed_rotation   = false,
+    .motor_steps    = direct_motor_steps,
+    .inverse        = delta_inverse,
+    .forward        = delta_forward_position,
+    .limits         = delta_limits,
+    .set_position   = delta_set_position,
+    .buffer_move    = delta_buffer_move,
+    .homing_dir     = delta_homing_dir,
+    .homing_axes    = delta_homing_axes,
+    .pause_position = delta_pause_position,
+};
+
+const kinematics_t *kinematics = &xyz_kinematics;
+
+/*
+ * Select kinematics from pa.machine_type
+ */
+int kinematics_init(void)
+{
+    switch (pa.machine_type) {
+        case MACHINE_XYZ:
+            kinematics = &xyz_kinematics;
+            break;
+        case MACHINE_DELTA:
+            kinematics = &delta_kinematics;
+            break;
+        case MACHINE_COREXY:
+            kinematics = &corexy_kinematics;
+            break;
+        default:
+            printf("unknown machine type %d, use xyz\n", pa.machine_type);
+            kinematics = &xyz_kinematics;
+            return -1;
+    }
+
+    printf("kinematics: %s\n", kinematics->name);
+    return 0;
+}
+
+void kinematics_set_bed_level(float (*level)[100])
+{
+    bed_level = level;
+}
@@ -0,0 +1,89 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * kinematics.h
+ * machine kinematics: xyz, delta, corexy
+*/
+#ifndef _KINEMATICS_H
+#define _KINEMATICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "delta.h"
+
+/*
+ * One implementation per machine type, selected once by kinematics_init(),
+ * so the per segment code does not test pa.machine_type.
+ */
+typedef struct {
+    const char *name;
+    uint8_t type;           /* MACHINE_XYZ, MACHINE_DELTA, MACHINE_COREXY */
+
+    /* plan_bed_level_matrix is applied to the planner target */
+    bool bed_rotation;
+
+    /*
+     * Motor step delta of the X and Y motors
+     * for a cartesian step delta dx, dy
+     */
+    void (*motor_steps)(long dx, long dy, long *da, long *db);
+
+    /* Planner coordinates of the nozzle at cartesian, tower heights for delta */
+    void (*inverse)(const float cartesian[3], float motor[3]);
+
+    /*
+     * Nozzle position of the planner coordinates motor,
+     * return -1 if there is none.
+     */
+    int (*forward)(const float motor[3], float cartesian[3]);
+
+    /* Clamp destination to the machine limits */
+    void (*limits)(float destination[NUM_AXIS]);
+
+    /*
+     * Planner position of the nozzle at cartesian, and the PRU step
+     * position where the PRU keeps it in tower coordinates.
+     */
+    void (*set_position)(const float cartesian[NUM_AXIS]);
+
+    /*
+     * Send the move from current to destination to the planner,
+     * destination within limits(), feed_rate in mm/s.
+     * Return -1 if there is nothing to move.
+     */
+    int (*buffer_move)(float current[NUM_AXIS], float destination[NUM_AXIS],
+                       float feed_rate, uint8_t extruder);
+
+    /* Homing direction bits */
+    uint32_t (*homing_dir)(void);
+
+    /* Axis bits the PRU homes when homing axis */
+    uint8_t (*homing_axes)(uint8_t axis);
+
+    /*
+     * Pause position in steps for the PRU to resume from,
+     * return -1 if the PRU calculates it by itself.
+     */
+    int (*pause_position)(long pos[3]);
+} kinematics_t;
+
+extern const kinematics_t *kinematics;
+
+/* Tower geometry, updated by set_delta_constants() */
+extern delta_geometry_t delta_geo;
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/* Select kinematics from pa.machine_type */
+extern int kinematics_init(void);
+
+/* Bed level grid used by delta moves when auto leveling */
+extern void kinematics_set_bed_level(float (*level)[100]);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
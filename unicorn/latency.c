@@ -0,0 +1,423 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * latency.c
+ * latency of a move through the motion pipeline,
+ * from the gcode read to the PRU finishing its queue element
+ *
+ * Every move is stamped as it passes a thread, the stage in between
+ * goes into a log2 histogram. The moves queued to the PRU wait in a
+ * ring until the sampler thread sees the PRU past them, so the last
+ * stage has the 10ms resolution of the sampler.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "stepper.h"
+#include "rt.h"
+#include "latency.h"
+
+#define SAMPLE_MS           (10)
+#define DEPTH_EVERY         (10)        /* samples, the depth every 100ms */
+#define DEPTH_SAMPLES       (600)       /* one minute */
+#define PENDING_LEN         (1024)      /* power of 2 */
+#define DUMP_SIZE           (8192)
+
+typedef struct {
+    uint32_t count;
+    uint64_t sum;
+    uint32_t max;
+    uint32_t bucket[LATENCY_BUCKETS];
+} histogram_t;
+
+typedef struct {
+    uint32_t t_start;       /* first stamp of the move */
+    uint32_t t_queue;
+    uint32_t pos;           /* queue position after its element */
+} pending_t;
+
+static const char *stage_name[NR_LAT_STAGES] = {
+    "read-plan",
+    "plan-fifo",
+    "fifo-queue",
+    "queue-pru",
+    "total",
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static histogram_t hist[NR_LAT_STAGES];
+
+static pending_t pending[PENDING_LEN];
+static unsigned int pending_head = 0;
+static unsigned int pending_tail = 0;
+static uint32_t untracked = 0;
+
+static uint16_t depth[DEPTH_SAMPLES];
+static unsigned int depth_pos = 0;
+static unsigned int depth_count = 0;
+
+/* gcode thread only */
+static uint32_t t_read = 0;
+
+static pthread_t latency_thread;
+static bool thread_quit = false;
+static bool thread_started = false;
+static int listen_fd = -1;
+
+uint32_t latency_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void latency_record(latency_stage_t stage, uint32_t us)
+{
+    histogram_t *h = &hist[stage];
+    int b = 0;
+
+    if (us > 0) {
+        b = 32 - __builtin_clz(us) - 1;
+    }
+    if (b >= LATENCY_BUCKETS) {
+        b = LATENCY_BUCKETS - 1;
+    }
+
+    h->count++;
+    h->sum += us;
+    if (us > h->max) {
+        h->max = us;
+    }
+    h->bucket[b]++;
+}
+
+void latency_line_read(void)
+{
+    t_read = latency_now();
+}
+
+void latency_line_done(void)
+{
+    t_read = 0;
+}
+
+/*
+ * Moves planned outside a gcode read, homing and the like,
+ * start at plan_buffer_line
+ */
+void latency_block_planned(block_t *block, uint32_t t_entry)
+{
+    block->t_read = t_read;
+    block->t_plan = t_entry;
+    block->t_fifo = 0;
+
+    if (t_read) {
+        pthread_mutex_lock(&lock);
+        latency_record(LAT_READ_PLAN, t_entry - t_read);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void latency_block_fifo(block_t *block)
+{
+    if (!block->t_plan) {
+        return;
+    }
+    block->t_fifo = latency_now();
+
+    pthread_mutex_lock(&lock);
+    latency_record(LAT_PLAN_FIFO, block->t_fifo - block->t_plan);
+    pthread_mutex_unlock(&lock);
+}
+
+void latency_block_queued(block_t *block)
+{
+    pending_t *p;
+    uint32_t pos;
+    uint32_t now;
+
+    if (!block->t_fifo) {
+        return;
+    }
+    now = latency_now();
+
+    pthread_mutex_lock(&lock);
+    latency_record(LAT_FIFO_QUEUE, now - block->t_fifo);
+
+    if (stepper_queue_get_pos(&pos) < 0) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    if (pending_tail - pending_head >= PENDING_LEN) {
+        untracked++;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    p = &pending[pending_tail % PENDING_LEN];
+    p->t_start = block->t_read ? block->t_read : block->t_plan;
+    p->t_queue = now;
+    p->pos = pos;
+    pending_tail++;
+    pthread_mutex_unlock(&lock);
+}
+
+void latency_flush(void)
+{
+    pthread_mutex_lock(&lock);
+    pending_head = pending_tail;
+    pthread_mutex_unlock(&lock);
+}
+
+void latency_reset(void)
+{
+    pthread_mutex_lock(&lock);
+    memset(hist, 0, sizeof(hist));
+    untracked = 0;
+    depth_pos = 0;
+    depth_count = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Retire the moves the PRU is done with
+ */
+static void latency_retire(void)
+{
+    uint32_t now = latency_now();
+    pending_t *p;
+
+    pthread_mutex_lock(&lock);
+    while (pending_head != pending_tail) {
+        p = &pending[pending_head % PENDING_LEN];
+        if (stepper_queue_pending(p->pos) != 0) {
+            break;
+        }
+        latency_record(LAT_QUEUE_PRU, now - p->t_queue);
+        latency_record(LAT_TOTAL, now - p->t_start);
+        pending_head++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void latency_sample_depth(void)
+{
+    int len = stepper_get_queue_len();
+
+    pthread_mutex_lock(&lock);
+    depth[depth_pos] = len;
+    depth_pos = (depth_pos + 1) % DEPTH_SAMPLES;
+    if (depth_count < DEPTH_SAMPLES) {
+        depth_count++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Upper bound of the bucket holding the fraction q of the count,
+ * not above the max
+ */
+static uint32_t histogram_percentile(histogram_t *h, int q)
+{
+    uint64_t n = 0;
+    int b;
+
+    for (b = 0; b < LATENCY_BUCKETS - 1; b++) {
+        n += h->bucket[b];
+        if (n * 100 >= (uint64_t)h->count * q) {
+            break;
+        }
+    }
+    if (b == LATENCY_BUCKETS - 1 || (2u << b) > h->max) {
+        return h->max;
+    }
+    return 2u << b;
+}
+
+int latency_dump(char *buf, int len, bool series)
+{
+    histogram_t *h;
+    int pos = 0;
+    int i, b;
+    int min = 0, max = 0;
+    long sum = 0;
+
+#define DUMP(...) \
+    do { \
+        if (pos < len) { \
+            pos += snprintf(buf + pos, len - pos, __VA_ARGS__); \
+        } \
+    } while (0)
+
+    pthread_mutex_lock(&lock);
+
+    DUMP("stage count avg_us p50_us p99_us max_us\n");
+    for (i = 0; i < NR_LAT_STAGES; i++) {
+        h = &hist[i];
+        DUMP("%s %u %u %u %u %u\n", stage_name[i], h->count,
+             h->count ? (uint32_t)(h->sum / h->count) : 0,
+             histogram_percentile(h, 50), histogram_percentile(h, 99),
+             h->max);
+    }
+    DUMP("pending %u untracked %u\n", pending_tail - pending_head, untracked);
+
+    for (i = 0; i < depth_count; i++) {
+        int d = depth[(depth_pos + DEPTH_SAMPLES - depth_count + i) % DEPTH_SAMPLES];
+        if (i == 0 || d < min) {
+            min = d;
+        }
+        if (i == 0 || d > max) {
+            max = d;
+        }
+        sum += d;
+    }
+    DUMP("depth min %d avg %ld max %d over %u00ms\n", min,
+         depth_count ? sum / depth_count : 0, max, depth_count);
+
+    if (series) {
+        /* buckets by their lower bound in us */
+        for (i = 0; i < NR_LAT_STAGES; i++) {
+            h = &hist[i];
+            DUMP("%s", stage_name[i]);
+            for (b = 0; b < LATENCY_BUCKETS; b++) {
+                if (h->bucket[b]) {
+                    DUMP(" %u:%u", b ? (1u << b) : 0, h->bucket[b]);
+                }
+            }
+            DUMP("\n");
+        }
+
+        DUMP("depth");
+        for (i = 0; i < depth_count; i++) {
+            DUMP(" %d", depth[(depth_pos + DEPTH_SAMPLES - depth_count + i) % DEPTH_SAMPLES]);
+        }
+        DUMP("\n");
+    }
+
+    pthread_mutex_unlock(&lock);
+#undef DUMP
+
+    if (pos >= len) {
+        pos = len - 1;
+    }
+    return pos;
+}
+
+static void latency_serve(void)
+{
+    char *buf;
+    int fd, len, n;
+
+    fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    buf = malloc(DUMP_SIZE);
+    if (buf) {
+        len = latency_dump(buf, DUMP_SIZE, true);
+        for (n = 0; n < len; ) {
+            int ret = write(fd, buf + n, len - n);
+            if (ret <= 0) {
+                break;
+            }
+            n += ret;
+        }
+        free(buf);
+    }
+    close(fd);
+}
+
+static void *latency_thread_worker(void *arg)
+{
+    struct pollfd pfd;
+    int ticks = 0;
+
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+
+    printf("[latency]: start up latency thread\n");
+    while (!thread_quit) {
+        pfd.revents = 0;
+        if (poll(&pfd, 1, SAMPLE_MS) > 0 && (pfd.revents & POLLIN)) {
+            latency_serve();
+        }
+
+        latency_retire();
+
+        if (++ticks >= DEPTH_EVERY) {
+            ticks = 0;
+            latency_sample_depth();
+        }
+    }
+
+    printf("[latency]: leaving latency thread\n");
+    return NULL;
+}
+
+static int latency_socket(void)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        printf("[latency]: socket failed\n");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, LATENCY_SOCKET, sizeof(addr.sun_path) - 1);
+    unlink(LATENCY_SOCKET);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(fd, 2) < 0) {
+        printf("[latency]: can not listen on %s\n", LATENCY_SOCKET);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int latency_init(void)
+{
+    int ret;
+
+    latency_reset();
+    latency_flush();
+
+    /* Without the socket the histograms are still there for M930 */
+    listen_fd = latency_socket();
+
+    thread_quit = false;
+    ret = rt_thread_create(RT_LATENCY, &latency_thread, latency_thread_worker, NULL);
+    if (ret) {
+        printf("[latency]: create latency thread failed with ret %d\n", ret);
+        return -1;
+    }
+    thread_started = true;
+
+    return 0;
+}
+
+void latency_exit(void)
+{
+    if (thread_started) {
+        thread_quit = true;
+        pthread_join(latency_thread, NULL);
+        thread_started = false;
+    }
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(LATENCY_SOCKET);
+        listen_fd = -1;
+    }
+}
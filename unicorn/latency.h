@@ -0,0 +1,62 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * latency.h
+ * latency of a move through the motion pipeline,
+ * from the gcode read to the PRU finishing its queue element
+*/
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "planner.h"
+
+/* Local socket, a client connecting gets the dump and EOF */
+#define LATENCY_SOCKET      "/tmp/unicorn_latency.sock"
+
+/* Log2 buckets of microseconds, the last one is open ended */
+#define LATENCY_BUCKETS     (24)
+
+typedef enum {
+    LAT_READ_PLAN = 0,      /* gcode read -> plan_buffer_line */
+    LAT_PLAN_FIFO,          /* plan_buffer_line -> Fifo to the stepper thread */
+    LAT_FIFO_QUEUE,         /* Fifo -> queued to the PRU */
+    LAT_QUEUE_PRU,          /* queued -> PRU done with it */
+    LAT_TOTAL,              /* first stamp -> PRU done with it */
+    NR_LAT_STAGES,
+} latency_stage_t;
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/* CLOCK_MONOTONIC in us, wraps after 71 minutes */
+extern uint32_t latency_now(void);
+
+/* gcode thread, around a read of the gcode stream */
+extern void latency_line_read(void);
+extern void latency_line_done(void);
+
+/* Stamps of a move, t_entry is when plan_buffer_line was called */
+extern void latency_block_planned(block_t *block, uint32_t t_entry);
+extern void latency_block_fifo(block_t *block);
+extern void latency_block_queued(block_t *block);
+
+/* Drop the moves waiting for the PRU, before the queue is reset */
+extern void latency_flush(void);
+extern void latency_reset(void);
+
+/*
+ * Write the histograms into buf, with the queue depth samples if series.
+ * Return the length written.
+ */
+extern int latency_dump(char *buf, int len, bool series);
+
+extern int latency_init(void);
+extern void latency_exit(void);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
@@ -12,6 +12,7 @@
 #include <pthread.h>
 #include <linux/input.h>
 
+#include "common.h"
 #include "unicorn.h"
 #include "lmsw.h"
 
@@ -73,13 +74,13 @@ int wait_lmsw_min(axis_e axis)
 
 	rd = select(fd + 1, &fds, 0, 0, &timeout);
 	if (rd <= 0) {
-        printf("read lmsw event timeout\n");
+        ULOG(LOG_WARNING, "read lmsw event timeout\n");
 		return -1;
 	}
 
     rd = read(fd, ev, sizeof(struct input_event) * 64);
     if (rd < (int) sizeof(struct input_event)) {
-        fprintf(stderr, "read lmsw event err\n");
+        ULOG(LOG_WARNING, "read lmsw event err\n");
         return -1;
     }
     
@@ -132,7 +133,7 @@ int wait_lmsw_min_test(axis_e axis)
 
     rd = read(fd, ev, sizeof(struct input_event) * 64);
     if (rd < (int) sizeof(struct input_event)) {
-        fprintf(stderr, "read lmsw event err\n");
+        ULOG(LOG_WARNING, "read lmsw event err\n");
         return -1;
     }
     
@@ -185,7 +186,7 @@ int wait_lmsw_max(axis_e axis)
 
     rd = read(fd, ev, sizeof(struct input_event) * 64);
     if (rd < (int) sizeof(struct input_event)) {
-        fprintf(stderr, "read lmsw event err\n");
+        ULOG(LOG_WARNING, "read lmsw event err\n");
         return -1;
     }
     
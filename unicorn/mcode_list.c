@@ -1,41 +1,50 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "common.h"
-#include "list.h"
 
 #define debug 0 
 
-static struct M_list  blist;
+/*
+ * Fixed ring, the gcode thread appends and the mcode thread takes,
+ * nothing is allocated while printing
+ */
+static struct M_list ring[MCodeRingSize];
+static unsigned int head = 0;  /* next to append */
+static unsigned int tail = 0;  /* oldest pending */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void init_MCode_list() 
 {
-  INIT_LIST_HEAD(&blist.list);
+  pthread_mutex_lock(&ring_lock);
+  head = tail = 0;
+  pthread_mutex_unlock(&ring_lock);
 }
 
 void destroy_MCode_list() 
 {
-  struct M_list* iter; 
-  /* remove all items in the list */
-  while( !list_empty(&blist.list) ) {
-    iter = list_entry(blist.list.next,struct M_list,list);
-    if(debug)
-        printf("remove %d %s \n", iter->no, iter->MCode);
-    list_del(&iter->list);
-    free(iter);
-  }
+  /* drop all pending items */
+  pthread_mutex_lock(&ring_lock);
+  if(debug)
+    printf("remove %u items\n", head - tail);
+  tail = head;
+  pthread_mutex_unlock(&ring_lock);
 }
 
+/*
+ * Oldest pending item, it stays valid until del_list_item()
+ */
 struct M_list* get_list_item()
 {
-  struct M_list* iter; 
-  if ( !list_empty(&blist.list) ) {
-    iter = list_entry(blist.list.next,struct M_list,list);
-    //if(debug)
-     //   printf("get list item %d %s \n", iter->no, iter->MCode);
-    return iter;
-  } else 
-    return NULL;
+  struct M_list* iter = NULL; 
+
+  pthread_mutex_lock(&ring_lock);
+  if (tail != head) {
+    iter = &ring[tail % MCodeRingSize];
+  }
+  pthread_mutex_unlock(&ring_lock);
+  return iter;
 }
 
 void del_list_item(struct M_list* item)
@@ -43,46 +52,50 @@ void del_list_item(struct M_list* item)
     if ( item != NULL ) {
         if(debug)
             printf("del list item %d %s \n", item->no, item->MCode);
-        list_del(&item->list);
-        free(item);
+        pthread_mutex_lock(&ring_lock);
+        if (tail != head && item == &ring[tail % MCodeRingSize]) {
+            tail++;
+        }
+        pthread_mutex_unlock(&ring_lock);
     }
 }
 
-void append_list(const char* mCode, int no)          
+/*
+ * Return -1 if the ring is full
+ */
+int append_list(const char* mCode, int code, int no)          
 {
   struct M_list* tmp;
-  tmp = (struct M_list*)malloc(sizeof(struct M_list));
-  if(!tmp) {
-    perror("malloc for append_list");
-	return;
+
+  pthread_mutex_lock(&ring_lock);
+  if (head - tail >= MCodeRingSize) {
+    pthread_mutex_unlock(&ring_lock);
+    return -1;
   }
-  memset(tmp->MCode, 0, sizeof(tmp->MCode));
-  strcpy(tmp->MCode, mCode);
+  tmp = &ring[head % MCodeRingSize];
+  pthread_mutex_unlock(&ring_lock);
+
+  /* only the appending thread touches the free slot */
+  snprintf(tmp->MCode, sizeof(tmp->MCode), "%s", mCode);
+  tmp->code = code;
   tmp->no = no;
   if(debug)
     printf("add M code %d %s \n", tmp->no, tmp->MCode);
 
-  list_add_tail( &(tmp->list), &(blist.list) );
+  pthread_mutex_lock(&ring_lock);
+  head++;
+  pthread_mutex_unlock(&ring_lock);
+  return 0;
 }
 
 void debug_MCode_list() 
 {
-  struct M_list* iter; 
-  /* iterates list */
-  list_for_each_entry(iter,&blist.list,list) {
-    printf("No:%d %s \n", iter->no, iter->MCode);
-  }
-}
+  unsigned int i;
 
-#if 0
-static int main_1()
-{
-  /* add item to list   
-  append_list(&blist, "NM", 87501);
-  append_list(&blist, "CA", 94041);
-  append_list(&blist, "IL", 60561);
-   */
-  return 0;
+  pthread_mutex_lock(&ring_lock);
+  for (i = tail; i != head; i++) {
+    printf("No:%d M%d %s \n", ring[i % MCodeRingSize].no,
+           ring[i % MCodeRingSize].code, ring[i % MCodeRingSize].MCode);
+  }
+  pthread_mutex_unlock(&ring_lock);
 }
-#endif
-
@@ -1,19 +1,26 @@
-
 #ifndef _MCODE_LIST_H
 #define _MCODE_LIST_H
 
-#define MCodeArrayMaxSize  50
+#define MCodeArrayMaxSize  64
+
+/* Pending synchronized M codes, power of 2 */
+#define MCodeRingSize      256
+
+/*
+ * An M code to run once the PRU passed marker no,
+ * parsed when it is queued
+ */
 struct M_list
 {
-  struct list_head list;
   int   no;
+  int   code;
   char MCode[MCodeArrayMaxSize];
 };
 
 
 void init_MCode_list();
 void destroy_MCode_list();
-void append_list(const char* mCode, int no);
+int append_list(const char* mCode, int code, int no);
 void debug_MCode_list();
 struct M_list* get_list_item();
 void del_list_item(struct M_list* item);
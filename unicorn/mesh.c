@@ -0,0 +1,185 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * mesh.c
+ * mesh bed compensation for xyz and corexy
+ *
+ * The probed grid is turned into one bilinear polynomial per cell,
+ *   z = a + b * u + c * v + d * u * v,  u, v in [0, 1] inside the cell
+ * so a lookup is a table index and three multiply-adds.
+ * Moves are split where they cross cell boundaries.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "parameter.h"
+#include "planner.h"
+#include "mesh.h"
+
+typedef struct {
+    bool valid;
+    int nx;             /* cells in x */
+    int ny;             /* cells in y */
+    float x0;           /* grid origin, left front */
+    float y0;
+    float dx;           /* cell size */
+    float dy;
+    float inv_dx;
+    float inv_dy;
+    float coef[(MESH_MAX_POINTS - 1) * (MESH_MAX_POINTS - 1)][4];
+} mesh_t;
+
+static mesh_t mesh;
+
+int mesh_build(float (*level)[100], int points,
+               float left, float right, float front, float back)
+{
+    int i, j;
+
+    mesh.valid = false;
+
+    if (points < 2 || points > MESH_MAX_POINTS
+            || right <= left || back <= front) {
+        printf("[mesh]: invalid grid, points:%d\n", points);
+        return -1;
+    }
+
+    mesh.nx = points - 1;
+    mesh.ny = points - 1;
+    mesh.x0 = left;
+    mesh.y0 = front;
+    mesh.dx = (right - left) / mesh.nx;
+    mesh.dy = (back - front) / mesh.ny;
+    mesh.inv_dx = 1.0 / mesh.dx;
+    mesh.inv_dy = 1.0 / mesh.dy;
+
+    for (j = 0; j < mesh.ny; j++) {
+        for (i = 0; i < mesh.nx; i++) {
+            float z00 = level[i][j];
+            float z10 = level[i + 1][j];
+            float z01 = level[i][j + 1];
+            float z11 = level[i + 1][j + 1];
+            float *c = mesh.coef[j * mesh.nx + i];
+
+            c[0] = z00;
+            c[1] = z10 - z00;
+            c[2] = z01 - z00;
+            c[3] = z11 - z10 - z01 + z00;
+        }
+    }
+
+    mesh.valid = true;
+    return 0;
+}
+
+void mesh_clear(void)
+{
+    mesh.valid = false;
+}
+
+bool mesh_active(void)
+{
+    return mesh.valid && (pa.autoLeveling == AUTO_LEVELING_MODE_MESH);
+}
+
+static inline int mesh_cell(float u, int n)
+{
+    int i = (int)floorf(u);
+
+    if (i < 0) {
+        return 0;
+    }
+    if (i >= n) {
+        return n - 1;
+    }
+    return i;
+}
+
+/*
+ * Outside the grid the edge value is used
+ */
+float mesh_z_offset(float x, float y)
+{
+    float u = (x - mesh.x0) * mesh.inv_dx;
+    float v = (y - mesh.y0) * mesh.inv_dy;
+    int i = mesh_cell(u, mesh.nx);
+    int j = mesh_cell(v, mesh.ny);
+    float fu = fminf(fmaxf(u - i, 0.0), 1.0);
+    float fv = fminf(fmaxf(v - j, 0.0), 1.0);
+    const float *c = mesh.coef[j * mesh.nx + i];
+
+    return c[0] + c[1] * fu + (c[2] + c[3] * fu) * fv;
+}
+
+void mesh_buffer_line(const float current[NUM_AXIS], const float destination[NUM_AXIS],
+                      float feed_rate, uint8_t extruder)
+{
+    int i;
+    float difference[NUM_AXIS];
+    float point[NUM_AXIS];
+    float inv_x = 0.0, inv_y = 0.0;
+    int cx, cy, cx_end, cy_end;
+    int step_x, step_y;
+
+    for (i = 0; i < NUM_AXIS; i++) {
+        difference[i] = destination[i] - current[i];
+    }
+
+    cx     = mesh_cell((current[X_AXIS] - mesh.x0) * mesh.inv_dx, mesh.nx);
+    cy     = mesh_cell((current[Y_AXIS] - mesh.y0) * mesh.inv_dy, mesh.ny);
+    cx_end = mesh_cell((destination[X_AXIS] - mesh.x0) * mesh.inv_dx, mesh.nx);
+    cy_end = mesh_cell((destination[Y_AXIS] - mesh.y0) * mesh.inv_dy, mesh.ny);
+    step_x = (cx_end > cx) ? 1 : -1;
+    step_y = (cy_end > cy) ? 1 : -1;
+
+    if (cx != cx_end) {
+        inv_x = 1.0 / difference[X_AXIS];
+    }
+    if (cy != cy_end) {
+        inv_y = 1.0 / difference[Y_AXIS];
+    }
+
+    /* Break the move at every cell boundary it crosses */
+    while (cx != cx_end || cy != cy_end) {
+        float tx = 2.0, ty = 2.0, t;
+
+        if (cx != cx_end) {
+            float line_x = mesh.x0 + (cx + (step_x > 0 ? 1 : 0)) * mesh.dx;
+            tx = (line_x - current[X_AXIS]) * inv_x;
+        }
+        if (cy != cy_end) {
+            float line_y = mesh.y0 + (cy + (step_y > 0 ? 1 : 0)) * mesh.dy;
+            ty = (line_y - current[Y_AXIS]) * inv_y;
+        }
+
+        t = fminf(tx, ty);
+        if (tx <= t) {
+            cx += step_x;
+        }
+        if (ty <= t) {
+            cy += step_y;
+        }
+        if (t <= 0.0 || t >= 1.0) {
+            continue;
+        }
+
+        for (i = 0; i < NUM_AXIS; i++) {
+            point[i] = current[i] + difference[i] * t;
+        }
+        plan_buffer_line(point[X_AXIS],
+                         point[Y_AXIS],
+                         point[Z_AXIS] + mesh_z_offset(point[X_AXIS], point[Y_AXIS]),
+                         point[E_AXIS],
+                         feed_rate,
+                         extruder);
+    }
+
+    plan_buffer_line(destination[X_AXIS],
+                     destination[Y_AXIS],
+                     destination[Z_AXIS] + mesh_z_offset(destination[X_AXIS], destination[Y_AXIS]),
+                     destination[E_AXIS],
+                     feed_rate,
+                     extruder);
+}
@@ -0,0 +1,44 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * mesh.h
+ * mesh bed compensation for xyz and corexy
+*/
+#ifndef _MESH_H
+#define _MESH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+
+/* Maximum probe grid points per dimension */
+#define MESH_MAX_POINTS     (32)
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Build the per cell coefficient table from the probed grid,
+ * level[x][y] is the z offset at left + x * spacing, front + y * spacing.
+ */
+extern int mesh_build(float (*level)[100], int points,
+                      float left, float right, float front, float back);
+extern void mesh_clear(void);
+
+/* Mesh built and pa.autoLeveling is AUTO_LEVELING_MODE_MESH */
+extern bool mesh_active(void);
+
+extern float mesh_z_offset(float x, float y);
+
+/*
+ * Send the move from current to destination to the planner,
+ * split where it crosses mesh cells, z offset added.
+ */
+extern void mesh_buffer_line(const float current[NUM_AXIS], const float destination[NUM_AXIS],
+                             float feed_rate, uint8_t extruder);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
@@ -4,8 +4,10 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "eeprom.h"
 #include "parameter.h"
@@ -17,22 +19,53 @@ parameter_t pa;
 
 void parameter_dump(int (*gcode_send_response_remote)(char *));
 
-static unsigned long calculate_eeprom_param_crc(parameter_t *param)
+/*
+ * Size of the parameter_t an EEPROM holds when it was saved
+ * before delta_segment_error was added
+ */
+#define PARAM_SIZE_NO_SEGMENT_ERROR  (offsetof(parameter_t, delta_segment_error))
+
+static unsigned long calculate_eeprom_param_crc(parameter_t *param, int param_size)
 {
 	void *data = (void *)(&(param->chk_sum) + sizeof(unsigned long));
-	int size = sizeof(parameter_t) - sizeof(param->chk_sum);
+	int size = param_size - sizeof(param->chk_sum);
 
 	return data_crc(data, size);
 }
 
 static void set_eeprom_param_crc(parameter_t *param)
 {
-	 param->chk_sum = calculate_eeprom_param_crc(param);
+	 param->chk_sum = calculate_eeprom_param_crc(param, sizeof(parameter_t));
 }
 
 static unsigned long get_eeprom_param_crc(parameter_t *param)
 {
-	return calculate_eeprom_param_crc(param);
+	return calculate_eeprom_param_crc(param, sizeof(parameter_t));
+}
+
+/*
+ * pa as read from an EEPROM saved before delta_segment_error:
+ * its CRC covers PARAM_SIZE_NO_SEGMENT_ERROR bytes. The CRC has always
+ * read a few words past the layout, they are taken as 0 here.
+ * Return true and set the new fields to their defaults if it matches.
+ */
+static bool parameter_migrate_no_segment_error(void)
+{
+	union {
+		parameter_t param;
+		uint8_t data[sizeof(parameter_t) + 4 * sizeof(unsigned long)];
+	} old;
+	unsigned long crc;
+
+	memset(&old, 0, sizeof(old));
+	memcpy(&old, &pa, PARAM_SIZE_NO_SEGMENT_ERROR);
+	crc = calculate_eeprom_param_crc(&old.param, PARAM_SIZE_NO_SEGMENT_ERROR);
+	if ((crc != pa.chk_sum) || (crc == 0)) {
+		return false;
+	}
+
+	pa.delta_segment_error = DELTA_SEGMENT_ERROR;
+	return true;
 }
 
 static int eeprom_write_param(parameter_t *param)
@@ -188,6 +221,7 @@ void parameter_restore_default(void)
     pa.diagonal_rod = DELTA_DIAGONAL_ROD;
     pa.z_home_pos = MANUAL_Z_HOME_POS;
     pa.segments_per_second = DELTA_SEGMENTS_PER_SECOND;
+    pa.delta_segment_error = DELTA_SEGMENT_ERROR;
 
     pa.endstop_adjust[0] = 0.0;
     pa.endstop_adjust[1] = 0.0;
@@ -289,6 +323,10 @@ int parameter_init(char *dev)
         crc = get_eeprom_param_crc(&pa);
 		if((crc == pa.chk_sum) && (crc != 0)){
             printf("param from eeprom is ok\n");
+        } else if (parameter_migrate_no_segment_error()) {
+            /* keep the calibration, store it in the current layout */
+            printf("param from eeprom is ok, old layout updated\n");
+            parameter_save_to_eeprom();
         } else {
             printf("param use default \n");
             parameter_restore_default();
@@ -488,8 +526,8 @@ void parameter_dump(int (*gcode_send_response_remote)(char *))
         default:
             break;
     }
-    printf("---Delta Machine diagonal_rod=%f,radius=%f,available_radius=%f,z_home_pos=%f,segments_per_second=%f\n", 
-                              pa.diagonal_rod, pa.radius, pa.delta_print_radius, pa.z_home_pos, pa.segments_per_second);
+    printf("---Delta Machine diagonal_rod=%f,radius=%f,available_radius=%f,z_home_pos=%f,segments_per_second=%f,segment_error=%fum\n", 
+                              pa.diagonal_rod, pa.radius, pa.delta_print_radius, pa.z_home_pos, pa.segments_per_second, pa.delta_segment_error);
 
 	printf("---Delta deploy start location:(%f, %f, %f), end location:(%f, %f, %f)\n", 
 			pa.delta_deploy_start_location[0],	pa.delta_deploy_start_location[1], pa.delta_deploy_start_location[2],
@@ -519,7 +557,7 @@ void parameter_dump(int (*gcode_send_response_remote)(char *))
 	memset(send_buf, 0, sizeof(send_buf));
 	sprintf(send_buf, "Machine type:%s \n"
 				  "bbp1_extend_func :%d\n"	
-				  "Delta Machine diagonal_rod=%f,radius=%f,available radius=%f,z_home_pos=%f,segments_per_second=%f\n"
+				  "Delta Machine diagonal_rod=%f,radius=%f,available radius=%f,z_home_pos=%f,segments_per_second=%f,segment_error=%fum\n"
 				  "Delta Radius adjustment: %f,%f,%f\n"
 				  "Delta Diagonal rod adjustment: %f,%f,%f\n"
 				  "Delta EndStop x,y,z: %f,%f,%f\n"
@@ -538,7 +576,7 @@ void parameter_dump(int (*gcode_send_response_remote)(char *))
 				  "Extruder num:%d\n"
 				    ,machine_type
 				    ,pa.bbp1_extend_func
-					,pa.diagonal_rod, pa.radius, pa.delta_print_radius, pa.z_home_pos, pa.segments_per_second
+					,pa.diagonal_rod, pa.radius, pa.delta_print_radius, pa.z_home_pos, pa.segments_per_second, pa.delta_segment_error
 					,pa.radius_adj[0], pa.radius_adj[1], pa.radius_adj[2]
 					,pa.diagonal_rod_adj[0], pa.diagonal_rod_adj[1], pa.diagonal_rod_adj[2]
 					,pa.endstop_adj[0], pa.endstop_adj[1], pa.endstop_adj[2] 
@@ -73,6 +73,14 @@
  */
 #define DELTA_SEGMENTS_PER_SECOND  (100)
 
+/*
+ * Maximum tower position error (um) of the straight lines above.
+ * Moves are split into just enough segments to stay within it,
+ * 0 falls back to DELTA_SEGMENTS_PER_SECOND.
+ */
+#define DELTA_SEGMENT_ERROR        (10)
+#define DELTA_MAX_SEGMENTS         (1000)
+
 /*
  * Center-to-center distance of the holes in the diagonal push rods
  * mm
@@ -141,6 +149,14 @@
 #define FRONT_PROBE_BED_POSITION   (20)
 /* Set the number of grid points per dimension */
 #define AUTO_LEVELING_GRID_POINTS  (2)
+
+/* 
+ * pa.autoLeveling on xyz and corexy
+ * plane: tilt the bed by plan_bed_level_matrix
+ * mesh:  bilinear z offset over the probed grid points
+ */
+#define AUTO_LEVELING_MODE_PLANE   (1)
+#define AUTO_LEVELING_MODE_MESH    (2)
 //#else
 /* 
  * 3 arbitrary points. 
@@ -582,7 +598,7 @@ typedef struct {
 	unsigned char max_heat_pwm_hotend;
 	unsigned char max_heat_pwm_bed;
 
-	unsigned char autoLeveling; //0 for disable,  1 for enable ----! 1 for 3 point, 2 for grid --!
+	unsigned char autoLeveling; //0 for disable,  1 for enable, 2 for mesh on xyz/corexy
 	unsigned char probeDeviceType; //Proximity:0, Servo:1 
 	float endstopOffset[3];
 	float zRaiseBeforeProbing;
@@ -617,6 +633,7 @@ typedef struct {
     unsigned char bbp1s_dual_xy_mode;
     unsigned char autolevel_endstop_invert;
     float autolevel_down_rate; //autolevel down speed
+    float delta_segment_error; //um, 0 for segments_per_second
 } parameter_t;
 
 extern parameter_t pa;
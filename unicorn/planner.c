@@ -40,8 +40,11 @@
 
 #include "common.h"
 #include "parameter.h"
+#include "latency.h"
+#include "rt.h"
 #include "unicorn.h"
 #include "planner.h"
+#include "kinematics.h"
 #include "stepper.h"
 #include "stepper_pruss.h"
 
@@ -60,6 +63,17 @@ static bool thread_quit = false;
 static pthread_t planner_thread;
 extern matrix_t plan_bed_level_matrix;
 
+/*
+ * Cartesian mm to absolute steps of X, Y and Z,
+ * bed level rotation and steps per unit folded into one 3x4 transform.
+ * Rebuilt by plan_update_transform().
+ */
+static float plan_transform[3][4] = {
+    {1.0, 0.0, 0.0, 0.0},
+    {0.0, 1.0, 0.0, 0.0},
+    {0.0, 0.0, 1.0, 0.0},
+};
+
 /*
  * Public variables
  */ 
@@ -101,6 +115,13 @@ static float previous_speed[4];
 /* Nominal speed of previous path line segment */
 static float previous_nominal_speed;      
 
+/* PWM level the moves carry while scaled, see plan_queue_pwm() */
+static unsigned char sync_pwm_ctl = 0;
+static unsigned long sync_pwm_level = 0;
+
+/* Offline estimate, no planner thread, see plan_init_offline() */
+static void (*offline_take)(void) = NULL;
+
 //static float last_E_axis_steps_per_unit = 0;
 /*
  * Returns the index of the next block in the ring buffer
@@ -178,35 +199,29 @@ static void calculate_trapezoid_for_block(block_t *block, float entry_factor, fl
         final_rate = 60;
     }
 
+    /* A block never enters or leaves above its nominal rate */
+    initial_rate = min(initial_rate, block->nominal_rate);
+    final_rate   = min(final_rate, block->nominal_rate);
+
     long acceleration = block->acceleration_st;
     float distance;
     distance = estimate_acceleration_distance(initial_rate, 
                                               block->nominal_rate, 
                                               acceleration);
     int32_t accelerate_steps = ceil(distance);
-#if 0
     if (accelerate_steps < 0) {
         accelerate_steps = 0;
     }
-#endif
     distance = estimate_acceleration_distance(block->nominal_rate, 
                                               final_rate, 
                                               -acceleration);
     int32_t decelerate_steps = floor(distance);
-#if 0
     if (decelerate_steps < 0) {
         decelerate_steps = 0;
     }
-#endif
     /* Calculate the size of Plateau of Nominal Rate */
     int32_t plateau_steps = block->step_event_count - accelerate_steps - decelerate_steps;
 
-	if (decelerate_steps < 0) {
-		//printf("lkj plan  1 block->nominal_rate:%ld, final_rate:%ld, acceleration:%ld, decelerate_steps:%d \n", 
-	//				block->nominal_rate, final_rate, acceleration, decelerate_steps);
-	//	printf("lkj plan 2  plateau_steps:%u, block->step_event_count:%lu, accelerate_steps:%u, decelerate_steps:%d \n", 
-	//			plateau_steps,  block->step_event_count, accelerate_steps, decelerate_steps);
-    }
     /* Is the Plateau of Nominal Rate smaller than nothing?
      * That means no cruising, and we will have intersection_distance() to calculate 
      * when to abort acceleration and start braking in order to reach the final_rate 
@@ -425,6 +440,46 @@ static void planner_recalculate(void)
     planner_forward_pass();
     planner_recalculate_trapezoids();
 }
+/*
+ * Rebuild plan_transform,
+ * must be called when plan_bed_level_matrix, pa.autoLeveling,
+ * pa.axis_steps_per_unit or the kinematics change.
+ */
+void plan_update_transform(void)
+{
+    int i, j;
+    bool rotation = kinematics->bed_rotation && pa.autoLeveling;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            if (rotation) {
+                /* same element order as vector_apply_rotation() */
+                plan_transform[i][j] = pa.axis_steps_per_unit[i] 
+                                       * plan_bed_level_matrix.matrix[3 * j + i];
+            } else {
+                plan_transform[i][j] = (i == j) ? pa.axis_steps_per_unit[i] : 0.0;
+            }
+        }
+        plan_transform[i][3] = 0.0;
+    }
+
+    if (rotation) {
+        debug_matrix(&plan_bed_level_matrix);
+    }
+}
+
+static inline void plan_transform_steps(float x, float y, float z, long *target)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        target[i] = lround(plan_transform[i][0] * x 
+                           + plan_transform[i][1] * y 
+                           + plan_transform[i][2] * z 
+                           + plan_transform[i][3]);
+    }
+}
+
 /*
  * Add a new linear movement to the buffer.
  * x, y and z is the signed, absolute target position in millimeters.
@@ -437,36 +492,37 @@ void plan_buffer_line(float x, float y, float z, const float e,
                       float feed_rate, const uint8_t extruder)
 {
     int i;
+    uint32_t t_entry = latency_now();
 
     /* Calculate the buffer head after we push this byte */
     int next_buffer_head = next_block_index(block_buffer_head);
 
     /* FIXME: here!!!!!!! */
-    while (block_buffer_tail == next_buffer_head) {
-        /* waste so many cpu resource here */
-        usleep(10);
-        if (stop) {
-            break;
+    if (block_buffer_tail == next_buffer_head) {
+        FTRACE_BEGIN("plan_full");
+        while (block_buffer_tail == next_buffer_head) {
+            if (offline_take) {
+                offline_take();
+                continue;
+            }
+            /* waste so many cpu resource here */
+            usleep(10);
+            if (stop) {
+                break;
+            }
         }
+        FTRACE_END();
     }
 
     if (stop) {
         return;
     }
 
-	if ((pa.machine_type != MACHINE_DELTA) && pa.autoLeveling) {
-        apply_rotation_xyz(plan_bed_level_matrix, &x, &y, &z);  
-		debug_matrix(&plan_bed_level_matrix);
-    }
-
-
     /*---------------------------------------------------------
      * 1. Calculate the target position in absolute steps 
      ---------------------------------------------------------*/
     long target[4];
-    target[X_AXIS] = lround(x * pa.axis_steps_per_unit[X_AXIS]);
-    target[Y_AXIS] = lround(y * pa.axis_steps_per_unit[Y_AXIS]);
-    target[Z_AXIS] = lround(z * pa.axis_steps_per_unit[Z_AXIS]);
+    plan_transform_steps(x, y, z, target);
     target[E_AXIS] = lround(e * pa.axis_steps_per_unit[E_AXIS + extruder]);
     
     /* Prepare to set up new block */
@@ -476,14 +532,17 @@ void plan_buffer_line(float x, float y, float z, const float e,
     /* Mark block as not busy, (Not executed by the stepper thread) */
     block->busy = false;
 	block->type = BLOCK_G_CMD;
+    block->pwm_ctl = sync_pwm_ctl;
+    block->fan_speed = sync_pwm_level;
 
-	if (pa.machine_type == MACHINE_COREXY) {
-        block->steps_x = labs((target[X_AXIS] - position[X_AXIS]) + (target[Y_AXIS] - position[Y_AXIS]));
-        block->steps_y = labs((target[X_AXIS] - position[X_AXIS]) - (target[Y_AXIS] - position[Y_AXIS]));
-    } else {
-        block->steps_x = labs(target[X_AXIS] - position[X_AXIS]);
-        block->steps_y = labs(target[Y_AXIS] - position[Y_AXIS]);
-    }
+    /* Motor steps of X and Y, differs from target for corexy */
+    long motor_x, motor_y;
+    kinematics->motor_steps(target[X_AXIS] - position[X_AXIS],
+                            target[Y_AXIS] - position[Y_AXIS],
+                            &motor_x, &motor_y);
+
+    block->steps_x = labs(motor_x);
+    block->steps_y = labs(motor_y);
     
     block->steps_z = labs(target[Z_AXIS] - position[Z_AXIS]);
 	{
@@ -503,6 +562,7 @@ void plan_buffer_line(float x, float y, float z, const float e,
     if (block->step_event_count <= dropsegments) {
         return;
     }
+    latency_block_planned(block, t_entry);
     
     /*---------------------------------------------------------
      * 2. Compute direction bits for this block 
@@ -511,20 +571,11 @@ void plan_buffer_line(float x, float y, float z, const float e,
      ---------------------------------------------------------*/
     block->direction_bits = 0;
 
-	if (pa.machine_type == MACHINE_COREXY) {
-        if ((target[X_AXIS] - position[X_AXIS]) + (target[Y_AXIS] - position[Y_AXIS]) < 0) { 
-            block->direction_bits |= (1 << X_AXIS);
-        }
-        if ((target[X_AXIS] - position[X_AXIS]) - (target[Y_AXIS] - position[Y_AXIS]) < 0) {
-            block->direction_bits |= (1 << Y_AXIS);
-        }
-    } else {
-        if (target[X_AXIS] < position[X_AXIS]) {
-            block->direction_bits |= (1 << X_AXIS);
-        }
-        if (target[Y_AXIS] < position[Y_AXIS]) {
-            block->direction_bits |= (1 << Y_AXIS);
-        }
+    if (motor_x < 0) {
+        block->direction_bits |= (1 << X_AXIS);
+    }
+    if (motor_y < 0) {
+        block->direction_bits |= (1 << Y_AXIS);
     }
 
     if (target[Z_AXIS] < position[Z_AXIS]) {
@@ -552,15 +603,8 @@ void plan_buffer_line(float x, float y, float z, const float e,
     
     float delta_mm[4];
 
-	if (pa.machine_type == MACHINE_COREXY) {
-        delta_mm[X_AXIS] = ((target[X_AXIS] - position[X_AXIS]) + (target[Y_AXIS] - position[Y_AXIS]))
-            / pa.axis_steps_per_unit[X_AXIS];
-        delta_mm[Y_AXIS] = ((target[X_AXIS] - position[X_AXIS]) - (target[Y_AXIS] - position[Y_AXIS]))
-            / pa.axis_steps_per_unit[Y_AXIS];
-    } else {
-        delta_mm[X_AXIS] = (target[X_AXIS] - position[X_AXIS]) / pa.axis_steps_per_unit[X_AXIS];
-        delta_mm[Y_AXIS] = (target[Y_AXIS] - position[Y_AXIS]) / pa.axis_steps_per_unit[Y_AXIS];
-    }
+    delta_mm[X_AXIS] = motor_x / pa.axis_steps_per_unit[X_AXIS];
+    delta_mm[Y_AXIS] = motor_y / pa.axis_steps_per_unit[Y_AXIS];
     
     delta_mm[Z_AXIS] = (target[Z_AXIS] - position[Z_AXIS]) / pa.axis_steps_per_unit[Z_AXIS];
     delta_mm[E_AXIS] = ((target[E_AXIS] - position[E_AXIS]) / pa.axis_steps_per_unit[E_AXIS + block->active_extruder])
@@ -750,10 +794,13 @@ void plan_buffer_line(float x, float y, float z, const float e,
     memcpy(position, target, sizeof(target));
 	//last_E_axis_steps_per_unit = pa.axis_steps_per_unit[E_AXIS + extruder];
 
+    FTRACE_BEGIN("plan_recalculate");
     planner_recalculate();
+    FTRACE_END();
 	
     /* Move buffer head */
     block_buffer_head = next_buffer_head;
+    FTRACE_COUNTER("plan_blocks", plan_get_block_size());
 }
 
 
@@ -765,13 +812,7 @@ extern volatile unsigned char active_extruder;
  */
 void plan_set_position(float x, float y, float z, const float e)
 {
-	if ((pa.machine_type != MACHINE_DELTA) && pa.autoLeveling) {
-        apply_rotation_xyz(plan_bed_level_matrix, &x, &y, &z);
-    }
-
-    position[X_AXIS] = lround(x * pa.axis_steps_per_unit[X_AXIS]); 
-    position[Y_AXIS] = lround(y * pa.axis_steps_per_unit[Y_AXIS]); 
-    position[Z_AXIS] = lround(z * pa.axis_steps_per_unit[Z_AXIS]); 
+    plan_transform_steps(x, y, z, position);
     position[E_AXIS] = lround(e * pa.axis_steps_per_unit[E_AXIS + active_extruder]); 
 
     /* Reset planner junction speeds. Assume start from rest */ 
@@ -784,18 +825,12 @@ void plan_set_position(float x, float y, float z, const float e)
 
 void plan_set_position_no_delta_autolevel(float x, float y, float z, const float e)
 {
-	if ((pa.machine_type != MACHINE_DELTA) && pa.autoLeveling) {
-        apply_rotation_xyz(plan_bed_level_matrix, &x, &y, &z);
-    }
-
-    position[X_AXIS] = lround(x * pa.axis_steps_per_unit[X_AXIS]); 
-    position[Y_AXIS] = lround(y * pa.axis_steps_per_unit[Y_AXIS]); 
-    position[Z_AXIS] = lround(z * pa.axis_steps_per_unit[Z_AXIS]); 
+    plan_transform_steps(x, y, z, position);
     position[E_AXIS] = lround(e * pa.axis_steps_per_unit[E_AXIS + active_extruder]); 
 
-	stepper_set_position(lround(x * pa.axis_steps_per_unit[X_AXIS]),
-			lround(y * pa.axis_steps_per_unit[Y_AXIS]),
-			lround(z * pa.axis_steps_per_unit[Z_AXIS]),
+	stepper_set_position(position[X_AXIS],
+			position[Y_AXIS],
+			position[Z_AXIS],
 			lround(e * pa.axis_steps_per_unit[E_AXIS]));
 
     /* Reset planner junction speeds. Assume start from rest */ 
@@ -860,6 +895,7 @@ void *planner_thread_worker(void *arg)
         Pause_test(hPause_printing);
     }
 
+    FTRACE_THREAD("planner");
     printf("[plan]: start up planner thread\n");
     while (!thread_quit) {
         //TODO: Blocking exit, Get all block from buffer
@@ -871,10 +907,14 @@ void *planner_thread_worker(void *arg)
         /* Get available block from stepper */
         plan_block = plan_get_current_block();
         if (plan_block) {
+            /* Wait for the stepper thread to give a block back */
+            FTRACE_BEGIN("fifo_st2plan");
             ret = Fifo_get(hFifo_st2plan, (void **)&st_block);
+            FTRACE_END();
             if (ret == 0 && st_block) {
                 /* get block from gcode thread */
                 memcpy(st_block, plan_block, sizeof(block_t));
+                latency_block_fifo(st_block);
 
                 /* Put stepper block to stepper thread */ 
                 ret = Fifo_put(hFifo_plan2st, st_block);
@@ -886,6 +926,7 @@ void *planner_thread_worker(void *arg)
 
                 /* Discard current block */
                 plan_discard_current_block();
+                FTRACE_COUNTER("plan_blocks", plan_get_block_size());
 
                 /* Put planner block back to gcode */
                 plan_block = NULL;
@@ -901,17 +942,14 @@ void *planner_thread_worker(void *arg)
     //pthread_exit(NULL);
 }
 
-void put_mcode_to_fifo()
+static void put_cmd_to_fifo(block_t *cmd_block)
 {
     int ret = 0;
-    block_t mcode_block = {0};
     block_t *st_block = NULL;
 
-	mcode_block.type = BLOCK_M_CMD;
-
 	ret = Fifo_get(hFifo_st2plan, (void **)&st_block);
 	if (ret == 0 && st_block) {
-		memcpy(st_block, &mcode_block, sizeof(block_t));
+		memcpy(st_block, cmd_block, sizeof(block_t));
 
 		ret = Fifo_put(hFifo_plan2st, st_block);
 		if (ret != 0) {
@@ -924,22 +962,56 @@ void put_mcode_to_fifo()
 	} 
 }
 
+void put_mcode_to_fifo()
+{
+    block_t mcode_block = {0};
+
+	mcode_block.type = BLOCK_M_CMD;
+    put_cmd_to_fifo(&mcode_block);
+}
+
+void plan_queue_pwm(uint8_t out, unsigned long level, bool scale)
+{
+    block_t pwm_block = {0};
+
+    pwm_block.type = BLOCK_PWM_CMD;
+    pwm_block.pwm_ctl = BLOCK_PWM_EVENT | (out & BLOCK_PWM_OUT_MASK);
+    pwm_block.fan_speed = level;
+
+    /* after every move buffered before it */
+    while (plan_get_block_size() > 0 && !stop && !thread_quit) {
+        if (offline_take) {
+            offline_take();
+        } else {
+            usleep(1000);
+        }
+    }
+    put_cmd_to_fifo(&pwm_block);
+
+    if (scale && level > 0) {
+        sync_pwm_ctl = BLOCK_PWM_EVENT | BLOCK_PWM_SCALE | (out & BLOCK_PWM_OUT_MASK);
+        sync_pwm_level = level;
+    } else if ((sync_pwm_ctl & BLOCK_PWM_OUT_MASK) == (out & BLOCK_PWM_OUT_MASK)) {
+        sync_pwm_ctl = 0;
+        sync_pwm_level = 0;
+    }
+}
+
 
 /*
  * Init the planner sub system
  */
-int plan_init(void)
+static void plan_reset(void)
 {
     int i;
-    int ret;
-    pthread_attr_t attr;
-    //struct sched_param sched;
 
     for (i = 0; i < NUM_AXIS; i++) {
         axis_steps_per_sqr_second[i] = pa.max_acceleration_units_per_sq_second[i] 
                                        * pa.axis_steps_per_unit[i];
     }
 
+    plan_update_transform();
+
     /* clear position */
     position[X_AXIS] = 0;
     position[Y_AXIS] = 0;
@@ -955,34 +1027,22 @@ int plan_init(void)
     previous_speed[3] = 0.0;
     
     previous_nominal_speed = 0.0;
+}
 
-    /* Initial the pthread attribute */
-    if (pthread_attr_init(&attr)) {
-        return -1;
-    }
+int plan_init(void)
+{
+    int ret;
 
-    /* Force the thread to use custom scheduling attributes  */
-	#if 0 //for android
-    if (pthread_attr_setschedpolicy(&attr, PTHREAD_EXPLICIT_SCHED)) {
-        return -1;
-    }
-    sched.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    plan_reset();
 
-    printf("sched_priority max: %d, min %d\n", 
-            sched.sched_priority,
-            sched_get_priority_min(SCHED_FIFO));
-    if (pthread_attr_setschedparam(&attr, &sched)) {
-        return -1;
-    }
-	#endif 
-    
+    rt_prefault(block_buffer, sizeof(block_buffer));
 
     if (thread_quit) {
         thread_quit = false;
     }
 
     printf("--- Creating planner_thread..."); 
-    ret = pthread_create(&planner_thread, &attr, planner_thread_worker, NULL);
+    ret = rt_thread_create(RT_PLANNER, &planner_thread, planner_thread_worker, NULL);
     if (ret) {
         printf("create planner thread failed with ret %d\n", ret);
         return -1;
@@ -992,6 +1052,22 @@ int plan_init(void)
 
     return 0;
 }
+/*
+ * Init the planner without its thread, for the offline estimate.
+ * take is called where the gcode thread would wait for the planner
+ * thread, it must take at least one block from the buffer.
+ */
+int plan_init_offline(void (*take)(void))
+{
+    if (!take) {
+        return -1;
+    }
+
+    plan_reset();
+    offline_take = take;
+    thread_quit = false;
+    return 0;
+}
 /*
  * Delete the planner sub system
  */
@@ -5,6 +5,8 @@
 #ifndef _PLANNER_H
 #define _PLANNER_H
 
+#include <stdint.h>
+
 extern unsigned long minsegmenttime;
 
 extern unsigned long axis_steps_per_sqr_second[];
@@ -34,9 +36,15 @@ extern unsigned char is_homing;
  * if acceleration management is active.
  */
 
+#define BLOCK_PWM_CMD   1<<2
 #define BLOCK_M_CMD   	1<<1
 #define BLOCK_G_CMD   	1<<0
 #define BLOCK_NONE_CMD  0
+
+/* pwm_ctl, PWM output the PRU writes at the block start */
+#define BLOCK_PWM_EVENT     (1 << 7)
+#define BLOCK_PWM_SCALE     (1 << 6)    /* fan_speed scaled with the step rate */
+#define BLOCK_PWM_OUT_MASK  (0x3)
 typedef struct {
     unsigned char type; //M gcmd = 1, other is 0
     /* Fields used by the bresenham algorithm for the tracing the line */
@@ -65,8 +73,14 @@ typedef struct {
     unsigned long initial_rate;        // The jerk-adjusted step rate at start of blcok
     unsigned long final_rate;          // The minimal rate at exit
     unsigned long acceleration_st;     // Acceleration step/sec^2
-    unsigned long fan_speed;
+    unsigned long fan_speed;           // PWM level [0, 100] of pwm_ctl
+    unsigned char pwm_ctl;
     volatile char busy;
+
+    /* Stamps of latency.c, us */
+    uint32_t t_read;                   // gcode read
+    uint32_t t_plan;                   // plan_buffer_line
+    uint32_t t_fifo;                   // Fifo to the stepper thread
 } block_t;
 
 #if defined (__cplusplus)
@@ -76,6 +90,7 @@ extern "C" {
  * Initialize and delete the motion plan subsystem
  */
 extern int  plan_init(void);
+extern int  plan_init_offline(void (*take)(void));
 extern void plan_exit(void);
 /*
  * Stop Planner
@@ -108,7 +123,13 @@ extern int plan_get_block_size(void);
 extern void plan_set_position(float x, float y, float z, const float e);
 extern void plan_set_position_no_delta_autolevel(float x, float y, float z, const float e);
 extern void plan_set_e_position(const float e);
+extern void plan_update_transform(void);
 extern void put_mcode_to_fifo();
+/*
+ * Queue a PWM level [0, 100] of a stepper PWM out,
+ * with scale it follows the step rate of the moves after it
+ */
+extern void plan_queue_pwm(uint8_t out, unsigned long level, bool scale);
 
 #if defined (__cplusplus)
 }
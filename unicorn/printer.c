@@ -25,11 +25,20 @@
 
 #include "gcode.h"
 #include "unicorn.h"
+#include "pruss.h"
+#include "stepper.h"
+#include "estimate.h"
+#include "ftrace.h"
+#include "rt.h"
 
 static int mode = FW_MODE_REMOTE;
 static int debug_log = 0;
 static char *file = NULL;
 static FILE *fp = NULL;
+static char *estimate = NULL;
+static float cpu_scale = 1.0;
+static bool trace = false;
+static char *priorities = NULL;
 
 static bool quit = false;
 static bool stop = false;
@@ -70,6 +79,12 @@ static void usage(void)
             "-i | --input    gcode input file\n"
             "-t | --test     auto test mode\n"
             "-d | --debug    set debug log level\n"
+            "-s | --split    step the extruders on PRU1 (bbp1s)\n"
+            "-S | --sched    exact per axis step schedule on the PRU\n"
+            "-e | --estimate print time of a gcode file, without printing\n"
+            "-c | --cpu      cpu of the board is this much slower, for -e\n"
+            "-T | --trace    timeline markers to the ftrace trace_marker\n"
+            "-P | --prio     SCHED_FIFO priorities, stepper=80,heater=50,... or off\n"
             "-h | --help     Print this message\n"
            );
 }
@@ -79,11 +94,17 @@ static void parse_args(int argc, char *argv[])
     int c;
     int index; 
     
-    const char short_option[] = "i:td:h";
+    const char short_option[] = "i:td:sSe:c:TP:h";
     const struct option long_option[] = {
         {"input",   required_argument, NULL, 'i'},
         {"test",    no_argument,       NULL, 't'},
         {"debug",   required_argument, NULL, 'd'},
+        {"split",   no_argument,       NULL, 's'},
+        {"sched",   no_argument,       NULL, 'S'},
+        {"estimate", required_argument, NULL, 'e'},
+        {"cpu",     required_argument, NULL, 'c'},
+        {"trace",   no_argument,       NULL, 'T'},
+        {"prio",    required_argument, NULL, 'P'},
         {"help",    no_argument,       NULL, 'h'},
         {0,0,0,0},
     };
@@ -110,6 +131,32 @@ static void parse_args(int argc, char *argv[])
                 debug_log = atoi(optarg);
                 break;
 
+            case 's':
+                printf("PRU: extruders on PRU1\n");
+                pruss_set_split_extruder(true);
+                break;
+
+            case 'S':
+                printf("PRU: step schedule\n");
+                stepper_set_sched(true);
+                break;
+
+            case 'e':
+                estimate = optarg;
+                break;
+
+            case 'c':
+                cpu_scale = atof(optarg);
+                break;
+
+            case 'T':
+                trace = true;
+                break;
+
+            case 'P':
+                priorities = optarg;
+                break;
+
             case 'h':
                 usage();
                 exit(1);
@@ -346,15 +393,14 @@ int control_init(void)
 {
     int ret = 0;
     printf("Create control thread\n");
-    ret = sub_sys_thread_create("control", 
-                                &control_thread, 
-                                NULL, 
-                                &control_thread_worker, 
-                                NULL);
+    COMM_DBG("--- Creating control_thread..."); 
+    ret = rt_thread_create(RT_CONTROL, &control_thread, control_thread_worker, NULL);
     if (ret) {
         printf("create control thread err\n");
         ret = -1;
-    } 
+    } else {
+        COMM_DBG("done ---\n");
+    }
 
     return ret;
 }
@@ -522,6 +568,11 @@ int main(int argc, char *argv[])
 {
     printf("Unicron: 3D printer firmware\n");
     parse_args(argc, argv);
+
+    /* Nothing of the hardware is touched */
+    if (estimate) {
+        exit(estimate_file(estimate, cpu_scale) < 0 ? 1 : 0);
+    }
     
     /* Check mode validity */
     if (mode <= FW_MODE_MIN || mode >= FW_MODE_MAX) {
@@ -550,6 +601,17 @@ int main(int argc, char *argv[])
 
     sys_init();
 
+    /* Before the threads and the buffers of unicorn_init */
+    if (priorities && rt_set_priorities(priorities) < 0) {
+        usage();
+        exit(1);
+    }
+    rt_init();
+
+    if (trace) {
+        ftrace_init();
+    }
+
 	if (mode != FW_MODE_REMOTE) {
     	control_init();
 	}
@@ -584,6 +646,7 @@ int main(int argc, char *argv[])
     }
 
     unicorn_exit(quit_blocking);
+    ftrace_exit();
     
     if (mode == FW_MODE_LOCAL) {
         if (fp) {
@@ -4,7 +4,12 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include <prussdrv.h>
 #include <pruss_intc_mapping.h>
@@ -13,6 +18,8 @@
 #include "pruss.h"
 #include "common.h"
 #include "eeprom.h"
+#include "stepper_pruss.h"
+#include "kinematics.h"
 
 #define LOAD_PRU_BIN
 #define PRU_BIN_PATH "/.octoprint/pruss_unicorn.bin"
@@ -21,7 +28,262 @@
 #include "./build/target/bin/bbp1_bin.h"
 #include "./build/target/bin/bbp1s_bin.h"
 //#endif
+#include "./build/target/bin/bbp1s_pru1_bin.h"
+#include "./build/target/bin/sched_bin.h"
+#include "./build/target/bin/pru_images.h"
 
+/*
+ * Step loops specialized for one machine setup by pruss/gen_images.sh,
+ * -1 matches any value, the generic image is used if none matches.
+ */
+struct pru_image {
+    int board;
+    int machine_type;
+    int extend_func;
+    int motor56_mode;
+    int ext_count;
+    int split;
+    const unsigned int *code;
+    unsigned int size;
+};
+
+#define PRU_IMAGE(board, machine_type, extend_func, motor56_mode, ext_count, split, array) \
+    { board, machine_type, extend_func, motor56_mode, ext_count, split, array, sizeof(array) },
+
+static const struct pru_image pru_images[] = {
+    PRU_IMAGES
+};
+
+/* code in IRAM, NULL when loaded from eeprom */
+static const unsigned int *pru_code = NULL;
+
+/* extruders stepped by PRU1, if the setup has a split image */
+static bool split_extruder = false;
+static bool pru1_running = false;
+
+/* step schedule backend, pruss_sched.p on PRU0 */
+static bool sched_mode = false;
+
+/* wakes every pruss_event_wait() for shutdown */
+static int wake_fd = -1;
+
+static inline bool pru_image_match(int value, int want)
+{
+    return (value == -1) || (value == want);
+}
+
+static const struct pru_image *pruss_find_image(int split)
+{
+    int i;
+    const struct pru_image *image;
+
+    for (i = 0; i < sizeof(pru_images) / sizeof(pru_images[0]); i++) {
+        image = &pru_images[i];
+
+        if (image->board == bbp_board_type
+                && image->split == split
+                && image->machine_type == kinematics->type
+                && pru_image_match(image->extend_func, pa.bbp1_extend_func)
+                && pru_image_match(image->motor56_mode, pa.bbp1s_dual_xy_mode)
+                && pru_image_match(image->ext_count, pa.ext_count)) {
+            return image;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Specialized image for the current parameters, else the generic one.
+ * A split image is only taken when asked for, *split tells the caller.
+ */
+static const unsigned int *pruss_select_code(unsigned int *size, bool *split)
+{
+    const struct pru_image *image = NULL;
+
+    *split = false;
+    if (sched_mode) {
+        *size = sizeof(SCHED_array);
+        return SCHED_array;
+    }
+
+    if (split_extruder) {
+        image = pruss_find_image(1);
+        if (image) {
+            *split = true;
+        } else {
+            printf("[pruss]: no split image for this setup, extruders stay on PRU0\n");
+        }
+    }
+    if (!image) {
+        image = pruss_find_image(0);
+    }
+
+    if (image) {
+        *size = image->size;
+        return image->code;
+    }
+
+    if (bbp_board_type == BOARD_BBP1) {
+        *size = sizeof(BBP1_array);
+        return BBP1_array;
+    } else if (bbp_board_type == BOARD_BBP1S) {
+        *size = sizeof(BBP1S_array);
+        return BBP1S_array;
+    }
+
+    return NULL;
+}
+
+/* PRU0 and PRU1 must be disabled */
+static int pruss_write_code(const unsigned int *code, unsigned int size, bool split)
+{
+    if (!code) {
+        printf("[pruss]: no image for board %d\n", bbp_board_type);
+        return -1;
+    }
+
+    COMM_DBG("[pruss]: loading %d words\n", size / 4);
+    prussdrv_pru_write_memory(PRUSS0_PRU0_IRAM, 0, code, size);
+    pru_code = code;
+
+    if (split) {
+        COMM_DBG("[pruss]: loading %d words to PRU1\n", (int)(sizeof(BBP1S_PRU1_array) / 4));
+        prussdrv_pru_write_memory(PRUSS0_PRU1_IRAM, 0, BBP1S_PRU1_array,
+                                  sizeof(BBP1S_PRU1_array));
+    }
+    pru1_running = split;
+
+    return 0;
+}
+
+/*
+ * The specialized images decode compact queue elements,
+ * the generic ones and an eeprom image take wide elements only
+ */
+bool pruss_compact_queue(void)
+{
+    return pru_code && !sched_mode
+        && pru_code != BBP1_array && pru_code != BBP1S_array;
+}
+
+void pruss_set_split_extruder(bool split)
+{
+    split_extruder = split;
+}
+
+void pruss_set_sched_mode(bool sched)
+{
+    sched_mode = sched;
+}
+
+/*
+ * PRU0 events for waiting threads.
+ * Every handle reads its own open of the uio device, so each waiter
+ * sees every event no matter which thread re-enables the interrupt.
+ */
+struct pruss_event {
+    int epfd;
+    int fd;
+};
+
+pruss_event_t *pruss_event_open(void)
+{
+    char path[32];
+    struct epoll_event ev;
+    pruss_event_t *pe;
+
+    pe = calloc(1, sizeof(*pe));
+    if (!pe) {
+        return NULL;
+    }
+
+    pe->epfd = epoll_create(2);
+    if (pe->epfd < 0) {
+        perror("[pruss]: epoll_create");
+        free(pe);
+        return NULL;
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", prussdrv_pru_event_fd(PRU_EVTOUT_0));
+    pe->fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (pe->fd < 0) {
+        perror("[pruss]: open event fd");
+        close(pe->epfd);
+        free(pe);
+        return NULL;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = pe->fd;
+    epoll_ctl(pe->epfd, EPOLL_CTL_ADD, pe->fd, &ev);
+
+    if (wake_fd >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.fd = wake_fd;
+        epoll_ctl(pe->epfd, EPOLL_CTL_ADD, wake_fd, &ev);
+    }
+
+    return pe;
+}
+
+void pruss_event_close(pruss_event_t *pe)
+{
+    if (!pe) {
+        return;
+    }
+    close(pe->fd);
+    close(pe->epfd);
+    free(pe);
+}
+
+/*
+ * Return 1 on a PRU event, 0 on timeout, -1 if woken up to exit.
+ */
+int pruss_event_wait(pruss_event_t *pe, int timeout_ms)
+{
+    struct epoll_event ev[2];
+    uint32_t count;
+    int i, n;
+    int ret = 0;
+
+    if (!pe) {
+        usleep(timeout_ms * 1000);
+        return 0;
+    }
+
+    n = epoll_wait(pe->epfd, ev, 2, timeout_ms);
+    for (i = 0; i < n; i++) {
+        if (ev[i].data.fd == wake_fd) {
+            return -1;
+        }
+        if (read(pe->fd, &count, sizeof(count)) == sizeof(count)) {
+            prussdrv_pru_clear_event(PRU_EVTOUT_0, PRU0_ARM_INTERRUPT);
+        }
+        ret = 1;
+    }
+
+    return ret;
+}
+
+void pruss_event_wake(bool wake)
+{
+    uint64_t val = 1;
+
+    if (wake_fd < 0) {
+        return;
+    }
+    if (wake) {
+        if (write(wake_fd, &val, sizeof(val)) < 0) {
+            perror("[pruss]: wake");
+        }
+    } else {
+        /* drain, non-blocking */
+        if (read(wake_fd, &val, sizeof(val)) < 0) {
+            val = 0;
+        }
+    }
+}
 
 /*
  * pruss drver interface
@@ -46,6 +308,11 @@ int pruss_init(void)
     }
 #endif
     prussdrv_pruintc_init(&intc_initdata);    
+
+    wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        perror("[pruss]: eventfd");
+    }
     
     /* Clean up DRAM */
 #if 0
@@ -60,17 +327,18 @@ int pruss_init(void)
 	COMM_DBG("parameter crc:%lu, eeprom pru crc:%lu \n", 
             pa.pru_checksum, pru_checksum);
 
-	if ((pa.pru_checksum == pru_checksum) && (pru_checksum != 0)) {
+	if ((pa.pru_checksum == pru_checksum) && (pru_checksum != 0) && !sched_mode) {
 		printf("PRU loading from eprom:%s \n", PRU_BIN_PATH);
 		prussdrv_exec_program(PRU_NUM, PRU_BIN_PATH);
 	} else {
     	printf("error,%s not exist, PRU loading default config \n", PRU_BIN_PATH);
 
-		if(bbp_board_type == BOARD_BBP1){
-			prussdrv_pru_write_memory(PRUSS0_PRU0_IRAM, 0, BBP1_array, sizeof(BBP1_array));
-		} else if(bbp_board_type == BOARD_BBP1S){
-			prussdrv_pru_write_memory(PRUSS0_PRU0_IRAM, 0, BBP1S_array, sizeof(BBP1S_array));
-		}
+		const unsigned int *code;
+		unsigned int size = 0;
+		bool split = false;
+
+		code = pruss_select_code(&size, &split);
+		pruss_write_code(code, size, split);
 	}
 
 #if 0
@@ -87,23 +355,75 @@ int pruss_init(void)
     return 0;
 }
 
+/*
+ * Switch to the image for changed machine parameters,
+ * the PRU restarts from INIT on the next enable.
+ * Return 1 if the image was reloaded.
+ */
+int pruss_update_code(void)
+{
+    const unsigned int *code;
+    unsigned int size = 0;
+    bool split = false;
+
+    /* keep the eeprom image */
+    if (!pru_code) {
+        return 0;
+    }
+
+    code = pruss_select_code(&size, &split);
+    if (code == pru_code) {
+        return 0;
+    }
+
+    printf("[pruss]: machine setup changed, reloading PRU image\n");
+    prussdrv_pru_disable(PRU_NUM);
+    prussdrv_pru_disable(PRU1_NUM);
+    if (pruss_write_code(code, size, split) < 0) {
+        return -1;
+    }
+    prussdrv_pru_reset(PRU_NUM);
+    prussdrv_pru_reset(PRU1_NUM);
+
+    return 1;
+}
+
 void pruss_exit(void)
 {
     prussdrv_pru_disable(PRU_NUM);
+    prussdrv_pru_disable(PRU1_NUM);
     prussdrv_exit();
+
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
 }
 
 int pruss_reset(void)
 {
+    if (pru1_running) {
+        prussdrv_pru_reset(PRU1_NUM);
+    }
     return prussdrv_pru_reset(PRU_NUM);
 }
 
 int pruss_disable(void)
 {
+    if (pru1_running) {
+        prussdrv_pru_disable(PRU1_NUM);
+    }
     return prussdrv_pru_disable(PRU_NUM);
 }
 
+/*
+ * PRU1 first, it takes the block number in shared RAM
+ * as its start point before PRU0 hands over a block.
+ */
 int pruss_enable(void)
 {
+    if (pru1_running) {
+        prussdrv_pru_enable(PRU1_NUM);
+    }
     return prussdrv_pru_enable(PRU_NUM);
 }
@@ -6,8 +6,12 @@
 #define _PRUSS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define PRU_NUM		(0)
+#define PRU1_NUM	(1)
+
+typedef struct pruss_event pruss_event_t;
 
 #if defined (__cplusplus)
 extern "C" {
@@ -16,6 +20,28 @@ extern "C" {
 extern int pruss_init(void);
 extern void pruss_exit(void);
 
+/* Reload the PRU image if machine type or extruder setup changed */
+extern int pruss_update_code(void);
+
+/* Step the extruders on PRU1, takes effect on the next image load */
+extern void pruss_set_split_extruder(bool split);
+
+/* Run pruss_sched.p instead of the queue images, before pruss_init */
+extern void pruss_set_sched_mode(bool sched);
+
+/* The loaded image decodes struct queue_element_compact */
+extern bool pruss_compact_queue(void);
+
+/*
+ * PRU0 events, one handle per waiting thread.
+ * pruss_event_wait returns 1 on an event, 0 on timeout
+ * and -1 while pruss_event_wake(true) is in effect.
+ */
+extern pruss_event_t *pruss_event_open(void);
+extern void pruss_event_close(pruss_event_t *pe);
+extern int pruss_event_wait(pruss_event_t *pe, int timeout_ms);
+extern void pruss_event_wake(bool wake);
+
 extern int pruss_reset(void);
 extern int pruss_disable(void);
 extern int pruss_enable(void);
@@ -16,6 +16,8 @@
 //------------------------------------------------------------
 #include "../pruss_unicorn.hp"
 
+;; r29.w2 is reserved in gExtendParameter, r30 drives outputs
+.setcallreg r29.w2
 .origin 0
 .entrypoint INIT
 
@@ -48,6 +50,11 @@ INIT:
     MOV     r1, CTPPR_1
     ST32    r0, r1
 
+#ifdef FW_PRU_STATS
+    MOV  r0, STATS_MAGIC
+    SBCO r0, CONST_PRUSHAREDRAM, STATS_MAGIC_OFF, 4
+#endif
+
     ;; Queue address in PRU memory
     MOV r2, 0
 
@@ -76,10 +83,13 @@ MAIN:
     ADD  r0, r0, 48
     LBCO gExtendParameter, CONST_PRUDRAM, r0, SIZE(gExtendParameter)
 
+#ifndef FW_MACHINE_FIXED
     QBEQ MAIN_DUAL_Z,   gExtendParameter.machine_type, MACHINE_XYZ
     QBEQ MAIN_COREXY,   gExtendParameter.machine_type, MACHINE_COREXY 
     QBEQ MAIN_DELTA,    gExtendParameter.machine_type, MACHINE_DELTA   
+#endif
 
+#ifdef FW_HAS_XYZ
 ;;--------------------------------------
 MAIN_DUAL_Z:
     MOV  r0, QUEUE_SIZE
@@ -111,7 +121,9 @@ NEXT_DUAL_Z_5:
     QBEQ UNLOAD_FILAMENT_STEP,   r1, UNLOAD_FILAMENT
 
     JMP MAIN
+#endif
 
+#ifdef FW_HAS_DELTA
 ;;--------------------------------------
 MAIN_DELTA:
     MOV  r0, QUEUE_SIZE
@@ -143,7 +155,9 @@ NEXT_DELTA_5:
     QBEQ UNLOAD_FILAMENT_STEP,   r1, UNLOAD_FILAMENT
 
     JMP MAIN
+#endif
 
+#ifdef FW_HAS_COREXY
 ;;--------------------------------------
 MAIN_COREXY:
     MOV  r0, QUEUE_SIZE
@@ -175,6 +189,7 @@ NEXT_COREXY_5:
     QBEQ UNLOAD_FILAMENT_STEP,   r1, UNLOAD_FILAMENT
 
     JMP MAIN
+#endif
 
 ;;------------------------------------------------------------
 ;; Filament 
@@ -195,8 +210,10 @@ LOAD_FILAMENT_STEP:
     ;; dir 
     LBBO r1, r6, 4, 4  ;;GPIO2_DATAOUT
     UpdateDir r1, r10, r3, AXIS_E, DIR_E
-    QBNE LOAD_FILAMENT_NOT_EXTRUDER_1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER  
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder LOAD_FILAMENT_NOT_EXTRUDER_1
         UpdateDir r1, r10, r3, AXIS_E, DIR_E2
+    #endif
 LOAD_FILAMENT_NOT_EXTRUDER_1:
 
     SBBO r1, r6, 4, 4
@@ -206,16 +223,20 @@ LOAD_FILAMENT_NOT_EXTRUDER_1:
     LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
 
     SET r0, STEP_E
-    QBNE LOAD_FILAMENT_NOT_EXTRUDER_2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER  
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder LOAD_FILAMENT_NOT_EXTRUDER_2
         SET r0, STEP_E2
+    #endif
 LOAD_FILAMENT_NOT_EXTRUDER_2:
     SBBO r0, r5, 4, 4
 
     DELAY_NS r3
 
     CLR r0, STEP_E
-    QBNE LOAD_FILAMENT_NOT_EXTRUDER_3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER  
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder LOAD_FILAMENT_NOT_EXTRUDER_3
         CLR r0, STEP_E2
+    #endif
 LOAD_FILAMENT_NOT_EXTRUDER_3:
     SBBO r0, r5, 4, 4
 
@@ -235,8 +256,10 @@ UNLOAD_FILAMENT_STEP:
     ;; dir 
     LBBO r1, r6, 4, 4  ;;GPIO2_DATAOUT
     UpdateDir r1, r10, r3, AXIS_E, DIR_E
-    QBNE UNLOAD_FILAMENT__NOT_EXTRUDER_1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER  
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder UNLOAD_FILAMENT__NOT_EXTRUDER_1
         UpdateDir r1, r10, r3, AXIS_E, DIR_E2
+    #endif
 UNLOAD_FILAMENT__NOT_EXTRUDER_1:
     SBBO r1, r6, 4, 4
     
@@ -245,16 +268,20 @@ UNLOAD_FILAMENT__NOT_EXTRUDER_1:
     LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
 
     SET r0, STEP_E
-    QBNE UNLOAD_FILAMENT__NOT_EXTRUDER_2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER  
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder UNLOAD_FILAMENT__NOT_EXTRUDER_2
         SET r0, STEP_E2
+    #endif
 UNLOAD_FILAMENT__NOT_EXTRUDER_2:
     SBBO r0, r5, 4, 4
 
     DELAY_NS r3
 
     CLR r0, STEP_E
-    QBNE UNLOAD_FILAMENT__NOT_EXTRUDER_3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER  
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder UNLOAD_FILAMENT__NOT_EXTRUDER_3
         CLR r0, STEP_E2
+    #endif
 UNLOAD_FILAMENT__NOT_EXTRUDER_3:
     SBBO r0, r5, 4, 4
 
@@ -329,6 +356,51 @@ TEST_DONE:
     
     JMP MAIN
 
+#ifdef FW_HAS_XYZ
 #include "pruss_unicorn_normal.p"
+#endif
+#ifdef FW_HAS_DELTA
 #include "pruss_unicorn_delta.p"
+#endif
+#ifdef FW_HAS_COREXY
 #include "pruss_unicorn_corexy.p"
+#endif
+
+;;------------------------------------------------------------
+;; Subroutines of the machine step loops
+;;------------------------------------------------------------
+QUEUE_IRQ:
+.using Print_Scope
+    QueueIrq r2, r0, r1
+.leave Print_Scope
+    RET
+
+RATE_SCALE:
+    RateScale r8, r7, r9
+    RET
+
+PWM_WRITE:
+.using Print_Scope
+    PwmWrite r7, r8, r9
+.leave Print_Scope
+    RET
+
+#ifdef FW_PRU_STATS
+COUNT_IDLE:
+    StatsIdle r0
+    RET
+
+COUNT_BLOCK_START:
+    StatsBlockStart r0, r7, r8, r9, r1
+    RET
+
+COUNT_BLOCK_END:
+.using Print_Scope
+    StatsBlockEnd r0, r7, r8
+.leave Print_Scope
+    RET
+
+COUNT_STEP:
+    StatsStep r8, r0, r7, r9
+    RET
+#endif
@@ -21,8 +21,10 @@ PAUSE_COREXY:
     UpdateDir r1, r10,  queue.homing_dir, AXIS_Y, DIR_Y
       XOR queue.homing_dir, queue.homing_dir,  AXIS_Z
     UpdateDir r1, r10, queue.homing_dir, AXIS_Z, DIR_Z
-    QBNE COREXY_PAUSE_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_PAUSE_NOT_DUAL_Z1
         UpdateDir r1, r10, queue.homing_dir, AXIS_Z, DIR_E2
+    #endif
     COREXY_PAUSE_NOT_DUAL_Z1:
 
     SBBO r1, r6, 4, 4
@@ -97,8 +99,10 @@ COREXY_PAUSE_UP_Z_SET:
     QBEQ PAUSE_XY_OUT_COREXY, r11, 0
     LBBO r0, r5, 4, 4 ;;GPIO1_DATAOUT
     SET r0, STEP_Z
-    QBNE COREXY_PAUSE_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_PAUSE_NOT_DUAL_Z2
         SET r0, STEP_E2
+    #endif
     COREXY_PAUSE_NOT_DUAL_Z2:
     SBBO r0, r5, 4, 4
     SUB r11, r11, 1
@@ -106,8 +110,10 @@ COREXY_PAUSE_UP_Z_SET:
     DELAY_NS queue.homing_time
 
     CLR r0, STEP_Z
-    QBNE COREXY_PAUSE_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_PAUSE_NOT_DUAL_Z3
         CLR r0, STEP_E2
+    #endif
     COREXY_PAUSE_NOT_DUAL_Z3:
     SBBO r0, r5, 4, 4
     DELAY_NS queue.homing_time
@@ -161,8 +167,10 @@ RESUME_COREXY:
     UpdateDir r1, r10, queue.homing_dir, AXIS_Y, DIR_Y
      XOR  queue.homing_dir, queue.homing_dir, AXIS_Z
     UpdateDir r1, r10, queue.homing_dir, AXIS_Z, DIR_Z
-    QBNE COREXY_RESUME_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_RESUME_NOT_DUAL_Z1
         UpdateDir r1, r10, queue.homing_dir, AXIS_Z, DIR_E2
+    #endif
     COREXY_RESUME_NOT_DUAL_Z1:
 
     SBBO r1, r6, 4, 4
@@ -171,8 +179,10 @@ COREXY_RESUME_UP_Z_SET:
     QBEQ RESUME_X_STEP_WHILE_COREXY, r11, 0
     LBBO r0, r5, 4, 4 ;;GPIO1_DATAOUT
     SET r0, STEP_Z
-    QBNE COREXY_RESUME_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_RESUME_NOT_DUAL_Z2
         SET r0, STEP_E2
+    #endif
     COREXY_RESUME_NOT_DUAL_Z2:
     SBBO r0, r5, 4, 4
     SUB r11, r11, 1
@@ -180,8 +190,10 @@ COREXY_RESUME_UP_Z_SET:
     DELAY_NS queue.homing_time
 
     CLR r0, STEP_Z
-    QBNE COREXY_RESUME_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_RESUME_NOT_DUAL_Z3
         CLR r0, STEP_E2
+    #endif
     COREXY_RESUME_NOT_DUAL_Z3:
     SBBO r0, r5, 4, 4
     DELAY_NS queue.homing_time
@@ -339,10 +351,12 @@ HOMING_MIN_Z_START_COREXY:
     LBBO r1, r6, 4, 4  ;;GPIO2_DATAOUT
 
     UpdateDir r1, r10, queue.homing_dir, AXIS_Z, DIR_Z
-    QBNE COREXY_HOMING_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_HOMING_NOT_DUAL_Z1
     #ifdef DUAL_Z
         UpdateDir r1, r10, queue.homing_dir, AXIS_Z, DIR_E2
     #endif
+    #endif
 COREXY_HOMING_NOT_DUAL_Z1:
     SBBO r1, r6, 4, 4
 
@@ -353,10 +367,12 @@ HOMING_MIN_Z_WHILE_COREXY:
 
     QBBC HOMING_DONE_COREXY, r7, MIN_Z
     SET r0, STEP_Z
-    QBNE COREXY_HOMING_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_HOMING_NOT_DUAL_Z2
     #ifdef DUAL_Z
         SET r0, STEP_E2
     #endif
+    #endif
 COREXY_HOMING_NOT_DUAL_Z2:
 
     SBBO r1, r6, 4, 4
@@ -365,10 +381,12 @@ COREXY_HOMING_NOT_DUAL_Z2:
     DELAY_NS queue.homing_time
 
     CLR r0, STEP_Z
-    QBNE COREXY_HOMING_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_HOMING_NOT_DUAL_Z3
     #ifdef DUAL_Z
         CLR r0, STEP_E2
     #endif
+    #endif
 COREXY_HOMING_NOT_DUAL_Z3:
 
     SBBO r0, r5, 4, 4
@@ -400,14 +418,20 @@ PRINT_COREXY:
     ;;.assign QueueHeader, r3, r3, header
     LBCO header, CONST_PRUDRAM, r2, SIZE(header)
     QBNE PRINT_COREXY_1, header.state, STATE_EMPTY
+    StatsCall COUNT_IDLE
     jmp MAIN
 
 PRINT_COREXY_1:
+    StatsCall COUNT_BLOCK_START
+
     ;; Get travel parameters
-    ADD r8, r2, SIZE(QueueHeader)
-    LBCO move, CONST_PRUDRAM, r8, SIZE(move)
+    QueueLoad r2, r8
 
 
+    ;; PWM event of the block, or a PWM only element
+    QueuePwm
+    QBBS DONE_STEP_GEN_COREXY, header.type, BLOCK_PWM_CMD_BIT
+
     QBBC PRINT_COREXY_GCODE, header.type, BLOCK_M_CMD_BIT
 
     MOV  r8, QUEUE_SIZE
@@ -428,17 +452,20 @@ PRINT_COREXY_GCODE:
     UpdateDir r1, r8, header.dir_bits, AXIS_Y, DIR_Y
     UpdateDir r1, r8, header.dir_bits, AXIS_Z, DIR_Z
 
-    QBNE COREXY_PRINT_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_PRINT_NOT_DUAL_Z1
     #ifdef DUAL_Z
         UpdateDir r1, r8, header.dir_bits, AXIS_E, DIR_E
         UpdateDir r1, r8, header.dir_bits, AXIS_Z, DIR_E2
     #endif
+    #endif
 COREXY_PRINT_NOT_DUAL_Z1:
 
     ;; Output direction bits to GPIO
     SBBO r1, r6, 4, 4
 
-    QBNE COREXY_PRINT_NOT_DUAL_EXTRUDER1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER 
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder COREXY_PRINT_NOT_DUAL_EXTRUDER1
         ;LBBO r7, move.ext_step_dir_gpio, 0, 4  ;;extruder dir gpio DATAOUT
         ;UpdateDir r7, r8, header.dir_bits, AXIS_E, move.ext_step_dir_offset
         ;SBBO r7, move.ext_step_dir_gpio, 0, 4
@@ -458,6 +485,7 @@ COREXY_PRINT_NOT_DUAL_Z1:
             MOV  r9, EXT_STEP_DIR_GPIO
             SBBO r7, r9, 0, 4
     COREXY_ACTIVE_EXTRUDER_DIR_OUT:
+    #endif
 COREXY_PRINT_NOT_DUAL_EXTRUDER1:
          
 
@@ -528,14 +556,17 @@ COREXY_NOT_HIT_STEP_GEN:
     UpdateStep r0, counter.x, move.steps_x, move.steps_count, STEP_X
     UpdateStep r0, counter.y, move.steps_y, move.steps_count, STEP_Y
 
-    QBNE COREXY_PRINT_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_PRINT_NOT_DUAL_Z2
         UpdateDualStep r0, counter.z, move.steps_z, move.steps_count, STEP_Z, STEP_E2
         UpdateStep     r0, counter.e, move.steps_e, move.steps_count, STEP_E
+    #endif
 COREXY_PRINT_NOT_DUAL_Z2:
 
     SBBO r0, r5, 4, 4
 
-    QBNE COREXY_PRINT_NOT_DUAL_EXTRUDER2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER 
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder COREXY_PRINT_NOT_DUAL_EXTRUDER2
         ;; Load STEP gpio data 
         LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
         UpdateStep r0, counter.z, move.steps_z, move.steps_count, STEP_Z
@@ -560,6 +591,7 @@ COREXY_PRINT_NOT_DUAL_Z2:
             MOV  r9, EXT_STEP_CTL_GPIO
             SBBO r7, r9, 0, 4
     COREXY_ACTIVE_EXTRUDER_CTL_SET_OUT:
+    #endif
 COREXY_PRINT_NOT_DUAL_EXTRUDER2:
 
     LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
@@ -599,8 +631,11 @@ UP_POS_E_COREXY:
     SBCO r9, CONST_PRUDRAM, r8, 4
 UP_POS_DONE_COREXY:
 
+    PwmPhase
+
     ;; Calc Delay time for speed control
     CalculateDelay r8, move
+    CALL RATE_SCALE
     ;;CalculateDelay_T r8
 
     DELAY_NS r8
@@ -610,16 +645,19 @@ UP_POS_DONE_COREXY:
     CLR r0, STEP_Y
     CLR r0, STEP_Z
 
-    QBNE COREXY_PRINT_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ COREXY_PRINT_NOT_DUAL_Z3
     #ifdef DUAL_Z
         CLR r0, STEP_E
         CLR r0, STEP_E2
     #endif
+    #endif
  COREXY_PRINT_NOT_DUAL_Z3:
 
     SBBO r0, r5, 4, 4
 
-    QBNE COREXY_PRINT_NOT_DUAL_EXTRUDER3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER 
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder COREXY_PRINT_NOT_DUAL_EXTRUDER3
         ;LBBO r7, move.ext_step_ctl_gpio, 0, 4  ;;extruder dir gpio DATAOUT
         ;CLR  r7, move.ext_step_ctl_offset
         ;SBBO r7, move.ext_step_ctl_gpio, 0, 4
@@ -639,10 +677,12 @@ UP_POS_DONE_COREXY:
             MOV  r9, EXT_STEP_CTL_GPIO
             SBBO r7, r9, 0, 4
     COREXY_ACTIVE_EXTRUDER_CTL_CLR_OUT: 
+    #endif
 COREXY_PRINT_NOT_DUAL_EXTRUDER3:
 
 
     DELAY_NS r8
+    StatsCall COUNT_STEP
 
     ;; Check all step done
     SUB r1, r1, 1
@@ -657,21 +697,16 @@ COREXY_PRINT_NOT_DUAL_EXTRUDER3:
 .leave Print_counter_Scope
 
 DONE_STEP_GEN_COREXY:
+    StatsCall COUNT_BLOCK_END
     ;; Make slot as empty
-    MOV  header.state, STATE_EMPTY 
-    SBCO header.state, CONST_PRUDRAM, r2, 1
+    QueueEmpty r2, r0
 
 IRQ_COREXY:
     ;; Send IRQ to ARM
-    MOV r0, QUEUE_SIZE
-    ADD r0, r0, 44
-    LBCO r3, CONST_PRUDRAM, r0, 4
-    QBNE IRQ_OUT_COREXY, r3, r2
-    MOV  R31.b0, PRU0_ARM_IRQ + 16
-IRQ_OUT_COREXY:
+    CALL QUEUE_IRQ
 
     ;; Next position in ring buffer
-    ADD  r2, r2, QUEUE_ELEMENT_SIZE
+    QueueNext r2
     MOV  r1, QUEUE_LEN * QUEUE_ELEMENT_SIZE
 
     QBGE COREXY_PRINT_END_1, r1, r2
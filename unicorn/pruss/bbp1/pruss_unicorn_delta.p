@@ -258,13 +258,19 @@ PRINT_DELTA:
     ;;.assign QueueHeader, r3, r3, header
     LBCO header, CONST_PRUDRAM, r2, SIZE(header)
     QBNE PRINT_DELTA_1, header.state, STATE_EMPTY
+    StatsCall COUNT_IDLE
     jmp MAIN
 
 PRINT_DELTA_1:
+    StatsCall COUNT_BLOCK_START
+
     ;; Get travel parameters
-    ADD r8, r2, SIZE(QueueHeader)
-    LBCO move, CONST_PRUDRAM, r8, SIZE(move)
+    QueueLoad r2, r8
+
 
+    ;; PWM event of the block, or a PWM only element
+    QueuePwm
+    QBBS DONE_STEP_GEN_DELTA, header.type, BLOCK_PWM_CMD_BIT
 
     QBBC PRINT_DELTA_GCODE, header.type, BLOCK_M_CMD_BIT
 
@@ -433,8 +439,11 @@ UP_POS_E_DELTA:
 UP_POS_DONE_DELTA:
 
 
+    PwmPhase
+
     ;; Calc Delay time for speed control
     CalculateDelay r8, move
+    CALL RATE_SCALE
     ;;CalculateDelay_T r8
 
     DELAY_NS r8 
@@ -467,6 +476,7 @@ DELTA_ACTIVE_EXTRUDER1_CTL_CLR:
 DELTA_ACTIVE_EXTRUDER_CTL_CLR_OUT:   
 
     DELAY_NS r8
+    StatsCall COUNT_STEP
 
     ;; Check all step done
     SUB r1, r1, 1
@@ -481,21 +491,16 @@ DELTA_ACTIVE_EXTRUDER_CTL_CLR_OUT:
 .leave Print_counter_Scope
 
 DONE_STEP_GEN_DELTA:
+    StatsCall COUNT_BLOCK_END
     ;; Make slot as empty
-    MOV  header.state, STATE_EMPTY 
-    SBCO header.state, CONST_PRUDRAM, r2, 1
+    QueueEmpty r2, r0
 
 IRQ_DELTA:
-    ;; Send IRQ_DELTA to ARM
-    MOV r0, QUEUE_SIZE
-    ADD r0, r0, 44
-    LBCO r3, CONST_PRUDRAM, r0, 4
-    QBNE IRQ_OUT_DELTA, r3, r2
-    MOV  R31.b0, PRU0_ARM_IRQ + 16
-IRQ_OUT_DELTA:
+    ;; Send IRQ to ARM
+    CALL QUEUE_IRQ
 
     ;; Next position in ring buffer
-    ADD  r2, r2, QUEUE_ELEMENT_SIZE
+    QueueNext r2
     MOV  r1, QUEUE_LEN * QUEUE_ELEMENT_SIZE
 
     QBGE DELTA_PRINT_END_1, r1, r2
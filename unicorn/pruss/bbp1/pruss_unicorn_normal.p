@@ -20,8 +20,10 @@ PAUSE:
     UpdateDir r1, r10, r3, AXIS_Y, DIR_Y
     XOR r3, r3,  AXIS_Z
     UpdateDir r1, r10, r3, AXIS_Z, DIR_Z
-    QBNE NORMAL_PAUSE_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_PAUSE_NOT_DUAL_Z1
         UpdateDir r1, r10, r3, AXIS_Z, DIR_E2
+    #endif
     NORMAL_PAUSE_NOT_DUAL_Z1:
 
     SBBO r1, r6, 4, 4
@@ -49,8 +51,10 @@ PAUSE_CH_MIN_Y:
 PAUSE_MOVE_DOWN_Z:
     QBEQ PAUSE_CH_LMSW_OUT, r11, 0
     SET r0, STEP_Z
-    QBNE NORMAL_PAUSE_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_PAUSE_NOT_DUAL_Z2
         SET r0, STEP_E2
+    #endif
     NORMAL_PAUSE_NOT_DUAL_Z2:
     SUB r11, r11, 1
 
@@ -62,8 +66,10 @@ PAUSE_CH_LMSW_OUT:
     CLR r0, STEP_X
     CLR r0, STEP_Y
     CLR r0, STEP_Z
-    QBNE NORMAL_PAUSE_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_PAUSE_NOT_DUAL_Z3
         CLR r0, STEP_E2
+    #endif
     NORMAL_PAUSE_NOT_DUAL_Z3:
 
     SBBO r0, r5, 4, 4
@@ -108,8 +114,10 @@ RESUME:
     UpdateDir r1, r10, r3, AXIS_Y, DIR_Y
     XOR r3, r3,  AXIS_Z
     UpdateDir r1, r10, r3, AXIS_Z, DIR_Z
-    QBNE NORMAL_RESUME_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_RESUME_NOT_DUAL_Z1
         UpdateDir r1, r10, r3, AXIS_Z, DIR_E2
+    #endif
     NORMAL_RESUME_NOT_DUAL_Z1:
 
     SBBO r1, r6, 4, 4
@@ -131,8 +139,10 @@ NORMAL_RESUME_UP_Z_SET:
     QBEQ RESUME_STEP, r11, 0
     LBBO r0, r5, 4, 4 ;;GPIO1_DATAOUT
     SET r0, STEP_Z
-    QBNE NORMAL_RESUME_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_RESUME_NOT_DUAL_Z2
         SET r0, STEP_E2
+    #endif
     NORMAL_RESUME_NOT_DUAL_Z2:
     SBBO r0, r5, 4, 4
     SUB r11, r11, 1
@@ -140,8 +150,10 @@ NORMAL_RESUME_UP_Z_SET:
     DELAY_NS r3
 
     CLR r0, STEP_Z
-    QBNE NORMAL_RESUME_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_RESUME_NOT_DUAL_Z3
         CLR r0, STEP_E2
+    #endif
     NORMAL_RESUME_NOT_DUAL_Z3:
     SBBO r0, r5, 4, 4
     DELAY_NS r3
@@ -201,10 +213,12 @@ HOMING:
     UpdateDir r1, r10, r3, AXIS_Y, DIR_Y
     UpdateDir r1, r10, r3, AXIS_Z, DIR_Z
 
-    QBNE NORMAL_HOMING_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_HOMING_NOT_DUAL_Z1
     #ifdef DUAL_Z
         UpdateDir r1, r10, r3, AXIS_Z, DIR_E2
     #endif 
+    #endif
 NORMAL_HOMING_NOT_DUAL_Z1:
 
     SBBO r1, r6, 4, 4
@@ -242,10 +256,12 @@ CH_MIN_Z:
     QBBC CH_LMSW_OUT, r7, MIN_Z
     SET r0, STEP_Z
 
-    QBNE NORMAL_HOMING_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_HOMING_NOT_DUAL_Z2
     #ifdef DUAL_Z
         SET r0, STEP_E2
     #endif
+    #endif
 NORMAL_HOMING_NOT_DUAL_Z2:
 
 CH_LMSW_OUT:
@@ -257,10 +273,12 @@ CH_LMSW_OUT:
     CLR r0, STEP_Y
     CLR r0, STEP_Z
 
-    QBNE NORMAL_HOMING_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_HOMING_NOT_DUAL_Z3
     #ifdef DUAL_Z
         CLR r0, STEP_E2
     #endif
+    #endif
 NORMAL_HOMING_NOT_DUAL_Z3:
 
     SBBO r0, r5, 4, 4
@@ -303,12 +321,18 @@ PRINT:
     ;;.assign QueueHeader, r3, r3, header
     LBCO header, CONST_PRUDRAM, r2, SIZE(header)
     QBNE PRINT_DUAL_Z_1, header.state, STATE_EMPTY
+    StatsCall COUNT_IDLE
     jmp MAIN
 
 PRINT_DUAL_Z_1:
+    StatsCall COUNT_BLOCK_START
+
     ;; Get travel parameters
-    ADD r8, r2, SIZE(QueueHeader)
-    LBCO move, CONST_PRUDRAM, r8, SIZE(move)
+    QueueLoad r2, r8
+
+    ;; PWM event of the block, or a PWM only element
+    QueuePwm
+    QBBS DONE_STEP_GEN, header.type, BLOCK_PWM_CMD_BIT
 
     QBBC NORMAL_GCODE, header.type, BLOCK_M_CMD_BIT
 
@@ -330,17 +354,20 @@ NORMAL_GCODE:
     UpdateDir r1, r8, header.dir_bits, AXIS_Y, DIR_Y
     UpdateDir r1, r8, header.dir_bits, AXIS_Z, DIR_Z
 
-    QBNE NORMAL_PRINT_NOT_DUAL_Z1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_PRINT_NOT_DUAL_Z1
     #ifdef DUAL_Z
         UpdateDir r1, r8, header.dir_bits, AXIS_E, DIR_E
         UpdateDir r1, r8, header.dir_bits, AXIS_Z, DIR_E2
     #endif
+    #endif
 NORMAL_PRINT_NOT_DUAL_Z1:
 
     ;; Output direction bits to GPIO
     SBBO r1, r6, 4, 4
 
-    QBNE NORMAL_PRINT_NOT_DUAL_EXTRUDER1, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER 
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder NORMAL_PRINT_NOT_DUAL_EXTRUDER1
         ;LBBO r7, move.ext_step_dir_gpio, 0, 4  ;;extruder dir gpio DATAOUT
         ;UpdateDir r7, r8, header.dir_bits, AXIS_E, move.ext_step_dir_offset
         ;SBBO r7, move.ext_step_dir_gpio, 0, 4
@@ -360,6 +387,7 @@ NORMAL_PRINT_NOT_DUAL_Z1:
                 MOV  r9, EXT_STEP_DIR_GPIO
                 SBBO r7, r9, 0, 4
         NORMAL_ACTIVE_EXTRUDER_DIR_OUT:   
+    #endif
 NORMAL_PRINT_NOT_DUAL_EXTRUDER1:
 
 
@@ -425,14 +453,17 @@ NORMAL_NOT_HIT_STEP_GEN:
     UpdateStep r0, counter.x, move.steps_x, move.steps_count, STEP_X
     UpdateStep r0, counter.y, move.steps_y, move.steps_count, STEP_Y
 
-    QBNE NORMAL_PRINT_NOT_DUAL_Z2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_PRINT_NOT_DUAL_Z2
         UpdateDualStep r0, counter.z, move.steps_z, move.steps_count, STEP_Z, STEP_E2
         UpdateStep     r0, counter.e, move.steps_e, move.steps_count, STEP_E
+    #endif
 NORMAL_PRINT_NOT_DUAL_Z2:
 
     SBBO r0, r5, 4, 4
 
-    QBNE NORMAL_PRINT_NOT_DUAL_EXTRUDER2, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER 
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder NORMAL_PRINT_NOT_DUAL_EXTRUDER2
         ;; Load STEP gpio data 
         LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
         UpdateStep r0, counter.z, move.steps_z, move.steps_count, STEP_Z
@@ -457,6 +488,7 @@ NORMAL_PRINT_NOT_DUAL_Z2:
                 MOV  r9, EXT_STEP_CTL_GPIO
                 SBBO r7, r9, 0, 4
         NORMAL_ACTIVE_EXTRUDER_CTL_SET_OUT:   
+    #endif
 NORMAL_PRINT_NOT_DUAL_EXTRUDER2:
 
     LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
@@ -497,8 +529,11 @@ UP_POS_E:
 UP_POS_DONE:
 
 
+    PwmPhase
+
     ;; Calc Delay time for speed control
     CalculateDelay r8, move
+    CALL RATE_SCALE
     ;;CalculateDelay_T r8
 
     DELAY_NS r8 
@@ -508,16 +543,19 @@ UP_POS_DONE:
     CLR r0, STEP_Y
     CLR r0, STEP_Z
 
-    QBNE NORMAL_PRINT_NOT_DUAL_Z3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_Z
+    #ifdef FW_HAS_DUAL_Z
+    IfDualZ NORMAL_PRINT_NOT_DUAL_Z3
     #ifdef DUAL_Z
         CLR r0, STEP_E
         CLR r0, STEP_E2
     #endif
+    #endif
 NORMAL_PRINT_NOT_DUAL_Z3:
 
     SBBO r0, r5, 4, 4
 
-    QBNE NORMAL_PRINT_NOT_DUAL_EXTRUDER3, gExtendParameter.bbp1_extend_func, BBP1_EXTEND_FUNC_DUAL_EXTRUDER 
+    #ifdef FW_HAS_DUAL_EXTRUDER
+    IfDualExtruder NORMAL_PRINT_NOT_DUAL_EXTRUDER3
         ;LBBO r7, move.ext_step_ctl_gpio, 0, 4  ;;extruder dir gpio DATAOUT
         ;CLR  r7, move.ext_step_ctl_offset
         ;SBBO r7, move.ext_step_ctl_gpio, 0, 4
@@ -537,9 +575,11 @@ NORMAL_PRINT_NOT_DUAL_Z3:
                 MOV  r9, EXT_STEP_CTL_GPIO
                 SBBO r7, r9, 0, 4
         NORMAL_ACTIVE_EXTRUDER_CTL_CLR_OUT:   
+    #endif
 NORMAL_PRINT_NOT_DUAL_EXTRUDER3:
 
     DELAY_NS r8 
+    StatsCall COUNT_STEP
 
     ;; Check all step done
     SUB r1, r1, 1
@@ -554,21 +594,16 @@ NORMAL_PRINT_NOT_DUAL_EXTRUDER3:
 .leave Print_counter_Scope
 
 DONE_STEP_GEN:
+    StatsCall COUNT_BLOCK_END
     ;; Make slot as empty
-    MOV  header.state, STATE_EMPTY 
-    SBCO header.state, CONST_PRUDRAM, r2, 1
+    QueueEmpty r2, r0
 
 IRQ:
     ;; Send IRQ to ARM
-    MOV r0, QUEUE_SIZE
-    ADD r0, r0, 44
-    LBCO r3, CONST_PRUDRAM, r0, 4
-    QBNE IRQ_OUT, r3, r2
-    MOV  R31.b0, PRU0_ARM_IRQ + 16
-IRQ_OUT:
+    CALL QUEUE_IRQ
 
     ;; Next position in ring buffer
-    ADD  r2, r2, QUEUE_ELEMENT_SIZE
+    QueueNext r2
     MOV  r1, QUEUE_LEN * QUEUE_ELEMENT_SIZE
 
     QBGE DUAL_Z_PRINT_END_1, r1, r2
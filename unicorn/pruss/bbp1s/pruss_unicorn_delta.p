@@ -297,13 +297,18 @@ PRINT_DELTA:
     ;;.assign QueueHeader, r3, r3, header
     LBCO header, CONST_PRUDRAM, r2, SIZE(header)
     QBNE PRINT_DELTA_1, header.state, STATE_EMPTY
+    StatsCall COUNT_IDLE
     jmp MAIN
 
 PRINT_DELTA_1:
+    StatsCall COUNT_BLOCK_START
+
     ;; Get travel parameters
-    ADD r8, r2, SIZE(QueueHeader)
-    LBCO move, CONST_PRUDRAM, r8, SIZE(move)
+    QueueLoad r2, r8
+
 
+    ;; fans are on i2c, nothing to write for a PWM element
+    QBBS DONE_STEP_GEN_DELTA, header.type, BLOCK_PWM_CMD_BIT
 
     QBBC PRINT_DELTA_GCODE, header.type, BLOCK_M_CMD_BIT
 
@@ -328,32 +333,35 @@ PRINT_DELTA_GCODE:
     ;; Output direction bits to GPIO
     SBBO r1, r6, 4, 4
 
+    ExtruderSyncWait r7, r9
     MOV  r9, EXT_STEP_DIR_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER1_DIR, r9.t0 
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER1_DIR, r9, 0
         UpdateDir r7, r8, header.dir_bits, AXIS_E, EXT0_STEP_DIR_OFFSET 
         MOV  r9, EXT_STEP_DIR_GPIO
         SBBO r7, r9, 0, 4
  DELTA_ACTIVE_EXTRUDER1_DIR:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_DIR_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER2_DIR, r9.t1
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER2_DIR, r9, 1
         UpdateDir r7, r8, header.dir_bits, AXIS_E, EXT1_STEP_DIR_OFFSET 
         MOV  r9, EXT_STEP_DIR_GPIO
         SBBO r7, r9, 0, 4
+    #endif
  DELTA_ACTIVE_EXTRUDER2_DIR:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT2_STEP_DIR_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER_DIR_OUT, r9.t2 
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER_DIR_OUT, r9, 2
         UpdateDir r7, r8, header.dir_bits, AXIS_E, EXT2_STEP_DIR_OFFSET 
         MOV  r9, EXT2_STEP_DIR_GPIO
         SBBO r7, r9, 0, 4
+    #endif
 DELTA_ACTIVE_EXTRUDER_DIR_OUT:   
 
     MOV r1, move.steps_count
+    ExtruderSyncBlock r1, r7, r9
     MOV r8, move.steps_count
     LSR r8, r8, 1
 .using Print_counter_Scope
@@ -457,40 +465,45 @@ DELTA_HIT_CHECK_ALL_HIT:
 DELTA_NOT_HIT_STEP_GEN:
 
     ;; Load STEP gpio data 
-    LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
+    StepLoad r0
 
     ;; Generate motor step high voltage
     UpdateStep r0, counter.x, move.steps_x, move.steps_count, STEP_X
     UpdateStep r0, counter.y, move.steps_y, move.steps_count, STEP_Y
     UpdateStep r0, counter.z, move.steps_z, move.steps_count, STEP_Z
-    SBBO r0, r5, 4, 4
+    StepHigh r0, r1, r7
 
+    #ifndef FW_SPLIT_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER1_CTL_SET, r9.t0
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER1_CTL_SET, r9, 0
         UpdateStep r7, counter.e, move.steps_e, move.steps_count, EXT0_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
 DELTA_ACTIVE_EXTRUDER1_CTL_SET:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER2_CTL_SET, r9.t1
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER2_CTL_SET, r9, 1
         UpdateStep r7, counter.e, move.steps_e, move.steps_count, EXT1_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
 DELTA_ACTIVE_EXTRUDER2_CTL_SET:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER_CTL_SET_OUT, r9.t2
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER_CTL_SET_OUT, r9, 2
         UpdateStep r7, counter.e, move.steps_e, move.steps_count, EXT2_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
+    #endif
 DELTA_ACTIVE_EXTRUDER_CTL_SET_OUT:   
 
+    #ifndef FW_SPLIT_EXTRUDER
     LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
+    #endif
 
     ;; Update current pos
 UP_POS_X_DELTA:
@@ -530,6 +543,7 @@ UP_POS_DONE_DELTA:
 
     ;; Calc Delay time for speed control
     CalculateDelay r8, move
+    CALL RATE_SCALE
     ;;CalculateDelay_T r8
 
     DELAY_NS r8 
@@ -539,34 +553,38 @@ UP_POS_DONE_DELTA:
     CLR r0, STEP_Y
     CLR r0, STEP_Z
 
-    SBBO r0, r5, 4, 4
+    StepLow r0, r1, r7
 
+    #ifndef FW_SPLIT_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER1_CTL_CLR, r9.t0
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER1_CTL_CLR, r9, 0
         CLR  r7, EXT0_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
 DELTA_ACTIVE_EXTRUDER1_CTL_CLR:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER2_CTL_CLR, r9.t1
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER2_CTL_CLR, r9, 1
         CLR  r7, EXT1_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
 DELTA_ACTIVE_EXTRUDER2_CTL_CLR:
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC DELTA_ACTIVE_EXTRUDER_CTL_CLR_OUT, r9.t2
+    IfActiveExtruder DELTA_ACTIVE_EXTRUDER_CTL_CLR_OUT, r9, 2
         CLR  r7, EXT2_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
+    #endif
 DELTA_ACTIVE_EXTRUDER_CTL_CLR_OUT:   
 
     DELAY_NS r8
+    StatsCall COUNT_STEP
 
     ;; Check all step done
     SUB r1, r1, 1
@@ -581,21 +599,17 @@ DELTA_ACTIVE_EXTRUDER_CTL_CLR_OUT:
 .leave Print_counter_Scope
 
 DONE_STEP_GEN_DELTA:
+    StatsCall COUNT_BLOCK_END
+    ExtruderSyncEnd r0
     ;; Make slot as empty
-    MOV  header.state, STATE_EMPTY 
-    SBCO header.state, CONST_PRUDRAM, r2, 1
+    QueueEmpty r2, r0
 
 IRQ_DELTA:
-    ;; Send IRQ_DELTA to ARM
-    MOV r0, QUEUE_SIZE
-    ADD r0, r0, 44
-    LBCO r3, CONST_PRUDRAM, r0, 4
-    QBNE IRQ_OUT_DELTA, r3, r2
-    MOV  R31.b0, PRU0_ARM_IRQ + 16
-IRQ_OUT_DELTA:
+    ;; Send IRQ to ARM
+    CALL QUEUE_IRQ
 
     ;; Next position in ring buffer
-    ADD  r2, r2, QUEUE_ELEMENT_SIZE
+    QueueNext r2
     MOV  r1, QUEUE_LEN * QUEUE_ELEMENT_SIZE
 
     QBGE DELTA_PRINT_END_1, r1, r2
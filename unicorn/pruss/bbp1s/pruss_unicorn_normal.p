@@ -21,10 +21,8 @@ PAUSE:
     LBBO r1, r6, 4, 4  ;;GPIO2_DATAOUT
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r21, CONST_PRUDRAM, r9, 4 
-    QBBC NORMAL_PAUSE_DUAL_XY_DIR_OUT, r21, 0 
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY NORMAL_PAUSE_DUAL_XY_DIR_OUT, r9, r21
         MOV  r9, EXT_STEP_DIR_GPIO  ;;ext1 --> X 
         LBBO r21, r9, 0, 4  
         UpdateDir r21, r10, r3, AXIS_X, EXT1_STEP_DIR_OFFSET 
@@ -34,6 +32,7 @@ PAUSE:
         LBBO r21, r9, 0, 4  
         UpdateDir r21, r10, r3, AXIS_Y, EXT2_STEP_DIR_OFFSET 
         SBBO r21, r9, 0, 4
+    #endif
 NORMAL_PAUSE_DUAL_XY_DIR_OUT:
 
     UpdateDir r1, r10, r3, AXIS_X, DIR_X
@@ -72,11 +71,10 @@ PAUSE_MIN_X_CHECK_HIGHT_1_OUT:
     SET r0, STEP_X
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r21, CONST_PRUDRAM, r9, 4 
-    QBBC PAUSE_NORMAL_DUAL_X_SET_OUT, r21, 0
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY PAUSE_NORMAL_DUAL_X_SET_OUT, r9, r21
         SET r0, EXT1_STEP_CTL_OFFSET
+    #endif
 PAUSE_NORMAL_DUAL_X_SET_OUT:
 
 PAUSE_CH_MIN_Y:
@@ -89,11 +87,10 @@ PAUSE_MIN_Y_CHECK_HIGHT_1_OUT:
         SET r0, STEP_Y
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r21, CONST_PRUDRAM, r9, 4 
-    QBBC PAUSE_NORMAL_DUAL_Y_SET_OUT, r21, 0
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY PAUSE_NORMAL_DUAL_Y_SET_OUT, r9, r21
         SET r0,  EXT2_STEP_CTL_OFFSET
+    #endif
 PAUSE_NORMAL_DUAL_Y_SET_OUT:
 
 
@@ -121,12 +118,11 @@ PAUSE_CH_LMSW_OUT:
     CLR r0, STEP_U
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r21, CONST_PRUDRAM, r9, 4 
-    QBBC PAUSE_NORMAL_DUAL_XY_CLR_OUT, r21, 0 
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY PAUSE_NORMAL_DUAL_XY_CLR_OUT, r9, r21
         CLR r0, EXT1_STEP_CTL_OFFSET 
         CLR r0, EXT2_STEP_CTL_OFFSET 
+    #endif
 PAUSE_NORMAL_DUAL_XY_CLR_OUT:
 
     SBBO r0, r5, 4, 4
@@ -182,10 +178,8 @@ RESUME:
     LBBO r1, r6, 4, 4 ;;GPIO2_DATAOUT
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r7, CONST_PRUDRAM, r9, 4 
-    QBBC RESUME_NORMAL_DUAL_XY_DIR_OUT, r7, 0 
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY RESUME_NORMAL_DUAL_XY_DIR_OUT, r9, r7
         MOV  r9, EXT_STEP_DIR_GPIO  ;;ext1 --> X 
         LBBO r7, r9, 0, 4  
         UpdateDir r7, r10, r3, AXIS_X, EXT1_STEP_DIR_OFFSET 
@@ -195,6 +189,7 @@ RESUME:
         LBBO r7, r9, 0, 4  
         UpdateDir r7, r10, r3, AXIS_Y, EXT2_STEP_DIR_OFFSET 
         SBBO r7, r9, 0, 4
+    #endif
 RESUME_NORMAL_DUAL_XY_DIR_OUT:
 
     UpdateDir r1, r10, r3, AXIS_X, DIR_X
@@ -248,11 +243,10 @@ RESUME_STEP:
     SET r0, STEP_X
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r7, CONST_PRUDRAM, r9, 4 
-    QBBC RESUME_NORMAL_DUAL_X_SET_OUT, r7, 0
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY RESUME_NORMAL_DUAL_X_SET_OUT, r9, r7
         SET r0, EXT1_STEP_CTL_OFFSET
+    #endif
 RESUME_NORMAL_DUAL_X_SET_OUT:
 
 RESUME_UP_Y:
@@ -261,11 +255,10 @@ RESUME_UP_Y:
     SET r0, STEP_Y
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r7, CONST_PRUDRAM, r9, 4 
-    QBBC RESUME_NORMAL_DUAL_Y_SET_OUT, r7, 0
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY RESUME_NORMAL_DUAL_Y_SET_OUT, r9, r7
         SET r0, EXT2_STEP_CTL_OFFSET
+    #endif
 RESUME_NORMAL_DUAL_Y_SET_OUT:
 
 
@@ -277,12 +270,11 @@ RESUME_GEN_STEP:
     CLR r0, STEP_Y
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r7, CONST_PRUDRAM, r9, 4 
-    QBBC RESUME_NORMAL_DUAL_XY_CLR_OUT, r7, 0 
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY RESUME_NORMAL_DUAL_XY_CLR_OUT, r9, r7
         CLR r0, EXT1_STEP_CTL_OFFSET 
         CLR r0, EXT2_STEP_CTL_OFFSET 
+    #endif
 RESUME_NORMAL_DUAL_XY_CLR_OUT:
 
     SBBO r0, r5, 4, 4
@@ -428,12 +420,17 @@ PRINT:
     ;;.assign QueueHeader, r3, r3, header
     LBCO header, CONST_PRUDRAM, r2, SIZE(header)
     QBNE PRINT_DUAL_Z_1, header.state, STATE_EMPTY
+    StatsCall COUNT_IDLE
     jmp MAIN
 
 PRINT_DUAL_Z_1:
+    StatsCall COUNT_BLOCK_START
+
     ;; Get travel parameters
-    ADD r8, r2, SIZE(QueueHeader)
-    LBCO move, CONST_PRUDRAM, r8, SIZE(move)
+    QueueLoad r2, r8
+
+    ;; fans are on i2c, nothing to write for a PWM element
+    QBBS DONE_STEP_GEN, header.type, BLOCK_PWM_CMD_BIT
 
     QBBC NORMAL_GCODE, header.type, BLOCK_M_CMD_BIT
 
@@ -459,10 +456,8 @@ NORMAL_GCODE:
     SBBO r1, r6, 4, 4
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r7, CONST_PRUDRAM, r9, 4 
-    QBBC NORMAL_DUAL_XY_DIR_OUT, r7, 0 
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY NORMAL_DUAL_XY_DIR_OUT, r9, r7
         MOV  r9, EXT_STEP_DIR_GPIO  ;;ext1 --> X 
         LBBO r7, r9, 0, 4  
         UpdateDir r7, r8, header.dir_bits, AXIS_X, EXT1_STEP_DIR_OFFSET 
@@ -472,6 +467,7 @@ NORMAL_GCODE:
         LBBO r7, r9, 0, 4  
         UpdateDir r7, r8, header.dir_bits, AXIS_Y, EXT2_STEP_DIR_OFFSET 
         SBBO r7, r9, 0, 4
+    #endif
 NORMAL_DUAL_XY_DIR_OUT:
 
     #ifdef DUAL_Z
@@ -484,33 +480,36 @@ NORMAL_DUAL_XY_DIR_OUT:
     #endif 
 
 
+    ExtruderSyncWait r7, r9
     MOV  r9, EXT_STEP_DIR_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER1_DIR, r9.t0 
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER1_DIR, r9, 0
         UpdateDir r7, r8, header.dir_bits, AXIS_E, EXT0_STEP_DIR_OFFSET 
         MOV  r9, EXT_STEP_DIR_GPIO
         SBBO r7, r9, 0, 4
  NORMAL_ACTIVE_EXTRUDER1_DIR:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_DIR_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER2_DIR, r9.t1
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER2_DIR, r9, 1
         UpdateDir r7, r8, header.dir_bits, AXIS_E, EXT1_STEP_DIR_OFFSET 
         MOV  r9, EXT_STEP_DIR_GPIO
         SBBO r7, r9, 0, 4
+    #endif
  NORMAL_ACTIVE_EXTRUDER2_DIR:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT2_STEP_DIR_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER_DIR_OUT, r9.t2 
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER_DIR_OUT, r9, 2
         UpdateDir r7, r8, header.dir_bits, AXIS_E, EXT2_STEP_DIR_OFFSET 
         MOV  r9, EXT2_STEP_DIR_GPIO
         SBBO r7, r9, 0, 4
+    #endif
 NORMAL_ACTIVE_EXTRUDER_DIR_OUT:   
 
 
     MOV r1, move.steps_count
+    ExtruderSyncBlock r1, r7, r9
     MOV r8, move.steps_count
     LSR r8, r8, 1
 .using Print_counter_Scope
@@ -613,7 +612,7 @@ NORMAL_HIT:
 NORMAL_NOT_HIT_STEP_GEN:
 
     ;; Load STEP gpio data 
-    LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
+    StepLoad r0
 
     ;; Generate motor step high voltage
     MOV r8, counter.x 
@@ -621,14 +620,12 @@ NORMAL_NOT_HIT_STEP_GEN:
     UpdateStep r0, counter.y, move.steps_y, move.steps_count, STEP_Y
     UpdateDualStep r0, counter.z, move.steps_z, move.steps_count, STEP_Z, STEP_U
 
-    SBBO r0, r5, 4, 4
+    StepHigh r0, r1, r7
 
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r7, CONST_PRUDRAM, r9, 4 
-    QBBC NORMAL_DUAL_XY_SET_OUT, r7, 0 
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY NORMAL_DUAL_XY_SET_OUT, r9, r7
         MOV  r9, EXT_STEP_CTL_GPIO  ;;ext1 --> X 
         LBBO r7, r9, 0, 4  
         MOV  r0, r8
@@ -640,35 +637,41 @@ NORMAL_NOT_HIT_STEP_GEN:
         MOV  r0, r8
         UpdateStep r7, r0, move.steps_y, move.steps_count, EXT2_STEP_CTL_OFFSET 
         SBBO r7, r9, 0, 4
+    #endif
 NORMAL_DUAL_XY_SET_OUT:
 
 
+    #ifndef FW_SPLIT_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER1_CTL_SET, r9.t0
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER1_CTL_SET, r9, 0
         UpdateStep r7, counter.e, move.steps_e, move.steps_count, EXT0_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
 NORMAL_ACTIVE_EXTRUDER1_CTL_SET:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER2_CTL_SET, r9.t1
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER2_CTL_SET, r9, 1
         UpdateStep r7, counter.e, move.steps_e, move.steps_count, EXT1_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
 NORMAL_ACTIVE_EXTRUDER2_CTL_SET:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER_CTL_SET_OUT, r9.t2
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER_CTL_SET_OUT, r9, 2
         UpdateStep r7, counter.e, move.steps_e, move.steps_count, EXT2_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
+    #endif
 NORMAL_ACTIVE_EXTRUDER_CTL_SET_OUT:   
 
+    #ifndef FW_SPLIT_EXTRUDER
     LBBO r0, r5, 4, 4  ;;GPIO1_DATAOUT
+    #endif
 
     ;; Update current pos
 UP_POS_X:
@@ -707,6 +710,7 @@ UP_POS_DONE:
 
     ;; Calc Delay time for speed control
     CalculateDelay r8, move
+    CALL RATE_SCALE
     ;;CalculateDelay_T r8
 
     DELAY_NS r8 
@@ -720,13 +724,11 @@ UP_POS_DONE:
         CLR r0, STEP_U
     #endif
 
-    SBBO r0, r5, 4, 4
+    StepLow r0, r1, r7
 
     ;; motor56 mode
-    MOV  r9, QUEUE_SIZE
-    ADD  r9, r9, 68
-    LBCO r7, CONST_PRUDRAM, r9, 4 
-    QBBC NORMAL_DUAL_XY_CLR_OUT, r7, 0 
+    #ifdef FW_HAS_MOTOR56_DUAL_XY
+    IfMotor56DualXY NORMAL_DUAL_XY_CLR_OUT, r9, r7
         MOV  r9, EXT_STEP_CTL_GPIO  ;;ext1 --> X 
         LBBO r7, r9, 0, 4  
         CLR r7, EXT1_STEP_CTL_OFFSET 
@@ -736,36 +738,41 @@ UP_POS_DONE:
         LBBO r7, r9, 0, 4  
         CLR r7, EXT2_STEP_CTL_OFFSET 
         SBBO r7, r9, 0, 4
+    #endif
 NORMAL_DUAL_XY_CLR_OUT:
 
 
+    #ifndef FW_SPLIT_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER1_CTL_CLR, r9.t0
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER1_CTL_CLR, r9, 0
         CLR  r7, EXT0_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
 NORMAL_ACTIVE_EXTRUDER1_CTL_CLR:   
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER2_CTL_CLR, r9.t1
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER2_CTL_CLR, r9, 1
         CLR  r7, EXT1_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
 NORMAL_ACTIVE_EXTRUDER2_CTL_CLR:
+    #ifndef FW_SINGLE_EXTRUDER
     MOV  r9, EXT_STEP_CTL_GPIO
     LBBO r7, r9, 0, 4  ;;extruder dir gpio DATAOUT
-    MOV  r9, move.ext_step_bit         ;; active extruder
-    QBBC NORMAL_ACTIVE_EXTRUDER_CTL_CLR_OUT, r9.t2
+    IfActiveExtruder NORMAL_ACTIVE_EXTRUDER_CTL_CLR_OUT, r9, 2
         CLR  r7, EXT2_STEP_CTL_OFFSET 
         MOV  r9, EXT_STEP_CTL_GPIO
         SBBO r7, r9, 0, 4
+    #endif
+    #endif
 NORMAL_ACTIVE_EXTRUDER_CTL_CLR_OUT:   
 
 
     DELAY_NS r8 
+    StatsCall COUNT_STEP
 
     ;; Check all step done
     SUB r1, r1, 1
@@ -780,21 +787,17 @@ NORMAL_ACTIVE_EXTRUDER_CTL_CLR_OUT:
 .leave Print_counter_Scope
 
 DONE_STEP_GEN:
+    StatsCall COUNT_BLOCK_END
+    ExtruderSyncEnd r0
     ;; Make slot as empty
-    MOV  header.state, STATE_EMPTY 
-    SBCO header.state, CONST_PRUDRAM, r2, 1
+    QueueEmpty r2, r0
 
 IRQ:
     ;; Send IRQ to ARM
-    MOV r0, QUEUE_SIZE
-    ADD r0, r0, 44
-    LBCO r3, CONST_PRUDRAM, r0, 4
-    QBNE IRQ_OUT, r3, r2
-    MOV  R31.b0, PRU0_ARM_IRQ + 16
-IRQ_OUT:
+    CALL QUEUE_IRQ
 
     ;; Next position in ring buffer
-    ADD  r2, r2, QUEUE_ELEMENT_SIZE
+    QueueNext r2
     MOV  r1, QUEUE_LEN * QUEUE_ELEMENT_SIZE
 
     QBGE DUAL_Z_PRINT_END_1, r1, r2
@@ -0,0 +1,146 @@
+//------------------------------------------------------------
+// pruss_unicorn_pru1.p
+// pru1 asm to generate extruder E0, E1, E2 step signals
+// of the split images, PRU0 runs x, y, z and hands each
+// block over through the ExtruderSync struct in shared RAM
+//------------------------------------------------------------
+// Registers
+// r0, r1    -> scratch
+// r2        -> GPIO1 SETDATAOUT
+// r3        -> GPIO1 CLEARDATAOUT
+// r4        -> pos_e offset in the queue
+// r5        -> current block
+// r6        -> step bits of the active extruders
+// r7        -> e counter
+// r8        -> last handled phase
+// r9        -> phase from PRU0
+// r10 ~ r15 -> ExtruderSync
+// r16       -> E step pins high
+//------------------------------------------------------------
+#include "../pruss_unicorn.hp"
+
+;; step pulse high and low time of the E drivers,
+;; A4988 1us, DRV8825 1.9us
+#define MIN_PULSE_NS    2000
+
+.macro PulseDelay
+.mparam scratch
+    MOV  scratch, MIN_PULSE_NS
+PD_LOOP:
+    SUB  scratch, scratch, 10
+    QBLT PD_LOOP, scratch, 10
+.endm
+
+.origin 0
+.entrypoint INIT
+
+;;------------------------------------------------------------
+;; Init
+;;------------------------------------------------------------
+INIT:
+    ;; Clear STANDBY_INIT bit
+    LBCO r0, CONST_PRUCFG, 4, 4
+    CLR  r0, r0, 4
+    SBCO r0, CONST_PRUCFG, 4, 4
+
+    ;; C28 -> shared RAM 0x00010000
+    MOV  r0, 0x00000100
+    MOV  r1, PRU1_CTPPR_0
+    ST32 r0, r1
+
+    ;; C31 -> DDR queue 0x80e00000
+    MOV  r0, 0xe0000000
+    MOV  r1, PRU1_CTPPR_1
+    ST32 r0, r1
+
+    MOV  r2, GPIO_1 | GPIO_SETDATAOUT
+    MOV  r3, GPIO_1 | GPIO_CLEARDATAOUT
+    MOV  r4, QUEUE_SIZE
+    ADD  r4, r4, 28
+
+    .assign ExtruderSync, r10, r15, sync
+
+    ;; Nothing pending
+    LBCO r5, CONST_PRUSHAREDRAM, SYNC_BLOCK, 4
+    SBCO r5, CONST_PRUSHAREDRAM, SYNC_ACK, 4
+
+;;------------------------------------------------------------
+;; Wait for the next block from PRU0
+;;------------------------------------------------------------
+IDLE:
+    LBCO r0, CONST_PRUSHAREDRAM, SYNC_BLOCK, 4
+    QBEQ IDLE, r0, r5
+
+    MOV  r5, r0
+    LBCO sync, CONST_PRUSHAREDRAM, 0, SIZE(sync)
+
+    ZERO &r6, 4
+    ZERO &r16, 4
+    QBBC EXT1_MASK, sync.ext_step_bit, 0
+        SET r6, EXT0_STEP_CTL_OFFSET
+EXT1_MASK:
+    QBBC EXT2_MASK, sync.ext_step_bit, 1
+        SET r6, EXT1_STEP_CTL_OFFSET
+EXT2_MASK:
+    QBBC EXT_MASK_OUT, sync.ext_step_bit, 2
+        SET r6, EXT2_STEP_CTL_OFFSET
+EXT_MASK_OUT:
+
+    LSR  r7, sync.steps_count, 1
+    LSL  r8, sync.steps_count, 1
+    ADD  r8, r8, 2
+
+;;------------------------------------------------------------
+;; Follow the half steps of PRU0,
+;; missed phases are caught up one by one
+;;------------------------------------------------------------
+WAIT_PHASE:
+    LBCO r9, CONST_PRUSHAREDRAM, SYNC_PHASE, 4
+    QBEQ WAIT_PHASE, r9, r8
+    QBNE FOLLOW_PHASE, r9, 0
+
+    ;; PRU0 is done with the block, step out the phases
+    ;; left to the last one, unless the print was stopped
+    MOV  r0, QUEUE_SIZE
+    LBCO r0, CONST_DDR, r0, 4
+    QBEQ BLOCK_DONE, r0, STATE_STOP
+    QBGE BLOCK_DONE, r8, 2
+    MOV  r9, 2
+    JMP  NEXT_PHASE
+
+FOLLOW_PHASE:
+    QBGT BLOCK_DONE, r8, r9
+
+NEXT_PHASE:
+    SUB  r8, r8, 1
+    QBBC PHASE_LOW, r8, 0
+
+    ;; high edge
+    ADD  r7, r7, sync.steps_e
+    QBGT PHASE_NEXT, r7, sync.steps_count
+    SUB  r7, r7, sync.steps_count
+    SBBO r6, r2, 0, 4
+    MOV  r16, 1
+
+    LBCO r0, CONST_DDR, r4, 4
+    UpdatePos r0, r1, sync.dir, AXIS_E
+    SBCO r0, CONST_DDR, r4, 4
+    PulseDelay r0
+    JMP  PHASE_NEXT
+
+PHASE_LOW:
+    SBBO r6, r3, 0, 4
+    QBEQ PHASE_LOW_OUT, r16, 0
+    ZERO &r16, 4
+    PulseDelay r0
+PHASE_LOW_OUT:
+    QBGE BLOCK_DONE, r8, 2
+
+PHASE_NEXT:
+    QBNE NEXT_PHASE, r8, r9
+    JMP  WAIT_PHASE
+
+BLOCK_DONE:
+    SBBO r6, r3, 0, 4
+    SBCO r5, CONST_PRUSHAREDRAM, SYNC_ACK, 4
+    JMP  IDLE
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Unicorn 3D Printer Firmware
+# gen_images.sh
+# Assemble one PRU image per board, machine type and extruder setup,
+# the -D flags are described in pruss_unicorn.hp.
+# pruss.c picks the image through the PRU_IMAGES table of pru_images.h
+#
+# usage: gen_images.sh pasm outdir
+#
+
+PASM=$1
+OUT=$2
+
+if [ -z "$PASM" ] || [ -z "$OUT" ]; then
+    echo "usage: $0 pasm outdir"
+    exit 1
+fi
+
+HEADER=$OUT/pru_images.h
+TABLE=$OUT/pru_images.tmp
+
+mkdir -p $OUT
+echo "/* generated by gen_images.sh, do not edit */" > $HEADER
+: > $TABLE
+
+# image name board machine extend_func motor56_mode ext_count split flags...
+# -1 matches any value, the first matching entry wins
+image() {
+    name=$1
+    array=`echo $1 | tr a-z A-Z`_array
+    entry="    PRU_IMAGE($2, $3, $4, $5, $6, $7, $array)"
+    shift 7
+
+    flags=""
+    for f in $*; do
+        flags="$flags -D$f"
+    done
+
+    ${PASM} -V3 -c -C$array $flags ./pruss/$board/pruss_unicorn.p $OUT/$name > /dev/null || exit 1
+
+    echo "#include \"${name}_bin.h\"" >> $HEADER
+    echo "$entry \\" >> $TABLE
+}
+
+board=bbp1
+for m in XYZ DELTA COREXY; do
+    lm=`echo $m | tr A-Z a-z`
+    image bbp1_${lm}_dual_z        BOARD_BBP1 MACHINE_$m BBP1_EXTEND_FUNC_DUAL_Z        -1 -1 0 FW_MACHINE_$m FW_EXTEND_DUAL_Z
+    image bbp1_${lm}_dual_extruder BOARD_BBP1 MACHINE_$m BBP1_EXTEND_FUNC_DUAL_EXTRUDER -1 -1 0 FW_MACHINE_$m FW_EXTEND_DUAL_EXTRUDER
+    image bbp1_${lm}               BOARD_BBP1 MACHINE_$m 0                              -1 -1 0 FW_MACHINE_$m FW_EXTEND_NONE
+done
+
+board=bbp1s
+image bbp1s_xyz_dual_xy BOARD_BBP1S MACHINE_XYZ -1 MOTOR56_MODE_DUAL_X_Y -1 0 FW_MACHINE_XYZ FW_MOTOR56_DUAL_XY
+for m in XYZ DELTA COREXY; do
+    lm=`echo $m | tr A-Z a-z`
+    image bbp1s_${lm}_split BOARD_BBP1S MACHINE_$m -1 MOTOR56_MODE_EXTRUDER -1 1 FW_MACHINE_$m FW_MOTOR56_EXTRUDER FW_SPLIT_EXTRUDER
+    image bbp1s_${lm}_e1    BOARD_BBP1S MACHINE_$m -1 MOTOR56_MODE_EXTRUDER 1  0 FW_MACHINE_$m FW_MOTOR56_EXTRUDER FW_SINGLE_EXTRUDER
+    image bbp1s_${lm}       BOARD_BBP1S MACHINE_$m -1 MOTOR56_MODE_EXTRUDER -1 0 FW_MACHINE_$m FW_MOTOR56_EXTRUDER
+done
+
+echo "" >> $HEADER
+echo "#define PRU_IMAGES \\" >> $HEADER
+cat $TABLE >> $HEADER
+echo "" >> $HEADER
+rm -f $TABLE
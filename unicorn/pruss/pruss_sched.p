@@ -0,0 +1,283 @@
+//------------------------------------------------------------
+// pruss_sched.p
+// pru asm to replay the step schedule of stepper_sched.c,
+// every axis steps at its own times from an entry ring in DDR
+// instead of the Bresenham ticks of the dominant axis
+//------------------------------------------------------------
+// Registers
+// r0, r1    -> scratch
+// r2        -> GPIO1 SETDATAOUT
+// r3        -> GPIO1 CLEARDATAOUT
+// r4        -> now, IEP cycles since INIT
+// r5        -> step bits of this pass
+// r6        -> pulse end
+// r7        -> unused
+// r8        -> IEP count at INIT
+// r9        -> scratch
+// r10 ~ r13 -> x next, interval, add, count
+// r14 ~ r17 -> y
+// r18 ~ r21 -> z
+// r22 ~ r25 -> e
+// r26 ~ r29 -> entry, output
+//------------------------------------------------------------
+#include "pruss_unicorn.hp"
+
+.origin 0
+.entrypoint INIT
+
+;; IEP timer, 200MHz
+#define CONST_IEP          C26
+#define IEP_GLOBAL_CFG     0x00
+#define IEP_COUNT          0x0C
+
+;; struct sched_ctrl, stepper_sched.h
+#define SCHED_STATE        0
+#define SCHED_NOW          4
+#define SCHED_LATE         8
+#define SCHED_PULSE        12
+#define SCHED_AXIS_X       32
+#define SCHED_AXIS_Y       80
+#define SCHED_AXIS_Z       128
+#define SCHED_AXIS_E       176
+#define SCHED_OUT          224
+
+;; struct sched_axis
+#define AXIS_WRITE_POS     0
+#define AXIS_READ_POS      4
+#define AXIS_POS           8
+#define AXIS_SIGN          12
+#define AXIS_STEP_MASK     16
+#define AXIS_OUT           20
+#define AXIS_ENDSTOP       24
+#define AXIS_HOMING        36
+
+;; struct sched_rings, 8 bytes an entry
+#define SCHED_RING_LEN     8192
+#define RING_X             0x00000
+#define RING_Y             0x10000
+#define RING_Z             0x20000
+#define RING_E             0x30000
+
+;; SCHED_FLAG_* in the upper half of the second word of an entry
+#define FLAG_DIR           16
+#define FLAG_NEG           17
+#define FLAG_SET_DIR       18
+#define FLAG_ABS           19
+#define FLAG_SELECT        20
+#define FLAG_OUT           24
+
+;;------------------------------------------------------------
+;; Step one axis when due, load its next entry
+;; once the axis clock comes near
+;;------------------------------------------------------------
+.macro SchedAxis
+.mparam axis, ring, next, interval, add, count
+    QBNE SA_DUE, count, 0
+
+    ;; load up to 65536 cycles ahead, so the first step is not late
+    SUB  r0, next, r4
+    QBBS SA_LOAD, r0, 31
+    LSR  r0, r0, 16
+    QBNE SA_OUT, r0, 0
+SA_LOAD:
+    LBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_WRITE_POS, 8
+    QBNE SA_ENTRY, r0, r1
+    ;; nothing queued, keep the axis clock current
+    MOV  next, r4
+    JMP  SA_OUT
+
+SA_ENTRY:
+    LSL  r9, r1, 3
+    MOV  r0, ring
+    ADD  r9, r9, r0
+    LBCO r26, CONST_DDR, r9, 8
+    ADD  r1, r1, 1
+    MOV  r0, SCHED_RING_LEN - 1
+    AND  r1, r1, r0
+    SBCO r1, CONST_PRUSHAREDRAM, axis + AXIS_READ_POS, 4
+    QBEQ SA_CONTROL, r27.w0, 0
+
+    ;; steps, add is signed
+    MOV  count, r27.w0
+    MOV  add, r27.w2
+    QBBC SA_ADD_POSITIVE, add, 15
+    MOV  r0, 0xffff0000
+    OR   add, add, r0
+SA_ADD_POSITIVE:
+    MOV  interval, r26
+    ADD  next, next, interval
+    SUB  r0, r4, next
+    QBBS SA_OUT, r0, 31
+    LBCO r0, CONST_PRUSHAREDRAM, SCHED_LATE, 4
+    ADD  r0, r0, 1
+    SBCO r0, CONST_PRUSHAREDRAM, SCHED_LATE, 4
+    JMP  SA_DUE
+
+SA_CONTROL:
+    QBBS SA_ABS, r27, FLAG_ABS
+    ADD  next, next, r26
+    JMP  SA_SELECT
+SA_ABS:
+    MOV  next, r26
+
+SA_SELECT:
+    QBBC SA_DIR, r27, FLAG_SELECT
+    ;; struct sched_output is 20 bytes
+    LSR  r0, r27, FLAG_OUT
+    AND  r0, r0, 7
+    LSL  r1, r0, 4
+    LSL  r0, r0, 2
+    ADD  r0, r0, r1
+    ADD  r0, r0, SCHED_OUT
+    SBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_OUT, 4
+    LBCO r1, CONST_PRUSHAREDRAM, r0, 4
+    SBCO r1, CONST_PRUSHAREDRAM, axis + AXIS_STEP_MASK, 4
+
+SA_DIR:
+    QBBC SA_OUT, r27, FLAG_SET_DIR
+    MOV  r0, 1
+    QBBC SA_SIGN, r27, FLAG_NEG
+    MOV  r0, 0xffffffff
+SA_SIGN:
+    SBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_SIGN, 4
+
+    ;; SETDATAOUT for high, CLEARDATAOUT for low
+    LBCO r9, CONST_PRUSHAREDRAM, axis + AXIS_OUT, 4
+    ADD  r9, r9, 4
+    LBCO r28, CONST_PRUSHAREDRAM, r9, 8
+    QBEQ SA_DIR2, r28, 0
+    QBBS SA_DIR_HIGH, r27, FLAG_DIR
+    SUB  r28, r28, 4
+SA_DIR_HIGH:
+    SBBO r29, r28, 0, 4
+
+SA_DIR2:
+    ADD  r9, r9, 8
+    LBCO r28, CONST_PRUSHAREDRAM, r9, 8
+    QBEQ SA_OUT, r28, 0
+    QBBS SA_DIR2_HIGH, r27, FLAG_DIR
+    SUB  r28, r28, 4
+SA_DIR2_HIGH:
+    SBBO r29, r28, 0, 4
+    JMP  SA_OUT
+
+SA_DUE:
+    SUB  r0, r4, next
+    QBBS SA_OUT, r0, 31
+    LBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_STEP_MASK, 4
+    OR   r5, r5, r0
+    LBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_POS, 8
+    ADD  r0, r0, r1
+    SBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_POS, 4
+    SUB  count, count, 1
+    QBEQ SA_OUT, count, 0
+    ADD  interval, interval, add
+    ADD  next, next, interval
+SA_OUT:
+.endm
+
+;;------------------------------------------------------------
+;; Stop a homing axis at its endstop and drop what is queued
+;;------------------------------------------------------------
+.macro SchedEndstop
+.mparam axis, count
+    LBCO r26, CONST_PRUSHAREDRAM, axis + AXIS_ENDSTOP, 16
+    QBEQ SE_OUT, r29, 0
+    LBBO r0, r26, 0, 4
+    AND  r0, r0, r27
+    QBNE SE_OUT, r0, r28
+
+    MOV  count, 0
+    LBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_WRITE_POS, 4
+    SBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_READ_POS, 4
+    ZERO &r0, 4
+    SBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_HOMING, 4
+SE_OUT:
+.endm
+
+;;------------------------------------------------------------
+;; Drop what is queued for an axis
+;;------------------------------------------------------------
+.macro SchedFlush
+.mparam axis, count
+    MOV  count, 0
+    LBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_WRITE_POS, 4
+    SBCO r0, CONST_PRUSHAREDRAM, axis + AXIS_READ_POS, 4
+.endm
+
+;;------------------------------------------------------------
+;; Init
+;;------------------------------------------------------------
+INIT:
+    ;; Clear STANDBY_INIT bit
+    LBCO r0, CONST_PRUCFG, 4, 4
+    CLR  r0, r0, 4
+    SBCO r0, CONST_PRUCFG, 4, 4
+
+    ;; C28 -> struct sched_ctrl 0x00010100
+    MOV  r0, 0x00000101
+    MOV  r1, CTPPR_0
+    ST32 r0, r1
+
+    ;; C31 -> DDR rings 0x80e00000
+    MOV  r0, 0xe0000000
+    MOV  r1, CTPPR_1
+    ST32 r0, r1
+
+    ;; IEP counter, increment by 1 every cycle
+    MOV  r0, 0x11
+    SBCO r0, CONST_IEP, IEP_GLOBAL_CFG, 4
+
+    MOV  r2, GPIO_1 | GPIO_SETDATAOUT
+    MOV  r3, GPIO_1 | GPIO_CLEARDATAOUT
+
+    LBCO r8, CONST_IEP, IEP_COUNT, 4
+    ZERO &r10, 64
+
+;;------------------------------------------------------------
+;; Main loop
+;;------------------------------------------------------------
+MAIN:
+    LBCO r4, CONST_IEP, IEP_COUNT, 4
+    SUB  r4, r4, r8
+    SBCO r4, CONST_PRUSHAREDRAM, SCHED_NOW, 4
+
+    LBCO r0, CONST_PRUSHAREDRAM, SCHED_STATE, 4
+    QBEQ RUN, r0, STATE_PRINT
+    QBEQ HOME, r0, STATE_HOME
+    QBEQ STOP, r0, STATE_STOP
+    JMP  MAIN
+
+STOP:
+    SchedFlush SCHED_AXIS_X, r13
+    SchedFlush SCHED_AXIS_Y, r17
+    SchedFlush SCHED_AXIS_Z, r21
+    SchedFlush SCHED_AXIS_E, r25
+    MOV  r0, STATE_IDLE
+    SBCO r0, CONST_PRUSHAREDRAM, SCHED_STATE, 4
+    JMP  MAIN
+
+HOME:
+    SchedEndstop SCHED_AXIS_X, r13
+    SchedEndstop SCHED_AXIS_Y, r17
+    SchedEndstop SCHED_AXIS_Z, r21
+
+RUN:
+    ZERO &r5, 4
+    SchedAxis SCHED_AXIS_X, RING_X, r10, r11, r12, r13
+    SchedAxis SCHED_AXIS_Y, RING_Y, r14, r15, r16, r17
+    SchedAxis SCHED_AXIS_Z, RING_Z, r18, r19, r20, r21
+    SchedAxis SCHED_AXIS_E, RING_E, r22, r23, r24, r25
+    QBEQ MAIN, r5, 0
+
+    ;; step pulse of all due axes
+    SBBO r5, r2, 0, 4
+    LBCO r6, CONST_IEP, IEP_COUNT, 4
+    LBCO r0, CONST_PRUSHAREDRAM, SCHED_PULSE, 4
+    ADD  r6, r6, r0
+PULSE_WAIT:
+    LBCO r0, CONST_IEP, IEP_COUNT, 4
+    SUB  r0, r0, r6
+    QBBS PULSE_WAIT, r0, 31
+    SBBO r5, r3, 0, 4
+    JMP  MAIN
@@ -9,6 +9,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdint.h>
 
 #include "pwm.h"
@@ -21,6 +22,8 @@ typedef struct {
     unsigned int frequency;
     unsigned int period_ns;
     unsigned int duty_ns;
+    uint32_t     compare_reg;       /* pwm_get_compare(), 0 out of reach */
+    uint32_t     compare_period;
 } pwm_t;
 
 static pwm_t *pwms = NULL;
@@ -88,6 +91,68 @@ int pwm_config(pwm_config_t *pcfgs, int nr_cfgs)
     return 0;
 }
 
+/*
+ * AM335x PWMSS registers of a SoC pwm, for the PRU to write the
+ * compare in step with the motion queue. reg has bit0 set for a
+ * 32 bit register, period is in compare counts.
+ * Read once the period is set, not for each M106.
+ */
+#define PWMSS_BASE(n)       (0x48300000 + (n) * 0x2000)
+#define PWMSS_ECAP          0x100
+#define PWMSS_EPWM          0x200
+#define ECAP_CAP1           0x08    /* APWM period */
+#define ECAP_CAP4           0x14    /* APWM shadow compare */
+#define EPWM_TBPRD          0x0A
+#define EPWM_CMPA           0x12
+#define EPWM_CMPB           0x14
+
+static void pwm_read_compare(pwm_t *pd)
+{
+    const char *name;
+    unsigned int n = 0, ch = 0;
+    volatile uint8_t *regs;
+    int fd;
+
+    pd->compare_reg = 0;
+    pd->compare_period = 0;
+
+    fd = open("/dev/mem", O_RDWR | O_SYNC);
+    if (fd < 0) {
+        perror("[pwm]: open /dev/mem");
+        return;
+    }
+
+    if ((name = strstr(pd->device_path, "ehrpwm.")) != NULL
+            && sscanf(name, "ehrpwm.%u:%u", &n, &ch) == 2) {
+        regs = mmap(0, 0x1000, PROT_READ, MAP_SHARED, fd, PWMSS_BASE(n));
+        if (regs == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+        pd->compare_period = *(volatile uint16_t *)(regs + PWMSS_EPWM + EPWM_TBPRD);
+        pd->compare_reg = PWMSS_BASE(n) + PWMSS_EPWM + (ch ? EPWM_CMPB : EPWM_CMPA);
+    } else if ((name = strstr(pd->device_path, "ecap.")) != NULL
+            && sscanf(name, "ecap.%u", &n) == 1) {
+        regs = mmap(0, 0x1000, PROT_READ, MAP_SHARED, fd, PWMSS_BASE(n));
+        if (regs == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+        pd->compare_period = *(volatile uint32_t *)(regs + PWMSS_ECAP + ECAP_CAP1);
+        pd->compare_reg = (PWMSS_BASE(n) + PWMSS_ECAP + ECAP_CAP4) | 1;
+    } else {
+        /* pca9685 on i2c, out of reach of the PRU */
+        close(fd);
+        return;
+    }
+
+    munmap((void *)regs, 0x1000);
+    close(fd);
+
+    PWM_DBG("pwm_read_compare: %s reg %#x period %u\n",
+            pd->id, pd->compare_reg, pd->compare_period);
+}
+
 int pwm_init()
 {
     int i;
@@ -110,6 +175,7 @@ int pwm_init()
             pwm_write_sysfs(pd->device_path, "period_freq", pd->frequency);
         }
         pwm_write_sysfs(pd->device_path, "duty_percent", 0);
+        pwm_read_compare(pd);
     }
 
     return 0;
@@ -153,6 +219,7 @@ int pwm_set_period(channel_tag pwm_ch, unsigned int period_ns)
         PWM_DBG("pwm_set_period_ns: %s period_ns %d\n", 
                 pd->id, period_ns);
         pwm_write_sysfs(pd->device_path, "period_ns", period_ns);
+        pwm_read_compare(pd);
     }
 
     return 0;
@@ -200,6 +267,7 @@ int pwm_set_freq(channel_tag pwm_ch, unsigned int freq)
 			PWM_DBG("pwm_set_freq: %s period_freq %d\n", 
 					pd->id, freq);
 			pwm_write_sysfs(pd->device_path, "period_freq", freq);
+            pwm_read_compare(pd);
         }
     } else {
         printf("pwm_set_freq: pwm[%d] not enabled\n", idx);
@@ -301,3 +369,26 @@ int pwm_get_state(channel_tag pwm_ch)
     return pd->state;
 }
 
+
+/*
+ * Compare register and period of a pwm read by pwm_read_compare(),
+ * return -1 if the pwm is not an ehrpwm or ecap output.
+ */
+int pwm_get_compare(channel_tag pwm_ch, uint32_t *reg, uint32_t *period)
+{
+    int idx = -1;
+    pwm_t *pd = NULL;
+
+    idx = pwm_index_lookup(pwm_ch);
+    if (idx < 0) {
+        return -1;
+    }
+    pd = &pwms[idx];
+
+    if (!pd->compare_reg) {
+        return -1;
+    }
+    *reg = pd->compare_reg;
+    *period = pd->compare_period;
+    return 0;
+}
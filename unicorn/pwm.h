@@ -36,6 +36,7 @@ extern int pwm_set_period(channel_tag pwm_ch, unsigned int period_ns);
 extern int pwm_set_duty(channel_tag pwm_ch, unsigned int duty_ns);
 
 extern int pwm_get_state(channel_tag pwm_ch);
+extern int pwm_get_compare(channel_tag pwm_ch, uint32_t *reg, uint32_t *period);
 
 extern channel_tag pwm_lookup_by_name(const char *name);
 
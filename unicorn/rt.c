@@ -0,0 +1,205 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * rt.c
+ * real-time profile, mlockall, prefaulted stacks and buffers,
+ * SCHED_FIFO priorities stepper > planner > gcode > heater > mcode > control
+ * > latency, the log thread runs SCHED_OTHER
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+typedef struct {
+    const char *name;
+    int prio;                   /* SCHED_FIFO priority, 0 SCHED_OTHER */
+    size_t stack;
+    void *(*worker)(void *);
+    void *arg;
+} rt_slot_t;
+
+static rt_slot_t rt_slots[NR_RT_THREADS] = {
+    [RT_STEPPER]     = { "stepper",     80, RT_STACK_SIZE },
+    [RT_PLANNER]     = { "planner",     70, RT_STACK_SIZE },
+    [RT_GCODE_EMERG] = { "gcode_emerg", 65, RT_STACK_SIZE },
+    [RT_GCODE]       = { "gcode",       60, RT_STACK_SIZE },
+    [RT_HEATER]      = { "heater",      50, RT_STACK_SIZE },
+    [RT_MCODE]       = { "mcode",       40, RT_STACK_SIZE },
+    [RT_CONTROL]     = { "control",     30, RT_STACK_SMALL },
+    [RT_LATENCY]     = { "latency",     20, RT_STACK_SMALL },
+    [RT_LOG]         = { "log",          0, RT_STACK_SMALL },
+    [RT_TEST]        = { "test",         0, RT_STACK_SMALL },
+};
+
+static bool rt_enabled = true;
+static bool mem_locked = false;
+static volatile bool no_permission = false;
+
+int rt_set_priorities(const char *spec)
+{
+    char buf[256];
+    char *tok;
+    char *save = NULL;
+    int max = sched_get_priority_max(SCHED_FIFO);
+    int i;
+
+    if (!strcmp(spec, "off")) {
+        rt_enabled = false;
+        return 0;
+    }
+
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        int prio;
+
+        if (!eq) {
+            printf("[rt]: '%s' is not name=priority\n", tok);
+            return -1;
+        }
+        *eq = 0;
+        prio = atoi(eq + 1);
+        if (prio < 0 || prio > max) {
+            printf("[rt]: priority %d of %s not in 0..%d\n", prio, tok, max);
+            return -1;
+        }
+
+        for (i = 0; i < NR_RT_THREADS; i++) {
+            if (!strcmp(tok, rt_slots[i].name)) {
+                rt_slots[i].prio = prio;
+                break;
+            }
+        }
+        if (i == NR_RT_THREADS) {
+            printf("[rt]: no thread %s\n", tok);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void rt_prefault(void *buf, size_t len)
+{
+    volatile uint8_t *p = buf;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    for (i = 0; i < len; i += page) {
+        p[i] = p[i];
+    }
+}
+
+static void __attribute__((noinline)) prefault_stack(void)
+{
+    volatile uint8_t stack[RT_STACK_PREFAULT];
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    for (i = 0; i < sizeof(stack); i += page) {
+        stack[i] = 0;
+    }
+}
+
+static void *rt_thread_start(void *arg)
+{
+    rt_slot_t *slot = arg;
+    struct sched_param sched;
+    int ret;
+
+    prefault_stack();
+
+    /*
+     * Set by the thread itself, without CAP_SYS_NICE it keeps
+     * running SCHED_OTHER instead of failing pthread_create
+     */
+    if (rt_enabled && slot->prio > 0) {
+        memset(&sched, 0, sizeof(sched));
+        sched.sched_priority = slot->prio;
+        ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sched);
+        if (ret == EPERM) {
+            if (!no_permission) {
+                no_permission = true;
+                printf("[rt]: no permission for SCHED_FIFO, running SCHED_OTHER\n");
+            }
+        } else if (ret) {
+            printf("[rt]: %s SCHED_FIFO %d failed, %s\n",
+                    slot->name, slot->prio, strerror(ret));
+        }
+    }
+
+    return slot->worker(slot->arg);
+}
+
+int rt_thread_create(rt_thread_t which, pthread_t *thread,
+                     void *(*worker)(void *), void *arg)
+{
+    rt_slot_t *slot = &rt_slots[which];
+    pthread_attr_t attr;
+    int ret;
+
+    slot->worker = worker;
+    slot->arg = arg;
+
+    if (pthread_attr_init(&attr)) {
+        return -1;
+    }
+
+    if (pthread_attr_setstacksize(&attr, slot->stack)) {
+        printf("[rt]: stack size of %s not set\n", slot->name);
+    }
+
+    ret = pthread_create(thread, &attr, rt_thread_start, slot);
+    pthread_attr_destroy(&attr);
+
+    return ret;
+}
+
+int rt_init(void)
+{
+    char buf[256];
+    int len = 0;
+    int i;
+
+    if (!rt_enabled) {
+        printf("[rt]: real-time profile off\n");
+        return 0;
+    }
+
+    /*
+     * Lock what is mapped and what will be, the bss buffers and the
+     * thread stacks are faulted in here and not in the first move
+     */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        printf("[rt]: mlockall failed, %s, memory is not locked\n", strerror(errno));
+    } else {
+        mem_locked = true;
+    }
+
+    /* Freed heap stays mapped, a later malloc does not fault */
+#ifdef M_TRIM_THRESHOLD
+    mallopt(M_TRIM_THRESHOLD, -1);
+#endif
+#ifdef M_MMAP_MAX
+    mallopt(M_MMAP_MAX, 0);
+#endif
+
+    for (i = 0; i < NR_RT_THREADS; i++) {
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s %d",
+                        i ? ", " : "", rt_slots[i].name, rt_slots[i].prio);
+    }
+    printf("[rt]: memory %s, SCHED_FIFO %s\n", mem_locked ? "locked" : "not locked", buf);
+
+    return 0;
+}
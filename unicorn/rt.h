@@ -0,0 +1,58 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * rt.h
+ * real-time profile of the firmware, locked memory and
+ * SCHED_FIFO priorities of the threads
+*/
+#ifndef _RT_H
+#define _RT_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Threads by priority, highest first */
+typedef enum {
+    RT_STEPPER = 0,
+    RT_PLANNER,
+    RT_GCODE_EMERG,
+    RT_GCODE,
+    RT_HEATER,
+    RT_MCODE,
+    RT_CONTROL,
+    RT_LATENCY,
+    RT_LOG,
+    RT_TEST,
+    NR_RT_THREADS,
+} rt_thread_t;
+
+#define RT_STACK_SIZE       (512 * 1024)    /* locked, not the 8M default */
+#define RT_STACK_SMALL      (128 * 1024)    /* threads off the motion path */
+#define RT_STACK_PREFAULT   (64 * 1024)
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * "off", or priorities by thread name, "stepper=80,heater=55",
+ * 0 runs a thread SCHED_OTHER. Before rt_init().
+ */
+extern int rt_set_priorities(const char *spec);
+
+/* Write every page of buf, it is not faulted in on the first use */
+extern void rt_prefault(void *buf, size_t len);
+
+/*
+ * Start a thread of the profile, it prefaults its stack and
+ * switches to its priority, SCHED_OTHER without CAP_SYS_NICE
+ */
+extern int rt_thread_create(rt_thread_t which, pthread_t *thread,
+                            void *(*worker)(void *), void *arg);
+
+/* Lock the memory and report the profile */
+extern int rt_init(void);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
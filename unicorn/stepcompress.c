@@ -0,0 +1,295 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * stepcompress.c
+ * exact per axis step times of a planner block and their compression
+ * into (interval, count, add) entries for the PRU step schedule
+ *
+ * The block trapezoid is inverted analytically, so every axis steps at
+ * its own exact times instead of the Bresenham ticks of the dominant
+ * axis. Runs of steps are then fitted by a second order sequence,
+ * greedily taking the longest run that stays within max_error.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "stepcompress.h"
+
+/* Largest interval of an entry, keeps the PRU clock compare signed */
+#define SCHED_MAX_INTERVAL  (0x40000000)
+
+/* Slowest rate a block runs at, avoids a division by zero */
+#define MIN_RATE            (1.0)
+
+/*------------------------------------------------------------------------
+ * Block profile
+ *-----------------------------------------------------------------------*/
+/*
+ * Time to cover ds speeding up from v0 at a, capped at vcap,
+ * 2 * ds / (v0 + v1) keeps the precision when a * ds is small.
+ */
+static double accel_time(double v0, double vcap, double a, double ds)
+{
+    double s_cap;
+
+    if (ds <= 0) {
+        return 0;
+    }
+    if (a <= 0) {
+        return ds / v0;
+    }
+
+    s_cap = (vcap * vcap - v0 * v0) / (2 * a);
+    if (ds <= s_cap) {
+        return 2 * ds / (v0 + sqrt(v0 * v0 + 2 * a * ds));
+    }
+    return (vcap - v0) / a + (ds - s_cap) / vcap;
+}
+
+/*
+ * Time to cover ds slowing down from vp at a, not below vf
+ */
+static double decel_time(double vp, double vf, double a, double ds)
+{
+    double s_floor;
+
+    if (ds <= 0) {
+        return 0;
+    }
+    if (a <= 0) {
+        return ds / vp;
+    }
+
+    s_floor = (vp * vp - vf * vf) / (2 * a);
+    if (ds <= s_floor) {
+        return 2 * ds / (vp + sqrt(vp * vp - 2 * a * ds));
+    }
+    return (vp - vf) / a + (ds - s_floor) / vf;
+}
+
+int step_profile_init(step_profile_t *p, uint32_t steps_count,
+                      uint32_t initial_rate, uint32_t nominal_rate,
+                      uint32_t final_rate, uint32_t accelerate_until,
+                      uint32_t decelerate_after, uint32_t acceleration)
+{
+    double s_accel, s_decel;
+
+    if (steps_count == 0 || nominal_rate == 0) {
+        return -1;
+    }
+
+    s_accel = accelerate_until;
+    if (s_accel > steps_count) {
+        s_accel = steps_count;
+    }
+    s_decel = decelerate_after;
+    if (s_decel < s_accel) {
+        s_decel = s_accel;
+    }
+    if (s_decel > steps_count) {
+        s_decel = steps_count;
+    }
+
+    p->a  = acceleration;
+    p->v0 = fmax(initial_rate, MIN_RATE);
+    p->vf = fmax(final_rate, MIN_RATE);
+
+    if (p->a <= 0) {
+        /* constant rate */
+        p->v0 = nominal_rate;
+        p->vf = nominal_rate;
+        s_accel = 0;
+        s_decel = steps_count;
+    }
+
+    if (s_accel > 0) {
+        p->vp = fmin(nominal_rate, sqrt(p->v0 * p->v0 + 2 * p->a * s_accel));
+    } else {
+        p->vp = p->v0;
+    }
+    p->vp = fmax(p->vp, MIN_RATE);
+    if (p->v0 > p->vp) {
+        p->v0 = p->vp;
+    }
+    if (p->vf > p->vp) {
+        p->vf = p->vp;
+    }
+
+    p->s_accel = s_accel;
+    p->s_decel = s_decel;
+    p->s_total = steps_count;
+
+    p->t_accel = accel_time(p->v0, p->vp, p->a, s_accel);
+    p->t_decel = p->t_accel + (s_decel - s_accel) / p->vp;
+    p->t_total = p->t_decel + decel_time(p->vp, p->vf, p->a, p->s_total - s_decel);
+
+    return 0;
+}
+
+double step_profile_time(const step_profile_t *p, double s)
+{
+    if (s <= p->s_accel) {
+        return accel_time(p->v0, p->vp, p->a, s);
+    }
+    if (s <= p->s_decel) {
+        return p->t_accel + (s - p->s_accel) / p->vp;
+    }
+    return p->t_decel + decel_time(p->vp, p->vf, p->a, s - p->s_decel);
+}
+
+void step_profile_step_times(const step_profile_t *p, uint64_t start,
+                             uint32_t steps, uint32_t first, int n,
+                             uint64_t *times)
+{
+    double ratio = p->s_total / steps;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        double s = (first + i + 0.5) * ratio;
+        times[i] = start + llround(step_profile_time(p, s) * SCHED_CLOCK_HZ);
+    }
+}
+
+/*------------------------------------------------------------------------
+ * Compression
+ *-----------------------------------------------------------------------*/
+/*
+ * Check the first count steps of interval, add against times
+ */
+static bool fit_check(const stepcompress_t *sc, const uint64_t *times, int count,
+                      int64_t interval, int64_t add)
+{
+    int64_t t = sc->last;
+    int64_t prev = sc->last;
+    int64_t iv = interval;
+    int j;
+
+    for (j = 0; j < count; j++) {
+        int64_t limit, err;
+
+        if (iv <= 0 || iv >= SCHED_MAX_INTERVAL) {
+            return false;
+        }
+        t += iv;
+
+        /* never more than half the gap to the step before */
+        limit = ((int64_t)times[j] - prev) / 2;
+        if (limit > sc->max_error) {
+            limit = sc->max_error;
+        }
+        err = t - (int64_t)times[j];
+        if (err > limit || -err > limit) {
+            return false;
+        }
+
+        prev = times[j];
+        iv += add;
+    }
+    return true;
+}
+
+/*
+ * Find interval and add for the first count steps, false if none fits
+ */
+static bool fit(const stepcompress_t *sc, const uint64_t *times, int count,
+                sched_entry_t *e)
+{
+    int64_t first = times[0] - sc->last;
+    int64_t span  = times[count - 1] - sc->last;
+    int64_t pairs = (int64_t)count * (count - 1) / 2;
+    int64_t add = 0;
+    int64_t iv[3];
+    int i;
+
+    if (count > 1) {
+        add = llround((double)(span - count * first) / pairs);
+        if (add < INT16_MIN || add > INT16_MAX) {
+            return false;
+        }
+    }
+
+    /* exact on the first step, exact on the last step, in between */
+    iv[0] = first;
+    iv[1] = llround((double)(span - add * pairs) / count);
+    iv[2] = (iv[0] + iv[1]) / 2;
+
+    for (i = 0; i < 3; i++) {
+        if (fit_check(sc, times, count, iv[i], add)) {
+            e->interval = iv[i];
+            e->count = count;
+            e->add = add;
+            return true;
+        }
+    }
+    return false;
+}
+
+int stepcompress_push(stepcompress_t *sc, const uint64_t *times, int n,
+                      stepcompress_emit_t emit, void *arg)
+{
+    int entries = 0;
+
+    while (n > 0) {
+        sched_entry_t e, best;
+        int limit = (n < SCHED_MAX_COUNT) ? n : SCHED_MAX_COUNT;
+        int lo = 1, hi = limit + 1, c;
+        int64_t gap = times[0] - sc->last;
+
+        /* Rounding put the last step on this one, take it right after */
+        if (gap <= 0) {
+            gap = 1;
+            hi = 2;
+        }
+
+        /* Too long for one interval, wait without stepping */
+        if (gap >= SCHED_MAX_INTERVAL) {
+            e.interval = SCHED_MAX_INTERVAL / 2;
+            e.count = 0;
+            e.add = 0;
+            if (emit(arg, &e) < 0) {
+                return -1;
+            }
+            sc->last += e.interval;
+            entries++;
+            continue;
+        }
+
+        best.interval = gap;
+        best.count = 1;
+        best.add = 0;
+
+        /* Double the run while it fits, then bisect the last step */
+        for (c = 2; c < hi; c *= 2) {
+            if (!fit(sc, times, c, &e)) {
+                hi = c;
+                break;
+            }
+            lo = c;
+            best = e;
+        }
+        while (hi - lo > 1) {
+            c = (lo + hi) / 2;
+            if (fit(sc, times, c, &e)) {
+                lo = c;
+                best = e;
+            } else {
+                hi = c;
+            }
+        }
+
+        if (emit(arg, &best) < 0) {
+            return -1;
+        }
+        entries++;
+
+        /* Continue from where the PRU puts the last step, not the exact time */
+        sc->last += (uint64_t)best.count * best.interval
+                  + (int64_t)best.add * best.count * (best.count - 1) / 2;
+
+        times += best.count;
+        n -= best.count;
+    }
+
+    return entries;
+}
@@ -0,0 +1,100 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * stepcompress.h
+ * exact per axis step times of a planner block and their compression
+ * into (interval, count, add) entries for the PRU step schedule
+*/
+#ifndef _STEPCOMPRESS_H
+#define _STEPCOMPRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* PRU-ICSS IEP counter, the clock of the step schedule */
+#define SCHED_CLOCK_HZ      (200000000)
+
+/*
+ * One schedule entry, count steps at
+ *   last + (j + 1) * interval + add * j * (j + 1) / 2,  j = 0 .. count - 1
+ * where last is the time of the step before.
+ * count 0 is a control entry, add then carries the SCHED_FLAG_* bits
+ * and interval advances the clock of the axis without a step.
+ */
+typedef struct {
+    uint32_t interval;
+    uint16_t count;
+    int16_t  add;
+} __attribute__((packed)) sched_entry_t;
+
+#define SCHED_FLAG_DIR          (1 << 0)    /* dir pin level */
+#define SCHED_FLAG_NEG          (1 << 1)    /* steps count the position down */
+#define SCHED_FLAG_SET_DIR      (1 << 2)    /* apply DIR and NEG */
+#define SCHED_FLAG_ABS          (1 << 3)    /* interval is the absolute clock */
+#define SCHED_FLAG_SELECT       (1 << 4)    /* switch to output SCHED_FLAG_OUT() */
+#define SCHED_FLAG_OUT(n)       ((n) << 8)
+
+#define SCHED_MAX_COUNT         (0xffff)
+
+/*
+ * Trapezoid of a block in step events and seconds,
+ * as the planner filled it in block_t
+ */
+typedef struct {
+    double v0;          /* step events/s at the start */
+    double vp;          /* peak */
+    double vf;          /* at the end */
+    double a;           /* step events/s^2 */
+    double s_accel;     /* step events at the end of the acceleration */
+    double s_decel;     /* step events at the start of the deceleration */
+    double s_total;
+    double t_accel;     /* time at s_accel */
+    double t_decel;     /* time at s_decel */
+    double t_total;
+} step_profile_t;
+
+/*
+ * Compression state of one axis, times in SCHED_CLOCK_HZ cycles
+ */
+typedef struct {
+    uint64_t last;          /* time of the last step, as the PRU replays it */
+    uint32_t max_error;     /* allowed deviation from the exact step time */
+} stepcompress_t;
+
+/* Called for every entry, return -1 to abort */
+typedef int (*stepcompress_emit_t)(void *arg, const sched_entry_t *e);
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Return -1 if the rates do not describe a move
+ */
+extern int step_profile_init(step_profile_t *p, uint32_t steps_count,
+                             uint32_t initial_rate, uint32_t nominal_rate,
+                             uint32_t final_rate, uint32_t accelerate_until,
+                             uint32_t decelerate_after, uint32_t acceleration);
+
+/* Time in seconds the block reaches step event s */
+extern double step_profile_time(const step_profile_t *p, double s);
+
+/*
+ * Exact times in cycles of the steps first .. first + n - 1 of an axis
+ * with steps of the block's steps_count, the block starting at start.
+ * Step k is taken when the axis passes k - 0.5 steps.
+ */
+extern void step_profile_step_times(const step_profile_t *p, uint64_t start,
+                                    uint32_t steps, uint32_t first, int n,
+                                    uint64_t *times);
+
+/*
+ * Compress n increasing step times into entries, times must be after sc->last.
+ * Return the number of entries emitted, -1 on error.
+ */
+extern int stepcompress_push(stepcompress_t *sc, const uint64_t *times, int n,
+                             stepcompress_emit_t emit, void *arg);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
@@ -19,12 +19,17 @@
 #include "analog.h"
 #include "parameter.h"
 #include "planner.h"
+#include "kinematics.h"
 #include "unicorn.h"
 #include "stepper.h"
 #include "stepper_pruss.h"
+#include "stepper_sched.h"
 
 #include "lmsw.h"
+#include "pwm.h"
 #include "common.h"
+#include "latency.h"
+#include "rt.h"
 
 #include "util/Fifo.h"
 #include "util/Pause.h"
@@ -53,6 +58,12 @@ typedef struct {
 
     int  (*queue_get_len)(void);
     int  (*queue_get_max_rate)(void);
+    uint32_t (*queue_get_mcode_count)(void);
+    int  (*queue_wait_event)(int timeout_ms);
+    int  (*queue_pwm_out)(uint32_t reg, uint32_t period);
+    int  (*queue_rate_scale)(int percent);
+    int  (*queue_get_pos)(uint32_t *pos);
+    int  (*queue_pending)(uint32_t pos);
 
     int  (*send_cmd)(st_cmd_t *cmd);
 } stepper_ops_t;
@@ -62,6 +73,13 @@ static int nr_steppers = 0;
 
 static stepper_ops_t *stepper_ops = NULL;
 
+/* step schedule backend instead of the pruss queue */
+static bool use_sched = false;
+
+/* Live rate of the queued moves, M220 percent and the underrun throttle */
+static int rate_percent = 100;
+static int rate_throttle = 100;
+
 static int st_dev_fd;
 
 static pthread_t stepper_thread;
@@ -470,80 +488,7 @@ int stepper_homing_axis(uint8_t axis)
 
 int get_homing_dir()
 {
-    uint32_t dir = 0;
-	if (pa.machine_type == MACHINE_COREXY) {
-		if (pa.invert_x_dir) {
-			dir &= ~(1 << X_AXIS);
-		} else {
-			dir |=  (1 << X_AXIS);
-		}
-
-		if (pa.invert_y_dir) {
-			dir &= ~(1 << Y_AXIS);
-		} else {
-			dir |=  (1 << Y_AXIS);
-		}
-
-		if (pa.invert_z_dir) {
-			dir &= ~(1 << Z_AXIS);
-		} else {
-			dir |=  (1 << Z_AXIS);
-		}
-		if (pa.invert_e_dir) {
-			dir &= ~(1 << E_AXIS);
-		} else {
-			dir |=  (1 << E_AXIS);
-		}
-	} else if (pa.machine_type == MACHINE_DELTA) {
-		/* delta */
-		if (pa.invert_x_dir) {
-			dir |=  (1 << X_AXIS);
-		} else {
-			dir &= ~(1 << X_AXIS);
-		}
-
-		if (pa.invert_y_dir) {
-			dir |=  (1 << Y_AXIS);
-		} else {
-			dir &= ~(1 << Y_AXIS);
-		}
-
-		if (pa.invert_z_dir) {
-			dir |=  (1 << Z_AXIS);
-		} else {
-			dir &= ~(1 << Z_AXIS);
-		}
-		if (pa.invert_e_dir) {
-			dir &= ~(1 << E_AXIS);
-		} else {
-			dir |=  (1 << E_AXIS);
-		}
-	} else {
-		/* xyz */
-		if (pa.invert_x_dir) {
-			dir &= ~(1 << X_AXIS);
-		} else {
-			dir |=  (1 << X_AXIS);
-		}
-
-		if (pa.invert_y_dir) {
-			dir &= ~(1 << Y_AXIS);
-		} else {
-			dir |=  (1 << Y_AXIS);
-		}
-
-		if (pa.invert_z_dir) {
-			dir &= ~(1 << Z_AXIS);
-		} else {
-			dir |=  (1 << Z_AXIS);
-		}
-		if (pa.invert_e_dir) {
-			dir &= ~(1 << E_AXIS);
-		} else {
-			dir |=  (1 << E_AXIS);
-		}
-	}
-	return dir;
+	return kinematics->homing_dir();
 }
 
 /*
@@ -892,6 +837,132 @@ int stepper_get_queue_len(void)
 
     return len;
 }
+/*
+ * M codes in the queue the PRU has reached
+ */
+uint32_t stepper_get_mcode_count(void)
+{
+    if (stepper_ops && stepper_ops->queue_get_mcode_count) {
+        return stepper_ops->queue_get_mcode_count();
+    }
+    return 0;
+}
+
+/*
+ * Queue position after the last move queued, -1 if the stepper
+ * backend has none
+ */
+int stepper_queue_get_pos(uint32_t *pos)
+{
+    if (stepper_ops && stepper_ops->queue_get_pos) {
+        return stepper_ops->queue_get_pos(pos);
+    }
+    return -1;
+}
+
+/*
+ * 1 while the PRU is not past pos of stepper_queue_get_pos(),
+ * -1 if the stepper backend can not tell
+ */
+int stepper_queue_pending(uint32_t pos)
+{
+    if (stepper_ops && stepper_ops->queue_pending) {
+        return stepper_ops->queue_pending(pos);
+    }
+    return -1;
+}
+
+/*
+ * Sleep until the PRU passed an M code or drained the queue,
+ * at most timeout_ms. -1 if the wait was terminated.
+ */
+int stepper_wait_event(int timeout_ms)
+{
+    if (stepper_ops && stepper_ops->queue_wait_event) {
+        return stepper_ops->queue_wait_event(timeout_ms);
+    }
+    usleep(timeout_ms * 1000);
+    return 0;
+}
+
+/*
+ * Out of a pwm for plan_queue_pwm(), -1 if the stepper
+ * backend can not write it in step with the moves
+ */
+int stepper_pwm_out(channel_tag pwm)
+{
+    uint32_t reg, period;
+
+    if (!pwm || !stepper_ops || !stepper_ops->queue_pwm_out) {
+        return -1;
+    }
+    if (pwm_get_compare(pwm, &reg, &period) < 0) {
+        return -1;
+    }
+    return stepper_ops->queue_pwm_out(reg, period);
+}
+
+static int stepper_update_rate_scale(void)
+{
+    if (!stepper_ops || !stepper_ops->queue_rate_scale) {
+        return -1;
+    }
+    return stepper_ops->queue_rate_scale(rate_percent * rate_throttle / 100);
+}
+
+/*
+ * Scale the rate of the moves already queued, return the percent
+ * applied, -1 if the stepper backend can not do it
+ */
+int stepper_set_rate_scale(int percent)
+{
+    if (!stepper_ops || !stepper_ops->queue_rate_scale) {
+        return -1;
+    }
+    rate_percent = constrain(percent, RATE_SCALE_MIN, RATE_LIVE_MAX);
+    if (stepper_update_rate_scale() < 0) {
+        return -1;
+    }
+    return rate_percent;
+}
+
+static int offline_send_cmd(st_cmd_t *cmd)
+{
+    return 0;
+}
+
+static int offline_queue_get_len(void)
+{
+    return 0;
+}
+
+/*
+ * No stepper hardware, for the offline estimate. Moves never reach
+ * the stepper thread, they are taken from the planner by estimate.c,
+ * commands are dropped. Instead of stepper_config and stepper_init.
+ */
+int stepper_offline_init(void)
+{
+    stepper_ops = calloc(1, sizeof(stepper_ops_t));
+    if (!stepper_ops) {
+        return -1;
+    }
+
+    stepper_ops->send_cmd      = offline_send_cmd;
+    stepper_ops->queue_get_len = offline_queue_get_len;
+
+    stop = false;
+    started = true;
+    return 0;
+}
+
+/*
+ * Select the step schedule backend, before stepper_config
+ */
+void stepper_set_sched(bool sched)
+{
+    use_sched = sched;
+}
 /*
  * Block until all buffered steps are executed
  */
@@ -1012,6 +1083,7 @@ void *stepper_thread_worker(void *arg)
         Pause_test(hPause_printing);
     }
 
+    FTRACE_THREAD("stepper");
     STEPPER_DBG("start up stepper thread\n");
 
     while (!stop || exit_waiting) 
@@ -1019,6 +1091,7 @@ void *stepper_thread_worker(void *arg)
         //TODO: Blocking exit, Get all block from buffer
         
         fifo_num = Fifo_getNumEntries(hFifo_plan2st);
+        FTRACE_COUNTER("fifo_plan2st", fifo_num);
         if (fifo_num > 0) {
             //STEPPER_DBG("stepper fifo_num %d\n", fifo_num);
             for (i = 0; i < fifo_num; i++) {
@@ -1047,7 +1120,19 @@ void *stepper_thread_worker(void *arg)
                              * rather than wait at the corner for a buffer refill 
                              */
 							int slowdown_len = pa.slowdown_percent / 100.0f * SLOWDOWN_LEN;
-                            if (len <= slowdown_len) {
+                            if (stepper_ops->queue_rate_scale) {
+                                /* Throttle the queued moves, the PRU ramps the rate */
+                                int throttle = 100;
+                                if (len <= slowdown_len) {
+                                    throttle = constrain(len * 100 / slowdown_len,
+                                                         RATE_SCALE_MIN, 100);
+                                }
+                                if (throttle != rate_throttle) {
+                                    rate_throttle = throttle;
+                                    stepper_update_rate_scale();
+                                    ULOG(LOG_DEBUG, "[STEPPER]:Throttle %d%%\n", throttle);
+                                }
+                            } else if (len <= slowdown_len) {
                                 scale = (float)len / ((float)slowdown_len);
                                 if (scale < 0.1) {
                                     scale = 0.1;
@@ -1055,9 +1140,7 @@ void *stepper_thread_worker(void *arg)
                                 block->initial_rate *= scale;
                                 block->nominal_rate *= scale;
                                 block->final_rate *= scale;
-                                //STEPPER_DBG("Slow down...%f\n", scale);
-                                printf("Slow down...%f\n", scale);
-     							syslog(LOG_DEBUG, "[STEPPER]:Slow down...%f\n", scale);   
+                                ULOG(LOG_INFO, "[STEPPER]:Slow down...%f\n", scale);
 							#if 0  //lkj for debug slowdown
                             int block_size = plan_get_block_size();
                             STEPPER_DBG("block %d, fifo %d, queue len %d\n", 
@@ -1070,7 +1153,10 @@ void *stepper_thread_worker(void *arg)
                     /* queue move to pru */
                     if (!stop) {
                         if (stepper_ops->queue_move) {
+                            FTRACE_BEGIN("queue_move");
                             stepper_ops->queue_move(block);
+                            FTRACE_END();
+                            latency_block_queued(block);
                         }
                     }
 
@@ -1212,6 +1298,27 @@ int stepper_config(stepper_config_t *pcfgs, int nr_cfgs)
         nr_steppers++;
     }
 
+    if (use_sched) {
+        STEPPER_DBG("stepper backend: step schedule\n");
+        stepper_ops->init          = sched_stepper_init;
+        stepper_ops->exit          = sched_stepper_exit;
+
+        stepper_ops->start         = sched_stepper_start;
+        stepper_ops->stop          = sched_stepper_stop;
+
+        stepper_ops->queue_move    = sched_queue_move;
+        stepper_ops->queue_is_full = sched_queue_is_full;
+        stepper_ops->queue_wait    = sched_queue_wait;
+        stepper_ops->queue_terminate_wait = sched_queue_terminate_wait;
+        stepper_ops->queue_get_len = sched_queue_get_len;
+        stepper_ops->queue_get_max_rate = sched_queue_get_max_rate;
+        stepper_ops->queue_get_mcode_count = sched_queue_get_mcode_count;
+        stepper_ops->queue_parameter_update = sched_stepper_parameter_update;
+
+        stepper_ops->send_cmd      = sched_send_cmd;
+        return 0;
+    }
+
     /* Register queue ops */
     stepper_ops->init          = pruss_stepper_init,
     stepper_ops->exit          = pruss_stepper_exit,
@@ -1225,6 +1332,12 @@ int stepper_config(stepper_config_t *pcfgs, int nr_cfgs)
     stepper_ops->queue_terminate_wait = pruss_queue_terminate_wait;
     stepper_ops->queue_get_len = pruss_queue_get_len;
     stepper_ops->queue_get_max_rate = pruss_queue_get_max_rate;
+    stepper_ops->queue_get_mcode_count = pruss_queue_get_mcode_count;
+    stepper_ops->queue_wait_event = pruss_queue_wait_event;
+    stepper_ops->queue_pwm_out = pruss_queue_pwm_out;
+    stepper_ops->queue_rate_scale = pruss_set_rate_scale;
+    stepper_ops->queue_get_pos = pruss_queue_get_pos;
+    stepper_ops->queue_pending = pruss_queue_pending;
     stepper_ops->queue_parameter_update = pruss_stepper_parameter_update;
 
     stepper_ops->send_cmd      = pruss_send_cmd;
@@ -1237,8 +1350,6 @@ int stepper_config(stepper_config_t *pcfgs, int nr_cfgs)
 int stepper_init(void)
 {
     int ret;
-    pthread_attr_t attr;
-    //struct sched_param sched;
 
 	STEPPER_DBG("stepper_init called.\n");
 
@@ -1334,25 +1445,11 @@ int stepper_init(void)
 
     stop = false;
 
-    /* Initial the pthread attribute */
-    if (pthread_attr_init(&attr)) {
-        return -1;
-    }
-
-    /* Force the thread to use custom scheduling attributes  */
-	#if 0 //for android
-    if (pthread_attr_setschedpolicy(&attr, PTHREAD_EXPLICIT_SCHED)) {
-        return -1;
-    }
-    sched.sched_priority = sched_get_priority_max(SCHED_FIFO);
-
-    if (pthread_attr_setschedparam(&attr, &sched)) {
-        return -1;
-    }
-	#endif
+    /* 8192 blocks, not faulted in by the first moves */
+    rt_prefault(stepper_blocks, sizeof(stepper_blocks));
     
     STEPPER_DBG("--- Creating stepper_thread..."); 
-    ret = pthread_create(&stepper_thread, &attr, stepper_thread_worker, NULL);
+    ret = rt_thread_create(RT_STEPPER, &stepper_thread, stepper_thread_worker, NULL);
     if (ret) {
         printf("create stepper thread failed with ret %d\n", ret);
         return -1;
@@ -1438,9 +1535,7 @@ void stepper_exit(int blocking)
  */
 int stepper_pause(void)
 {
-    int pos_x;
-    int pos_y;
-    int pos_z;
+    long pos[3];
 
     if (!paused) { 
         paused = true;
@@ -1455,56 +1550,11 @@ int stepper_pause(void)
         	stepper_wait_for_lmsw(X_AXIS);
         	stepper_wait_for_lmsw(Y_AXIS);
 
-            /* Update pause position */ 
-            if (pa.machine_type == MACHINE_DELTA) {
-
-        	    stepper_wait_for_lmsw(Z_AXIS);
-
-                float delta_tower1_x = -SIN_60 * (pa.radius + pa.radius_adj[0]);
-                float delta_tower1_y = -COS_60 * (pa.radius + pa.radius_adj[0]);
-                float delta_tower2_x =  SIN_60 * (pa.radius + pa.radius_adj[1]);
-                float delta_tower2_y =  COS_60 * (pa.radius + pa.radius_adj[1]);
-                float delta_tower3_x = 0.0;
-                float delta_tower3_y = (pa.radius + pa.radius_adj[2]);
-
-                float delta_diagonal_rod_2_tower1 = pow(pa.diagonal_rod + pa.diagonal_rod_adj[0], 2);
-                float delta_diagonal_rod_2_tower2 = pow(pa.diagonal_rod + pa.diagonal_rod_adj[1], 2);
-                float delta_diagonal_rod_2_tower3 = pow(pa.diagonal_rod + pa.diagonal_rod_adj[2], 2);
-
-                float delta_x = sqrt(delta_diagonal_rod_2_tower1 
-                                    - powf(delta_tower1_x, 2)
-                                    - powf(delta_tower1_y, 2)
-                                    ) + pa.z_home_pos;
-
-                float delta_y = sqrt(delta_diagonal_rod_2_tower2 
-                                    - powf(delta_tower2_x, 2)
-                                    - powf(delta_tower2_y, 2)
-                                    ) + pa.z_home_pos;
-
-                float delta_z = sqrt(delta_diagonal_rod_2_tower3 
-                                    - powf(delta_tower3_x, 2)
-                                    - powf(delta_tower3_y, 2)
-                                    ) + pa.z_home_pos;
-
-
-                pos_x = lround(delta_x * pa.axis_steps_per_unit[X_AXIS]);
-                pos_y = lround(delta_y * pa.axis_steps_per_unit[X_AXIS]);
-                pos_z = lround(delta_z * pa.axis_steps_per_unit[X_AXIS]);
-                
-                pos_x -= stepper_get_position(X_AXIS);
-                pos_y -= stepper_get_position(Y_AXIS);
-                pos_z -= stepper_get_position(Z_AXIS);
-            } else {
-                pos_x = stepper_get_position(X_AXIS);
-                pos_y = stepper_get_position(Y_AXIS);
-                pos_z = stepper_get_position(Z_AXIS);
-            }
-
             /* Set the pause position, so the PRU know where to resume 
              * COREXY type, calculate resume x,y,z by itself in pru code.
              */
-            if (pa.machine_type == MACHINE_XYZ || pa.machine_type == MACHINE_DELTA) {
-                stepper_set_pause_position(pos_x, pos_y, pos_z);
+            if (kinematics->pause_position(pos) == 0) {
+                stepper_set_pause_position(pos[X_AXIS], pos[Y_AXIS], pos[Z_AXIS]);
             }
         } else {
             return -1;
@@ -1561,6 +1611,7 @@ int stepper_start(void)
 #ifdef SLOWDOWN
         first_run = 0;
 #endif
+        rate_throttle = 100;
         
         STEPPER_DBG("stepper_start...........\n");
 
@@ -1570,12 +1621,18 @@ int stepper_start(void)
 
         stepper_reset_fifo();
 
+        /* A stop left the queue waits woken, they block again from here */
+        if (stepper_ops->queue_terminate_wait) {
+            stepper_ops->queue_terminate_wait(0);
+        }
+
         //STEPPER_DBG("After %d plan2st fifo left\n", Fifo_getNumEntries(hFifo_plan2st));
         //STEPPER_DBG("After %d st2plan fifo left\n", Fifo_getNumEntries(hFifo_st2plan));
 
         if (stepper_ops->start) {
             stepper_ops->start();
         }
+        stepper_update_rate_scale();
 
         st_cmd_t cmd = {
             .ctrl.cmd = ST_CMD_START,
@@ -1617,6 +1674,9 @@ int stepper_stop(bool blocking)
             .ctrl.cmd = ST_CMD_STOP,
         };
 
+        /* The queue positions start over */
+        latency_flush();
+
         if (stepper_ops->send_cmd) {
             stepper_ops->send_cmd(&cmd);
         } else {
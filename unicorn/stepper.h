@@ -10,6 +10,12 @@
 
 #define STEPPER_SPI_DEV "/dev/stepper_spi"
 
+/*
+ * Most of M220 applied to the moves already queued, percent.
+ * Faster step delays would also raise the acceleration by the square.
+ */
+#define RATE_LIVE_MAX        (100)
+
 typedef const struct {
     channel_tag  tag;
     channel_tag  vref;
@@ -147,6 +153,14 @@ extern float stepper_get_position_mm(uint8_t axis);
 extern void stepper_parameter_update(void);
 
 extern int stepper_get_queue_len(void);
+extern uint32_t stepper_get_mcode_count(void);
+extern int stepper_queue_get_pos(uint32_t *pos);
+extern int stepper_queue_pending(uint32_t pos);
+extern int stepper_wait_event(int timeout_ms);
+extern int stepper_pwm_out(channel_tag pwm);
+extern int stepper_set_rate_scale(int percent);
+extern void stepper_set_sched(bool sched);
+extern int stepper_offline_init(void);
 extern void stepper_load_filament(int cmd); //1, upload , 2 unload , 3 pause 
 
 extern int stepper_config_lmsw(uint8_t axis, bool high); //default active low 
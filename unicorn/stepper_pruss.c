@@ -26,6 +26,7 @@
 #include "pruss.h"
 #include "stepper.h"
 #include "stepper_pruss.h"
+#include "kinematics.h"
 
 #if 0
 static struct active_extruder_gpio g_active_ext_gpio[MAX_EXTRUDER] = {
@@ -73,18 +74,56 @@ struct position {
  */
 //static volatile struct queue *pru_queue = NULL;
 volatile struct queue *pru_queue = NULL;
-static volatile unsigned int queue_pos = 0;
+static volatile unsigned int queue_pos = 0;     /* QUEUE_UNIT index */
+
+#define QUEUE_UNITS     (QUEUE_LEN * sizeof(struct queue_element) / QUEUE_UNIT)
+#define QUEUE_BYTES     (QUEUE_LEN * sizeof(struct queue_element))
+
+/* The loaded image decodes compact elements */
+static bool queue_compact = false;
 
 static int mem_fd;
 static void *ddr_mem = NULL;
 
+/* PRU events of the stepper thread, stepper_sync and the M code thread */
+static pruss_event_t *full_event = NULL;
+static pruss_event_t *sync_event = NULL;
+static pruss_event_t *mcode_event = NULL;
+
+static int exit_queue_wait = 0;
+
+/* Period in compare counts of queue->pwm_out[] */
+static uint32_t pwm_period[PRU_PWM_OUTS];
+
+static struct rate_scale *rate_scale = NULL;
+static struct pru_stats *pru_stats = NULL;
+
 
 /*
  * pruss queue operation
  */
+static inline volatile uint8_t *queue_unit(unsigned int unit)
+{
+    return (volatile uint8_t *)pru_queue->ring_buf + (unit % QUEUE_UNITS) * QUEUE_UNIT;
+}
+
+static inline int queue_element_units(volatile uint8_t *e)
+{
+    return (e[3] & QUEUE_TYPE_COMPACT) ? 1 : 2;
+}
+
+static void queue_clear(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < QUEUE_UNITS; i++) {
+        *queue_unit(i) = STATE_EMPTY;
+    }
+    queue_pos = 0;
+}
+
 static volatile struct queue *queue_mmap(void)
 {
-    int i;
 
 #if defined(SHARE_PRU_MEM)
     void *dram = NULL;
@@ -126,28 +165,48 @@ static volatile struct queue *queue_mmap(void)
     pru_queue = (struct queue *)(ddr_mem);
 #endif
 
-    for (i = 0; i < QUEUE_LEN; i++) {
-        pru_queue->ring_buf[i].state = STATE_EMPTY;
-    }
-    queue_pos = 0;
+    queue_clear();
 
     return pru_queue;
 }
 
-static volatile struct queue_element *queue_get_next_element(void)
+/*
+ * Wait for units free queue units, a full ring is refilled
+ * once the PRU raised the low-water event.
+ * The PRU empties the second unit of a wide element first.
+ * NULL only if the queue is being stopped.
+ */
+static volatile uint8_t *queue_get_next_element(int units)
 {
-    queue_pos %= QUEUE_LEN;
+    int i;
+    int ret;
 
-    /* Update queue pos */
-    pru_queue->write_pos = queue_pos * sizeof(struct queue_element);
+    queue_pos %= QUEUE_UNITS;
 
-    /* Wait for an available queue element */
-    while (pru_queue->ring_buf[queue_pos].state != STATE_EMPTY) {
-        prussdrv_pru_wait_event(PRU_EVTOUT_0);
-        prussdrv_pru_clear_event(PRU_EVTOUT_0, PRU0_ARM_INTERRUPT);
+    for (i = 0; i < units; i++) {
+        while (*queue_unit(queue_pos + i) != STATE_EMPTY) {
+            /* The PRU clears the mark with the event, set it for each wait */
+            pru_queue->irq_low_water = QUEUE_LOW_WATER * sizeof(struct queue_element);
+            __sync_synchronize();
+            if (*queue_unit(queue_pos + i) == STATE_EMPTY) {
+                break;
+            }
+
+            FTRACE_BEGIN("pru_full");
+            ret = pruss_event_wait(full_event, 1000);
+            FTRACE_END();
+            if (ret < 0) {
+                if (exit_queue_wait) {
+                    return NULL;
+                }
+                /* a wake left from the last stop, keep waiting for the slot */
+                pruss_event_wake(false);
+            }
+        }
     }
 
-    return &pru_queue->ring_buf[queue_pos++];
+    queue_pos += units;
+    return queue_unit(queue_pos - units);
 }
 
 //test
@@ -196,30 +255,251 @@ static void queue_dump_element(volatile struct queue_element *e)
 }
 #endif
 
-static void queue_put_element(struct queue_element *element)
+/*
+ * Compact form of a wide element, -1 if it does not fit
+ */
+static int queue_compact_element(const struct queue_element *qe,
+                                 struct queue_element_compact *qc)
 {
-    uint8_t state_to_send = element->state;
-    if (state_to_send == STATE_EMPTY) {
-        printf("queue an empty element? %#x\n", element->state);
-        return;
+    if (qe->loops_accel > UINT16_MAX || qe->loops_travel > UINT16_MAX
+            || qe->loops_decel > UINT16_MAX
+            || qe->accel_cycles > UINT16_MAX || qe->decel_cycles > UINT16_MAX
+            || qe->steps_x > UINT16_MAX || qe->steps_y > UINT16_MAX
+            || qe->steps_z > UINT16_MAX || qe->steps_e > UINT16_MAX
+            || qe->steps_count != qe->loops_accel + qe->loops_travel + qe->loops_decel
+            || qe->pwm_ctl || qe->pwm_duty) {
+        return -1;
     }
 
+    bzero(qc, sizeof(*qc));
+    qc->state          = qe->state;
+    qc->direction_bits = qe->direction_bits;
+    qc->direction      = qe->direction;
+    qc->type           = qe->type | QUEUE_TYPE_COMPACT;
+
+    qc->loops_accel    = qe->loops_accel;
+    qc->loops_travel   = qe->loops_travel;
+    qc->loops_decel    = qe->loops_decel;
+    qc->accel_cycles   = qe->accel_cycles;
+    qc->travel_cycles  = qe->travel_cycles;
+    qc->decel_cycles   = qe->decel_cycles;
+    qc->ext_step_bit   = qe->ext_step_bit;
+    qc->init_cycles    = qe->init_cycles;
+
+    qc->steps_x        = qe->steps_x;
+    qc->steps_y        = qe->steps_y;
+    qc->steps_z        = qe->steps_z;
+    qc->steps_e        = qe->steps_e;
+    return 0;
+}
+
+static void queue_put_units(void *element, int units)
+{
+    uint8_t *e = element;
+    uint8_t state_to_send = e[0];
+    volatile uint8_t *qe;
+
     /* Initially, we copy everything with 'STATE_EMPTY', then flip the state
      * to avoid a race condition while copying.
      */
-    element->state = STATE_EMPTY;
-    volatile struct queue_element *qe = queue_get_next_element();
-    *qe = *element;
+    e[0] = STATE_EMPTY;
+    qe = queue_get_next_element(units);
+    if (!qe) {
+        return;
+    }
+    if (units == 1) {
+        *(volatile struct queue_element_compact *)qe = *(struct queue_element_compact *)e;
+    } else {
+        *(volatile struct queue_element *)qe = *(struct queue_element *)e;
+    }
+
+    /*
+     * Last element written, the PRU raises the drain event after it.
+     * Published before the state flip, a PRU done with the element
+     * must not still see the previous write_pos.
+     */
+    pru_queue->write_pos = qe - (volatile uint8_t *)pru_queue->ring_buf;
+    __sync_synchronize();
 
     /* Fully inited. Tell busy-waiting PRU by flipping the state */
-    qe->state = state_to_send;
+    qe[0] = state_to_send;
+}
 
-#if 0
-    if (DBG(D_STEPPER)) {
-        queue_dump_element(qe);
+static void queue_put_element(struct queue_element *element)
+{
+    struct queue_element_compact qc;
+
+    if (element->state == STATE_EMPTY) {
+        printf("queue an empty element? %#x\n", element->state);
+        return;
+    }
+
+    if (queue_compact && queue_compact_element(element, &qc) == 0) {
+        queue_put_units(&qc, 1);
+        return;
+    }
+
+    /* A wide element does not wrap, the PRU skips a PWM element without event */
+    if (queue_pos % QUEUE_UNITS == QUEUE_UNITS - 1) {
+        bzero(&qc, sizeof(qc));
+        qc.state = STATE_FILLED;
+        qc.type  = BLOCK_PWM_CMD | QUEUE_TYPE_COMPACT;
+        queue_put_units(&qc, 1);
+    }
+    queue_put_units(element, 2);
+}
+/*
+ * Register a PWM compare register for the PRU to write,
+ * return its out, -1 if all are taken
+ */
+int pruss_queue_pwm_out(uint32_t reg, uint32_t period)
+{
+    int i;
+
+    for (i = 0; i < PRU_PWM_OUTS; i++) {
+        if (pru_queue->pwm_out[i] == reg) {
+            pwm_period[i] = period;
+            return i;
+        }
+    }
+    for (i = 0; i < PRU_PWM_OUTS; i++) {
+        if (pru_queue->pwm_out[i] == 0) {
+            pwm_period[i] = period;
+            pru_queue->pwm_out[i] = reg;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Steps between two units of the rate scale, so the speed of the
+ * fastest axis changes within its acceleration: v^2 / (RATE_ONE * a)
+ */
+static uint32_t rate_scale_ramp(void)
+{
+    float ramp = 0;
+    float v, a;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        v = pa.max_feedrate[i] * pa.axis_steps_per_unit[i];
+        a = pa.max_acceleration_units_per_sq_second[i] * pa.axis_steps_per_unit[i];
+        if (a > 0) {
+            ramp = fmax(ramp, v * v / (RATE_ONE * a));
+        }
+    }
+    return (uint32_t)ceilf(ramp);
+}
+
+static void rate_scale_reset(void)
+{
+    if (!rate_scale) {
+        return;
+    }
+    rate_scale->cur    = RATE_ONE;
+    rate_scale->target = RATE_ONE;
+    rate_scale->ramp   = rate_scale_ramp();
+    rate_scale->count  = 0;
+}
+
+/*
+ * Scale the rate of the moves already queued to percent,
+ * the PRU ramps to it within the acceleration
+ */
+int pruss_set_rate_scale(int percent)
+{
+    if (!rate_scale) {
+        return -1;
+    }
+    percent = constrain(percent, RATE_SCALE_MIN, RATE_SCALE_MAX);
+    rate_scale->target = RATE_ONE * 100 / percent;
+    return 0;
+}
+
+/*
+ * Clear the counters, and the magic when another image starts up,
+ * the PRU writes it from INIT
+ */
+static void pru_stats_reset(bool magic)
+{
+    uint32_t m;
+
+    if (!pru_stats) {
+        return;
+    }
+    m = magic ? 0 : pru_stats->magic;
+    memset((void *)pru_stats, 0, sizeof(*pru_stats));
+    pru_stats->magic = m;
+}
+
+/*
+ * Copy of the PRU counters, -1 if the PRU image does not count
+ */
+int pruss_get_stats(struct pru_stats *stats)
+{
+    if (!pru_stats || pru_stats->magic != PRU_STATS_MAGIC) {
+        return -1;
+    }
+    memcpy(stats, (void *)pru_stats, sizeof(*stats));
+    return 0;
+}
+
+int pruss_stats_dump(char *buf, int len)
+{
+    struct pru_stats st;
+    uint32_t stall;
+
+    if (pruss_get_stats(&st) < 0) {
+        return snprintf(buf, len, "no PRU counters in this image\n");
+    }
+
+    stall = st.cycles ? (uint32_t)((uint64_t)st.stalls * 100 / st.cycles) : 0;
+    return snprintf(buf, len,
+                    "blocks %u idle %u underruns %u max_gap_us %u overruns %u\n"
+                    "steps x %u y %u z %u e %u stall %u%%\n",
+                    st.blocks, st.idle, st.underruns,
+                    st.max_gap * PRU_CYCLE_NS / 1000, st.overruns,
+                    st.steps[0], st.steps[1], st.steps[2], st.steps[3], stall);
+}
+
+/*
+ * PWM level of the block in compare counts, scaled by the
+ * mean rate of each phase over the nominal rate
+ */
+static void queue_set_pwm(struct queue_element *qe, block_t *block)
+{
+    uint8_t out = block->pwm_ctl & BLOCK_PWM_OUT_MASK;
+    uint8_t shift = 0;
+    uint32_t duty;
+
+    qe->pwm_ctl = block->pwm_ctl;
+    if (!(block->pwm_ctl & BLOCK_PWM_EVENT)) {
+        return;
+    }
+
+    /* The 32 bit eCAP period does not fit the 16 bit duties, drop low bits */
+    duty = (uint64_t)pwm_period[out] * block->fan_speed / 100;
+    while ((duty >> shift) > UINT16_MAX) {
+        shift++;
+    }
+    qe->pwm_shift = shift;
+    qe->pwm_duty = duty >> shift;
+    qe->pwm_duty_travel = duty >> shift;
+    qe->pwm_duty_decel = duty >> shift;
+
+    if ((block->pwm_ctl & BLOCK_PWM_SCALE) && block->nominal_rate) {
+        qe->pwm_duty_decel = ((uint64_t)duty * (block->nominal_rate + block->final_rate)
+                              / (2 * block->nominal_rate)) >> shift;
+        if (qe->loops_accel) {
+            qe->pwm_duty = ((uint64_t)duty * (block->initial_rate + block->nominal_rate)
+                            / (2 * block->nominal_rate)) >> shift;
+        } else if (!qe->loops_travel) {
+            qe->pwm_duty = qe->pwm_duty_decel;
+        }
     }
-#endif
 }
+
 /*
  * pruss queue movement
  */
@@ -248,6 +528,11 @@ int pruss_queue_move(block_t *block)
     	queue_put_element(&qe);
 		return 0;
 	}
+    if (qe.type == BLOCK_PWM_CMD) {
+        queue_set_pwm(&qe, block);
+    	queue_put_element(&qe);
+		return 0;
+    }
 
     if (pa.invert_x_dir) {
         if ((dir & (1 << X_AXIS)) != 0) {
@@ -295,10 +580,10 @@ int pruss_queue_move(block_t *block)
         qe.loops_travel = block->decelerate_after - block->accelerate_until;
         qe.loops_decel  = block->step_event_count - block->decelerate_after;
     }
- 	if (block->step_event_count - block->decelerate_after < 0) {
+    if ((long)block->step_event_count < block->decelerate_after) {
         qe.loops_travel = block->step_event_count - block->accelerate_until;
-       	qe.loops_decel = 0;
-	}
+        qe.loops_decel  = 0;
+    }
 
     /* Calculate delay */
     qe.init_cycles   = NSEC_PER_SEC / block->initial_rate / DELAY_PER_STEP;
@@ -337,6 +622,8 @@ int pruss_queue_move(block_t *block)
     //qe.ext_step_dir_gpio   = g_active_ext_gpio[block->active_extruder].ext_step_dir_gpio;
     //qe.ext_step_ctl_offset = g_active_ext_gpio[block->active_extruder].ext_step_ctl_offset;
     //qe.ext_step_dir_offset = g_active_ext_gpio[block->active_extruder].ext_step_dir_offset;
+
+    queue_set_pwm(&qe, block);
     queue_put_element(&qe);
 
 #if 0    
@@ -361,8 +648,8 @@ int pruss_queue_move(block_t *block)
 
 int pruss_queue_is_full(void)
 {
-    queue_pos %= QUEUE_LEN;
-    if (pru_queue->ring_buf[queue_pos].state == STATE_EMPTY) {
+    queue_pos %= QUEUE_UNITS;
+    if (*queue_unit(queue_pos) == STATE_EMPTY) {
         return 0;
     } else {
         return -1;
@@ -371,11 +658,12 @@ int pruss_queue_is_full(void)
 
 static int pruss_queue_is_empty(void)
 {
-    int i;
+    unsigned int i;
     int ret = 1;
 
-    for (i = 0; i < QUEUE_LEN; i++) {
-        if (pru_queue->ring_buf[i].state != STATE_EMPTY) {
+    /* second units of wide elements hold data without compact elements */
+    for (i = 0; i < QUEUE_UNITS; i += queue_compact ? 1 : 2) {
+        if (*queue_unit(i) != STATE_EMPTY) {
             ret = 0;
             break;
         }
@@ -384,42 +672,61 @@ static int pruss_queue_is_empty(void)
     return ret;
 }
 
-static int exit_queue_wait = 0;
 void pruss_queue_terminate_wait(int exit)
 {
 	exit_queue_wait = exit;
+    pruss_event_wake(exit != 0);
 }
 
+/*
+ * Wake up on the drain event of the PRU,
+ * the timeout only covers a missed event.
+ */
 int pruss_queue_wait(void)
 {
-#if 0
-    const unsigned int last = (queue_pos - 1) % QUEUE_LEN;
-
-    while (pru_queue->ring_buf[last].state != STATE_EMPTY) {
-        usleep(10000);
-    }
-#else
+    FTRACE_BEGIN("pru_sync");
     while ( !pruss_queue_is_empty() && (exit_queue_wait == 0) ) {
-        usleep(100000);
+        if (pruss_event_wait(sync_event, 100) < 0) {
+            break;
+        }
     }
-#endif
+    FTRACE_END();
 
     return 0;
 }
 
+/*
+ * For the M code thread, returns on an M code marker,
+ * the queue draining or after timeout_ms
+ */
+int pruss_queue_wait_event(int timeout_ms)
+{
+    return pruss_event_wait(mcode_event, timeout_ms);
+}
+
 int pruss_queue_get_max_rate(void)
 {
-    int i;
+    unsigned int i;
+    unsigned int unit;
     int cycles = 0;
     int min_cycles = 40000000;
     int max_rate = 0; 
+    volatile uint8_t *e = NULL;
 
-    for (i = 0; i < QUEUE_LEN; i++) {
-        if (pru_queue->ring_buf[i].state != STATE_EMPTY) {
-            cycles = pru_queue->ring_buf[i].travel_cycles;
-            if (cycles < min_cycles && cycles != 0) {
-                min_cycles = cycles;
-            }
+    /* The queued elements follow the one the PRU is at */
+    unit = pru_queue->read_pos_pru / QUEUE_UNIT;
+    for (i = 0; i < QUEUE_UNITS; i += queue_element_units(e)) {
+        e = queue_unit(unit + i);
+        if (*e == STATE_EMPTY) {
+            break;
+        }
+        if (e[3] & QUEUE_TYPE_COMPACT) {
+            cycles = ((volatile struct queue_element_compact *)e)->travel_cycles;
+        } else {
+            cycles = ((volatile struct queue_element *)e)->travel_cycles;
+        }
+        if (cycles < min_cycles && cycles != 0) {
+            min_cycles = cycles;
         }
     }
     max_rate = NSEC_PER_SEC / (min_cycles * DELAY_PER_STEP);
@@ -427,22 +734,54 @@ int pruss_queue_get_max_rate(void)
     return max_rate;
 }
 
+/*
+ * Queued bytes in wide elements, a compact element counts half
+ */
 int pruss_queue_get_len(void)
 {
-#if 0
-    int i; 
-    int len = 0; 
-    for (i = 0; i < QUEUE_LEN; i++) {
-        if (pru_queue->ring_buf[i].state != STATE_EMPTY) {
-            len++; 
-        }
-    }
-#endif
-    int len = ((pru_queue->write_pos - pru_queue->read_pos_pru) / sizeof(struct queue_element) + QUEUE_LEN) & (QUEUE_LEN - 1);
+    int len = ((pru_queue->write_pos + QUEUE_BYTES - pru_queue->read_pos_pru) % QUEUE_BYTES)
+              / sizeof(struct queue_element);
 
     return len;
 }
 
+uint32_t pruss_queue_get_mcode_count(void)
+{
+    return pru_queue->mcode_count;
+}
+
+/*
+ * Byte offset after the last element queued
+ */
+int pruss_queue_get_pos(uint32_t *pos)
+{
+    *pos = (queue_pos % QUEUE_UNITS) * QUEUE_UNIT;
+    return 0;
+}
+
+/*
+ * 1 while the element ending at pos is queued, read_pos_pru moves
+ * past an element once the PRU has emptied it
+ */
+int pruss_queue_pending(uint32_t pos)
+{
+    uint32_t read = pru_queue->read_pos_pru;
+    uint32_t end = (queue_pos % QUEUE_UNITS) * QUEUE_UNIT;
+    uint32_t queued, left;
+
+    queued = (end + QUEUE_BYTES - read) % QUEUE_BYTES;
+    if (queued == 0 && *queue_unit(read / QUEUE_UNIT) != STATE_EMPTY) {
+        queued = QUEUE_BYTES;
+    }
+
+    left = (pos + QUEUE_BYTES - read) % QUEUE_BYTES;
+    if (left == 0) {
+        left = QUEUE_BYTES;
+    }
+
+    return left <= queued;
+}
+
 int pruss_stepper_start(void)
 {
     int i;
@@ -450,6 +789,9 @@ int pruss_stepper_start(void)
     float max_speed;
 
     uint32_t dir = 0;
+    bool reloaded;
+
+    reloaded = pruss_update_code() > 0;
 
 	dir = get_homing_dir();
     
@@ -479,12 +821,10 @@ int pruss_stepper_start(void)
     pru_queue->read_pos_pru = 0;
 
     /* Clear up queue buffer */
-    for (i = 0; i < QUEUE_LEN; i++) {
-        pru_queue->ring_buf[i].state = STATE_EMPTY;
-    }
-    queue_pos = 0;
+    queue_compact = pruss_compact_queue();
+    queue_clear();
     
-    pru_queue->machine_type = pa.machine_type;
+    pru_queue->machine_type = kinematics->type;
 	pru_queue->bbp1_extend_func = pa.bbp1_extend_func;
 	pru_queue->motor56_mode = pa.bbp1s_dual_xy_mode;
 
@@ -492,6 +832,9 @@ int pruss_stepper_start(void)
     pru_queue->invert_endstop = (pa.x_endstop_invert << 0) | (pa.y_endstop_invert << 1) | 
                                 (pa.z_endstop_invert << 2) | (pa.autolevel_endstop_invert << 3);
     pru_queue->mcode_count = 0;
+    pru_queue->irq_low_water = 0;
+    rate_scale_reset();
+    pru_stats_reset(reloaded);
 
     pruss_enable();
     return 0;
@@ -516,19 +859,21 @@ void pruss_stepper_parameter_update(void)
     pru_queue->homing_dir  = dir; 
     pru_queue->homing_time = NSEC_PER_SEC / max_speed / DELAY_PER_STEP;
 
-    pru_queue->machine_type = pa.machine_type;
+    pru_queue->machine_type = kinematics->type;
 	pru_queue->bbp1_extend_func = pa.bbp1_extend_func;
 	pru_queue->motor56_mode = pa.bbp1s_dual_xy_mode;
 
     pru_queue->invert_endstop = 0;
     pru_queue->invert_endstop = (pa.x_endstop_invert << 0) | (pa.y_endstop_invert << 1) | 
                                 (pa.z_endstop_invert << 2) | (pa.autolevel_endstop_invert << 3);
+
+    if (rate_scale) {
+        rate_scale->ramp = rate_scale_ramp();
+    }
 }
 
 void pruss_stepper_stop(void)
 {
-    int i;
-
     pru_queue->pos_x = 0;
     pru_queue->pos_y = 0;
     pru_queue->pos_z = 0;
@@ -538,10 +883,7 @@ void pruss_stepper_stop(void)
     pru_queue->read_pos_pru = 0;
 
     //pru_queue->state = STATE_IDLE;  //FIXME: Bug here!!!
-    for (i = 0; i < QUEUE_LEN; i++) {
-        pru_queue->ring_buf[i].state = STATE_EMPTY;
-    }
-    queue_pos = 0;
+    queue_clear();
 }
 
 int pruss_send_cmd(st_cmd_t *cmd)
@@ -551,11 +893,7 @@ int pruss_send_cmd(st_cmd_t *cmd)
 
     switch (cmd->gen[0]) {
     case ST_CMD_AXIS_HOMING:
-		if (pa.machine_type == MACHINE_DELTA) {
-        	pru_queue->homing_axis = (1 << X_AXIS) | (1 << Y_AXIS) | (1 << Z_AXIS);
-		} else {
-        	pru_queue->homing_axis |= 1 << cmd->homing.axis;
-		}
+        pru_queue->homing_axis |= kinematics->homing_axes(cmd->homing.axis);
         pru_queue->homing_dir  = cmd->homing.dir;
         pru_queue->homing_time = NSEC_PER_SEC / cmd->homing.speed / DELAY_PER_STEP;
         pru_queue->state = STATE_HOME;
@@ -616,8 +954,8 @@ int pruss_send_cmd(st_cmd_t *cmd)
                    pru_queue->invert_endstop |= (cmd->lmsw.min_invert) << (3);
                    break;
         }
-       printf("lkj invert_endstop,axis 0x%x, invert:%x\n", cmd->lmsw.axis, cmd->lmsw.min_invert);
-       printf("lkj invert_endstop, 0x%x\n", pru_queue->invert_endstop);
+        LMSW_DBG("invert_endstop, axis 0x%x, invert:%x\n", cmd->lmsw.axis, cmd->lmsw.min_invert);
+        LMSW_DBG("invert_endstop, 0x%x\n", pru_queue->invert_endstop);
         break;
 
     case ST_CMD_SET_POS:
@@ -628,7 +966,7 @@ int pruss_send_cmd(st_cmd_t *cmd)
         break;
 
     case ST_CMD_GET_POS:
-		printf("ST_CMD_GET_POS pru_queue->pos_z:%d\n", pru_queue->pos_z);
+        PRUSS_DBG("ST_CMD_GET_POS pru_queue->pos_z:%d\n", pru_queue->pos_z);
        // cmd->pos.x = abs(pru_queue->pos_x);
       //  cmd->pos.y = abs(pru_queue->pos_y);
       //  cmd->pos.z = abs(pru_queue->pos_z);
@@ -673,7 +1011,7 @@ int pruss_send_cmd(st_cmd_t *cmd)
  */
 int pruss_stepper_init(void)
 {
-    int i = 0;
+    void *shared_mem = NULL;
 
     STEPPER_DBG("pruss_stepper_init\n");
     pruss_init();
@@ -698,13 +1036,29 @@ int pruss_stepper_init(void)
     pru_queue->write_pos = 0; 
     pru_queue->mcode_count = 0;
 
-    for (i = 0; i < QUEUE_LEN; i++) {
-        pru_queue->ring_buf[i].state = STATE_EMPTY;
-    }
-    queue_pos = 0;
+    queue_compact = pruss_compact_queue();
+    queue_clear();
 
 
     pru_queue->pause_z_distance_steps = 0;
+    pru_queue->irq_low_water = 0;
+    memset((void *)pru_queue->pwm_out, 0, sizeof(pru_queue->pwm_out));
+
+    if (prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, &shared_mem) < 0) {
+        printf("[pruss]: map pru shared mem err, no live rate scale\n");
+    } else {
+        rate_scale = (struct rate_scale *)((uint8_t *)shared_mem + RATE_SCALE_OFFSET);
+        rate_scale_reset();
+        pru_stats = (struct pru_stats *)((uint8_t *)shared_mem + PRU_STATS_OFFSET);
+        pru_stats_reset(false);
+    }
+
+    full_event  = pruss_event_open();
+    sync_event  = pruss_event_open();
+    mcode_event = pruss_event_open();
+    if (!full_event || !sync_event || !mcode_event) {
+        printf("[pruss]: no PRU events, polling the queue\n");
+    }
 
     pruss_enable();
     return 0;
@@ -715,6 +1069,12 @@ void pruss_stepper_exit(void)
 	STEPPER_DBG("pruss exit\n");
   	prussdrv_pru_disable(0);
   	prussdrv_pru_disable(1);
+	pruss_event_close(full_event);
+	pruss_event_close(sync_event);
+	pruss_event_close(mcode_event);
+	full_event = sync_event = mcode_event = NULL;
+	rate_scale = NULL;
+	pru_stats = NULL;
 	pruss_exit();
 	if (ddr_mem) {
 		munmap(ddr_mem, 0x100000);
@@ -35,6 +35,12 @@
 #define QUEUE_LEN      (15360)
 //#define QUEUE_LEN      (16384)
 
+/* A full ring is refilled once the PRU drained it to this */
+#define QUEUE_LOW_WATER (QUEUE_LEN / 4)
+
+/* PWM outputs the PRU writes in step with the queue */
+#define PRU_PWM_OUTS   (4)
+
 #define MOTOR56_MODE_EXTRUDER   0
 #define MOTOR56_MODE_DUAL_X_Y   1
 
@@ -70,15 +76,42 @@ struct queue_element {
     uint8_t ext_reserved_3;              
 
     //.u32 ext_step_dir_gpio;     
-    uint8_t  reserved_1;         
-    uint8_t  reserved_2;         
-    uint8_t  reserved_3;         
-    uint8_t  reserved_4;         
-
-    uint8_t  reserved_5;         //ext_step_ctl_offset;     
-    uint8_t  reserved_6;         //ext_step_dir_offset;  
-	uint8_t  reserved_7;         
-    uint8_t  reserved_8; 
+    uint8_t  pwm_ctl;            /* BLOCK_PWM_EVENT, BLOCK_PWM_SCALE, out */
+    uint8_t  pwm_shift;          /* the duties are compare counts >> pwm_shift */
+    uint16_t pwm_duty;           /* compare counts at the block start */
+
+    uint16_t pwm_duty_travel;    /* compare counts of the phases, scaled */
+    uint16_t pwm_duty_decel;
+} __attribute__((packed));
+
+/*
+ * 32 byte form of a move with 16 bit counts and no PWM, type has
+ * QUEUE_TYPE_COMPACT, steps_count is loops_accel + loops_travel + loops_decel.
+ * Only the specialized PRU images decode it, see pruss_compact_queue().
+ */
+#define QUEUE_TYPE_COMPACT  (1 << 3)
+#define QUEUE_UNIT          (32)    /* ring granularity, a wide element takes 2 */
+
+struct queue_element_compact {
+    uint8_t  state;
+    uint8_t  direction_bits;
+    uint8_t  direction;
+    uint8_t  type;
+
+    uint16_t loops_accel;
+    uint16_t loops_travel;
+    uint16_t loops_decel;
+    uint16_t accel_cycles;
+    uint32_t travel_cycles;
+    uint16_t decel_cycles;
+    uint8_t  ext_step_bit;
+    uint8_t  reserved;
+    uint32_t init_cycles;
+
+    uint16_t steps_x;
+    uint16_t steps_y;
+    uint16_t steps_z;
+    uint16_t steps_e;
 } __attribute__((packed));
 
 struct active_extruder_gpio {
@@ -88,6 +121,45 @@ struct active_extruder_gpio {
     uint8_t  ext_step_dir_offset;
 }; 
 
+/*
+ * Live rate scale in PRU shared RAM, RATE_* of pruss_unicorn.hp.
+ * Step delays of the queued moves are multiplied by cur / RATE_ONE.
+ */
+#define RATE_SCALE_OFFSET   (0x40)
+#define RATE_ONE            (256)
+#define RATE_SCALE_MIN      (25)        /* percent, cur up to 4 * RATE_ONE */
+#define RATE_SCALE_MAX      (400)
+
+struct rate_scale {
+    volatile uint32_t cur;      /* PRU, applied factor */
+    volatile uint32_t target;   /* ARM */
+    volatile uint32_t ramp;     /* ARM, steps per unit cur moves to target */
+    volatile uint32_t count;    /* PRU */
+} __attribute__((packed));
+
+/*
+ * Performance counters of the specialized PRU images in PRU shared RAM,
+ * STATS_* of pruss_unicorn.hp. Counters wrap, cycles are 5ns.
+ */
+#define PRU_STATS_OFFSET    (0x50)
+#define PRU_STATS_MAGIC     (0x50525553)
+#define PRU_CYCLE_NS        (5)
+
+struct pru_stats {
+    volatile uint32_t magic;        /* PRU at start up */
+    volatile uint32_t blocks;       /* queue elements executed */
+    volatile uint32_t idle;         /* loops on an empty element while printing */
+    volatile uint32_t underruns;    /* blocks started after the queue ran dry */
+    volatile uint32_t max_gap;      /* cycles from a block end to the next start */
+    volatile uint32_t overruns;     /* steps more than 1/8 above their delay */
+    volatile uint32_t steps[4];     /* x, y, z, e of the blocks executed */
+    volatile uint32_t cycles;       /* CYCLE register, summed per block */
+    volatile uint32_t stalls;       /* STALL register, summed per block */
+    volatile uint32_t last_end;     /* PRU only */
+    volatile uint32_t last_step;
+    volatile uint32_t dry;
+} __attribute__((packed));
+
 struct queue {
     volatile struct queue_element ring_buf[QUEUE_LEN];
     volatile uint32_t state;
@@ -118,6 +190,8 @@ struct queue {
     volatile uint32_t cancel_z_up_steps; //offset 64, z move up distance
     volatile uint32_t motor56_mode; //offset 68
     volatile uint32_t invert_endstop; //offset 72, bit0-7 invert x,y,z,autolevel;
+    volatile uint32_t irq_low_water; //offset 76, bytes left in the ring for an IRQ, set by ARM while waiting, PRU clears it, 0 off
+    volatile uint32_t pwm_out[PRU_PWM_OUTS]; //offset 80, compare register address, bit0 32bit, 0 unused
 };
 
 /*
@@ -138,9 +212,17 @@ extern int pruss_send_cmd(st_cmd_t *cmd);
 
 extern int pruss_queue_wait(void);
 extern void pruss_queue_terminate_wait(int exit);
+extern int pruss_queue_wait_event(int timeout_ms);
+extern int pruss_queue_pwm_out(uint32_t reg, uint32_t period);
+extern int pruss_set_rate_scale(int percent);
+extern int pruss_get_stats(struct pru_stats *stats);
+extern int pruss_stats_dump(char *buf, int len);
 extern int pruss_queue_is_full(void);
 extern int pruss_queue_get_max_rate(void);
 extern int pruss_queue_get_len(void);
+extern uint32_t pruss_queue_get_mcode_count(void);
+extern int pruss_queue_get_pos(uint32_t *pos);
+extern int pruss_queue_pending(uint32_t pos);
 extern void pruss_stepper_parameter_update(void);
 #if defined (__cplusplus)
 }
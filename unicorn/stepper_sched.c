@@ -0,0 +1,803 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * stepper_sched.c
+ * step schedule backend, the ARM computes the exact step times of
+ * every axis and pruss/pruss_sched.p replays them from a ring per axis
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <errno.h>
+
+#include <prussdrv.h>
+#include <pruss_intc_mapping.h>
+
+#include "common.h"
+#include "parameter.h"
+#include "planner.h"
+#include "pruss.h"
+#include "stepper.h"
+#include "stepper_pruss.h"
+#include "stepper_sched.h"
+#include "kinematics.h"
+
+#define SCHED_DDR_BASEADDR  (0x80e00000)
+#define SCHED_DDR_SIZE      (0x100000)
+
+#define SCHED_CYCLES_PER_US (SCHED_CLOCK_HZ / 1000000)
+
+#define SCHED_PULSE_US      (2)         /* step pulse width */
+#define SCHED_MAX_ERROR_US  (25)        /* step time deviation of the compression */
+#define SCHED_LEAD_MS       (100)       /* start of a move after the queue ran dry */
+#define SCHED_MIN_LEAD_MS   (10)
+#define SCHED_CHUNK         (1024)      /* step times computed at once */
+#define SCHED_PENDING_LEN   (8192)      /* queued blocks, power of 2 */
+
+/* Outputs, index of struct sched_ctrl out[] */
+#define OUT_X               (0)
+#define OUT_Y               (1)
+#define OUT_Z               (2)
+#define OUT_E0              (3)
+
+#define GPIO_0_BASE         (0x44E07000)
+#define GPIO_1_BASE         (0x4804C000)
+#define GPIO_2_BASE         (0x481AC000)
+#define GPIO_3_BASE         (0x481AE000)
+#define GPIO_DATAIN         (0x138)
+#define GPIO_SETDATAOUT     (0x194)
+
+/*
+ * Block queued to the PRU, retired once the schedule clock passes end
+ */
+typedef struct {
+    uint64_t end;
+    uint32_t rate;
+    uint8_t  type;
+} sched_pending_t;
+
+static int mem_fd = -1;
+static void *ddr_mem = NULL;
+static volatile struct sched_rings *rings = NULL;
+static volatile struct sched_ctrl *ctrl = NULL;
+
+static uint32_t ring_pos[SCHED_AXES];   /* next entry to write */
+static uint64_t timeline = 0;           /* end of the last queued move */
+
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static sched_pending_t pending[SCHED_PENDING_LEN];
+static unsigned int pending_head = 0;
+static unsigned int pending_tail = 0;
+static uint32_t mcode_count = 0;
+
+/* 64 bit schedule clock */
+static uint64_t clock_now = 0;
+static uint64_t clock_mono = 0;
+
+static uint64_t step_times[SCHED_CHUNK];
+
+static int exit_queue_wait = 0;
+static uint32_t cancel_z_up_steps = 0;
+
+/*------------------------------------------------------------------------
+ * Schedule clock
+ *-----------------------------------------------------------------------*/
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sched_clock_reset(void)
+{
+    pthread_mutex_lock(&sched_lock);
+    clock_now = 0;
+    clock_mono = mono_ns();
+    pthread_mutex_unlock(&sched_lock);
+}
+
+/*
+ * The PRU clock is 32 bit and wraps every 21s,
+ * the monotonic clock tells how many wraps were missed.
+ */
+static uint64_t sched_now(void)
+{
+    uint64_t mono, elapsed, wraps;
+    uint32_t delta;
+
+    pthread_mutex_lock(&sched_lock);
+    mono = mono_ns();
+    elapsed = (mono - clock_mono) / (NSEC_PER_SEC / SCHED_CLOCK_HZ);
+    delta = ctrl->now - (uint32_t)clock_now;
+
+    wraps = 0;
+    if (elapsed > delta) {
+        wraps = (elapsed - delta + (1ULL << 31)) >> 32;
+    }
+    clock_now += (wraps << 32) + delta;
+    clock_mono = mono;
+    mono = clock_now;
+    pthread_mutex_unlock(&sched_lock);
+
+    return mono;
+}
+
+/*------------------------------------------------------------------------
+ * Queued blocks
+ *-----------------------------------------------------------------------*/
+/* sched_lock held */
+static void pending_retire(uint64_t now)
+{
+    while (pending_head != pending_tail && pending[pending_head].end <= now) {
+        if (pending[pending_head].type == BLOCK_M_CMD) {
+            mcode_count++;
+        }
+        pending_head = (pending_head + 1) & (SCHED_PENDING_LEN - 1);
+    }
+}
+
+static int pending_put(uint64_t end, uint32_t rate, uint8_t type)
+{
+    unsigned int next;
+
+    for (;;) {
+        uint64_t now = sched_now();
+
+        pthread_mutex_lock(&sched_lock);
+        pending_retire(now);
+        next = (pending_tail + 1) & (SCHED_PENDING_LEN - 1);
+        if (next != pending_head) {
+            pending[pending_tail].end = end;
+            pending[pending_tail].rate = rate;
+            pending[pending_tail].type = type;
+            pending_tail = next;
+            pthread_mutex_unlock(&sched_lock);
+            return 0;
+        }
+        pthread_mutex_unlock(&sched_lock);
+
+        if (exit_queue_wait) {
+            return -1;
+        }
+        usleep(1000);
+    }
+}
+
+static void pending_flush(void)
+{
+    pthread_mutex_lock(&sched_lock);
+    pending_head = pending_tail;
+    pthread_mutex_unlock(&sched_lock);
+}
+
+/*------------------------------------------------------------------------
+ * Entry rings
+ *-----------------------------------------------------------------------*/
+static void ring_publish(void)
+{
+    int i;
+
+    __sync_synchronize();
+    for (i = 0; i < SCHED_AXES; i++) {
+        ctrl->axis[i].write_pos = ring_pos[i];
+    }
+}
+
+static int ring_put(int axis, const sched_entry_t *e)
+{
+    uint32_t next = (ring_pos[axis] + 1) & (SCHED_RING_LEN - 1);
+
+    /* Full, let the PRU have what is written so far */
+    while (next == ctrl->axis[axis].read_pos) {
+        if (exit_queue_wait) {
+            return -1;
+        }
+        ring_publish();
+        usleep(1000);
+    }
+
+    rings->ring[axis][ring_pos[axis]] = *e;
+    ring_pos[axis] = next;
+
+    return 0;
+}
+
+static int ring_emit(void *arg, const sched_entry_t *e)
+{
+    return ring_put((intptr_t)arg, e);
+}
+
+static bool rings_empty(void)
+{
+    int i;
+
+    for (i = 0; i < SCHED_AXES; i++) {
+        if (ctrl->axis[i].read_pos != ring_pos[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void homing_clear(void)
+{
+    int i;
+
+    for (i = 0; i < SCHED_AXES; i++) {
+        ctrl->axis[i].homing = 0;
+    }
+}
+
+static void rings_reset(void)
+{
+    int i;
+
+    for (i = 0; i < SCHED_AXES; i++) {
+        ring_pos[i] = 0;
+        ctrl->axis[i].write_pos = 0;
+        ctrl->axis[i].read_pos = 0;
+        ctrl->axis[i].pos = 0;
+        ctrl->axis[i].sign = 1;
+    }
+}
+
+/*
+ * PRU drops what is queued and goes idle,
+ * also from idle as a segment may be left in its registers
+ */
+static void sched_flush(void)
+{
+    int count = 100;
+    int i;
+
+    ctrl->state = STATE_STOP;
+    while (ctrl->state != STATE_IDLE && count--) {
+        usleep(1000);
+    }
+    for (i = 0; i < SCHED_AXES; i++) {
+        ring_pos[i] = ctrl->axis[i].read_pos;
+        ctrl->axis[i].write_pos = ring_pos[i];
+    }
+    pending_flush();
+    timeline = sched_now();
+}
+
+/*------------------------------------------------------------------------
+ * Machine setup
+ *-----------------------------------------------------------------------*/
+static void set_output(int idx, uint32_t step_bit,
+                       uint32_t dir_base, uint32_t dir_bit,
+                       uint32_t dir2_base, uint32_t dir2_bit)
+{
+    volatile struct sched_output *out = &ctrl->out[idx];
+
+    out->step_mask = 1 << step_bit;
+    out->dir_gpio  = dir_base ? dir_base + GPIO_SETDATAOUT : 0;
+    out->dir_mask  = 1 << dir_bit;
+    out->dir2_gpio = dir2_base ? dir2_base + GPIO_SETDATAOUT : 0;
+    out->dir2_mask = dir2_base ? 1 << dir2_bit : 0;
+}
+
+static void set_endstop(int axis, uint32_t base, uint32_t bit, bool invert)
+{
+    ctrl->axis[axis].endstop_gpio  = base + GPIO_DATAIN;
+    ctrl->axis[axis].endstop_mask  = 1 << bit;
+    ctrl->axis[axis].endstop_level = invert ? 1 << bit : 0;
+}
+
+/*
+ * Pins of pruss_unicorn.hp, mirrored motors step with their axis
+ */
+static void sched_setup(void)
+{
+    bool dual_xy = (bbp_board_type == BOARD_BBP1S)
+                   && (pa.bbp1s_dual_xy_mode == MOTOR56_MODE_DUAL_X_Y);
+    bool dual_z  = (bbp_board_type == BOARD_BBP1)
+                   && (pa.bbp1_extend_func == BBP1_EXTEND_FUNC_DUAL_Z);
+    int i;
+
+    memset((void *)ctrl->out, 0, sizeof(ctrl->out));
+
+    if (dual_xy) {
+        set_output(OUT_X, 21, GPIO_2_BASE, 0, GPIO_2_BASE, 5);
+        ctrl->out[OUT_X].step_mask |= 1 << 24;
+        set_output(OUT_Y, 22, GPIO_2_BASE, 4, GPIO_3_BASE, 7);
+        ctrl->out[OUT_Y].step_mask |= 1 << 25;
+    } else {
+        set_output(OUT_X, 21, GPIO_2_BASE, 0, 0, 0);
+        set_output(OUT_Y, 22, GPIO_2_BASE, 4, 0, 0);
+    }
+
+    if (bbp_board_type == BOARD_BBP1S) {
+        set_output(OUT_Z, 23, GPIO_2_BASE, 3, GPIO_3_BASE, 8);
+        ctrl->out[OUT_Z].step_mask |= 1 << 27;
+    } else if (dual_z) {
+        set_output(OUT_Z, 23, GPIO_2_BASE, 3, GPIO_2_BASE, 5);
+        ctrl->out[OUT_Z].step_mask |= 1 << 24;
+    } else {
+        set_output(OUT_Z, 23, GPIO_2_BASE, 3, 0, 0);
+    }
+
+    set_output(OUT_E0,     28, GPIO_2_BASE, 2, 0, 0);
+    set_output(OUT_E0 + 1, 24, GPIO_2_BASE, 5, 0, 0);
+    set_output(OUT_E0 + 2, 25, GPIO_3_BASE, 7, 0, 0);
+
+    set_endstop(X_AXIS, GPIO_2_BASE, 1, pa.x_endstop_invert);
+    set_endstop(Y_AXIS, GPIO_1_BASE, 17, pa.y_endstop_invert);
+    if (pa.autoLeveling && bbp_board_type == BOARD_BBP1S) {
+        set_endstop(Z_AXIS, GPIO_0_BASE, 14, pa.autolevel_endstop_invert);
+    } else {
+        set_endstop(Z_AXIS, GPIO_0_BASE, 31, pa.z_endstop_invert);
+    }
+
+    for (i = 0; i < SCHED_AXES; i++) {
+        ctrl->axis[i].out = 0;
+        ctrl->axis[i].step_mask = 0;
+    }
+    ctrl->pulse = SCHED_PULSE_US * SCHED_CYCLES_PER_US;
+}
+
+/* Output the E axis steps of the active extruder on */
+static int extruder_output(uint8_t extruder)
+{
+    if (extruder >= 3) {
+        return OUT_E0;
+    }
+    if (bbp_board_type == BOARD_BBP1S
+            && pa.bbp1s_dual_xy_mode == MOTOR56_MODE_EXTRUDER) {
+        return OUT_E0 + extruder;
+    }
+    if (bbp_board_type == BOARD_BBP1
+            && pa.bbp1_extend_func == BBP1_EXTEND_FUNC_DUAL_EXTRUDER
+            && extruder < 2) {
+        return OUT_E0 + extruder;
+    }
+    return OUT_E0;
+}
+
+static bool axis_dir_inverted(int axis)
+{
+    switch (axis) {
+    case X_AXIS:
+        return pa.invert_x_dir;
+    case Y_AXIS:
+        return pa.invert_y_dir;
+    case Z_AXIS:
+        return pa.invert_z_dir;
+    case E_AXIS:
+        return pa.invert_e_dir;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Control entry starting the axis at start,
+ * neg counts the position down, level is the dir pin
+ */
+static int axis_begin(int axis, uint64_t start, int out, bool neg, bool level)
+{
+    sched_entry_t e;
+    uint32_t flags = SCHED_FLAG_SET_DIR | SCHED_FLAG_ABS
+                   | SCHED_FLAG_SELECT | SCHED_FLAG_OUT(out);
+
+    if (neg) {
+        flags |= SCHED_FLAG_NEG;
+    }
+    if (level) {
+        flags |= SCHED_FLAG_DIR;
+    }
+
+    e.interval = (uint32_t)start;
+    e.count = 0;
+    e.add = flags;
+
+    return ring_put(axis, &e);
+}
+
+/*------------------------------------------------------------------------
+ * stepper ops
+ *-----------------------------------------------------------------------*/
+int sched_queue_move(block_t *block)
+{
+    step_profile_t profile;
+    uint64_t start, now;
+    long steps[SCHED_AXES];
+    int i;
+
+    if (!block) {
+        return -1;
+    }
+
+    /* Handled once the moves before it are done */
+    if (block->type == BLOCK_M_CMD) {
+        return pending_put(timeline, 0, block->type);
+    }
+
+    /* no queued PWM, stepper_pwm_out() keeps it off the queue */
+    if (block->type == BLOCK_PWM_CMD) {
+        return 0;
+    }
+
+    if (step_profile_init(&profile, block->step_event_count,
+                          block->initial_rate, block->nominal_rate,
+                          block->final_rate, block->accelerate_until,
+                          block->decelerate_after, block->acceleration_st) < 0) {
+        return 0;
+    }
+
+    now = sched_now();
+    start = timeline;
+    if (start < now + (uint64_t)SCHED_MIN_LEAD_MS * SCHED_CLOCK_HZ / 1000) {
+        start = now + (uint64_t)SCHED_LEAD_MS * SCHED_CLOCK_HZ / 1000;
+    }
+
+    steps[X_AXIS] = block->steps_x;
+    steps[Y_AXIS] = block->steps_y;
+    steps[Z_AXIS] = block->steps_z;
+    steps[E_AXIS] = block->steps_e;
+
+    for (i = 0; i < SCHED_AXES; i++) {
+        stepcompress_t sc;
+        bool neg;
+        int out;
+        uint32_t first;
+
+        if (steps[i] <= 0) {
+            continue;
+        }
+
+        neg = (block->direction_bits >> i) & 1;
+        out = (i == E_AXIS) ? extruder_output(block->active_extruder) : i;
+        if (axis_begin(i, start, out, neg, neg ^ axis_dir_inverted(i)) < 0) {
+            return -1;
+        }
+
+        sc.last = start;
+        sc.max_error = SCHED_MAX_ERROR_US * SCHED_CYCLES_PER_US;
+
+        for (first = 0; first < steps[i]; first += SCHED_CHUNK) {
+            int n = steps[i] - first;
+
+            if (n > SCHED_CHUNK) {
+                n = SCHED_CHUNK;
+            }
+            step_profile_step_times(&profile, start, steps[i], first, n, step_times);
+            if (stepcompress_push(&sc, step_times, n,
+                                  ring_emit, (void *)(intptr_t)i) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    ring_publish();
+
+    timeline = start + llround(profile.t_total * SCHED_CLOCK_HZ);
+    return pending_put(timeline, block->nominal_rate, block->type);
+}
+
+int sched_queue_is_full(void)
+{
+    int i;
+
+    for (i = 0; i < SCHED_AXES; i++) {
+        uint32_t used = (ring_pos[i] - ctrl->axis[i].read_pos) & (SCHED_RING_LEN - 1);
+
+        if (used >= SCHED_RING_LEN - SCHED_RING_LEN / 4) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void sched_queue_terminate_wait(int exit)
+{
+    exit_queue_wait = exit;
+}
+
+int sched_queue_wait(void)
+{
+    while (exit_queue_wait == 0) {
+        bool done;
+        uint64_t now = sched_now();
+
+        pthread_mutex_lock(&sched_lock);
+        pending_retire(now);
+        done = (pending_head == pending_tail);
+        pthread_mutex_unlock(&sched_lock);
+
+        if (done && rings_empty() && now >= timeline) {
+            break;
+        }
+        usleep(100000);
+    }
+
+    return 0;
+}
+
+int sched_queue_get_len(void)
+{
+    int len;
+    uint64_t now = sched_now();
+
+    pthread_mutex_lock(&sched_lock);
+    pending_retire(now);
+    len = (pending_tail - pending_head) & (SCHED_PENDING_LEN - 1);
+    pthread_mutex_unlock(&sched_lock);
+
+    return len;
+}
+
+int sched_queue_get_max_rate(void)
+{
+    unsigned int i;
+    uint32_t max_rate = 0;
+    uint64_t now = sched_now();
+
+    pthread_mutex_lock(&sched_lock);
+    pending_retire(now);
+    for (i = pending_head; i != pending_tail; i = (i + 1) & (SCHED_PENDING_LEN - 1)) {
+        if (pending[i].rate > max_rate) {
+            max_rate = pending[i].rate;
+        }
+    }
+    pthread_mutex_unlock(&sched_lock);
+
+    return max_rate;
+}
+
+uint32_t sched_queue_get_mcode_count(void)
+{
+    uint32_t count;
+    uint64_t now = sched_now();
+
+    pthread_mutex_lock(&sched_lock);
+    pending_retire(now);
+    count = mcode_count;
+    pthread_mutex_unlock(&sched_lock);
+
+    return count;
+}
+
+/*
+ * Homing, every axis runs towards its endstop at a constant rate
+ * for 1.5 times the longest axis, the PRU stops it at the endstop.
+ */
+static int sched_homing(uint8_t axis, uint32_t dir, uint32_t speed)
+{
+    uint32_t mask = kinematics->homing_axes(axis) & 0x7;
+    float max_length = fmax(pa.x_max_length, fmax(pa.y_max_length, pa.z_max_length));
+    uint64_t start;
+    int i;
+
+    if (speed == 0) {
+        return -1;
+    }
+
+    start = sched_now() + (uint64_t)SCHED_MIN_LEAD_MS * SCHED_CLOCK_HZ / 1000;
+
+    for (i = 0; i < 3; i++) {
+        sched_entry_t e;
+        bool level = (dir >> i) & 1;
+        long steps;
+
+        if (!(mask & (1 << i))) {
+            continue;
+        }
+
+        if (axis_begin(i, start, i, level ^ axis_dir_inverted(i), level) < 0) {
+            return -1;
+        }
+
+        e.interval = SCHED_CLOCK_HZ / speed;
+        e.add = 0;
+        for (steps = 1.5 * max_length * pa.axis_steps_per_unit[i]; steps > 0;
+                steps -= e.count) {
+            e.count = (steps > SCHED_MAX_COUNT) ? SCHED_MAX_COUNT : steps;
+            if (ring_put(i, &e) < 0) {
+                return -1;
+            }
+        }
+    }
+    ring_publish();
+
+    for (i = 0; i < 3; i++) {
+        if (mask & (1 << i)) {
+            ctrl->axis[i].homing = 1;
+        }
+    }
+    ctrl->state = STATE_HOME;
+
+    return 0;
+}
+
+int sched_send_cmd(st_cmd_t *cmd)
+{
+    int ret = 0;
+
+    switch (cmd->gen[0]) {
+    case ST_CMD_AXIS_HOMING:
+        ret = sched_homing(cmd->homing.axis, cmd->homing.dir, cmd->homing.speed);
+        break;
+
+    case ST_CMD_START:
+        homing_clear();
+        ctrl->state = STATE_PRINT;
+        break;
+
+    case ST_CMD_STOP:
+        sched_flush();
+        break;
+
+    case ST_CMD_IDLE:
+        homing_clear();
+        ctrl->state = STATE_IDLE;
+        break;
+
+    case ST_CMD_PAUSE:
+    case ST_CMD_RESUME:
+    case ST_CMD_TEST:
+        printf("[sched]: cmd %d not supported by the step schedule\n", cmd->gen[0]);
+        ret = -1;
+        break;
+
+    case ST_CMD_LMSW_CONFIG:
+        switch (cmd->lmsw.axis) {
+            case X_AXIS:
+            case Y_AXIS:
+            case Z_AXIS:
+                ctrl->axis[cmd->lmsw.axis].endstop_level =
+                    cmd->lmsw.min_invert ? ctrl->axis[cmd->lmsw.axis].endstop_mask : 0;
+                break;
+        }
+        break;
+
+    case ST_CMD_SET_POS:
+        ctrl->axis[X_AXIS].pos = cmd->pos.x;
+        ctrl->axis[Y_AXIS].pos = cmd->pos.y;
+        ctrl->axis[Z_AXIS].pos = cmd->pos.z;
+        ctrl->axis[E_AXIS].pos = cmd->pos.e;
+        break;
+
+    case ST_CMD_GET_POS:
+        cmd->pos.x = ctrl->axis[X_AXIS].pos;
+        cmd->pos.y = ctrl->axis[Y_AXIS].pos;
+        cmd->pos.z = ctrl->axis[Z_AXIS].pos;
+        cmd->pos.e = ctrl->axis[E_AXIS].pos;
+        break;
+
+    case ST_CMD_SET_PAUSE_POS:
+        break;
+
+    case ST_CMD_GET_PRU_STATE:
+        cmd->state.state = ctrl->state;
+        break;
+
+    case ST_CMD_SET_PRU_STATE:
+        switch (cmd->state.state) {
+            case STATE_IDLE:
+            case STATE_PRINT:
+            case STATE_HOME:
+                ctrl->state = cmd->state.state;
+                break;
+            default:
+                printf("[sched]: pru state %d not supported\n", cmd->state.state);
+                ret = -1;
+                break;
+        }
+        break;
+
+    case ST_CMD_SET_CANCEL_Z_UP_POS:
+        cancel_z_up_steps = cmd->pos.z;
+        break;
+
+    case ST_CMD_GET_CANCEL_Z_UP_POS:
+        cmd->pos.z = cancel_z_up_steps;
+        break;
+
+    default:
+        ret = -1;
+        break;
+    }
+
+    return ret;
+}
+
+void sched_stepper_parameter_update(void)
+{
+    sched_setup();
+}
+
+int sched_stepper_start(void)
+{
+    pruss_update_code();
+
+    sched_flush();
+    rings_reset();
+    sched_setup();
+
+    pthread_mutex_lock(&sched_lock);
+    mcode_count = 0;
+    pthread_mutex_unlock(&sched_lock);
+
+    homing_clear();
+    ctrl->late = 0;
+    ctrl->now = 0;
+    ctrl->state = STATE_IDLE;
+    timeline = 0;
+    sched_clock_reset();
+
+    pruss_enable();
+    return 0;
+}
+
+void sched_stepper_stop(void)
+{
+    sched_flush();
+    rings_reset();
+}
+
+int sched_stepper_init(void)
+{
+    void *shared_mem = NULL;
+
+    STEPPER_DBG("sched_stepper_init\n");
+    pruss_set_sched_mode(true);
+    if (pruss_init() < 0) {
+        return -1;
+    }
+
+    if (prussdrv_map_prumem(PRUSS0_SHARED_DATARAM, &shared_mem) < 0) {
+        printf("[sched]: map pru shared mem err\n");
+        return -1;
+    }
+    ctrl = (struct sched_ctrl *)((uint8_t *)shared_mem + SCHED_CTRL_OFFSET);
+
+    mem_fd = open("/dev/mem", O_RDWR);
+    if (mem_fd < 0) {
+        printf("[sched]: failed to open /dev/mem (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    ddr_mem = mmap(0, SCHED_DDR_SIZE, PROT_WRITE | PROT_READ, MAP_SHARED,
+                   mem_fd, SCHED_DDR_BASEADDR);
+    if (ddr_mem == MAP_FAILED) {
+        printf("[sched]: failed to map the rings (%s)\n", strerror(errno));
+        ddr_mem = NULL;
+        close(mem_fd);
+        return -1;
+    }
+    rings = (struct sched_rings *)ddr_mem;
+
+    memset((void *)ctrl, 0, sizeof(*ctrl));
+    ctrl->state = STATE_IDLE;
+    rings_reset();
+    sched_setup();
+    sched_clock_reset();
+
+    pruss_enable();
+    return 0;
+}
+
+void sched_stepper_exit(void)
+{
+    STEPPER_DBG("sched exit\n");
+    pruss_exit();
+    if (ddr_mem) {
+        munmap(ddr_mem, SCHED_DDR_SIZE);
+        ddr_mem = NULL;
+    }
+    if (mem_fd >= 0) {
+        close(mem_fd);
+        mem_fd = -1;
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * stepper_sched.h
+ * step schedule backend, the ARM computes the step times of every axis
+ * and pruss/pruss_sched.p replays them
+*/
+#ifndef _STEPPER_SCHED_H
+#define _STEPPER_SCHED_H
+
+#include <stdint.h>
+
+#include "planner.h"
+#include "common.h"
+#include "stepper.h"
+#include "stepcompress.h"
+
+#define SCHED_AXES          (4)         /* x, y, z, e */
+#define SCHED_RING_LEN      (8192)      /* entries per axis, power of 2 */
+#define SCHED_OUTPUTS       (8)
+
+/* Offset of struct sched_ctrl in the PRU shared RAM, C28 of pruss_sched.p */
+#define SCHED_CTRL_OFFSET   (0x100)
+
+/*
+ * Step and dir pins an axis drives,
+ * dir_gpio is the GPIOn SETDATAOUT address, 0 if unused
+ */
+struct sched_output {
+    uint32_t step_mask;     /* GPIO1 bits */
+    uint32_t dir_gpio;
+    uint32_t dir_mask;
+    uint32_t dir2_gpio;     /* mirrored motor */
+    uint32_t dir2_mask;
+} __attribute__((packed));
+
+struct sched_axis {
+    volatile uint32_t write_pos;    /* ARM, entry index */
+    volatile uint32_t read_pos;     /* PRU */
+    volatile int32_t  pos;          /* PRU, steps */
+    volatile int32_t  sign;         /* PRU, 1 or -1 */
+    volatile uint32_t step_mask;    /* PRU, of the selected output */
+    volatile uint32_t out;          /* PRU, ctrl offset of the selected output */
+    volatile uint32_t endstop_gpio; /* ARM, GPIOn DATAIN address */
+    volatile uint32_t endstop_mask;
+    volatile uint32_t endstop_level;    /* endstop_mask when hit reads high */
+    volatile uint32_t homing;       /* ARM sets, PRU clears at the endstop */
+    uint32_t reserved[2];
+} __attribute__((packed));
+
+/*
+ * Offsets are used by pruss_sched.p, keep them in sync
+ */
+struct sched_ctrl {
+    volatile uint32_t state;        /* ARM, STATE_IDLE, PRINT, HOME, STOP */
+    volatile uint32_t now;          /* PRU, schedule clock */
+    volatile uint32_t late;         /* PRU, segments started after their first step */
+    volatile uint32_t pulse;        /* ARM, step pulse width, cycles */
+    uint32_t reserved[4];
+    struct sched_axis axis[SCHED_AXES];     /* offset 32 */
+    struct sched_output out[SCHED_OUTPUTS]; /* offset 224 */
+} __attribute__((packed));
+
+/* Entry rings in DDR, same mapping as struct queue */
+struct sched_rings {
+    volatile sched_entry_t ring[SCHED_AXES][SCHED_RING_LEN];
+};
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+extern int sched_stepper_init(void);
+extern void sched_stepper_exit(void);
+
+extern int sched_stepper_start(void);
+extern void sched_stepper_stop(void);
+
+extern int sched_queue_move(block_t *block);
+
+extern int sched_send_cmd(st_cmd_t *cmd);
+
+extern int sched_queue_wait(void);
+extern void sched_queue_terminate_wait(int exit);
+extern int sched_queue_is_full(void);
+extern int sched_queue_get_max_rate(void);
+extern int sched_queue_get_len(void);
+extern uint32_t sched_queue_get_mcode_count(void);
+extern void sched_stepper_parameter_update(void);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * delta_bench.c
+ * Benchmark of the batch delta kinematics against the per point path
+ * of calculate_delta() in gcode.c plus the bilinear bed level offset.
+ *
+ * Usage: delta_bench [points] [loops]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "delta.h"
+
+#define SIN_60  0.8660254037844386
+#define COS_60  0.5
+
+#define RADIUS          (124.0)
+#define DIAGONAL_ROD    (250.0)
+#define PRINT_RADIUS    (80.0)
+#define GRID_POINTS     (7)
+
+static float bed_level[100][100];
+static delta_geometry_t geo;
+static delta_level_t level;
+
+static float ref[3];
+
+/* Same math as calculate_delta() and delta_level_offset(), one point at a time */
+static void calculate_delta_ref(float x, float y, float z, int leveling)
+{
+    int i;
+    float offset = 0.0;
+
+    for (i = 0; i < 3; i++) {
+        ref[i] = sqrt(geo.rod_2[i]
+                      - powf((geo.tower_x[i] - x), 2)
+                      - powf((geo.tower_y[i] - y), 2)
+                      ) + z;
+    }
+
+    if (leveling) {
+        int half = (GRID_POINTS - 1) / 2;
+        float x_num = 2 * PRINT_RADIUS / (GRID_POINTS - 1);
+        float y_num = 2 * PRINT_RADIUS / (GRID_POINTS - 1);
+        float grid_x = fmax(0.001 - half, fmin(half - 0.001, x / x_num));
+        float grid_y = fmax(0.001 - half, fmin(half - 0.001, y / y_num));
+        int floor_x = floor(grid_x);
+        int floor_y = floor(grid_y);
+        float ratio_x = grid_x - floor_x;
+        float ratio_y = grid_y - floor_y;
+        float z1 = bed_level[floor_x+half][floor_y+half];
+        float z2 = bed_level[floor_x+half][floor_y+half+1];
+        float z3 = bed_level[floor_x+half+1][floor_y+half];
+        float z4 = bed_level[floor_x+half+1][floor_y+half+1];
+        float left = (1-ratio_y)*z1 + ratio_y*z2;
+        float right = (1-ratio_y)*z3 + ratio_y*z4;
+        offset = (1-ratio_x)*left + ratio_x*right;
+    }
+
+    for (i = 0; i < 3; i++) {
+        ref[i] += offset;
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void setup(void)
+{
+    int x, y;
+
+    geo.tower_x[0] = -SIN_60 * RADIUS;
+    geo.tower_y[0] = -COS_60 * RADIUS;
+    geo.tower_x[1] =  SIN_60 * RADIUS;
+    geo.tower_y[1] = -COS_60 * RADIUS;
+    geo.tower_x[2] = 0.0;
+    geo.tower_y[2] = RADIUS;
+    for (x = 0; x < 3; x++) {
+        geo.rod_2[x] = DIAGONAL_ROD * DIAGONAL_ROD;
+    }
+
+    for (x = 0; x < GRID_POINTS; x++) {
+        for (y = 0; y < GRID_POINTS; y++) {
+            bed_level[x][y] = 0.05 * sin(x) * cos(y);
+        }
+    }
+    level.z = bed_level;
+    level.half = (GRID_POINTS - 1) / 2;
+    level.inv_x_num = (GRID_POINTS - 1) / (2 * PRINT_RADIUS);
+    level.inv_y_num = (GRID_POINTS - 1) / (2 * PRINT_RADIUS);
+}
+
+int main(int argc, char *argv[])
+{
+    int points = DELTA_BATCH_SIZE;
+    int loops = 100000;
+    int i, j, l, leveling;
+    float *x, *y, *z, *t[3], *r[3];
+    double start, ns_ref, ns_scalar, ns_batch, ns_forward;
+    double err_scalar, err_batch, err_forward;
+    float fx, fy, fz;
+    volatile float sink = 0;
+
+    if (argc > 1) {
+        points = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        loops = atoi(argv[2]);
+    }
+    if (points <= 0 || loops <= 0) {
+        fprintf(stderr, "usage: %s [points] [loops]\n", argv[0]);
+        return -1;
+    }
+
+    setup();
+
+    x = malloc(sizeof(float) * points * 9);
+    if (!x) {
+        return -1;
+    }
+    y = x + points;
+    z = y + points;
+    for (i = 0; i < 3; i++) {
+        t[i] = z + points * (1 + i);
+        r[i] = z + points * (4 + i);
+    }
+
+    /* A segmented move across the bed */
+    for (i = 0; i < points; i++) {
+        float f = (float)i / points;
+        x[i] = -PRINT_RADIUS * 0.9 + 1.8 * PRINT_RADIUS * f;
+        y[i] = -PRINT_RADIUS * 0.3 + 0.9 * PRINT_RADIUS * f;
+        z[i] = 0.3 + 2.0 * f;
+    }
+
+    printf("# test leveling points loops ns_per_point max_err_mm\n");
+
+    for (leveling = 0; leveling <= 1; leveling++) {
+        const delta_level_t *lv = leveling ? &level : NULL;
+
+        start = now_ns();
+        for (l = 0; l < loops; l++) {
+            for (i = 0; i < points; i++) {
+                calculate_delta_ref(x[i], y[i], z[i], leveling);
+                r[0][i] = ref[0];
+                r[1][i] = ref[1];
+                r[2][i] = ref[2];
+            }
+            sink += r[0][0];
+        }
+        ns_ref = (now_ns() - start) / loops / points;
+
+        start = now_ns();
+        for (l = 0; l < loops; l++) {
+            delta_calculate_batch_scalar(&geo, lv, points, x, y, z, t[0], t[1], t[2]);
+            sink += t[0][0];
+        }
+        ns_scalar = (now_ns() - start) / loops / points;
+
+        err_scalar = 0;
+        for (j = 0; j < 3; j++) {
+            for (i = 0; i < points; i++) {
+                err_scalar = fmax(err_scalar, fabs(t[j][i] - r[j][i]));
+            }
+        }
+
+        start = now_ns();
+        for (l = 0; l < loops; l++) {
+            delta_calculate_batch(&geo, lv, points, x, y, z, t[0], t[1], t[2]);
+            sink += t[0][0];
+        }
+        ns_batch = (now_ns() - start) / loops / points;
+
+        err_batch = 0;
+        for (j = 0; j < 3; j++) {
+            for (i = 0; i < points; i++) {
+                err_batch = fmax(err_batch, fabs(t[j][i] - r[j][i]));
+            }
+        }
+
+        printf("per_point %d %d %d %.2f %.9f\n", leveling, points, loops, ns_ref, 0.0);
+        printf("batch_scalar %d %d %d %.2f %.9f\n", leveling, points, loops, ns_scalar, err_scalar);
+        printf("batch %d %d %d %.2f %.9f\n", leveling, points, loops, ns_batch, err_batch);
+    }
+
+    /* delta_forward() back from the tower heights of the points */
+    delta_calculate_batch_scalar(&geo, NULL, points, x, y, z, r[0], r[1], r[2]);
+    start = now_ns();
+    for (l = 0; l < loops; l++) {
+        for (i = 0; i < points; i++) {
+            delta_forward(&geo, r[0][i], r[1][i], r[2][i], &fx, &fy, &fz);
+        }
+        sink += fx;
+    }
+    ns_forward = (now_ns() - start) / loops / points;
+
+    err_forward = 0;
+    for (i = 0; i < points; i++) {
+        if (delta_forward(&geo, r[0][i], r[1][i], r[2][i], &fx, &fy, &fz) < 0) {
+            err_forward = INFINITY;
+            break;
+        }
+        err_forward = fmax(err_forward, fabs(fx - x[i]));
+        err_forward = fmax(err_forward, fabs(fy - y[i]));
+        err_forward = fmax(err_forward, fabs(fz - z[i]));
+    }
+    printf("forward 0 %d %d %.2f %.9f\n", points, loops, ns_forward, err_forward);
+
+    free(x);
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+; golden trace corpus: three layers of a small part
+; perimeters, arcs, infill, retracts and a queued fan
+G21
+G90
+M82
+G92 X0 Y0 Z0 E0
+G1 Z0.3 F1200
+M106 S128 V99999.0
+; layer 0
+G1 Z0.30 F1200
+G0 X10.000 Y0.000 F6000
+G1 X9.659 Y2.588 E0.0500 F1800
+G1 X8.660 Y5.000 E0.1000 F1800
+G1 X7.071 Y7.071 E0.1500 F1800
+G1 X5.000 Y8.660 E0.2000 F1800
+G1 X2.588 Y9.659 E0.2500 F1800
+G1 X0.000 Y10.000 E0.3000 F1800
+G1 X-2.588 Y9.659 E0.3500 F1800
+G1 X-5.000 Y8.660 E0.4000 F1800
+G1 X-7.071 Y7.071 E0.4500 F1800
+G1 X-8.660 Y5.000 E0.5000 F1800
+G1 X-9.659 Y2.588 E0.5500 F1800
+G1 X-10.000 Y0.000 E0.6000 F1800
+G1 X-9.659 Y-2.588 E0.6500 F1800
+G1 X-8.660 Y-5.000 E0.7000 F1800
+G1 X-7.071 Y-7.071 E0.7500 F1800
+G1 X-5.000 Y-8.660 E0.8000 F1800
+G1 X-2.588 Y-9.659 E0.8500 F1800
+G1 X-0.000 Y-10.000 E0.9000 F1800
+G1 X2.588 Y-9.659 E0.9500 F1800
+G1 X5.000 Y-8.660 E1.0000 F1800
+G1 X7.071 Y-7.071 E1.0500 F1800
+G1 X8.660 Y-5.000 E1.1000 F1800
+G1 X9.659 Y-2.588 E1.1500 F1800
+G1 X10.000 Y-0.000 E1.2000 F1800
+G1 E0.2000 F2400
+G0 X-5.000 Y-8.000 F6000
+G1 E1.2000 F2400
+G1 X5.000 Y-8.000 E1.5000 F1500
+G3 X8.000 Y-5.000 I0.000 J3.000 E1.6000
+G1 X8.000 Y5.000 E1.9000
+G3 X5.000 Y8.000 I-3.000 J0.000 E2.0000
+G1 X-5.000 Y8.000 E2.3000
+G2 X-5.000 Y-8.000 I0.000 J-8.000 E2.4500
+G0 X-4.000 Y-6.000 F6000
+G1 X4.000 Y-6.000 E2.7000 F2400
+G0 X4.000 Y-3.600 F6000
+G1 X-4.000 Y-3.600 E2.9500 F2400
+G0 X-4.000 Y-1.200 F6000
+G1 X4.000 Y-1.200 E3.2000 F2400
+G0 X4.000 Y1.200 F6000
+G1 X-4.000 Y1.200 E3.4500 F2400
+G0 X-4.000 Y3.600 F6000
+G1 X4.000 Y3.600 E3.7000 F2400
+G0 X4.000 Y6.000 F6000
+G1 X-4.000 Y6.000 E3.9500 F2400
+; layer 1
+G1 Z0.50 F1200
+G0 X10.000 Y0.000 F6000
+G1 X9.659 Y2.588 E4.0000 F1800
+G1 X8.660 Y5.000 E4.0500 F1800
+G1 X7.071 Y7.071 E4.1000 F1800
+G1 X5.000 Y8.660 E4.1500 F1800
+G1 X2.588 Y9.659 E4.2000 F1800
+G1 X0.000 Y10.000 E4.2500 F1800
+G1 X-2.588 Y9.659 E4.3000 F1800
+G1 X-5.000 Y8.660 E4.3500 F1800
+G1 X-7.071 Y7.071 E4.4000 F1800
+G1 X-8.660 Y5.000 E4.4500 F1800
+G1 X-9.659 Y2.588 E4.5000 F1800
+G1 X-10.000 Y0.000 E4.5500 F1800
+G1 X-9.659 Y-2.588 E4.6000 F1800
+G1 X-8.660 Y-5.000 E4.6500 F1800
+G1 X-7.071 Y-7.071 E4.7000 F1800
+G1 X-5.000 Y-8.660 E4.7500 F1800
+G1 X-2.588 Y-9.659 E4.8000 F1800
+G1 X-0.000 Y-10.000 E4.8500 F1800
+G1 X2.588 Y-9.659 E4.9000 F1800
+G1 X5.000 Y-8.660 E4.9500 F1800
+G1 X7.071 Y-7.071 E5.0000 F1800
+G1 X8.660 Y-5.000 E5.0500 F1800
+G1 X9.659 Y-2.588 E5.1000 F1800
+G1 X10.000 Y-0.000 E5.1500 F1800
+G1 E4.1500 F2400
+G0 X-5.000 Y-8.000 F6000
+G1 E5.1500 F2400
+G1 X5.000 Y-8.000 E5.4500 F1500
+G3 X8.000 Y-5.000 I0.000 J3.000 E5.5500
+G1 X8.000 Y5.000 E5.8500
+G3 X5.000 Y8.000 I-3.000 J0.000 E5.9500
+G1 X-5.000 Y8.000 E6.2500
+G2 X-5.000 Y-8.000 I0.000 J-8.000 E6.4000
+G0 X-4.000 Y-6.000 F6000
+G1 X4.000 Y-6.000 E6.6500 F2400
+G0 X4.000 Y-3.600 F6000
+G1 X-4.000 Y-3.600 E6.9000 F2400
+G0 X-4.000 Y-1.200 F6000
+G1 X4.000 Y-1.200 E7.1500 F2400
+G0 X4.000 Y1.200 F6000
+G1 X-4.000 Y1.200 E7.4000 F2400
+G0 X-4.000 Y3.600 F6000
+G1 X4.000 Y3.600 E7.6500 F2400
+G0 X4.000 Y6.000 F6000
+G1 X-4.000 Y6.000 E7.9000 F2400
+M106 S255 V99999.0
+; layer 2
+G1 Z0.70 F1200
+G0 X10.000 Y0.000 F6000
+G1 X9.659 Y2.588 E7.9500 F1800
+G1 X8.660 Y5.000 E8.0000 F1800
+G1 X7.071 Y7.071 E8.0500 F1800
+G1 X5.000 Y8.660 E8.1000 F1800
+G1 X2.588 Y9.659 E8.1500 F1800
+G1 X0.000 Y10.000 E8.2000 F1800
+G1 X-2.588 Y9.659 E8.2500 F1800
+G1 X-5.000 Y8.660 E8.3000 F1800
+G1 X-7.071 Y7.071 E8.3500 F1800
+G1 X-8.660 Y5.000 E8.4000 F1800
+G1 X-9.659 Y2.588 E8.4500 F1800
+G1 X-10.000 Y0.000 E8.5000 F1800
+G1 X-9.659 Y-2.588 E8.5500 F1800
+G1 X-8.660 Y-5.000 E8.6000 F1800
+G1 X-7.071 Y-7.071 E8.6500 F1800
+G1 X-5.000 Y-8.660 E8.7000 F1800
+G1 X-2.588 Y-9.659 E8.7500 F1800
+G1 X-0.000 Y-10.000 E8.8000 F1800
+G1 X2.588 Y-9.659 E8.8500 F1800
+G1 X5.000 Y-8.660 E8.9000 F1800
+G1 X7.071 Y-7.071 E8.9500 F1800
+G1 X8.660 Y-5.000 E9.0000 F1800
+G1 X9.659 Y-2.588 E9.0500 F1800
+G1 X10.000 Y-0.000 E9.1000 F1800
+G1 E8.1000 F2400
+G0 X-5.000 Y-8.000 F6000
+G1 E9.1000 F2400
+G1 X5.000 Y-8.000 E9.4000 F1500
+G3 X8.000 Y-5.000 I0.000 J3.000 E9.5000
+G1 X8.000 Y5.000 E9.8000
+G3 X5.000 Y8.000 I-3.000 J0.000 E9.9000
+G1 X-5.000 Y8.000 E10.2000
+G2 X-5.000 Y-8.000 I0.000 J-8.000 E10.3500
+G0 X-4.000 Y-6.000 F6000
+G1 X4.000 Y-6.000 E10.6000 F2400
+G0 X4.000 Y-3.600 F6000
+G1 X-4.000 Y-3.600 E10.8500 F2400
+G0 X-4.000 Y-1.200 F6000
+G1 X4.000 Y-1.200 E11.1000 F2400
+G0 X4.000 Y1.200 F6000
+G1 X-4.000 Y1.200 E11.3500 F2400
+G0 X-4.000 Y3.600 F6000
+G1 X4.000 Y3.600 E11.6000 F2400
+G0 X4.000 Y6.000 F6000
+G1 X-4.000 Y6.000 E11.8500 F2400
+G1 E10.8500 F2400
+M107 V99999.0
+G0 Z5.000 F1200
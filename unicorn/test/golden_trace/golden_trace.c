@@ -0,0 +1,581 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * golden_trace.c
+ * Golden trace of the planner output: a G-code corpus goes through
+ * gcode_process_line(), every block through the real pruss_queue_move(),
+ * and every queue element it writes is read back and recorded.
+ *
+ * Usage: golden_trace [-m xyz|corexy|delta] [-c] [-o trace] [-g golden]
+ *                     [-s steps] [-l loops] [-p permille] corpus.gcode
+ *
+ *   -c  let pruss_queue_move() write compact elements, the trace
+ *       must not change
+ *   -o  write the trace
+ *   -g  compare with a golden trace, exit 1 if they differ by more
+ *       than the tolerance of the steps, the loops and the cycles
+ *
+ * Every move, of the run and of the golden trace, must have its three
+ * phases add up to steps_count, or the run fails.
+ *
+ * The planner buffer runs full, a block is taken where the gcode thread
+ * would wait for the planner thread, as during a print.
+ * M codes and PWM commands go through the Fifo to the stepper thread,
+ * they are queued after the corpus line that made them.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "parameter.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper_pruss.h"
+#include "gcode.h"
+#include "util/Fifo.h"
+#include "trace.h"
+
+#define LINE_LEN        (256)
+
+/* PWM out 0 of the corpus, 10kHz at the 100MHz PWMSS clock */
+#define TRACE_PWM_REG       (0x48302212)
+#define TRACE_PWM_PERIOD    (10000)
+
+enum {
+    TOL_EXACT = 0,
+    TOL_STEPS,
+    TOL_LOOPS,
+    TOL_CYCLES,
+};
+
+enum {
+    F_DIRECTION_BITS = 0,
+    F_DIRECTION,
+    F_STEPS_COUNT,
+    F_STEPS_X,
+    F_STEPS_Y,
+    F_STEPS_Z,
+    F_STEPS_E,
+    F_LOOPS_ACCEL,
+    F_LOOPS_TRAVEL,
+    F_LOOPS_DECEL,
+    F_INIT_CYCLES,
+    F_ACCEL_CYCLES,
+    F_TRAVEL_CYCLES,
+    F_DECEL_CYCLES,
+    F_EXT_STEP_BIT,
+    F_PWM_CTL,
+    F_PWM_DUTY,
+    F_PWM_DUTY_TRAVEL,
+    F_PWM_DUTY_DECEL,
+    NR_FIELDS,
+};
+
+static const struct {
+    const char *name;
+    int tol;
+} field[NR_FIELDS] = {
+    { "direction_bits",  TOL_EXACT },
+    { "direction",       TOL_EXACT },
+    { "steps_count",     TOL_STEPS },
+    { "steps_x",         TOL_STEPS },
+    { "steps_y",         TOL_STEPS },
+    { "steps_z",         TOL_STEPS },
+    { "steps_e",         TOL_STEPS },
+    { "loops_accel",     TOL_LOOPS },
+    { "loops_travel",    TOL_LOOPS },
+    { "loops_decel",     TOL_LOOPS },
+    { "init_cycles",     TOL_CYCLES },
+    { "accel_cycles",    TOL_CYCLES },
+    { "travel_cycles",   TOL_CYCLES },
+    { "decel_cycles",    TOL_CYCLES },
+    { "ext_step_bit",    TOL_EXACT },
+    { "pwm_ctl",         TOL_EXACT },
+    { "pwm_duty",        TOL_CYCLES },
+    { "pwm_duty_travel", TOL_CYCLES },
+    { "pwm_duty_decel",  TOL_CYCLES },
+};
+
+typedef struct {
+    int line;                   /* corpus line the element came from */
+    char kind;                  /* G move, M code, P pwm */
+    uint32_t v[NR_FIELDS];
+} record_t;
+
+typedef struct {
+    record_t *r;
+    int len;
+    int size;
+} trace_t;
+
+extern volatile struct queue *pru_queue;
+extern Fifo_Handle hFifo_plan2st;
+extern Fifo_Handle hFifo_st2plan;
+
+bool trace_compact = false;
+
+static trace_t trace;
+static int cur_line = 0;
+static unsigned int read_unit = 0;
+static block_t cmd_block;
+
+static int tol_steps = 1;
+static int tol_loops = 2;
+static int tol_permille = 5;
+
+static record_t *trace_add(trace_t *t)
+{
+    record_t *r;
+
+    if (t->len == t->size) {
+        t->size = t->size ? t->size * 2 : 4096;
+        r = realloc(t->r, t->size * sizeof(record_t));
+        if (!r) {
+            fprintf(stderr, "[golden]: out of memory\n");
+            exit(-1);
+        }
+        t->r = r;
+    }
+    r = &t->r[t->len++];
+    memset(r, 0, sizeof(*r));
+    return r;
+}
+
+static char element_kind(uint8_t type)
+{
+    if (type & BLOCK_M_CMD) {
+        return 'M';
+    } else if (type & BLOCK_PWM_CMD) {
+        return 'P';
+    }
+    return 'G';
+}
+
+/*
+ * Read back what pruss_queue_move() wrote and empty the units,
+ * as the PRU does. A compact element is recorded as the wide
+ * element it stands for, the padding before a wrap is skipped.
+ */
+static void trace_collect(int line)
+{
+    const unsigned int units = QUEUE_LEN * sizeof(struct queue_element) / QUEUE_UNIT;
+    struct queue_element qe;
+    struct queue_element_compact qc;
+    volatile uint8_t *u;
+    record_t *r;
+
+    for (;;) {
+        u = (volatile uint8_t *)pru_queue->ring_buf + (read_unit % units) * QUEUE_UNIT;
+        if (u[0] == STATE_EMPTY) {
+            break;
+        }
+
+        if (u[3] & QUEUE_TYPE_COMPACT) {
+            memcpy(&qc, (const void *)u, sizeof(qc));
+            u[0] = STATE_EMPTY;
+            read_unit += 1;
+            if ((qc.type & ~QUEUE_TYPE_COMPACT) == BLOCK_PWM_CMD) {
+                continue;
+            }
+
+            bzero(&qe, sizeof(qe));
+            qe.direction_bits = qc.direction_bits;
+            qe.direction      = qc.direction;
+            qe.type           = qc.type & ~QUEUE_TYPE_COMPACT;
+            qe.loops_accel    = qc.loops_accel;
+            qe.loops_travel   = qc.loops_travel;
+            qe.loops_decel    = qc.loops_decel;
+            qe.steps_count    = qc.loops_accel + qc.loops_travel + qc.loops_decel;
+            qe.accel_cycles   = qc.accel_cycles;
+            qe.travel_cycles  = qc.travel_cycles;
+            qe.decel_cycles   = qc.decel_cycles;
+            qe.init_cycles    = qc.init_cycles;
+            qe.ext_step_bit   = qc.ext_step_bit;
+            qe.steps_x        = qc.steps_x;
+            qe.steps_y        = qc.steps_y;
+            qe.steps_z        = qc.steps_z;
+            qe.steps_e        = qc.steps_e;
+        } else {
+            memcpy(&qe, (const void *)u, sizeof(qe));
+            u[0] = STATE_EMPTY;
+            u[QUEUE_UNIT] = STATE_EMPTY;
+            read_unit += 2;
+        }
+
+        r = trace_add(&trace);
+        r->line = line;
+        r->kind = element_kind(qe.type);
+        r->v[F_DIRECTION_BITS]  = qe.direction_bits;
+        r->v[F_DIRECTION]       = qe.direction;
+        r->v[F_STEPS_COUNT]     = qe.steps_count;
+        r->v[F_STEPS_X]         = qe.steps_x;
+        r->v[F_STEPS_Y]         = qe.steps_y;
+        r->v[F_STEPS_Z]         = qe.steps_z;
+        r->v[F_STEPS_E]         = qe.steps_e;
+        r->v[F_LOOPS_ACCEL]     = qe.loops_accel;
+        r->v[F_LOOPS_TRAVEL]    = qe.loops_travel;
+        r->v[F_LOOPS_DECEL]     = qe.loops_decel;
+        r->v[F_INIT_CYCLES]     = qe.init_cycles;
+        r->v[F_ACCEL_CYCLES]    = qe.accel_cycles;
+        r->v[F_TRAVEL_CYCLES]   = qe.travel_cycles;
+        r->v[F_DECEL_CYCLES]    = qe.decel_cycles;
+        r->v[F_EXT_STEP_BIT]    = qe.ext_step_bit;
+        r->v[F_PWM_CTL]         = qe.pwm_ctl;
+        r->v[F_PWM_DUTY]        = qe.pwm_duty;
+        r->v[F_PWM_DUTY_TRAVEL] = qe.pwm_duty_travel;
+        r->v[F_PWM_DUTY_DECEL]  = qe.pwm_duty_decel;
+    }
+}
+
+/*
+ * The planner thread and the stepper thread in one:
+ * the oldest block goes to the queue. false if there is none.
+ */
+static bool trace_take_block(void)
+{
+    block_t *block;
+    int line;
+
+    trace_plan_stamp(cur_line);
+    block = trace_plan_take(&line);
+    if (!block) {
+        return false;
+    }
+    pruss_queue_move(block);
+    plan_discard_current_block();
+    trace_collect(line);
+    return true;
+}
+
+void trace_planner_wait(void)
+{
+    trace_take_block();
+}
+
+/*
+ * M codes and PWM commands put_cmd_to_fifo() sent to the stepper thread
+ */
+static void trace_commands(int line)
+{
+    block_t *cmd;
+
+    while (Fifo_getNumEntries(hFifo_plan2st) > 0) {
+        if (Fifo_get(hFifo_plan2st, (void **)&cmd) < 0) {
+            break;
+        }
+        pruss_queue_move(cmd);
+        trace_collect(line);
+        Fifo_put(hFifo_st2plan, cmd);
+    }
+}
+
+static int setup(const char *machine)
+{
+    Fifo_Attrs fAttrs = Fifo_Attrs_DEFAULT;
+
+    parameter_restore_default();
+
+    if (!strcmp(machine, "xyz")) {
+        pa.machine_type = MACHINE_XYZ;
+    } else if (!strcmp(machine, "corexy")) {
+        pa.machine_type = MACHINE_COREXY;
+    } else if (!strcmp(machine, "delta")) {
+        pa.machine_type = MACHINE_DELTA;
+    } else {
+        fprintf(stderr, "[golden]: unknown machine %s\n", machine);
+        return -1;
+    }
+    pa.autoLeveling = 0;
+    kinematics_init();
+    gcode_init();
+
+    /* one block for the commands, as the stepper thread hands back */
+    hFifo_plan2st = Fifo_create(&fAttrs);
+    hFifo_st2plan = Fifo_create(&fAttrs);
+    if (!hFifo_plan2st || !hFifo_st2plan) {
+        fprintf(stderr, "[golden]: create Fifo failed\n");
+        return -1;
+    }
+    Fifo_put(hFifo_st2plan, &cmd_block);
+
+    pru_queue = calloc(1, sizeof(struct queue));
+    if (!pru_queue) {
+        return -1;
+    }
+    pruss_stepper_start();
+    pruss_queue_pwm_out(TRACE_PWM_REG, TRACE_PWM_PERIOD);
+
+    trace_plan_reset();
+    gcode_stop();
+    return 0;
+}
+
+static int run_corpus(const char *corpus)
+{
+    char buf[LINE_LEN];
+    char *p;
+    FILE *fp;
+    int n = 0;
+
+    fp = fopen(corpus, "r");
+    if (!fp) {
+        fprintf(stderr, "[golden]: can not open %s\n", corpus);
+        return -1;
+    }
+
+    while (fgets(buf, sizeof(buf), fp)) {
+        n++;
+        p = strchr(buf, ';');
+        if (p) {
+            *p = '\0';
+        }
+        buf[strcspn(buf, "\r\n")] = '\0';
+        p = buf + strspn(buf, " \t");
+        if (*p == '\0') {
+            continue;
+        }
+
+        cur_line = n;
+        gcode_process_line(p, false);
+        trace_plan_stamp(n);
+        trace_commands(n);
+    }
+    fclose(fp);
+
+    /* the end of the print, everything buffered goes out */
+    while (trace_take_block()) {
+    }
+    trace_commands(n);
+    return 0;
+}
+
+static int trace_write(const char *file, const char *corpus, const char *machine)
+{
+    FILE *fp;
+    record_t *r;
+    int i, j;
+
+    fp = fopen(file, "w");
+    if (!fp) {
+        fprintf(stderr, "[golden]: can not write %s\n", file);
+        return -1;
+    }
+
+    fprintf(fp, "# golden_trace %s %s %s\n", strrchr(corpus, '/') ? strrchr(corpus, '/') + 1 : corpus,
+            machine, FW_VERSION);
+    fprintf(fp, "# line kind");
+    for (j = 0; j < NR_FIELDS; j++) {
+        fprintf(fp, " %s", field[j].name);
+    }
+    fprintf(fp, "\n");
+
+    for (i = 0; i < trace.len; i++) {
+        r = &trace.r[i];
+        fprintf(fp, "%d %c", r->line, r->kind);
+        for (j = 0; j < NR_FIELDS; j++) {
+            fprintf(fp, " %u", r->v[j]);
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int trace_load(const char *file, trace_t *t)
+{
+    char buf[LINE_LEN];
+    record_t *r;
+    char *p, *end;
+    FILE *fp;
+    int j;
+
+    fp = fopen(file, "r");
+    if (!fp) {
+        fprintf(stderr, "[golden]: can not open %s\n", file);
+        return -1;
+    }
+
+    while (fgets(buf, sizeof(buf), fp)) {
+        if (buf[0] == '#' || buf[0] == '\n') {
+            continue;
+        }
+        r = trace_add(t);
+        r->line = strtol(buf, &p, 10);
+        p += strspn(p, " ");
+        r->kind = *p++;
+        for (j = 0; j < NR_FIELDS; j++) {
+            r->v[j] = strtoul(p, &end, 10);
+            if (end == p) {
+                fprintf(stderr, "[golden]: %s: bad element %d\n", file, t->len);
+                fclose(fp);
+                return -1;
+            }
+            p = end;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static bool within(int tol, uint32_t a, uint32_t b)
+{
+    uint32_t diff = a > b ? a - b : b - a;
+    uint32_t limit;
+
+    switch (tol) {
+        case TOL_STEPS:
+            return diff <= tol_steps;
+        case TOL_LOOPS:
+            return diff <= tol_loops;
+        case TOL_CYCLES:
+            limit = (uint64_t)max(a, b) * tol_permille / 1000;
+            return diff <= max(limit, 2);
+        default:
+            return diff == 0;
+    }
+}
+
+/*
+ * Number of elements differing beyond the tolerance,
+ * the first few are printed
+ */
+static int trace_compare(trace_t *golden, trace_t *t)
+{
+    record_t *g, *r;
+    int bad = 0;
+    int i, j;
+
+    if (golden->len != t->len) {
+        fprintf(stderr, "[golden]: %d elements, golden has %d\n", t->len, golden->len);
+    }
+
+    for (i = 0; i < min(golden->len, t->len); i++) {
+        g = &golden->r[i];
+        r = &t->r[i];
+
+        if (g->kind != r->kind || g->line != r->line) {
+            if (bad++ < 10) {
+                fprintf(stderr, "[golden]: element %d: line %d %c, golden line %d %c\n",
+                        i, r->line, r->kind, g->line, g->kind);
+            }
+            continue;
+        }
+        for (j = 0; j < NR_FIELDS; j++) {
+            if (!within(field[j].tol, g->v[j], r->v[j])) {
+                if (bad++ < 10) {
+                    fprintf(stderr, "[golden]: element %d line %d: %s %u, golden %u\n",
+                            i, r->line, field[j].name, r->v[j], g->v[j]);
+                }
+                break;
+            }
+        }
+    }
+    return bad + abs(golden->len - t->len);
+}
+
+/*
+ * Number of moves whose loops_accel + loops_travel + loops_decel
+ * is not steps_count, a phase that wrapped below 0 counts as well
+ */
+static int trace_check_phases(const char *name, trace_t *t)
+{
+    record_t *r;
+    uint64_t loops;
+    int bad = 0;
+    int i;
+
+    for (i = 0; i < t->len; i++) {
+        r = &t->r[i];
+        if (r->kind != 'G') {
+            continue;
+        }
+        loops = (uint64_t)r->v[F_LOOPS_ACCEL] + r->v[F_LOOPS_TRAVEL] + r->v[F_LOOPS_DECEL];
+        if (loops != r->v[F_STEPS_COUNT]) {
+            if (bad++ < 10) {
+                fprintf(stderr, "[golden]: %s element %d line %d: loops %u + %u + %u, steps_count %u\n",
+                        name, i, r->line, r->v[F_LOOPS_ACCEL], r->v[F_LOOPS_TRAVEL],
+                        r->v[F_LOOPS_DECEL], r->v[F_STEPS_COUNT]);
+            }
+        }
+    }
+    return bad;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-m xyz|corexy|delta] [-c] [-o trace] [-g golden]\n"
+                    "          [-s steps] [-l loops] [-p permille] corpus.gcode\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *machine = "xyz";
+    const char *out = NULL;
+    const char *golden_file = NULL;
+    trace_t golden = { NULL, 0, 0 };
+    int opt, bad;
+
+    while ((opt = getopt(argc, argv, "m:co:g:s:l:p:")) != -1) {
+        switch (opt) {
+            case 'm':
+                machine = optarg;
+                break;
+            case 'c':
+                trace_compact = true;
+                break;
+            case 'o':
+                out = optarg;
+                break;
+            case 'g':
+                golden_file = optarg;
+                break;
+            case 's':
+                tol_steps = atoi(optarg);
+                break;
+            case 'l':
+                tol_loops = atoi(optarg);
+                break;
+            case 'p':
+                tol_permille = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+    if (optind != argc - 1 || (!out && !golden_file)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (golden_file && trace_load(golden_file, &golden) < 0) {
+        return -1;
+    }
+    if (setup(machine) < 0) {
+        return -1;
+    }
+    if (run_corpus(argv[optind]) < 0) {
+        return -1;
+    }
+
+    if (out && trace_write(out, argv[optind], machine) < 0) {
+        return -1;
+    }
+
+    bad = trace_check_phases("trace", &trace);
+    if (golden_file) {
+        bad += trace_check_phases("golden", &golden);
+        bad += trace_compare(&golden, &trace);
+        fprintf(stderr, "[golden]: %s %s%s: %d elements, %s\n", argv[optind], machine,
+                trace_compact ? " compact" : "", trace.len, bad ? "FAILED" : "ok");
+        return bad ? 1 : 0;
+    }
+    if (bad) {
+        fprintf(stderr, "[golden]: %s %s: %d elements, FAILED\n", argv[optind], machine, trace.len);
+        return 1;
+    }
+    return 0;
+}
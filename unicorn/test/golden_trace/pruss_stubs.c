@@ -0,0 +1,30 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * pruss_stubs.c
+ * pruss.c and prussdrv for stepper_pruss.c in the golden trace,
+ * there is no PRU, the queue is a buffer the trace reads back
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <prussdrv.h>
+
+#include "pruss.h"
+#include "trace.h"
+
+int pruss_init(void) { return 0; }
+void pruss_exit(void) { }
+int pruss_update_code(void) { return 0; }
+int pruss_enable(void) { return 0; }
+bool pruss_compact_queue(void) { return trace_compact; }
+
+pruss_event_t *pruss_event_open(void) { return NULL; }
+void pruss_event_close(pruss_event_t *pe) { }
+int pruss_event_wait(pruss_event_t *pe, int timeout_ms) { return -1; }
+void pruss_event_wake(bool wake) { }
+
+int prussdrv_map_prumem(unsigned int pru_ram_id, void **address) { return -1; }
+int prussdrv_pru_disable(unsigned int prunum) { return 0; }
+
+int get_homing_dir() { return 0; }
@@ -0,0 +1,31 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * trace.h
+ * golden trace of the queue elements a G-code corpus makes
+*/
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdbool.h>
+
+#include "planner.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/* golden_trace.c, pruss_compact_queue() of the stubs */
+extern bool trace_compact;
+
+/* golden_trace.c, the planner buffer is full, take a block */
+extern void trace_planner_wait(void);
+
+/* trace_planner.c */
+extern void trace_plan_reset(void);
+extern void trace_plan_stamp(int line);
+extern block_t *trace_plan_take(int *line);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
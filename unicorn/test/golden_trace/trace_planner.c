@@ -0,0 +1,60 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * trace_planner.c
+ * planner.c for the golden trace. Where the gcode thread sleeps
+ * until the planner thread takes a block, the trace takes one,
+ * so the buffer runs full as it does during a print.
+*/
+#include <unistd.h>
+
+#include "trace.h"
+
+#define usleep(us)      trace_planner_wait()
+#include "../../planner.c"
+#undef usleep
+
+/* corpus line of every block in the buffer */
+static int origin[BLOCK_BUFFER_SIZE];
+static int stamped = 0;
+
+/*
+ * plan_init() without the planner thread
+ */
+void trace_plan_reset(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_AXIS; i++) {
+        axis_steps_per_sqr_second[i] = pa.max_acceleration_units_per_sq_second[i]
+                                       * pa.axis_steps_per_unit[i];
+    }
+
+    plan_update_transform();
+    plan_start();
+    stamped = block_buffer_head;
+}
+
+/*
+ * Blocks buffered since the last stamp came from line
+ */
+void trace_plan_stamp(int line)
+{
+    while (stamped != block_buffer_head) {
+        origin[stamped] = line;
+        stamped = next_block_index(stamped);
+    }
+}
+
+/*
+ * The oldest block and its corpus line, NULL if the buffer is empty.
+ * plan_discard_current_block() once it is queued.
+ */
+block_t *trace_plan_take(int *line)
+{
+    block_t *block = plan_get_current_block();
+
+    if (block) {
+        *line = origin[block_buffer_tail];
+    }
+    return block;
+}
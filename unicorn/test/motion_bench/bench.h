@@ -0,0 +1,34 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * bench.h
+ * Entry points of planner.c and gcode.c the motion bench reaches,
+ * the static ones through bench_planner.c and bench_gcode.c
+*/
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdint.h>
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/* bench_planner.c */
+extern void bench_plan_reset(void);
+extern void bench_plan_drain(int keep);
+extern void bench_plan_dirty(void);
+extern void bench_plan_recalculate(void);
+extern uint32_t bench_plan_checksum(void);
+
+/* bench_gcode.c */
+extern void bench_gcode_reset(void);
+extern int bench_gcode_coordinates(char *line, float target[4], float ij[2], float *feed_rate);
+extern void bench_gcode_set_bed_level(float amplitude);
+extern void bench_gcode_delta_point(float cartesian[4], float out[3], int leveling);
+extern void bench_gcode_delta(int n, const float *x, const float *y, const float *z,
+                              float *a, float *b, float *c, int leveling);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
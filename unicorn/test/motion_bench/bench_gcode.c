@@ -0,0 +1,102 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * bench_gcode.c
+ * gcode.c built into the bench, for the static field parsers
+ * and the bed_level grid of the delta kinematics
+*/
+#include "../../gcode.c"
+
+#include "bench.h"
+
+/*
+ * gcode_stop() and the modes a print starts with
+ */
+void bench_gcode_reset(void)
+{
+    gcode_stop();
+    relative_mode = false;
+    feedmultiply = 100;
+    active_extruder = 0;
+}
+
+/*
+ * The G0-G3 field parse, target and feed_rate in mm and mm/s,
+ * ij is the arc center offset of G2 and G3.
+ * Return the G number.
+ */
+int bench_gcode_coordinates(char *line, float target[4], float ij[2], float *feed_rate)
+{
+    int i;
+    int g = get_int(line, 'G');
+
+    if (g == 2 || g == 3) {
+        get_arc_coordinates(line);
+        ij[0] = offset[0];
+        ij[1] = offset[1];
+    } else {
+        get_coordinates(line);
+        ij[0] = 0.0;
+        ij[1] = 0.0;
+    }
+
+    for (i = 0; i < NUM_AXIS; i++) {
+        target[i] = destination[i];
+        current_position[i] = destination[i];
+    }
+    *feed_rate = feedrate / 60.0;
+    return g;
+}
+
+/*
+ * A smooth bed over the probe grid in pa, amplitude in mm
+ */
+void bench_gcode_set_bed_level(float amplitude)
+{
+    int x, y;
+
+    for (x = 0; x < pa.probeGridPoints; x++) {
+        for (y = 0; y < pa.probeGridPoints; y++) {
+            bed_level[x][y] = amplitude * sin(x) * cos(y);
+        }
+    }
+}
+
+static void bench_gcode_level(delta_level_t *level)
+{
+    level->z = bed_level;
+    level->half = (pa.probeGridPoints - 1) / 2;
+    level->inv_x_num = (pa.probeGridPoints - 1) / (pa.probeRightPos - pa.probeLeftPos);
+    level->inv_y_num = (pa.probeGridPoints - 1) / (pa.probeBackPos - pa.probeFrontPos);
+}
+
+/*
+ * Tower heights of one point the per point way, calculate_delta()
+ * plus the bed level offset when leveling, the reference for the batch
+ */
+void bench_gcode_delta_point(float cartesian[4], float out[3], int leveling)
+{
+    delta_level_t level;
+    float off = 0.0;
+
+    calculate_delta(cartesian);
+    if (leveling) {
+        bench_gcode_level(&level);
+        off = delta_level_offset(&level, cartesian[X_AXIS], cartesian[Y_AXIS]);
+    }
+    out[0] = delta[X_AXIS] + off;
+    out[1] = delta[Y_AXIS] + off;
+    out[2] = delta[Z_AXIS] + off;
+}
+
+/*
+ * Tower heights of n points the way the delta kinematics computes them,
+ * delta_calculate_batch() with the bed_level grid when leveling
+ */
+void bench_gcode_delta(int n, const float *x, const float *y, const float *z,
+                       float *a, float *b, float *c, int leveling)
+{
+    delta_level_t level;
+
+    bench_gcode_level(&level);
+    delta_calculate_batch(&delta_geo, leveling ? &level : NULL, n, x, y, z, a, b, c);
+}
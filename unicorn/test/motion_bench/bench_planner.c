@@ -0,0 +1,74 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * bench_planner.c
+ * planner.c built into the bench, so planner_recalculate() can be timed
+ * and the block buffer drained without the planner thread
+*/
+#include "../../planner.c"
+
+#include "bench.h"
+
+/*
+ * plan_init() without the planner thread
+ */
+void bench_plan_reset(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_AXIS; i++) {
+        axis_steps_per_sqr_second[i] = pa.max_acceleration_units_per_sq_second[i]
+                                       * pa.axis_steps_per_unit[i];
+    }
+
+    plan_update_transform();
+    plan_start();
+}
+
+/*
+ * Drop the oldest blocks until keep are left,
+ * the planner keeps recalculating a buffer that deep.
+ */
+void bench_plan_drain(int keep)
+{
+    while (plan_get_block_size() > keep) {
+        plan_discard_current_block();
+    }
+}
+
+/*
+ * Undo what the last planner_recalculate() settled,
+ * so the next one does the whole work again
+ */
+void bench_plan_dirty(void)
+{
+    int idx = block_buffer_tail;
+
+    while (idx != block_buffer_head) {
+        block_buffer[idx].entry_speed = block_buffer[idx].max_entry_speed;
+        block_buffer[idx].recalculate_flag = true;
+        idx = next_block_index(idx);
+    }
+}
+
+void bench_plan_recalculate(void)
+{
+    planner_recalculate();
+}
+
+/*
+ * Sum of the trapezoids in the buffer,
+ * keeps the compiler from dropping the work
+ */
+uint32_t bench_plan_checksum(void)
+{
+    uint32_t sum = 0;
+    int idx = block_buffer_tail;
+
+    while (idx != block_buffer_head) {
+        sum += block_buffer[idx].accelerate_until;
+        sum += block_buffer[idx].decelerate_after;
+        sum += block_buffer[idx].initial_rate;
+        idx = next_block_index(idx);
+    }
+    return sum;
+}
@@ -0,0 +1,66 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * bench_stubs.c
+ * Heaters, fans, servos and the rest of unicorn.c the motion code
+ * links against, none of them touch hardware here.
+ * A fan is its name, so M106 with V can be queued.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "fan.h"
+#include "heater.h"
+#include "servo.h"
+#include "unicorn.h"
+#include "util/Fifo.h"
+#include "util/Pause.h"
+
+int bbp_board_type = -1;
+
+Fifo_Handle hFifo_st2plan;
+Fifo_Handle hFifo_plan2st;
+Pause_Handle hPause_printing;
+
+int read_fd = -1;
+int write_fd = -1;
+int read_emerg_fd = -1;
+
+int fan_enable(channel_tag fan) { return 0; }
+int fan_disable(channel_tag fan) { return 0; }
+channel_tag fan_get_pwm(channel_tag fan) { return fan; }
+channel_tag fan_lookup_by_name(const char *name) { return name; }
+int fan_set_level(channel_tag fan, unsigned int level) { return 0; }
+int fan_set_queued_level(channel_tag fan, unsigned int level) { return 0; }
+
+void heater_enable(channel_tag heater) { }
+void heater_reconfig(void) { }
+channel_tag heater_lookup_by_index(int idx) { return NULL; }
+channel_tag heater_lookup_by_name(const char *name) { return NULL; }
+int heater_get_celsius(channel_tag heater, double *pcelsius) { *pcelsius = 0.0; return 0; }
+int heater_get_setpoint(channel_tag heater, double *setpoint) { *setpoint = 0.0; return 0; }
+int heater_set_setpoint(channel_tag heater, double setpoint) { return 0; }
+int heater_get_pid_values(channel_tag heater, pid_settings *pid) { return -1; }
+int heater_set_pid_values(channel_tag heater, const pid_settings *pid) { return -1; }
+int heater_temp_reached(channel_tag heater) { return 1; }
+void pid_autotune(float target_temp, int extruder, int ncycles, int w,
+                  int (*gcode_send_response_remote)(char *)) { }
+int heater_model_calibrate(float target_temp, int extruder,
+                           int (*gcode_send_response_remote)(char *)) { return -1; }
+int heater_set_rate(channel_tag heater, int hz) { return -1; }
+void heater_jitter_reset(void) { }
+int heater_jitter_dump(char *buf, int len) { return 0; }
+
+int servo_enable(channel_tag servo) { return 0; }
+int servo_disable(channel_tag servo) { return 0; }
+channel_tag servo_lookup_by_index(int idx) { return NULL; }
+channel_tag servo_lookup_by_name(const char *name) { return NULL; }
+int servo_set_angle(channel_tag servo, unsigned int angle) { return 0; }
+
+int unicorn_get_mode(void) { return FW_MODE_LOCAL; }
+int unicorn_pause(void) { return 0; }
+int unicorn_resume(void) { return 0; }
+int unicorn_restart(void) { return 0; }
+int unicorn_stop(bool blocking) { return 0; }
+int unicorn_disconnect_octoprint() { return 0; }
@@ -0,0 +1,588 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * motion_bench.c
+ * Throughput of the planner, the kinematics helpers and the
+ * gcode field parsers, on a slicer like workload or a captured print.
+ *
+ * Usage: motion_bench [-f file.gcode] [-n loops] [-o result]
+ *
+ * Every result is one line of
+ *   bench version arch workload ops ns_per_op kops_per_s checksum
+ * so the lines of runs on different firmware versions and boards
+ * can be put together and compared. The checksum changes when the
+ * bench computes something different, not when it gets faster.
+ * The firmware code prints to stdout too, -o keeps the results apart.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "common.h"
+#include "parameter.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "motion.h"
+#include "vector.h"
+#include "thermistor.h"
+#include "gcode.h"
+#include "bench.h"
+
+#if defined(__aarch64__)
+#define BENCH_ARCH      "aarch64"
+#elif defined(__arm__)
+#define BENCH_ARCH      "arm"
+#elif defined(__x86_64__)
+#define BENCH_ARCH      "x86_64"
+#elif defined(__i386__)
+#define BENCH_ARCH      "x86"
+#else
+#define BENCH_ARCH      "unknown"
+#endif
+
+#define LINE_LEN        (96)
+#define MAX_LINES       (200000)
+
+/* Blocks left in the planner buffer, about what the planner thread keeps */
+#define PLAN_DEPTH      (48)
+
+typedef struct {
+    int g;
+    float start[4];
+    float target[4];
+    float ij[2];
+    float feed_rate;        /* mm/s */
+} move_t;
+
+static char (*lines)[LINE_LEN];
+static int nr_lines = 0;
+static move_t *moves;
+static int nr_moves = 0;
+static float center[2];
+
+static const char *workload = "generated";
+static int loops = 50;
+static FILE *out;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *bench, long ops, double ns, uint32_t checksum)
+{
+    double ns_per_op = ops ? ns / ops : 0.0;
+
+    fprintf(out, "%s %s %s %s %ld %.1f %.1f %08x\n",
+            bench, FW_VERSION, BENCH_ARCH, workload, ops, ns_per_op,
+            ns_per_op > 0 ? 1e6 / ns_per_op : 0.0, checksum);
+    fflush(out);
+}
+
+static uint32_t float_sum(float f)
+{
+    return isfinite(f) ? (uint32_t)lroundf(f * 1000.0) : 0;
+}
+
+/*---------------------------------------------------------------
+ * Workload
+ *--------------------------------------------------------------*/
+static void add_line(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void add_line(const char *fmt, ...)
+{
+    va_list args;
+
+    if (nr_lines >= MAX_LINES) {
+        return;
+    }
+    va_start(args, fmt);
+    vsnprintf(lines[nr_lines++], LINE_LEN, fmt, args);
+    va_end(args);
+}
+
+/*
+ * Layers of what a slicer writes: a round perimeter in short segments,
+ * a rounded square with arc corners, zig zag infill, travels with retract
+ */
+static void workload_generate(void)
+{
+    int layer, i;
+    float e = 0.0;
+    float z, x, y, px, py;
+    const float r = 20.0;
+    const float seg = 0.8;
+    const float side = 30.0;
+    const float corner = 3.0;
+    const float spacing = 0.45;
+    const float e_per_mm = 0.033;
+    int n = 2 * M_PI * r / seg;
+
+    for (layer = 0; layer < 20; layer++) {
+        z = 0.3 + 0.2 * layer;
+
+        add_line("G1 Z%.3f F600", z);
+        add_line("G0 X%.3f Y%.3f F9000", r, 0.0);
+        add_line("G1 E%.5f F2400", e += 1.0);
+        for (i = 1; i <= n; i++) {
+            x = r * cos(2 * M_PI * i / n);
+            y = r * sin(2 * M_PI * i / n);
+            e += seg * e_per_mm;
+            add_line("G1 X%.3f Y%.3f E%.5f F1800", x, y, e);
+        }
+        add_line("G1 E%.5f F2400", e -= 1.0);
+
+        /* rounded square, counter clockwise */
+        px = side / 2;
+        py = -side / 2 + corner;
+        add_line("G0 X%.3f Y%.3f F9000", px, py);
+        add_line("G1 E%.5f F2400", e += 1.0);
+        for (i = 0; i < 4; i++) {
+            float dx[4] = {0, -1, 0, 1};
+            float dy[4] = {1, 0, -1, 0};
+            float len = side - 2 * corner;
+
+            px += dx[i] * len;
+            py += dy[i] * len;
+            e += len * e_per_mm;
+            add_line("G1 X%.3f Y%.3f E%.5f F1500", px, py, e);
+
+            /* quarter circle to the next side, center is to the left */
+            x = px + dx[(i + 1) % 4] * corner + dx[i] * corner;
+            y = py + dy[(i + 1) % 4] * corner + dy[i] * corner;
+            e += M_PI / 2 * corner * e_per_mm;
+            add_line("G3 X%.3f Y%.3f I%.3f J%.3f E%.5f",
+                     x, y, dx[(i + 1) % 4] * corner, dy[(i + 1) % 4] * corner, e);
+            px = x;
+            py = y;
+        }
+        add_line("G1 E%.5f F2400", e -= 1.0);
+
+        /* infill inside the square, alternating direction per layer */
+        add_line("G0 X%.3f Y%.3f F9000", -side / 2 + 1, -side / 2 + 1);
+        add_line("G1 E%.5f F2400", e += 1.0);
+        for (i = 0; -side / 2 + 1 + i * spacing < side / 2 - 1; i++) {
+            float a = -side / 2 + 1 + i * spacing;
+            float b0 = (i & 1) ? side / 2 - 1 : -side / 2 + 1;
+            float b1 = -b0;
+
+            e += (side - 2) * e_per_mm;
+            if (layer & 1) {
+                add_line("G1 X%.3f Y%.3f F3600", b0, a);
+                add_line("G1 X%.3f Y%.3f E%.5f", b1, a, e);
+            } else {
+                add_line("G1 X%.3f Y%.3f F3600", a, b0);
+                add_line("G1 X%.3f Y%.3f E%.5f", a, b1, e);
+            }
+        }
+        add_line("G1 E%.5f F2400", e -= 1.0);
+    }
+}
+
+/*
+ * G0-G3 of a captured print, comments and other commands are dropped
+ */
+static int workload_load(const char *file)
+{
+    char buf[256];
+    char *p;
+    FILE *fp;
+
+    fp = fopen(file, "r");
+    if (!fp) {
+        fprintf(stderr, "can not open %s\n", file);
+        return -1;
+    }
+
+    while (fgets(buf, sizeof(buf), fp) && nr_lines < MAX_LINES) {
+        p = strchr(buf, ';');
+        if (p) {
+            *p = '\0';
+        }
+        p = buf + strspn(buf, " \t");
+        if (p[0] != 'G' || !strchr("0123", p[1]) || (p[2] != ' ' && p[2] != '\r'
+                && p[2] != '\n' && p[2] != '\0')) {
+            continue;
+        }
+        p[strcspn(p, "\r\n")] = '\0';
+        add_line("%s", p);
+    }
+    fclose(fp);
+
+    workload = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+    return 0;
+}
+
+/*
+ * Targets of every line, the start of a move is the end of the one before
+ */
+static void workload_parse(void)
+{
+    float min[2] = {0, 0}, max[2] = {0, 0};
+    float prev[4] = {0, 0, 0, 0};
+    move_t *m;
+    int i;
+
+    bench_gcode_reset();
+    for (i = 0; i < nr_lines; i++) {
+        m = &moves[nr_moves++];
+        memcpy(m->start, prev, sizeof(prev));
+        m->g = bench_gcode_coordinates(lines[i], m->target, m->ij, &m->feed_rate);
+        memcpy(prev, m->target, sizeof(prev));
+
+        if (i == 0 || m->target[X_AXIS] < min[0]) min[0] = m->target[X_AXIS];
+        if (i == 0 || m->target[Y_AXIS] < min[1]) min[1] = m->target[Y_AXIS];
+        if (i == 0 || m->target[X_AXIS] > max[0]) max[0] = m->target[X_AXIS];
+        if (i == 0 || m->target[Y_AXIS] > max[1]) max[1] = m->target[Y_AXIS];
+    }
+
+    /* the delta points are put around the bed center */
+    center[0] = (min[0] + max[0]) / 2;
+    center[1] = (min[1] + max[1]) / 2;
+}
+
+/*---------------------------------------------------------------
+ * Benches
+ *--------------------------------------------------------------*/
+static void bench_gcode_fields(void)
+{
+    float target[4], ij[2], feed_rate;
+    uint32_t sum = 0;
+    double start, ns = 0;
+    int l, i;
+
+    for (l = 0; l < loops; l++) {
+        bench_gcode_reset();
+        start = now_ns();
+        for (i = 0; i < nr_lines; i++) {
+            sum += bench_gcode_coordinates(lines[i], target, ij, &feed_rate);
+        }
+        ns += now_ns() - start;
+        sum += float_sum(target[X_AXIS] + target[Y_AXIS] + target[E_AXIS]);
+    }
+    report("gcode_fields", (long)loops * nr_lines, ns, sum);
+}
+
+static void bench_plan_buffer_line(void)
+{
+    uint32_t sum = 0;
+    double start, ns = 0;
+    move_t *m;
+    int l, i;
+    long ops = 0;
+
+    for (l = 0; l < loops; l++) {
+        bench_plan_reset();
+        start = now_ns();
+        for (i = 0; i < nr_moves; i++) {
+            m = &moves[i];
+            if (m->g == 2 || m->g == 3) {
+                continue;
+            }
+            plan_buffer_line(m->target[X_AXIS], m->target[Y_AXIS], m->target[Z_AXIS],
+                             m->target[E_AXIS], m->feed_rate, 0);
+            bench_plan_drain(PLAN_DEPTH);
+            ops++;
+        }
+        ns += now_ns() - start;
+        sum += bench_plan_checksum();
+    }
+    report("plan_buffer_line", ops, ns, sum);
+}
+
+static void bench_planner_recalculate(void)
+{
+    uint32_t sum = 0;
+    double start;
+    move_t *m;
+    int i;
+    long ops = (long)loops * 1000;
+
+    /* a full buffer of the first moves */
+    bench_plan_reset();
+    for (i = 0; i < nr_moves && plan_get_block_size() < PLAN_DEPTH; i++) {
+        m = &moves[i];
+        if (m->g != 2 && m->g != 3) {
+            plan_buffer_line(m->target[X_AXIS], m->target[Y_AXIS], m->target[Z_AXIS],
+                             m->target[E_AXIS], m->feed_rate, 0);
+        }
+    }
+
+    start = now_ns();
+    for (i = 0; i < ops; i++) {
+        bench_plan_dirty();
+        bench_plan_recalculate();
+    }
+    sum = bench_plan_checksum();
+    report("planner_recalculate", ops, now_ns() - start, sum);
+}
+
+static void bench_mc_arc(void)
+{
+    float position[4], target[4], offset[3];
+    uint32_t sum = 0;
+    double start, ns = 0;
+    move_t *m;
+    int l, i;
+    long ops = 0;
+
+    for (l = 0; l < loops; l++) {
+        bench_plan_reset();
+        start = now_ns();
+        for (i = 0; i < nr_moves; i++) {
+            m = &moves[i];
+            if (m->g != 2 && m->g != 3) {
+                continue;
+            }
+            /* mc_arc() plans from where the last arc ended */
+            plan_set_position(m->start[X_AXIS], m->start[Y_AXIS], m->start[Z_AXIS],
+                              m->start[E_AXIS]);
+            memcpy(position, m->start, sizeof(position));
+            memcpy(target, m->target, sizeof(target));
+            offset[0] = m->ij[0];
+            offset[1] = m->ij[1];
+            offset[2] = 0.0;
+            mc_arc(position, target, offset, X_AXIS, Y_AXIS, Z_AXIS,
+                   m->feed_rate, hypot(offset[0], offset[1]), m->g == 2, 0);
+            bench_plan_drain(PLAN_DEPTH);
+            ops++;
+        }
+        ns += now_ns() - start;
+        sum += bench_plan_checksum();
+    }
+    report("mc_arc", ops, ns, sum);
+}
+
+/*
+ * The move targets one point at a time, the per point baseline
+ * the batch path is measured against
+ */
+static void bench_delta_point(int leveling)
+{
+    float cartesian[4], tower[3];
+    uint32_t sum = 0;
+    double start, ns = 0;
+    int l, i;
+
+    for (l = 0; l < loops; l++) {
+        start = now_ns();
+        for (i = 0; i < nr_moves; i++) {
+            cartesian[X_AXIS] = moves[i].target[X_AXIS] - center[0];
+            cartesian[Y_AXIS] = moves[i].target[Y_AXIS] - center[1];
+            cartesian[Z_AXIS] = moves[i].target[Z_AXIS];
+            cartesian[E_AXIS] = moves[i].target[E_AXIS];
+            bench_gcode_delta_point(cartesian, tower, leveling);
+        }
+        ns += now_ns() - start;
+        sum += float_sum(tower[0] + tower[1] + tower[2]);
+    }
+    report(leveling ? "calculate_delta_adjust" : "calculate_delta",
+           (long)loops * nr_moves, ns, sum);
+}
+
+/*
+ * The move targets in batches of DELTA_BATCH_SIZE,
+ * as the delta kinematics splits a move
+ */
+static void bench_delta(int leveling)
+{
+    float x[DELTA_BATCH_SIZE], y[DELTA_BATCH_SIZE], z[DELTA_BATCH_SIZE];
+    float a[DELTA_BATCH_SIZE], b[DELTA_BATCH_SIZE], c[DELTA_BATCH_SIZE];
+    uint32_t sum = 0;
+    double start, ns = 0;
+    int l, i, j, n;
+
+    for (l = 0; l < loops; l++) {
+        start = now_ns();
+        for (i = 0; i < nr_moves; i += n) {
+            n = min(DELTA_BATCH_SIZE, nr_moves - i);
+            for (j = 0; j < n; j++) {
+                x[j] = moves[i + j].target[X_AXIS] - center[0];
+                y[j] = moves[i + j].target[Y_AXIS] - center[1];
+                z[j] = moves[i + j].target[Z_AXIS];
+            }
+            bench_gcode_delta(n, x, y, z, a, b, c, leveling);
+        }
+        ns += now_ns() - start;
+        sum += float_sum(a[0] + b[0] + c[0]);
+    }
+    report(leveling ? "delta_calculate_batch_level" : "delta_calculate_batch",
+           (long)loops * nr_moves, ns, sum);
+}
+
+static void bench_apply_rotation(void)
+{
+    vector_t normal = { 0.004, -0.007, 1.0 };
+    matrix_t m = matrix_create_look_at(normal);
+    float x, y, z;
+    float acc = 0.0;
+    double start, ns = 0;
+    int l, i;
+
+    for (l = 0; l < loops; l++) {
+        start = now_ns();
+        for (i = 0; i < nr_moves; i++) {
+            x = moves[i].target[X_AXIS];
+            y = moves[i].target[Y_AXIS];
+            z = moves[i].target[Z_AXIS];
+            apply_rotation_xyz(m, &x, &y, &z);
+            acc += z;
+        }
+        ns += now_ns() - start;
+    }
+    report("apply_rotation_xyz", (long)loops * nr_moves, ns, float_sum(acc / loops));
+}
+
+/*
+ * convert() over the valid adc range, through the extruder and bed tables
+ */
+static void bench_convert(void)
+{
+    double celsius, acc = 0.0;
+    double start, ns = 0;
+    int l, adc;
+    long ops = 0;
+
+    for (l = 0; l < loops * 10; l++) {
+        start = now_ns();
+        for (adc = ERROR_MIN_ADC; adc <= ERROR_MAX_ADC; adc++) {
+            if (temp_convert_extruder1(adc, &celsius) == 0) {
+                acc += celsius;
+            }
+            if (temp_convert_bed(adc, &celsius) == 0) {
+                acc += celsius;
+            }
+            ops += 2;
+        }
+        ns += now_ns() - start;
+    }
+    report("convert", ops, ns, float_sum(acc / loops / 10 / 1000));
+}
+
+/*
+ * A whole G0-G3 line, parse, kinematics and planner
+ */
+static void bench_gcode_process_line(void)
+{
+    char line[LINE_LEN];
+    uint32_t sum = 0;
+    double start, ns = 0;
+    int l, i;
+
+    for (l = 0; l < loops; l++) {
+        bench_plan_reset();
+        bench_gcode_reset();
+        start = now_ns();
+        for (i = 0; i < nr_lines; i++) {
+            strcpy(line, lines[i]);
+            gcode_process_line(line, false);
+            bench_plan_drain(PLAN_DEPTH);
+        }
+        ns += now_ns() - start;
+        sum += bench_plan_checksum();
+    }
+    report("gcode_process_line", (long)loops * nr_lines, ns, sum);
+}
+
+static void setup(void)
+{
+    parameter_restore_default();
+
+    pa.machine_type = MACHINE_XYZ;
+    pa.autoLeveling = 0;
+    kinematics_init();
+
+    /* a 7x7 grid over +-80mm for the delta bed level offset */
+    pa.probeGridPoints = 7;
+    pa.probeLeftPos = -80;
+    pa.probeRightPos = 80;
+    pa.probeFrontPos = -80;
+    pa.probeBackPos = 80;
+
+    gcode_init();
+    bench_gcode_set_bed_level(0.05);
+    bench_plan_reset();
+}
+
+int main(int argc, char *argv[])
+{
+    const char *file = NULL;
+    const char *result = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:n:o:")) != -1) {
+        switch (opt) {
+            case 'f':
+                file = optarg;
+                break;
+            case 'n':
+                loops = atoi(optarg);
+                break;
+            case 'o':
+                result = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-f file.gcode] [-n loops] [-o result]\n", argv[0]);
+                return -1;
+        }
+    }
+    if (loops <= 0) {
+        fprintf(stderr, "loops must be > 0\n");
+        return -1;
+    }
+
+    out = stdout;
+    if (result) {
+        out = fopen(result, "w");
+        if (!out) {
+            fprintf(stderr, "can not open %s\n", result);
+            return -1;
+        }
+    }
+
+    lines = malloc(sizeof(*lines) * MAX_LINES);
+    moves = malloc(sizeof(*moves) * MAX_LINES);
+    if (!lines || !moves) {
+        return -1;
+    }
+
+    setup();
+
+    if (file) {
+        if (workload_load(file) < 0) {
+            return -1;
+        }
+    } else {
+        workload_generate();
+    }
+    workload_parse();
+
+    fprintf(out, "# lines %d loops %d\n", nr_lines, loops);
+    fprintf(out, "# bench version arch workload ops ns_per_op kops_per_s checksum\n");
+
+    bench_gcode_fields();
+    bench_plan_buffer_line();
+    bench_planner_recalculate();
+    bench_mc_arc();
+    bench_delta_point(0);
+    bench_delta_point(1);
+    bench_delta(0);
+    bench_delta(1);
+    bench_apply_rotation();
+    bench_convert();
+    bench_gcode_process_line();
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(lines);
+    free(moves);
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * stepper_stubs.c
+ * stepper.c for the motion bench, moves end at the planner.
+ * Positions and the mcode count read 0, the queue reads empty.
+ * Also linked by test/golden_trace, with the real stepper_pruss.c.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "stepper.h"
+
+void stepper_enable_drivers(void) { }
+void stepper_disable_drivers(void) { }
+bool stepper_is_stop() { return false; }
+bool motor_is_disable() { return false; }
+
+void stepper_sync(void) { }
+int stepper_update(void) { return 0; }
+void stepper_parameter_update(void) { }
+int stepper_wait_event(int timeout_ms) { return 0; }
+void stepper_load_filament(int cmd) { }
+
+void stepper_set_position(const long x, const long y, const long z, const long e) { }
+uint32_t stepper_get_position(uint8_t axis) { return 0; }
+float stepper_get_position_mm(uint8_t axis) { return 0.0; }
+
+int stepper_check_lmsw(uint8_t axis) { return 0; }
+int stepper_config_lmsw(uint8_t axis, bool high) { return 0; }
+int stepper_wait_for_lmsw(uint8_t axis) { return 0; }
+int stepper_autoLevel_gpio_turn(bool on) { return 0; }
+int stepper_wait_for_autoLevel(void) { return 0; }
+
+int stepper_set_current(uint8_t axis, uint32_t current) { return 0; }
+int stepper_set_microstep(uint8_t axis, uint8_t steps) { return 0; }
+int stepper_set_rate_scale(int percent) { return 0; }
+int stepper_pwm_out(channel_tag pwm) { return 0; }
+
+int stepper_get_queue_len(void) { return 0; }
+uint32_t stepper_get_mcode_count(void) { return 0; }
+int stepper_queue_get_pos(uint32_t *pos) { return -1; }
+int stepper_queue_pending(uint32_t pos) { return -1; }
+
+#ifndef WITH_STEPPER_PRUSS
+int pruss_stats_dump(char *buf, int len) { return -1; }
+#endif
@@ -0,0 +1,934 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * pru_emu.c
+ * Host side PRU emulator for the pasm -b images of pruss_unicorn.p
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pru_emu.h"
+
+static const char *op_names[OP_MAXIDX + 1] = {
+    "???",
+    "ADD", "ADC", "SUB", "SUC", "LSL", "LSR", "RSB", "RSC",
+    "AND", "OR", "XOR", "NOT", "MIN", "MAX", "CLR", "SET",
+    "LDI", "LBBO", "LBCO", "SBBO", "SBCO", "LFC", "STC", "JAL",
+    "JMP", "QBGT", "QBLT", "QBEQ", "QBGE", "QBLE", "QBNE", "QBA",
+    "QBBS", "QBBC", "LMBD", "CALL", "WBC", "WBS", "MOV", "MVIB",
+    "MVIW", "MVID", "SCAN", "HALT", "SLP", "RET", "ZERO", "FILL",
+    "XIN", "XOUT", "XCHG", "SXIN", "SXOUT", "SXCHG", "LOOP", "ILOOP",
+    "NOP0", "NOP1", "NOP2", "NOP3", "NOP4", "NOP5", "NOP6", "NOP7",
+    "NOP8", "NOP9", "NOPA", "NOPB", "NOPC", "NOPD", "NOPE", "NOPF",
+};
+
+/* Register field FIELDTYPE_7_0 ... FIELDTYPE_31_0 */
+static const uint8_t field_shift[8] = { 0, 8, 16, 24, 0, 8, 16, 0 };
+static const uint8_t field_width[8] = { 8, 8, 8, 8, 16, 16, 16, 32 };
+static const uint32_t field_mask[8] = {
+    0xff, 0xff, 0xff, 0xff, 0xffff, 0xffff, 0xffff, 0xffffffff
+};
+
+/* AM335x PRU constant table, 24-31 are completed from CTBIR/CTPPR */
+static const uint32_t const_table[32] = {
+    0x00020000, 0x48040000, 0x4802A000, 0x00030000,
+    0x00026000, 0x48060000, 0x48030000, 0x00028000,
+    0x46000000, 0x4A100000, 0x48318000, 0x48022000,
+    0x48024000, 0x48310000, 0x481CC000, 0x481D0000,
+    0x481A0000, 0x4819C000, 0x48300000, 0x48302000,
+    0x48304000, 0x00032400, 0x480C8000, 0x480CA000,
+    0x00000000, 0x00002000, 0x0002E000, 0x00032000,
+    0x00000000, 0x49000000, 0x40000000, 0x80000000,
+};
+
+const char *pru_emu_op_name(uint32_t op)
+{
+    if (op > OP_MAXIDX) {
+        return op_names[0];
+    }
+    return op_names[op];
+}
+
+/*------------------------------------------------------------------------
+ * Decoder, the reverse of ProcessOp() in pasmop.c
+ *-----------------------------------------------------------------------*/
+static void arg_reg(PRU_ARG *arg, uint32_t reg, uint32_t field)
+{
+    arg->Type  = ARGTYPE_REGISTER;
+    arg->Value = reg & 0x1f;
+    arg->Field = field & 0x7;
+}
+
+static void arg_imm(PRU_ARG *arg, uint32_t type, uint32_t value)
+{
+    arg->Type  = type;
+    arg->Value = value;
+}
+
+/* OP(255): register or 8 bit immediate in bits 24:16 */
+static void arg_op2(PRU_ARG *arg, uint32_t word)
+{
+    if (word & (1 << 24)) {
+        arg_imm(arg, ARGTYPE_IMMEDIATE, (word >> 16) & 0xff);
+    } else {
+        arg_reg(arg, word >> 16, word >> 21);
+    }
+}
+
+/* Burst length n - 1, or R0.b0-b3 from 124 */
+static void arg_count(PRU_ARG *arg, uint32_t count)
+{
+    if (count >= 124) {
+        arg_imm(arg, ARGTYPE_R0BYTE, count - 124);
+    } else {
+        arg_imm(arg, ARGTYPE_COUNT, count + 1);
+    }
+}
+
+/* 10 bit signed branch offset in bits 26:25 and 7:0 */
+static void arg_offset(PRU_ARG *arg, uint32_t word)
+{
+    int32_t offset = (word & 0xff) | ((word >> 17) & 0x300);
+
+    if (offset & 0x200) {
+        offset -= 0x400;
+    }
+    arg_imm(arg, ARGTYPE_OFFSET, (uint32_t)offset);
+}
+
+static uint32_t mvi_flags(uint32_t type)
+{
+    switch (type) {
+    case 1:
+        return PA_FLG_REGPOINTER;
+    case 2:
+        return PA_FLG_REGPOINTER | PA_FLG_POSTINC;
+    case 3:
+        return PA_FLG_REGPOINTER | PA_FLG_PREDEC;
+    default:
+        return 0;
+    }
+}
+
+int pru_emu_decode(uint32_t word, PRU_INST *inst)
+{
+    uint32_t op;
+
+    memset(inst, 0, sizeof(*inst));
+
+    switch (word >> 29) {
+    case 0:
+        /* ADD ... SET, MOV is coded as AND */
+        inst->Op = OP_ADD + ((word >> 25) & 0xf);
+        goto ARITHMETIC;
+
+    case 1:
+        op = (word >> 25) & 0x7f;
+        switch (op) {
+        case 0x10:
+        case 0x11:
+            /* JMP, JAL, CALL and RET */
+            inst->Op = (op == 0x10) ? OP_JMP : OP_JAL;
+            inst->ArgCnt = 2;
+            arg_reg(&inst->Arg[0], word, word >> 5);
+            if (word & (1 << 24)) {
+                arg_imm(&inst->Arg[1], ARGTYPE_IMMEDIATE, (word >> 8) & 0xffff);
+            } else {
+                arg_reg(&inst->Arg[1], word >> 16, word >> 21);
+            }
+            return 0;
+        case 0x12:
+            inst->Op = OP_LDI;
+            inst->ArgCnt = 2;
+            arg_reg(&inst->Arg[0], word, word >> 5);
+            arg_imm(&inst->Arg[1], ARGTYPE_IMMEDIATE, (word >> 8) & 0xffff);
+            return 0;
+        case 0x13:
+            inst->Op = OP_LMBD;
+            goto ARITHMETIC;
+        case 0x14:
+            inst->Op = OP_SCAN;
+            goto ARITHMETIC;
+        case 0x15:
+            inst->Op = OP_HALT;
+            return 0;
+        case 0x16:
+            switch ((word >> 16) & 0x3) {
+            case 0:
+                inst->Op = OP_MVIB;
+                break;
+            case 1:
+                inst->Op = OP_MVIW;
+                break;
+            case 2:
+                inst->Op = OP_MVID;
+                break;
+            default:
+                return -1;
+            }
+            inst->ArgCnt = 2;
+            arg_reg(&inst->Arg[0], word, word >> 5);
+            inst->Arg[0].Flags = mvi_flags((word >> 23) & 0x3);
+            arg_reg(&inst->Arg[1], word >> 8, word >> 13);
+            inst->Arg[1].Flags = mvi_flags((word >> 21) & 0x3);
+            if (word & (1 << 20)) {
+                inst->ArgCnt = 3;
+                arg_imm(&inst->Arg[2], ARGTYPE_R0BYTE, (word >> 18) & 0x3);
+            }
+            return 0;
+        case 0x17:
+            /* XIN, XOUT, XCHG, ZERO and FILL */
+            switch ((word >> 23) & 0x3) {
+            case 1:
+                inst->Op = (word & (1 << 14)) ? OP_SXIN : OP_XIN;
+                if (((word >> 15) & 0xff) == 255) {
+                    inst->Op = OP_ZERO;
+                } else if (((word >> 15) & 0xff) == 254) {
+                    inst->Op = OP_FILL;
+                }
+                break;
+            case 2:
+                inst->Op = (word & (1 << 14)) ? OP_SXOUT : OP_XOUT;
+                break;
+            case 3:
+                inst->Op = (word & (1 << 14)) ? OP_SXCHG : OP_XCHG;
+                break;
+            default:
+                return -1;
+            }
+            inst->ArgCnt = 3;
+            arg_imm(&inst->Arg[0], ARGTYPE_IMMEDIATE, (word >> 15) & 0xff);
+            arg_imm(&inst->Arg[1], ARGTYPE_IMMEDIATE, (word & 0x1f) * 4 + ((word >> 5) & 0x3));
+            arg_count(&inst->Arg[2], (word >> 7) & 0x7f);
+            return 0;
+        case 0x18:
+        case 0x19:
+        case 0x1a:
+        case 0x1b:
+            inst->Op = (word & (1 << 15)) ? OP_ILOOP : OP_LOOP;
+            inst->ArgCnt = 2;
+            arg_imm(&inst->Arg[0], ARGTYPE_OFFSET, word & 0xff);
+            if (word & (1 << 24)) {
+                arg_imm(&inst->Arg[1], ARGTYPE_IMMEDIATE, ((word >> 16) & 0xff) + 1);
+            } else {
+                arg_reg(&inst->Arg[1], word >> 16, word >> 21);
+            }
+            return 0;
+        case 0x1f:
+            inst->Op = OP_SLP;
+            inst->ArgCnt = 1;
+            arg_imm(&inst->Arg[0], ARGTYPE_IMMEDIATE, (word >> 23) & 0x1);
+            return 0;
+        default:
+            return -1;
+        }
+
+    case 2:
+    case 3:
+        /* Condition bits 29:27 are GT, EQ, LT */
+        switch ((word >> 27) & 0x7) {
+        case 1:
+            inst->Op = OP_QBLT;
+            break;
+        case 2:
+            inst->Op = OP_QBEQ;
+            break;
+        case 3:
+            inst->Op = OP_QBLE;
+            break;
+        case 4:
+            inst->Op = OP_QBGT;
+            break;
+        case 5:
+            inst->Op = OP_QBNE;
+            break;
+        case 6:
+            inst->Op = OP_QBGE;
+            break;
+        case 7:
+            inst->Op = OP_QBA;
+            inst->ArgCnt = 1;
+            arg_offset(&inst->Arg[0], word);
+            return 0;
+        default:
+            return -1;
+        }
+        goto QUICK_BRANCH;
+
+    case 4:
+    case 7:
+        /* SBCO, LBCO, SBBO, LBBO */
+        if ((word >> 29) == 4) {
+            inst->Op = (word & (1 << 28)) ? OP_LBCO : OP_SBCO;
+            arg_imm(&inst->Arg[1], ARGTYPE_CONSTANT, (word >> 8) & 0x1f);
+        } else {
+            inst->Op = (word & (1 << 28)) ? OP_LBBO : OP_SBBO;
+            arg_reg(&inst->Arg[1], word >> 8, FIELDTYPE_31_0);
+        }
+        inst->ArgCnt = 4;
+        arg_imm(&inst->Arg[0], ARGTYPE_IMMEDIATE, (word & 0x1f) * 4 + ((word >> 5) & 0x3));
+        arg_op2(&inst->Arg[2], word);
+        arg_count(&inst->Arg[3], ((word >> 21) & 0x70) | ((word >> 12) & 0x0e) | ((word >> 7) & 0x1));
+        return 0;
+
+    case 5:
+        op = (word >> 25) & 0x7f;
+        if (op < 0x50 || op > 0x5f) {
+            return -1;
+        }
+        inst->Op = OP_NOP0 + (op - 0x50);
+        goto ARITHMETIC;
+
+    case 6:
+        /* QBBC, QBBS, WBS and WBC are the same with offset 0 */
+        switch ((word >> 27) & 0x1f) {
+        case 0x19:
+            inst->Op = OP_QBBC;
+            break;
+        case 0x1a:
+            inst->Op = OP_QBBS;
+            break;
+        default:
+            return -1;
+        }
+        goto QUICK_BRANCH;
+    }
+
+    return -1;
+
+ARITHMETIC:
+    inst->ArgCnt = 3;
+    arg_reg(&inst->Arg[0], word, word >> 5);
+    arg_reg(&inst->Arg[1], word >> 8, word >> 13);
+    arg_op2(&inst->Arg[2], word);
+    return 0;
+
+QUICK_BRANCH:
+    inst->ArgCnt = 3;
+    arg_offset(&inst->Arg[0], word);
+    arg_reg(&inst->Arg[1], word >> 8, word >> 13);
+    arg_op2(&inst->Arg[2], word);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+ * Memory
+ *-----------------------------------------------------------------------*/
+pru_emu_region_t *pru_emu_add_region(pru_emu_t *emu, const char *name,
+                                     uint32_t base, uint32_t size, uint8_t *mem,
+                                     uint32_t read_cycles, uint32_t write_cycles)
+{
+    pru_emu_region_t *region;
+
+    if (emu->nr_regions >= PRU_EMU_MAX_REGIONS || size == 0) {
+        fprintf(stderr, "[pru_emu]: can't map %s\n", name);
+        return NULL;
+    }
+
+    region = &emu->regions[emu->nr_regions];
+    memset(region, 0, sizeof(*region));
+
+    if (!mem) {
+        mem = calloc(1, size);
+        if (!mem) {
+            return NULL;
+        }
+        region->owned = true;
+    }
+
+    region->name = name;
+    region->base = base;
+    region->size = size;
+    region->mem  = mem;
+    region->read_cycles  = read_cycles;
+    region->write_cycles = write_cycles;
+
+    emu->nr_regions++;
+    return region;
+}
+
+pru_emu_region_t *pru_emu_find_region(pru_emu_t *emu, uint32_t addr)
+{
+    int i;
+
+    for (i = 0; i < emu->nr_regions; i++) {
+        pru_emu_region_t *region = &emu->regions[i];
+        if (addr >= region->base && addr - region->base < region->size) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Copy len bytes between the bus and buf,
+ * return the modelled cycles of the access.
+ */
+static uint32_t mem_access(pru_emu_t *emu, uint32_t addr, uint8_t *buf, uint32_t len, bool write)
+{
+    pru_emu_region_t *region = pru_emu_find_region(emu, addr);
+    uint32_t words = (len + 3) / 4;
+    uint32_t offset;
+
+    if (!region || addr - region->base + len > region->size) {
+        emu->unmapped++;
+        if (!write) {
+            memset(buf, 0, len);
+        }
+        return (write ? PRU_EMU_L4_WRITE : PRU_EMU_L4_READ) + words - 1;
+    }
+
+    offset = addr - region->base;
+    if (write) {
+        memcpy(region->mem + offset, buf, len);
+        region->writes++;
+        if (emu->write_hook) {
+            emu->write_hook(emu, region, offset, len, emu->write_arg);
+        }
+        return region->write_cycles + words - 1;
+    }
+
+    memcpy(buf, region->mem + offset, len);
+    region->reads++;
+    return region->read_cycles + words - 1;
+}
+
+static uint32_t ctrl_reg(pru_emu_t *emu, uint32_t offset)
+{
+    pru_emu_region_t *region = pru_emu_find_region(emu, PRU_EMU_CTRL + offset);
+    uint32_t val = 0;
+
+    if (region) {
+        memcpy(&val, region->mem + (PRU_EMU_CTRL + offset - region->base), 4);
+    }
+    return val;
+}
+
+/*
+ * CYCLE and STALL stop at 0xffffffff, a memory access
+ * stalls for all but its first cycle
+ */
+static void ctrl_count(pru_emu_t *emu, uint32_t cycles)
+{
+    pru_emu_region_t *region = pru_emu_find_region(emu, PRU_EMU_CTRL);
+    uint32_t control, cycle, stall;
+
+    if (!region) {
+        return;
+    }
+    memcpy(&control, region->mem + PRU_EMU_CONTROL, 4);
+    if (!(control & PRU_EMU_COUNTER_ENABLE)) {
+        return;
+    }
+    memcpy(&cycle, region->mem + PRU_EMU_CYCLE, 4);
+    memcpy(&stall, region->mem + PRU_EMU_STALL, 4);
+    cycle = (cycle > UINT32_MAX - cycles) ? UINT32_MAX : cycle + cycles;
+    stall = (stall > UINT32_MAX - (cycles - 1)) ? UINT32_MAX : stall + cycles - 1;
+    memcpy(region->mem + PRU_EMU_CYCLE, &cycle, 4);
+    memcpy(region->mem + PRU_EMU_STALL, &stall, 4);
+}
+
+uint32_t pru_emu_constant(pru_emu_t *emu, int n)
+{
+    uint32_t ctbir0, ctbir1, ctppr0, ctppr1;
+
+    n &= 0x1f;
+    if (n < 24) {
+        return const_table[n];
+    }
+
+    ctbir0 = ctrl_reg(emu, PRU_EMU_CTBIR0);
+    ctbir1 = ctrl_reg(emu, PRU_EMU_CTBIR1);
+    ctppr0 = ctrl_reg(emu, PRU_EMU_CTPPR0);
+    ctppr1 = ctrl_reg(emu, PRU_EMU_CTPPR1);
+
+    switch (n) {
+    case 24:
+        return const_table[n] | ((ctbir0 & 0xff) << 8);
+    case 25:
+        return const_table[n] | (((ctbir0 >> 16) & 0xff) << 8);
+    case 26:
+        return const_table[n] | ((ctbir1 & 0xff) << 8);
+    case 27:
+        return const_table[n] | (((ctbir1 >> 16) & 0xff) << 8);
+    case 28:
+        return (ctppr0 & 0xffff) << 8;
+    case 29:
+        return const_table[n] | (((ctppr0 >> 16) & 0xffff) << 8);
+    case 30:
+        return const_table[n] | ((ctppr1 & 0xffff) << 8);
+    default:
+        return const_table[n] | (((ctppr1 >> 16) & 0xffff) << 8);
+    }
+}
+
+/*------------------------------------------------------------------------
+ * Registers
+ *-----------------------------------------------------------------------*/
+static inline uint8_t *reg_file(pru_emu_t *emu)
+{
+    return (uint8_t *)emu->reg;
+}
+
+static inline uint32_t reg_get(pru_emu_t *emu, const PRU_ARG *arg)
+{
+    uint32_t val = (arg->Value == 31) ? emu->r31_in : emu->reg[arg->Value];
+
+    return (val >> field_shift[arg->Field]) & field_mask[arg->Field];
+}
+
+static inline void reg_set(pru_emu_t *emu, const PRU_ARG *arg, uint32_t val)
+{
+    uint32_t mask = field_mask[arg->Field] << field_shift[arg->Field];
+    uint32_t *reg = (arg->Value == 31) ? &emu->r31_out : &emu->reg[arg->Value];
+
+    *reg = (*reg & ~mask) | ((val << field_shift[arg->Field]) & mask);
+
+    /* R31 strobe raises system event 16 + vector */
+    if (arg->Value == 31 && (emu->r31_out & (1 << 5))) {
+        if (emu->event_hook) {
+            emu->event_hook(emu, 16 + (emu->r31_out & 0xf), emu->event_arg);
+        }
+        emu->r31_out &= ~(1 << 5);
+    }
+}
+
+static inline uint32_t op2_get(pru_emu_t *emu, const PRU_ARG *arg)
+{
+    if (arg->Type == ARGTYPE_REGISTER) {
+        return reg_get(emu, arg);
+    }
+    return arg->Value;
+}
+
+static inline uint32_t count_get(pru_emu_t *emu, const PRU_ARG *arg)
+{
+    if (arg->Type == ARGTYPE_R0BYTE) {
+        return (emu->reg[0] >> (arg->Value * 8)) & 0x7f;
+    }
+    return arg->Value;
+}
+
+/* MVIx operand, through a R1.bn pointer when flagged */
+static uint32_t mvi_addr(pru_emu_t *emu, const PRU_ARG *arg, uint32_t size)
+{
+    uint32_t ptr = reg_get(emu, arg);
+
+    if (arg->Flags & PA_FLG_PREDEC) {
+        ptr -= size;
+        reg_set(emu, arg, ptr);
+    } else if (arg->Flags & PA_FLG_POSTINC) {
+        reg_set(emu, arg, ptr + size);
+    }
+    return ptr & 0x7f;
+}
+
+/*------------------------------------------------------------------------
+ * Execution
+ *-----------------------------------------------------------------------*/
+int pru_emu_init(pru_emu_t *emu)
+{
+    memset(emu, 0, sizeof(*emu));
+
+    if (!pru_emu_add_region(emu, "dram0", PRU_EMU_DRAM0, 0x2000, NULL,
+                            PRU_EMU_LOCAL_READ, PRU_EMU_LOCAL_WRITE)
+        || !pru_emu_add_region(emu, "dram1", PRU_EMU_DRAM1, 0x2000, NULL,
+                               PRU_EMU_LOCAL_READ, PRU_EMU_LOCAL_WRITE)
+        || !pru_emu_add_region(emu, "shared", PRU_EMU_SHARED_RAM, 0x3000, NULL,
+                               PRU_EMU_LOCAL_READ, PRU_EMU_LOCAL_WRITE)
+        || !pru_emu_add_region(emu, "intc", PRU_EMU_INTC, 0x2000, NULL,
+                               PRU_EMU_LOCAL_READ, PRU_EMU_LOCAL_WRITE)
+        || !pru_emu_add_region(emu, "ctrl", PRU_EMU_CTRL, 0x1000, NULL,
+                               PRU_EMU_LOCAL_READ, PRU_EMU_LOCAL_WRITE)
+        || !pru_emu_add_region(emu, "cfg", PRU_EMU_CFG, 0x2000, NULL,
+                               PRU_EMU_LOCAL_READ, PRU_EMU_LOCAL_WRITE)) {
+        pru_emu_exit(emu);
+        return -1;
+    }
+
+    return 0;
+}
+
+void pru_emu_exit(pru_emu_t *emu)
+{
+    int i;
+
+    for (i = 0; i < emu->nr_regions; i++) {
+        if (emu->regions[i].owned) {
+            free(emu->regions[i].mem);
+        }
+        emu->regions[i].mem = NULL;
+    }
+    emu->nr_regions = 0;
+}
+
+int pru_emu_load_words(pru_emu_t *emu, const uint32_t *code, uint32_t words)
+{
+    uint32_t i;
+
+    if (words > PRU_EMU_IRAM_WORDS) {
+        fprintf(stderr, "[pru_emu]: image of %u words exceeds IRAM\n", words);
+        return -1;
+    }
+
+    memset(emu->iram, 0, sizeof(emu->iram));
+    memset(emu->inst, 0, sizeof(emu->inst));
+    for (i = 0; i < words; i++) {
+        emu->iram[i] = code[i];
+        if (pru_emu_decode(code[i], &emu->inst[i]) < 0) {
+            /* Op 0 faults only if executed */
+            emu->inst[i].Op = 0;
+        }
+    }
+    emu->code_words = words;
+    emu->pc = 0;
+    emu->halted = false;
+    return 0;
+}
+
+int pru_emu_load(pru_emu_t *emu, const char *path)
+{
+    uint8_t buf[PRU_EMU_IRAM_WORDS * 4 + 1];
+    uint32_t code[PRU_EMU_IRAM_WORDS];
+    size_t len, i;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "[pru_emu]: can't open %s\n", path);
+        return -1;
+    }
+    len = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+
+    if (len == 0 || len > PRU_EMU_IRAM_WORDS * 4 || (len & 3)) {
+        fprintf(stderr, "[pru_emu]: %s is not a pasm -b image\n", path);
+        return -1;
+    }
+
+    for (i = 0; i < len / 4; i++) {
+        code[i] = buf[4 * i] | (buf[4 * i + 1] << 8)
+                | (buf[4 * i + 2] << 16) | ((uint32_t)buf[4 * i + 3] << 24);
+    }
+
+    return pru_emu_load_words(emu, code, len / 4);
+}
+
+int pru_emu_step(pru_emu_t *emu)
+{
+    const PRU_INST *inst;
+    uint32_t pc, next, cycles = 1;
+    uint32_t a, b, len, addr;
+    uint64_t r;
+    int width;
+
+    if (emu->halted) {
+        return 0;
+    }
+
+    pc = emu->pc;
+    if (pc >= emu->code_words) {
+        fprintf(stderr, "[pru_emu]: pc 0x%04x out of the image\n", pc);
+        return -1;
+    }
+
+    inst = &emu->inst[pc];
+    next = pc + 1;
+
+    if (emu->trace) {
+        fprintf(stderr, "%12llu %04x %08x %s\n",
+                (unsigned long long)emu->cycles, pc, emu->iram[pc], pru_emu_op_name(inst->Op));
+    }
+
+    switch (inst->Op) {
+    case OP_ADD:
+    case OP_ADC:
+    case OP_SUB:
+    case OP_SUC:
+    case OP_LSL:
+    case OP_LSR:
+    case OP_RSB:
+    case OP_RSC:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_NOT:
+    case OP_MIN:
+    case OP_MAX:
+    case OP_CLR:
+    case OP_SET:
+    case OP_LMBD:
+        a = reg_get(emu, &inst->Arg[1]);
+        b = op2_get(emu, &inst->Arg[2]);
+        width = field_width[inst->Arg[0].Field];
+
+        switch (inst->Op) {
+        case OP_ADD:
+            r = (uint64_t)a + b;
+            emu->carry = (r >> width) & 1;
+            break;
+        case OP_ADC:
+            r = (uint64_t)a + b + emu->carry;
+            emu->carry = (r >> width) & 1;
+            break;
+        case OP_SUB:
+            r = (uint64_t)a - b;
+            emu->carry = (r >> width) & 1;
+            break;
+        case OP_SUC:
+            r = (uint64_t)a - b - emu->carry;
+            emu->carry = (r >> width) & 1;
+            break;
+        case OP_RSB:
+            r = (uint64_t)b - a;
+            emu->carry = (r >> width) & 1;
+            break;
+        case OP_RSC:
+            r = (uint64_t)b - a - emu->carry;
+            emu->carry = (r >> width) & 1;
+            break;
+        case OP_LSL:
+            r = a << (b & 0x1f);
+            break;
+        case OP_LSR:
+            r = a >> (b & 0x1f);
+            break;
+        case OP_AND:
+            r = a & b;
+            break;
+        case OP_OR:
+            r = a | b;
+            break;
+        case OP_XOR:
+            r = a ^ b;
+            break;
+        case OP_NOT:
+            r = ~a;
+            break;
+        case OP_MIN:
+            r = (a < b) ? a : b;
+            break;
+        case OP_MAX:
+            r = (a > b) ? a : b;
+            break;
+        case OP_CLR:
+            r = a & ~(1u << (b & 0x1f));
+            break;
+        case OP_SET:
+            r = a | (1u << (b & 0x1f));
+            break;
+        default:
+            /* LMBD: left most bit equal to b.t0, 32 if none */
+            r = 32;
+            for (width = 31; width >= 0; width--) {
+                if (((a >> width) & 1) == (b & 1)) {
+                    r = width;
+                    break;
+                }
+            }
+            break;
+        }
+        reg_set(emu, &inst->Arg[0], (uint32_t)r);
+        break;
+
+    case OP_LDI:
+        reg_set(emu, &inst->Arg[0], inst->Arg[1].Value);
+        break;
+
+    case OP_MVIB:
+    case OP_MVIW:
+    case OP_MVID:
+        len = (inst->Op == OP_MVIB) ? 1 : (inst->Op == OP_MVIW) ? 2 : 4;
+        if (inst->Arg[1].Flags & PA_FLG_REGPOINTER) {
+            b = 0;
+            memcpy(&b, reg_file(emu) + mvi_addr(emu, &inst->Arg[1], len), len);
+        } else {
+            b = reg_get(emu, &inst->Arg[1]) & (0xffffffff >> (32 - 8 * len));
+        }
+        if (inst->Arg[0].Flags & PA_FLG_REGPOINTER) {
+            memcpy(reg_file(emu) + mvi_addr(emu, &inst->Arg[0], len), &b, len);
+        } else {
+            reg_set(emu, &inst->Arg[0], b);
+        }
+        break;
+
+    case OP_LBBO:
+    case OP_LBCO:
+    case OP_SBBO:
+    case OP_SBCO:
+        if (inst->Op == OP_LBBO || inst->Op == OP_SBBO) {
+            addr = reg_get(emu, &inst->Arg[1]);
+        } else {
+            addr = pru_emu_constant(emu, inst->Arg[1].Value);
+        }
+        addr += op2_get(emu, &inst->Arg[2]);
+        len = count_get(emu, &inst->Arg[3]);
+        if (len == 0) {
+            break;
+        }
+        if (inst->Arg[0].Value + len > sizeof(emu->reg)) {
+            fprintf(stderr, "[pru_emu]: burst past r31 at pc 0x%04x\n", pc);
+            return -1;
+        }
+        cycles = mem_access(emu, addr, reg_file(emu) + inst->Arg[0].Value, len,
+                            inst->Op == OP_SBBO || inst->Op == OP_SBCO);
+        break;
+
+    case OP_ZERO:
+    case OP_FILL:
+        len = count_get(emu, &inst->Arg[2]);
+        if (inst->Arg[1].Value + len > sizeof(emu->reg)) {
+            return -1;
+        }
+        memset(reg_file(emu) + inst->Arg[1].Value, (inst->Op == OP_ZERO) ? 0 : 0xff, len);
+        break;
+
+    case OP_XIN:
+    case OP_XOUT:
+    case OP_XCHG:
+    case OP_SXIN:
+    case OP_SXOUT:
+    case OP_SXCHG:
+        /* Scratch pad banks 10-12, other devices read as zero */
+        a = inst->Arg[0].Value;
+        len = count_get(emu, &inst->Arg[2]);
+        addr = inst->Arg[1].Value;
+        if (addr + len > sizeof(emu->scratch[0])) {
+            return -1;
+        }
+        if (a >= 10 && a <= 12) {
+            uint8_t *sp = (uint8_t *)emu->scratch[a - 10] + addr;
+            uint8_t tmp[sizeof(emu->scratch[0])];
+
+            switch (inst->Op) {
+            case OP_XIN:
+            case OP_SXIN:
+                memcpy(reg_file(emu) + addr, sp, len);
+                break;
+            case OP_XOUT:
+            case OP_SXOUT:
+                memcpy(sp, reg_file(emu) + addr, len);
+                break;
+            default:
+                memcpy(tmp, sp, len);
+                memcpy(sp, reg_file(emu) + addr, len);
+                memcpy(reg_file(emu) + addr, tmp, len);
+                break;
+            }
+        } else if (inst->Op == OP_XIN || inst->Op == OP_SXIN) {
+            memset(reg_file(emu) + addr, 0, len);
+        }
+        break;
+
+    case OP_JMP:
+        next = op2_get(emu, &inst->Arg[1]) & 0xffff;
+        break;
+
+    case OP_JAL:
+        reg_set(emu, &inst->Arg[0], pc + 1);
+        next = op2_get(emu, &inst->Arg[1]) & 0xffff;
+        break;
+
+    case OP_QBGT:
+    case OP_QBGE:
+    case OP_QBLT:
+    case OP_QBLE:
+    case OP_QBEQ:
+    case OP_QBNE:
+    case OP_QBBS:
+    case OP_QBBC:
+    case OP_QBA:
+        a = (inst->Op == OP_QBA) ? 0 : reg_get(emu, &inst->Arg[1]);
+        b = (inst->Op == OP_QBA) ? 0 : op2_get(emu, &inst->Arg[2]);
+        switch (inst->Op) {
+        case OP_QBGT:
+            r = b > a;
+            break;
+        case OP_QBGE:
+            r = b >= a;
+            break;
+        case OP_QBLT:
+            r = b < a;
+            break;
+        case OP_QBLE:
+            r = b <= a;
+            break;
+        case OP_QBEQ:
+            r = b == a;
+            break;
+        case OP_QBNE:
+            r = b != a;
+            break;
+        case OP_QBBS:
+            r = (a >> (b & 0x1f)) & 1;
+            break;
+        case OP_QBBC:
+            r = !((a >> (b & 0x1f)) & 1);
+            break;
+        default:
+            r = 1;
+            break;
+        }
+        if (r) {
+            next = pc + (int32_t)inst->Arg[0].Value;
+        }
+        break;
+
+    case OP_LOOP:
+    case OP_ILOOP:
+        a = op2_get(emu, &inst->Arg[1]);
+        if (inst->Arg[1].Type == ARGTYPE_REGISTER) {
+            a &= 0xffff;
+        }
+        if (a == 0) {
+            next = pc + inst->Arg[0].Value;
+            break;
+        }
+        emu->loop_active = true;
+        emu->loop_start = pc + 1;
+        emu->loop_end   = pc + inst->Arg[0].Value;
+        emu->loop_count = a;
+        break;
+
+    case OP_HALT:
+    case OP_SLP:
+        /* No wake up source is modelled */
+        emu->halted = true;
+        next = pc;
+        break;
+
+    default:
+        if (inst->Op >= OP_NOP0 && inst->Op <= OP_NOPF) {
+            break;
+        }
+        fprintf(stderr, "[pru_emu]: invalid opcode 0x%08x at pc 0x%04x\n", emu->iram[pc], pc);
+        return -1;
+    }
+
+    if (emu->loop_active && next == emu->loop_end) {
+        if (--emu->loop_count > 0) {
+            next = emu->loop_start;
+        } else {
+            emu->loop_active = false;
+        }
+    }
+
+    emu->pc = next;
+    emu->cycles += cycles;
+    ctrl_count(emu, cycles);
+    emu->instructions++;
+    emu->op_count[inst->Op]++;
+    emu->op_cycles[inst->Op] += cycles;
+
+    return cycles;
+}
+
+int pru_emu_run(pru_emu_t *emu, uint64_t max_cycles)
+{
+    while (!emu->halted && emu->cycles < max_cycles) {
+        if (pru_emu_step(emu) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * pru_emu.h
+ * Host side PRU emulator for the pasm -b images of pruss_unicorn.p
+ *
+ * Instructions are decoded into the PRU_INST records of pasm (pru_ins.h),
+ * the reverse of the encoding in pasmop.c, and executed one per cycle
+ * plus the latency of the memory region a LBxO/SBxO touches.
+*/
+#ifndef _PRU_EMU_H
+#define _PRU_EMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "pru_ins.h"
+
+#define PRU_EMU_IRAM_WORDS      (2048)      /* 8KB instruction RAM */
+#define PRU_EMU_MAX_REGIONS     (16)
+#define PRU_EMU_CLOCK_HZ        (200000000)
+#define PRU_EMU_NS_PER_CYCLE    (5)
+
+/* PRU0 view of the PRU-ICSS */
+#define PRU_EMU_DRAM0           (0x00000000)
+#define PRU_EMU_DRAM1           (0x00002000)
+#define PRU_EMU_SHARED_RAM      (0x00010000)
+#define PRU_EMU_INTC            (0x00020000)
+#define PRU_EMU_CTRL            (0x00022000)
+#define PRU_EMU_CFG             (0x00026000)
+
+#define PRU_EMU_CTBIR0          (0x20)
+#define PRU_EMU_CTBIR1          (0x24)
+#define PRU_EMU_CTPPR0          (0x28)
+#define PRU_EMU_CTPPR1          (0x2C)
+
+/* PRU CTRL counters, CYCLE and STALL count while COUNTER_ENABLE is set */
+#define PRU_EMU_CONTROL         (0x00)
+#define PRU_EMU_CYCLE           (0x0C)
+#define PRU_EMU_STALL           (0x10)
+#define PRU_EMU_COUNTER_ENABLE  (1 << 3)
+
+/*
+ * Modelled access cost in cycles of a 4 byte access,
+ * every further word of a burst adds one cycle.
+ * L3/L4 numbers are estimates for the OCP master port,
+ * override them to match a measured board.
+ */
+#define PRU_EMU_LOCAL_READ      (3)
+#define PRU_EMU_LOCAL_WRITE     (2)
+#define PRU_EMU_L4_READ         (40)
+#define PRU_EMU_L4_WRITE        (8)
+#define PRU_EMU_DDR_READ        (70)
+#define PRU_EMU_DDR_WRITE       (8)
+
+typedef struct pru_emu pru_emu_t;
+
+typedef struct {
+    const char *name;
+    uint32_t base;
+    uint32_t size;
+    uint8_t *mem;
+    bool     owned;         /* allocated by pru_emu_add_region */
+    uint32_t read_cycles;
+    uint32_t write_cycles;
+    uint64_t reads;
+    uint64_t writes;
+} pru_emu_region_t;
+
+/* Called after a store into region, offset and len inside region->mem */
+typedef void (*pru_emu_write_hook_t)(pru_emu_t *emu, pru_emu_region_t *region,
+                                     uint32_t offset, uint32_t len, void *arg);
+
+/* Called on a R31 write with the strobe bit set, event is the system event */
+typedef void (*pru_emu_event_hook_t)(pru_emu_t *emu, int event, void *arg);
+
+struct pru_emu {
+    uint32_t reg[32];
+    uint32_t r31_in;        /* R31 read value, host interrupt and GPI bits */
+    uint32_t r31_out;
+    uint32_t carry;
+    uint32_t pc;
+
+    /* hardware LOOP */
+    bool     loop_active;
+    uint32_t loop_start;
+    uint32_t loop_end;
+    uint32_t loop_count;
+
+    uint32_t iram[PRU_EMU_IRAM_WORDS];
+    PRU_INST inst[PRU_EMU_IRAM_WORDS];
+    uint32_t code_words;
+
+    uint32_t scratch[3][30];    /* XIN/XOUT scratch pad banks 10-12 */
+
+    pru_emu_region_t regions[PRU_EMU_MAX_REGIONS];
+    int nr_regions;
+
+    pru_emu_write_hook_t write_hook;
+    void *write_arg;
+    pru_emu_event_hook_t event_hook;
+    void *event_arg;
+
+    bool halted;
+    bool trace;
+
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t unmapped;          /* accesses outside any region */
+    uint64_t op_count[OP_MAXIDX + 1];
+    uint64_t op_cycles[OP_MAXIDX + 1];
+};
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Reset the core and map PRU0 data RAM, PRU1 data RAM, shared RAM,
+ * INTC, control and config registers.
+ */
+extern int pru_emu_init(pru_emu_t *emu);
+extern void pru_emu_exit(pru_emu_t *emu);
+
+/*
+ * Map size bytes at base, mem NULL to allocate zeroed memory.
+ * Return the region, NULL on error.
+ */
+extern pru_emu_region_t *pru_emu_add_region(pru_emu_t *emu, const char *name,
+                                            uint32_t base, uint32_t size, uint8_t *mem,
+                                            uint32_t read_cycles, uint32_t write_cycles);
+extern pru_emu_region_t *pru_emu_find_region(pru_emu_t *emu, uint32_t addr);
+
+/* Load a little endian pasm -b image at instruction 0 */
+extern int pru_emu_load(pru_emu_t *emu, const char *path);
+extern int pru_emu_load_words(pru_emu_t *emu, const uint32_t *code, uint32_t words);
+
+/* Decode one instruction word, return -1 if it is not a PRU v3 opcode */
+extern int pru_emu_decode(uint32_t word, PRU_INST *inst);
+
+/* Constant table entry n, as the current CTBIR/CTPPR settings point it */
+extern uint32_t pru_emu_constant(pru_emu_t *emu, int n);
+
+/*
+ * Execute one instruction,
+ * return the cycles it took, 0 when halted, -1 on error.
+ */
+extern int pru_emu_step(pru_emu_t *emu);
+
+/* Run until halted or cycles reaches max_cycles, -1 on error */
+extern int pru_emu_run(pru_emu_t *emu, uint64_t max_cycles);
+
+extern const char *pru_emu_op_name(uint32_t op);
+
+#if defined (__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,826 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * pru_queue_harness.c
+ * Run a pruss_unicorn.bin image in the PRU emulator against a filled
+ * struct queue ring, and report the step rates and the gaps between
+ * blocks seen on the GPIO1 step pins.
+ *
+ * Usage: pru_emu [-m machine_type] [-x extend_func] [-f moves] [-c max_cycles]
+ *                [-g read,write] [-d read,write] [-s window,low_water]
+ *                [-p pru1.bin[,percent]] [-k] [-t] [-v] pruss_unicorn.bin
+ *
+ * -k queues compact elements where a move fits, for the specialized images.
+ * -p runs the PRU1 image of a split image on a second core, at percent
+ *    of the PRU0 clock to let it fall behind. PRU1 steps E through
+ *    SET/CLEARDATAOUT, its steps count for the block it was handed.
+ * -s streams the moves the way stepper_pruss.c does: at most window
+ *    QUEUE_UNITs queued, and once full, no refill before the PRU raised
+ *    the event of the low_water mark. A refill that finds the ring drained
+ *    counts as a mismatch. Without -f, compact moves with a wide PWM move
+ *    every third block, -k -s 24,9 steps over an odd low_water mark.
+ *
+ * moves file, one block per line:
+ *   steps_x steps_y steps_z steps_e dir initial_rate nominal_rate final_rate
+ *   accelerate_until decelerate_after [pwm_duty]
+ * or M for a M code block, # starts a comment.
+ * A pwm_duty queues a PWM event on an unused out, a wide element.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "parameter.h"
+#include "stepper_pruss.h"
+#include "pru_emu.h"
+
+#define GPIO_BANKS          (4)
+#define GPIO_DATAIN         (0x138)
+#define GPIO_DATAOUT        (0x13C)
+#define GPIO_STEP_BANK      (1)
+
+/* Same mapping as stepper_pruss.c */
+#define DDR_BASEADDR        (0x80e00000)
+
+#define PRU0_ARM_IRQ        (19)
+#define DELAY_PER_STEP      (2)
+#define MAX_MOVES           (QUEUE_LEN - 1)
+#define RUN_SLICE           (100000)
+#define STREAM_SLICE        (2000)      /* 10us, ARM refill latency */
+#define SPLIT_SLICE         (20)        /* PRU0 and PRU1 take turns */
+
+#define GPIO_CLEARDATAOUT   (0x190)
+#define GPIO_SETDATAOUT     (0x194)
+#define PRU1_CTRL           (0x00024000)
+#define PRU1_START          (100)       /* cycles of PRU1 INIT */
+
+/* struct ExtruderSync of pruss_unicorn.hp at the start of shared RAM */
+#define SYNC_BLOCK          (0)
+#define SYNC_ACK            (8)
+#define STREAM_MOVES        (300)
+
+static const uint32_t gpio_base[GPIO_BANKS] = {
+    0x44E07000, 0x4804C000, 0x481AC000, 0x481AE000
+};
+
+/* STEP_X, STEP_Y, STEP_Z, STEP_E of pruss_unicorn.hp, on GPIO1 */
+static const int step_bit[NUM_AXIS] = { 21, 22, 23, 28 };
+
+typedef struct {
+    bool     mcode;
+    uint32_t steps[NUM_AXIS];
+    uint8_t  dir;
+    uint32_t initial_rate;      /* steps/s */
+    uint32_t nominal_rate;
+    uint32_t final_rate;
+    uint32_t accelerate_until;
+    uint32_t decelerate_after;
+    uint32_t pwm_duty;
+} move_t;
+
+typedef struct {
+    uint32_t steps[NUM_AXIS];
+    int      axis;          /* axis with steps_count steps */
+    uint32_t events;
+    uint64_t first_step;
+    uint64_t last_step;
+    uint64_t min_period;
+    uint64_t max_period;
+    uint64_t done;
+    uint32_t travel_cycles;
+} block_stat_t;
+
+static const move_t default_moves[] = {
+    /* x accel, travel, decel */
+    { false, { 1600,   0,   0,  0 }, 0x0, 2000, 20000, 2000, 400, 1200 },
+    /* xy diagonal with extrusion */
+    { false, { 1200, 900,   0, 60 }, 0x2, 2000, 16000, 2000, 300,  900 },
+    /* z */
+    { false, {    0,   0, 400,  0 }, 0x4, 1000,  4000, 1000, 100,  300 },
+    { true },
+    /* short move, no travel phase */
+    { false, {  200, 200,   0, 10 }, 0x0, 4000,  6000, 4000, 100,  100 },
+    /* constant rate */
+    { false, {  800,   0,   0,  0 }, 0x1, 20000, 20000, 20000, 0,  800 },
+};
+
+static struct queue *q;
+static pru_emu_region_t *ddr;
+static pru_emu_region_t *gpio[GPIO_BANKS];
+static move_t moves[MAX_MOVES];
+static block_stat_t *stats;
+static int nr_moves;
+static int cur_block;
+static uint32_t step_out;
+
+/* -p, PRU1 and the block of each ExtruderSync.block sequence */
+static pru_emu_t *emu0;
+static pru_emu_t *emu1;
+static pru_emu_region_t *shared;
+static int *seq_block;
+static uint32_t irqs;
+static uint64_t last_irq;
+
+/* block starting at a QUEUE_UNIT of the ring, -1 if none */
+static int unit_block[QUEUE_LEN * sizeof(struct queue_element) / QUEUE_UNIT];
+
+/* ring unit of each block */
+static uint32_t *block_unit;
+static uint32_t next_unit;
+static int next_move;
+
+/* -s, the ARM side of the ring */
+typedef struct {
+    uint32_t window;        /* units */
+    uint32_t low_water;
+    bool     waiting;
+    uint32_t wait_irqs;
+    uint32_t waits;
+    uint32_t dry;
+} stream_t;
+
+static uint32_t max_steps(const move_t *m)
+{
+    uint32_t count = 0;
+    int i;
+
+    for (i = 0; i < NUM_AXIS; i++) {
+        if (m->steps[i] > count) {
+            count = m->steps[i];
+        }
+    }
+    return count;
+}
+
+/*
+ * Same conversion as pruss_queue_move(), without the direction inversion
+ */
+static int move_to_element(const move_t *m, struct queue_element *qe)
+{
+    uint32_t final_cycles;
+    uint32_t steps_count = max_steps(m);
+
+    memset(qe, 0, sizeof(*qe));
+    qe->state = STATE_FILLED;
+
+    if (m->mcode) {
+        qe->type = BLOCK_M_CMD;
+        return 0;
+    }
+
+    if (steps_count == 0 || !m->initial_rate || !m->nominal_rate || !m->final_rate
+            || m->accelerate_until > m->decelerate_after
+            || m->decelerate_after > steps_count) {
+        return -1;
+    }
+
+    qe->type = BLOCK_G_CMD;
+    qe->direction = m->dir;
+    qe->direction_bits = m->dir;
+
+    qe->steps_count = steps_count;
+    qe->steps_x = m->steps[X_AXIS];
+    qe->steps_y = m->steps[Y_AXIS];
+    qe->steps_z = m->steps[Z_AXIS];
+    qe->steps_e = m->steps[E_AXIS];
+
+    qe->loops_accel = m->accelerate_until;
+    if (m->nominal_rate == m->final_rate) {
+        qe->loops_travel = steps_count - m->accelerate_until;
+        qe->loops_decel  = 0;
+    } else {
+        qe->loops_travel = m->decelerate_after - m->accelerate_until;
+        qe->loops_decel  = steps_count - m->decelerate_after;
+    }
+
+    qe->init_cycles   = NSEC_PER_SEC / m->initial_rate / DELAY_PER_STEP;
+    qe->travel_cycles = NSEC_PER_SEC / m->nominal_rate / DELAY_PER_STEP;
+    final_cycles      = NSEC_PER_SEC / m->final_rate / DELAY_PER_STEP;
+
+    if (qe->loops_accel != 0) {
+        qe->accel_cycles = (qe->init_cycles - qe->travel_cycles) / qe->loops_accel;
+    }
+    if (qe->loops_decel != 0) {
+        qe->decel_cycles = (final_cycles - qe->travel_cycles) / qe->loops_decel;
+    }
+
+    /* extruder 0 active, e dir for e0, e1, e2 */
+    qe->ext_step_bit = 1 | (((m->dir >> E_AXIS) & 0x1) << 3)
+                         | (((m->dir >> E_AXIS) & 0x1) << 4)
+                         | (((m->dir >> E_AXIS) & 0x1) << 5);
+
+    /* out 0 has no compare register, the PRU skips the write */
+    if (m->pwm_duty) {
+        qe->pwm_ctl  = BLOCK_PWM_EVENT;
+        qe->pwm_duty = m->pwm_duty;
+    }
+    return 0;
+}
+
+/*
+ * Same as queue_compact_element() of stepper_pruss.c
+ */
+static int compact_element(const struct queue_element *qe,
+                           struct queue_element_compact *qc)
+{
+    if (qe->loops_accel > UINT16_MAX || qe->loops_travel > UINT16_MAX
+            || qe->loops_decel > UINT16_MAX
+            || qe->accel_cycles > UINT16_MAX || qe->decel_cycles > UINT16_MAX
+            || qe->steps_x > UINT16_MAX || qe->steps_y > UINT16_MAX
+            || qe->steps_z > UINT16_MAX || qe->steps_e > UINT16_MAX
+            || qe->steps_count != qe->loops_accel + qe->loops_travel + qe->loops_decel
+            || qe->pwm_ctl || qe->pwm_duty) {
+        return -1;
+    }
+
+    memset(qc, 0, sizeof(*qc));
+    qc->state          = qe->state;
+    qc->direction_bits = qe->direction_bits;
+    qc->direction      = qe->direction;
+    qc->type           = qe->type | QUEUE_TYPE_COMPACT;
+    qc->loops_accel    = qe->loops_accel;
+    qc->loops_travel   = qe->loops_travel;
+    qc->loops_decel    = qe->loops_decel;
+    qc->accel_cycles   = qe->accel_cycles;
+    qc->travel_cycles  = qe->travel_cycles;
+    qc->decel_cycles   = qe->decel_cycles;
+    qc->ext_step_bit   = qe->ext_step_bit;
+    qc->init_cycles    = qe->init_cycles;
+    qc->steps_x        = qe->steps_x;
+    qc->steps_y        = qe->steps_y;
+    qc->steps_z        = qe->steps_z;
+    qc->steps_e        = qe->steps_e;
+    return 0;
+}
+
+static int load_moves(const char *path)
+{
+    char line[256];
+    FILE *fp;
+    int n = 0;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "can't open %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) && n < MAX_MOVES) {
+        move_t *m = &moves[n];
+        unsigned int dir;
+        char *p = line;
+
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+
+        memset(m, 0, sizeof(*m));
+        if (*p == 'M' || *p == 'm') {
+            m->mcode = true;
+        } else if (sscanf(p, "%u %u %u %u %u %u %u %u %u %u %u",
+                          &m->steps[X_AXIS], &m->steps[Y_AXIS],
+                          &m->steps[Z_AXIS], &m->steps[E_AXIS], &dir,
+                          &m->initial_rate, &m->nominal_rate, &m->final_rate,
+                          &m->accelerate_until, &m->decelerate_after,
+                          &m->pwm_duty) < 10) {
+            fprintf(stderr, "bad move: %s", line);
+            fclose(fp);
+            return -1;
+        } else {
+            m->dir = dir;
+        }
+        n++;
+    }
+
+    fclose(fp);
+    return n;
+}
+
+/*
+ * Short moves at a constant rate, a wide PWM move every third block,
+ * so the bytes queued drop by 32 and 64 around the low-water mark
+ */
+static int stream_moves(void)
+{
+    int i;
+
+    for (i = 0; i < STREAM_MOVES; i++) {
+        move_t *m = &moves[i];
+
+        memset(m, 0, sizeof(*m));
+        m->steps[X_AXIS] = 10;
+        m->steps[E_AXIS] = (i % 3 == 1) ? 2 : 0;
+        m->dir = (i & 1);
+        m->initial_rate = 20000;
+        m->nominal_rate = 20000;
+        m->final_rate = 20000;
+        m->decelerate_after = 10;
+        m->pwm_duty = (i % 3 == 2) ? 100 + i : 0;
+    }
+    return STREAM_MOVES;
+}
+
+/*
+ * Queue the next move the way queue_put_units() does: the element with
+ * the state empty, write_pos, then the state flip.
+ * Return -1 if the move is invalid or does not fit the ring.
+ */
+static int put_move(bool compact)
+{
+    int i = next_move;
+    struct queue_element qe;
+    struct queue_element_compact qc;
+    uint8_t *e = (uint8_t *)q->ring_buf + next_unit * QUEUE_UNIT;
+    uint32_t units;
+    int j;
+
+    if (move_to_element(&moves[i], &qe) < 0) {
+        fprintf(stderr, "invalid move %d\n", i);
+        return -1;
+    }
+    units = (compact && compact_element(&qe, &qc) == 0) ? 1 : 2;
+    if ((next_unit + units) * QUEUE_UNIT > sizeof(q->ring_buf)) {
+        fprintf(stderr, "move %d does not fit the ring\n", i);
+        return -1;
+    }
+
+    if (units == 1) {
+        qc.state = STATE_EMPTY;
+        memcpy(e, &qc, sizeof(qc));
+    } else {
+        qe.state = STATE_EMPTY;
+        memcpy(e, &qe, sizeof(qe));
+    }
+    q->write_pos = next_unit * QUEUE_UNIT;
+    e[0] = STATE_FILLED;
+
+    unit_block[next_unit] = i;
+    block_unit[i] = next_unit;
+    next_unit += units;
+    next_move++;
+
+    stats[i].travel_cycles = qe.travel_cycles;
+    for (j = 0; j < NUM_AXIS; j++) {
+        if (moves[i].steps[j] == qe.steps_count) {
+            stats[i].axis = j;
+            break;
+        }
+    }
+    return 0;
+}
+
+/* units queued and not done yet */
+static uint32_t stream_queued(void)
+{
+    return (cur_block < next_move) ? next_unit - block_unit[cur_block] : 0;
+}
+
+/*
+ * Refill up to the window, once full set the low-water mark and
+ * wait for the event, as queue_get_next_element() does
+ */
+static int stream_fill(stream_t *sm, bool compact)
+{
+    if (sm->waiting) {
+        if (irqs == sm->wait_irqs) {
+            return 0;
+        }
+        sm->waiting = false;
+        if (stream_queued() == 0) {
+            sm->dry++;
+        }
+    }
+
+    while (next_move < nr_moves) {
+        if (stream_queued() + 2 > sm->window) {
+            q->irq_low_water = sm->low_water * QUEUE_UNIT;
+            sm->waiting = true;
+            sm->wait_irqs = irqs;
+            sm->waits++;
+            return 0;
+        }
+        if (put_move(compact) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t shared_word(uint32_t offset)
+{
+    uint32_t val;
+
+    memcpy(&val, shared->mem + offset, 4);
+    return val;
+}
+
+static void write_hook(pru_emu_t *emu, pru_emu_region_t *region,
+                       uint32_t offset, uint32_t len, void *arg)
+{
+    /* The GPIO module applies SET/CLEARDATAOUT to DATAOUT */
+    if (region->mem == gpio[GPIO_STEP_BANK]->mem
+            && (offset == GPIO_SETDATAOUT || offset == GPIO_CLEARDATAOUT)) {
+        uint32_t bits, out;
+
+        memcpy(&bits, region->mem + offset, 4);
+        memcpy(&out, region->mem + GPIO_DATAOUT, 4);
+        out = (offset == GPIO_SETDATAOUT) ? (out | bits) : (out & ~bits);
+        memcpy(region->mem + GPIO_DATAOUT, &out, 4);
+        offset = GPIO_DATAOUT;
+    }
+
+    if (region->mem == gpio[GPIO_STEP_BANK]->mem && offset == GPIO_DATAOUT) {
+        uint32_t out, rising;
+        block_stat_t *st;
+        uint64_t now = emu0->cycles;
+        int block = cur_block;
+        int i;
+
+        memcpy(&out, region->mem + offset, 4);
+        rising = out & ~step_out;
+        step_out = out;
+
+        /* PRU1 may still step E of a block PRU0 is done with */
+        if (emu == emu1) {
+            uint32_t seq = emu1->reg[5];
+            block = (seq <= (uint32_t)nr_moves) ? seq_block[seq] : -1;
+        }
+        if (block < 0 || block >= nr_moves) {
+            return;
+        }
+        st = &stats[block];
+
+        for (i = 0; i < NUM_AXIS; i++) {
+            if (rising & (1 << step_bit[i])) {
+                st->steps[i]++;
+            }
+        }
+        /* Step period of the axis with the most steps */
+        if (rising & (1 << step_bit[st->axis])) {
+            if (st->events == 0) {
+                st->first_step = now;
+            } else {
+                uint64_t period = now - st->last_step;
+                if (st->events == 1 || period < st->min_period) {
+                    st->min_period = period;
+                }
+                if (period > st->max_period) {
+                    st->max_period = period;
+                }
+            }
+            st->last_step = now;
+            st->events++;
+        }
+        return;
+    }
+
+    /* Block handed to PRU1 */
+    if (region->mem == shared->mem && emu == emu0 && offset == SYNC_BLOCK) {
+        uint32_t seq = shared_word(SYNC_BLOCK);
+        if (seq <= (uint32_t)nr_moves) {
+            seq_block[seq] = cur_block;
+        }
+        return;
+    }
+
+    /* A slot marked empty ends the block */
+    if (region == ddr && len == 1
+            && offset < sizeof(q->ring_buf)
+            && offset % QUEUE_UNIT == 0
+            && region->mem[offset] == STATE_EMPTY) {
+        int block = unit_block[offset / QUEUE_UNIT];
+        if (block >= 0 && block < nr_moves) {
+            stats[block].done = emu->cycles;
+            cur_block = block + 1;
+        }
+    }
+}
+
+static void event_hook(pru_emu_t *emu, int event, void *arg)
+{
+    if (event == PRU0_ARM_IRQ) {
+        irqs++;
+        last_irq = emu->cycles;
+    }
+}
+
+/*
+ * PRU1 on a second core with its own RAM and registers, sharing the
+ * shared RAM, DDR and GPIO of PRU0. PRU1 sets its CTPPR at PRU1_CTRL.
+ */
+static pru_emu_t *pru1_init(const char *path)
+{
+    pru_emu_t *emu = calloc(1, sizeof(*emu));
+    pru_emu_region_t *region;
+    int i;
+
+    if (!emu || pru_emu_init(emu) < 0) {
+        return NULL;
+    }
+
+    region = pru_emu_find_region(emu, PRU_EMU_SHARED_RAM);
+    free(region->mem);
+    region->mem = shared->mem;
+    region->owned = false;
+
+    region = pru_emu_find_region(emu, PRU_EMU_CTRL);
+    if (!pru_emu_add_region(emu, "ctrl1", PRU1_CTRL, region->size, region->mem,
+                            PRU_EMU_LOCAL_READ, PRU_EMU_LOCAL_WRITE)
+            || !pru_emu_add_region(emu, "ddr", ddr->base, ddr->size, ddr->mem,
+                                   ddr->read_cycles, ddr->write_cycles)) {
+        return NULL;
+    }
+    for (i = 0; i < GPIO_BANKS; i++) {
+        if (!pru_emu_add_region(emu, "gpio", gpio[i]->base, gpio[i]->size, gpio[i]->mem,
+                                gpio[i]->read_cycles, gpio[i]->write_cycles)) {
+            return NULL;
+        }
+    }
+    if (pru_emu_load(emu, path) < 0) {
+        return NULL;
+    }
+
+    emu->write_hook = write_hook;
+    return emu;
+}
+
+static int parse_cycles(const char *s, uint32_t *read, uint32_t *write)
+{
+    return (sscanf(s, "%u,%u", read, write) == 2) ? 0 : -1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-m machine_type] [-x extend_func] [-f moves] [-c max_cycles]\n"
+                    "          [-g read,write] [-d read,write] [-s window,low_water]\n"
+                    "          [-p pru1.bin[,percent]] [-k] [-t] [-v] pruss_unicorn.bin\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    pru_emu_t *emu;
+    const char *moves_file = NULL;
+    unsigned long long max_cycles = 2000000000ULL;
+    uint32_t gpio_read = PRU_EMU_L4_READ, gpio_write = PRU_EMU_L4_WRITE;
+    uint32_t ddr_read = PRU_EMU_DDR_READ, ddr_write = PRU_EMU_DDR_WRITE;
+    int machine_type = 0, extend_func = BBP1_EXTEND_FUNC_DUAL_Z;
+    bool trace = false, verbose = false, compact = false, stream = false;
+    stream_t sm;
+    char *pru1_image = NULL, *p;
+    unsigned int pru1_percent = 100;
+    uint64_t prev_last = 0;
+    struct pru_stats *pst;
+    int mismatch = 0;
+    int opt, i, j;
+
+    memset(&sm, 0, sizeof(sm));
+    while ((opt = getopt(argc, argv, "m:x:f:c:g:d:s:p:ktv")) != -1) {
+        switch (opt) {
+        case 'm':
+            machine_type = atoi(optarg);
+            break;
+        case 'x':
+            extend_func = atoi(optarg);
+            break;
+        case 'f':
+            moves_file = optarg;
+            break;
+        case 'c':
+            max_cycles = strtoull(optarg, NULL, 0);
+            break;
+        case 'g':
+            if (parse_cycles(optarg, &gpio_read, &gpio_write) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'd':
+            if (parse_cycles(optarg, &ddr_read, &ddr_write) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 's':
+            if (parse_cycles(optarg, &sm.window, &sm.low_water) < 0
+                    || sm.low_water + 2 > sm.window) {
+                usage(argv[0]);
+                return -1;
+            }
+            stream = true;
+            break;
+        case 'p':
+            pru1_image = optarg;
+            p = strchr(optarg, ',');
+            if (p) {
+                *p = '\0';
+                pru1_percent = atoi(p + 1);
+            }
+            if (pru1_percent == 0 || pru1_percent > 100) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'k':
+            compact = true;
+            break;
+        case 't':
+            trace = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (moves_file) {
+        nr_moves = load_moves(moves_file);
+        if (nr_moves <= 0) {
+            return -1;
+        }
+    } else if (stream) {
+        nr_moves = stream_moves();
+    } else {
+        nr_moves = sizeof(default_moves) / sizeof(default_moves[0]);
+        memcpy(moves, default_moves, sizeof(default_moves));
+    }
+
+    emu = calloc(1, sizeof(*emu));
+    stats = calloc(nr_moves, sizeof(*stats));
+    block_unit = calloc(nr_moves, sizeof(*block_unit));
+    seq_block = malloc((nr_moves + 1) * sizeof(*seq_block));
+    if (!emu || !stats || !block_unit || !seq_block || pru_emu_init(emu) < 0) {
+        return -1;
+    }
+    memset(seq_block, 0xff, (nr_moves + 1) * sizeof(*seq_block));
+    emu0 = emu;
+    shared = pru_emu_find_region(emu, PRU_EMU_SHARED_RAM);
+
+    ddr = pru_emu_add_region(emu, "ddr", DDR_BASEADDR, sizeof(struct queue), NULL,
+                             ddr_read, ddr_write);
+    for (i = 0; i < GPIO_BANKS; i++) {
+        gpio[i] = pru_emu_add_region(emu, "gpio", gpio_base[i], 0x1000, NULL,
+                                     gpio_read, gpio_write);
+        if (!gpio[i]) {
+            return -1;
+        }
+        /* Inputs high, no end stop hit */
+        memset(gpio[i]->mem + GPIO_DATAIN, 0xff, 4);
+    }
+    if (!ddr || pru_emu_load(emu, argv[optind]) < 0) {
+        return -1;
+    }
+    if (pru1_image) {
+        emu1 = pru1_init(pru1_image);
+        if (!emu1) {
+            return -1;
+        }
+        /* pruss.c enables PRU1 first, its INIT acks what is in shared RAM */
+        if (pru_emu_run(emu1, PRU1_START) < 0) {
+            return 2;
+        }
+    }
+
+    /* Queue as pruss_stepper_init() leaves it, then start printing */
+    q = (struct queue *)ddr->mem;
+    memset(unit_block, 0xff, sizeof(unit_block));
+    if (stream) {
+        if (stream_fill(&sm, compact) < 0) {
+            return -1;
+        }
+    } else {
+        while (next_move < nr_moves) {
+            if (put_move(compact) < 0) {
+                return -1;
+            }
+        }
+    }
+    q->machine_type = machine_type;
+    q->bbp1_extend_func = extend_func;
+    q->homing_dir = 0;
+    q->state = STATE_PRINT;
+
+    emu->trace = trace;
+    emu->write_hook = write_hook;
+    emu->event_hook = event_hook;
+
+    /* and until PRU1 acked its last block */
+    while ((cur_block < nr_moves
+                || (emu1 && shared_word(SYNC_ACK) != shared_word(SYNC_BLOCK)))
+            && emu->cycles < max_cycles && !emu->halted) {
+        if (emu1) {
+            if (pru_emu_run(emu, emu->cycles + SPLIT_SLICE) < 0
+                    || pru_emu_run(emu1, emu->cycles * pru1_percent / 100) < 0) {
+                return 2;
+            }
+        } else if (pru_emu_run(emu, emu->cycles + (stream ? STREAM_SLICE : RUN_SLICE)) < 0) {
+            return 2;
+        }
+        if (stream && stream_fill(&sm, compact) < 0) {
+            return -1;
+        }
+    }
+
+    printf("# block type steps_count x y z e expect_x expect_y expect_z expect_e "
+           "start_us duration_us min_period_ns max_period_ns travel_period_ns gap_ns\n");
+    for (i = 0; i < nr_moves; i++) {
+        block_stat_t *st = &stats[i];
+        move_t *m = &moves[i];
+        uint64_t start = (i == 0) ? 0 : stats[i - 1].done;
+        long long gap = -1;
+
+        for (j = 0; j < NUM_AXIS; j++) {
+            if (!m->mcode && st->steps[j] != m->steps[j]) {
+                mismatch++;
+            }
+        }
+        if (st->done == 0) {
+            mismatch++;
+        }
+        if (st->events && prev_last) {
+            gap = (st->first_step - prev_last) * PRU_EMU_NS_PER_CYCLE;
+        }
+        if (st->events) {
+            prev_last = st->last_step;
+        }
+
+        printf("%d %c %u %u %u %u %u %u %u %u %u %.3f %.3f %llu %llu %u %lld\n",
+               i, m->mcode ? 'M' : 'G', max_steps(m),
+               st->steps[X_AXIS], st->steps[Y_AXIS], st->steps[Z_AXIS], st->steps[E_AXIS],
+               m->steps[X_AXIS], m->steps[Y_AXIS], m->steps[Z_AXIS], m->steps[E_AXIS],
+               start * PRU_EMU_NS_PER_CYCLE / 1000.0,
+               (st->done - start) * PRU_EMU_NS_PER_CYCLE / 1000.0,
+               (unsigned long long)st->min_period * PRU_EMU_NS_PER_CYCLE,
+               (unsigned long long)st->max_period * PRU_EMU_NS_PER_CYCLE,
+               m->mcode ? 0 : st->travel_cycles * DELAY_PER_STEP,
+               gap);
+    }
+
+    if (emu1) {
+        printf("# pru1 percent %u cycles %llu instructions %llu block %u ack %u\n",
+               pru1_percent, (unsigned long long)emu1->cycles,
+               (unsigned long long)emu1->instructions,
+               shared_word(SYNC_BLOCK), shared_word(SYNC_ACK));
+    }
+    if (stream) {
+        printf("# stream window %u low_water %u waits %u dry %u\n",
+               sm.window, sm.low_water, sm.waits, sm.dry);
+        mismatch += sm.dry;
+    }
+
+    printf("# cycles %llu instructions %llu time_ms %.3f irqs %u last_irq_us %.3f "
+           "unmapped %llu mcode_count %u mismatch %d\n",
+           (unsigned long long)emu->cycles, (unsigned long long)emu->instructions,
+           emu->cycles * PRU_EMU_NS_PER_CYCLE / 1e6, irqs,
+           last_irq * PRU_EMU_NS_PER_CYCLE / 1000.0,
+           (unsigned long long)emu->unmapped, q->mcode_count, mismatch);
+
+    pst = (struct pru_stats *)(pru_emu_find_region(emu, PRU_EMU_SHARED_RAM)->mem
+                              + PRU_STATS_OFFSET);
+    if (pst->magic == PRU_STATS_MAGIC) {
+        printf("# stats blocks %u idle %u underruns %u max_gap %u overruns %u "
+               "steps %u %u %u %u cycles %u stalls %u\n",
+               pst->blocks, pst->idle, pst->underruns, pst->max_gap, pst->overruns,
+               pst->steps[0], pst->steps[1], pst->steps[2], pst->steps[3],
+               pst->cycles, pst->stalls);
+    }
+
+    if (verbose) {
+        printf("# op count cycles\n");
+        for (i = 1; i <= OP_MAXIDX; i++) {
+            if (emu->op_count[i]) {
+                printf("%s %llu %llu\n", pru_emu_op_name(i),
+                       (unsigned long long)emu->op_count[i],
+                       (unsigned long long)emu->op_cycles[i]);
+            }
+        }
+        printf("# region reads writes\n");
+        for (i = 0; i < emu->nr_regions; i++) {
+            printf("%s@0x%08x %llu %llu\n", emu->regions[i].name, emu->regions[i].base,
+                   (unsigned long long)emu->regions[i].reads,
+                   (unsigned long long)emu->regions[i].writes);
+        }
+    }
+
+    if (emu1) {
+        pru_emu_exit(emu1);
+        free(emu1);
+    }
+    pru_emu_exit(emu);
+    free(emu);
+    free(stats);
+    free(block_unit);
+    free(seq_block);
+
+    return mismatch ? 1 : 0;
+}
@@ -0,0 +1,492 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * ulog.c
+ * Asynchronous logging. ulog_write() keeps the format pointer and the
+ * arguments in a ring of the calling thread, one writer and one reader,
+ * no lock and no syscall. The log thread runs at a low priority and
+ * prints the records of all rings in the order they were written, to
+ * stdout and up to ulog_syslog_level to syslog.
+ * A full ring drops the record, the motion threads never wait for it.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "ulog.h"
+#include "rt.h"
+
+#define ULOG_PERIOD_US      (10000)
+#define ULOG_NICE           (10)
+#define ULOG_LINE_LEN       (512)
+
+typedef enum {
+    ARG_NONE = 0,           /* not understood, the rest of fmt is literal */
+    ARG_PERCENT,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_DOUBLE,
+    ARG_STR,
+    ARG_PTR,
+} arg_type_t;
+
+typedef union {
+    long long i;            /* ARG_STR, offset in str */
+    double d;
+    const void *p;
+} ulog_arg_t;
+
+struct ulog_record {
+    const char *fmt;
+    uint32_t seq;
+    uint32_t suppressed;
+    uint8_t level;
+    uint8_t nargs;
+    ulog_arg_t arg[ULOG_ARGS];
+    char str[ULOG_STR_LEN];
+};
+
+struct ulog_ring {
+    volatile uint32_t head;         /* writer */
+    volatile uint32_t tail;         /* log thread */
+    volatile uint32_t dropped;
+    uint32_t reported;              /* log thread */
+    volatile bool dead;             /* the writer exited */
+    struct ulog_record rec[ULOG_RING_LEN];
+};
+
+volatile int ulog_level = LOG_INFO;
+volatile int ulog_syslog_level = LOG_INFO;
+volatile int ulog_rate = ULOG_RATE;
+
+static struct ulog_ring *rings[ULOG_THREADS];
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static __thread struct ulog_ring *thread_ring = NULL;
+
+static volatile uint32_t seq = 0;
+static volatile uint32_t no_ring = 0;
+static uint32_t no_ring_reported = 0;
+
+static pthread_t ulog_thread;
+static volatile bool running = false;
+static volatile bool thread_quit = false;
+
+/*
+ * The conversion after a '%' of fmt, return its end
+ */
+static const char *ulog_spec(const char *fmt, arg_type_t *type)
+{
+    const char *p = fmt;
+    int l = 0;
+
+    p += strspn(p, "-+ #0");
+    p += strspn(p, "0123456789");
+    if (*p == '.') {
+        p += 1 + strspn(p + 1, "0123456789");
+    }
+    for (; *p && strchr("hlzjt", *p); p++) {
+        if (*p == 'l') {
+            l++;
+        } else if (*p != 'h') {
+            l = 2;
+        }
+    }
+
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            *type = (l == 0) ? ARG_INT : (l == 1) ? ARG_LONG : ARG_LLONG;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            *type = ARG_DOUBLE;
+            break;
+        case 's':
+            *type = ARG_STR;
+            break;
+        case 'p':
+            *type = ARG_PTR;
+            break;
+        case '%':
+            *type = ARG_PERCENT;
+            break;
+        default:
+            *type = ARG_NONE;
+            return p;
+    }
+    return p + 1;
+}
+
+/*
+ * Take the arguments fmt asks for, strings are copied
+ */
+static void ulog_capture(struct ulog_record *r, const char *fmt, va_list ap)
+{
+    const char *p = fmt;
+    const char *s;
+    arg_type_t type;
+    int off = 0;
+    int len;
+    int n = 0;
+
+    while ((p = strchr(p, '%')) != NULL) {
+        p = ulog_spec(p + 1, &type);
+        if (type == ARG_NONE || n == ULOG_ARGS) {
+            break;
+        }
+
+        switch (type) {
+            case ARG_PERCENT:
+                continue;
+            case ARG_INT:
+                r->arg[n].i = va_arg(ap, int);
+                break;
+            case ARG_LONG:
+                r->arg[n].i = va_arg(ap, long);
+                break;
+            case ARG_LLONG:
+                r->arg[n].i = va_arg(ap, long long);
+                break;
+            case ARG_DOUBLE:
+                r->arg[n].d = va_arg(ap, double);
+                break;
+            case ARG_PTR:
+                r->arg[n].p = va_arg(ap, void *);
+                break;
+            case ARG_STR:
+                s = va_arg(ap, const char *);
+                if (!s) {
+                    s = "(null)";
+                }
+                len = strnlen(s, max(ULOG_STR_LEN - off - 1, 0));
+                memcpy(&r->str[off], s, len);
+                r->str[off + len] = '\0';
+                r->arg[n].i = off;
+                off = min(off + len + 1, ULOG_STR_LEN - 1);
+                break;
+            default:
+                break;
+        }
+        n++;
+    }
+    r->nargs = n;
+}
+
+static int ulog_format(char *buf, int len, const struct ulog_record *r)
+{
+    const char *p = r->fmt;
+    const char *q, *end;
+    char spec[32];
+    arg_type_t type;
+    int pos = 0;
+    int n = 0;
+
+    while (*p && pos < len - 1) {
+        q = strchr(p, '%');
+        if (!q) {
+            pos += snprintf(buf + pos, len - pos, "%s", p);
+            break;
+        }
+        pos += snprintf(buf + pos, len - pos, "%.*s", (int)(q - p), p);
+        pos = min(pos, len - 1);
+
+        end = ulog_spec(q + 1, &type);
+        if (type == ARG_PERCENT) {
+            pos += snprintf(buf + pos, len - pos, "%%");
+            p = end;
+            continue;
+        }
+        if (type == ARG_NONE || n >= r->nargs || end - q >= (int)sizeof(spec)) {
+            pos += snprintf(buf + pos, len - pos, "%s", q);
+            break;
+        }
+
+        memcpy(spec, q, end - q);
+        spec[end - q] = '\0';
+        switch (type) {
+            case ARG_INT:
+                pos += snprintf(buf + pos, len - pos, spec, (int)r->arg[n].i);
+                break;
+            case ARG_LONG:
+                pos += snprintf(buf + pos, len - pos, spec, (long)r->arg[n].i);
+                break;
+            case ARG_LLONG:
+                pos += snprintf(buf + pos, len - pos, spec, r->arg[n].i);
+                break;
+            case ARG_DOUBLE:
+                pos += snprintf(buf + pos, len - pos, spec, r->arg[n].d);
+                break;
+            case ARG_PTR:
+                pos += snprintf(buf + pos, len - pos, spec, r->arg[n].p);
+                break;
+            case ARG_STR:
+                pos += snprintf(buf + pos, len - pos, spec, &r->str[r->arg[n].i]);
+                break;
+            default:
+                break;
+        }
+        pos = min(pos, len - 1);
+        n++;
+        p = end;
+    }
+    return min(pos, len - 1);
+}
+
+static void ulog_thread_exit(void *arg)
+{
+    struct ulog_ring *ring = arg;
+
+    ring->dead = true;
+}
+
+/*
+ * The ring of the calling thread, a ring of an exited thread
+ * is taken over once it is printed
+ */
+static struct ulog_ring *ulog_ring_get(void)
+{
+    struct ulog_ring *ring = NULL;
+    int i;
+
+    if (thread_ring) {
+        return thread_ring;
+    }
+
+    pthread_mutex_lock(&rings_lock);
+    for (i = 0; i < ULOG_THREADS; i++) {
+        if (!rings[i]) {
+            rings[i] = calloc(1, sizeof(struct ulog_ring));
+            ring = rings[i];
+            break;
+        }
+        if (rings[i]->dead && rings[i]->head == rings[i]->tail) {
+            ring = rings[i];
+            ring->dead = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    if (ring) {
+        thread_ring = ring;
+        pthread_setspecific(ring_key, ring);
+    }
+    return ring;
+}
+
+void ulog_write(ulog_limit_t *limit, int level, const char *fmt, ...)
+{
+    struct ulog_ring *ring;
+    struct ulog_record *r;
+    struct timespec ts;
+    uint32_t suppressed = 0;
+    uint32_t head;
+    va_list ap;
+
+    /* Races of threads on a call site only make the limit fuzzy */
+    if (limit && ulog_rate > 0) {
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        if (limit->sec != (uint32_t)ts.tv_sec) {
+            limit->sec = ts.tv_sec;
+            limit->count = 0;
+        }
+        if (++limit->count > (uint32_t)ulog_rate) {
+            limit->suppressed++;
+            return;
+        }
+        suppressed = limit->suppressed;
+        limit->suppressed = 0;
+    }
+
+    va_start(ap, fmt);
+    if (!running) {
+        vprintf(fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    ring = ulog_ring_get();
+    if (!ring) {
+        __sync_fetch_and_add(&no_ring, 1);
+        va_end(ap);
+        return;
+    }
+
+    head = ring->head;
+    if (head - ring->tail >= ULOG_RING_LEN) {
+        ring->dropped++;
+        va_end(ap);
+        return;
+    }
+
+    r = &ring->rec[head & (ULOG_RING_LEN - 1)];
+    r->fmt = fmt;
+    r->seq = __sync_fetch_and_add(&seq, 1);
+    r->suppressed = suppressed;
+    r->level = level;
+    ulog_capture(r, fmt, ap);
+    va_end(ap);
+
+    /* The record is complete before the log thread sees it */
+    __sync_synchronize();
+    ring->head = head + 1;
+}
+
+static void ulog_print(int level, const char *buf)
+{
+    fputs(buf, stdout);
+    if (level <= ulog_syslog_level) {
+        syslog(level, "%s", buf);
+    }
+}
+
+/*
+ * Print what is queued, oldest first over all rings.
+ * Return the number of records printed.
+ */
+static int ulog_drain(void)
+{
+    char buf[ULOG_LINE_LEN];
+    struct ulog_ring *ring, *next;
+    struct ulog_record *r;
+    uint32_t dropped;
+    int printed = 0;
+    int i;
+
+    for (;;) {
+        next = NULL;
+        for (i = 0; i < ULOG_THREADS; i++) {
+            ring = rings[i];
+            if (!ring || ring->head == ring->tail) {
+                continue;
+            }
+            if (!next || (int32_t)(ring->rec[ring->tail & (ULOG_RING_LEN - 1)].seq
+                        - next->rec[next->tail & (ULOG_RING_LEN - 1)].seq) < 0) {
+                next = ring;
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        __sync_synchronize();
+        r = &next->rec[next->tail & (ULOG_RING_LEN - 1)];
+        if (r->suppressed) {
+            snprintf(buf, sizeof(buf), "[ulog]: %u records suppressed\n", r->suppressed);
+            ulog_print(LOG_NOTICE, buf);
+        }
+        ulog_format(buf, sizeof(buf), r);
+        ulog_print(r->level, buf);
+
+        __sync_synchronize();
+        next->tail++;
+        printed++;
+    }
+
+    for (i = 0; i < ULOG_THREADS; i++) {
+        ring = rings[i];
+        if (ring && ring->dropped != ring->reported) {
+            dropped = ring->dropped;
+            snprintf(buf, sizeof(buf), "[ulog]: %u records dropped\n", dropped - ring->reported);
+            ulog_print(LOG_WARNING, buf);
+            ring->reported = dropped;
+        }
+    }
+    if (no_ring != no_ring_reported) {
+        dropped = no_ring;
+        snprintf(buf, sizeof(buf), "[ulog]: %u records of threads without a ring dropped\n",
+                dropped - no_ring_reported);
+        ulog_print(LOG_WARNING, buf);
+        no_ring_reported = dropped;
+    }
+
+    if (printed) {
+        fflush(stdout);
+    }
+    return printed;
+}
+
+static void *ulog_thread_worker(void *arg)
+{
+    /* SCHED_OTHER by default, below the other threads of the process */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), ULOG_NICE);
+
+    FTRACE_THREAD("ulog");
+    printf("[ulog]: start up log thread\n");
+    while (!thread_quit) {
+        if (ulog_drain() == 0) {
+            usleep(ULOG_PERIOD_US);
+        }
+    }
+    ulog_drain();
+
+    printf("Leaving log thread!\n");
+    return NULL;
+}
+
+void ulog_stats(uint32_t *pending, uint32_t *dropped)
+{
+    struct ulog_ring *ring;
+    int i;
+
+    *pending = 0;
+    *dropped = no_ring;
+    for (i = 0; i < ULOG_THREADS; i++) {
+        ring = rings[i];
+        if (ring) {
+            *pending += ring->head - ring->tail;
+            *dropped += ring->dropped;
+        }
+    }
+}
+
+int ulog_init(void)
+{
+    int ret;
+
+    if (running) {
+        return 0;
+    }
+
+    if (pthread_key_create(&ring_key, ulog_thread_exit)) {
+        return -1;
+    }
+
+    thread_quit = false;
+    running = true;
+
+    printf("--- Creating ulog_thread...");
+    ret = rt_thread_create(RT_LOG, &ulog_thread, ulog_thread_worker, NULL);
+    if (ret) {
+        running = false;
+        printf("create log thread failed with ret %d\n", ret);
+        return -1;
+    } else {
+        printf("done ---\n");
+    }
+    return 0;
+}
+
+/*
+ * Print what is left, later records are printed right away
+ */
+void ulog_exit(void)
+{
+    if (!running) {
+        return;
+    }
+
+    running = false;
+    thread_quit = true;
+    pthread_join(ulog_thread, NULL);
+}
@@ -0,0 +1,76 @@
+/*
+ * Unicorn 3D Printer Firmware
+ * ulog.h
+ * asynchronous logging, a thread writes the format and its arguments
+ * into a ring of its own and the log thread prints them
+*/
+#ifndef _ULOG_H
+#define _ULOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <syslog.h>
+
+/* Levels of syslog.h above this are compiled out */
+#ifndef ULOG_COMPILE_LEVEL
+#define ULOG_COMPILE_LEVEL  LOG_DEBUG
+#endif
+
+#define ULOG_RING_LEN       (256)       /* records per thread, power of 2 */
+#define ULOG_THREADS        (16)
+#define ULOG_ARGS           (8)
+#define ULOG_STR_LEN        (80)        /* bytes of the %s arguments of a record */
+#define ULOG_RATE           (50)        /* records per second of a call site */
+
+/* Rate limit of a call site */
+typedef struct {
+    uint32_t sec;
+    uint32_t count;
+    uint32_t suppressed;
+} ulog_limit_t;
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+extern volatile int ulog_level;         /* runtime level, LOG_INFO */
+extern volatile int ulog_syslog_level;  /* also to syslog up to, LOG_INFO */
+extern volatile int ulog_rate;          /* per call site and second, 0 unlimited */
+
+/*
+ * Queue a record, printed as printf(fmt, ...) would by the log thread.
+ * Before ulog_init() it is printed right away.
+ */
+extern void ulog_write(ulog_limit_t *limit, int level, const char *fmt, ...)
+                       __attribute__((format(printf, 3, 4)));
+
+/* Records queued and not printed, dropped as the ring was full */
+extern void ulog_stats(uint32_t *pending, uint32_t *dropped);
+
+extern int ulog_init(void);
+extern void ulog_exit(void);
+
+#if defined (__cplusplus)
+}
+#endif
+
+#define ULOG_ENABLED(level)     ((level) <= ULOG_COMPILE_LEVEL)
+
+#define ULOG(level, fmt, ...)                                           \
+        do {                                                            \
+            static ulog_limit_t _ulog_limit;                            \
+            if (ULOG_ENABLED(level) && (level) <= ulog_level) {         \
+                ulog_write(&_ulog_limit, level, fmt, ##__VA_ARGS__);    \
+            }                                                           \
+        } while (0)
+
+/* Debug records of a module, enabled by the D_* bits of debug, M111 */
+#define ULOG_DBG(mask, fmt, ...)                                        \
+        do {                                                            \
+            static ulog_limit_t _ulog_limit;                            \
+            if (ULOG_ENABLED(LOG_DEBUG) && DBG(mask)) {                 \
+                ulog_write(&_ulog_limit, LOG_DEBUG, fmt, ##__VA_ARGS__);\
+            }                                                           \
+        } while (0)
+
+#endif
@@ -24,7 +24,10 @@
 #include "lmsw.h"
 #include "stepper.h"
 #include "planner.h"
+#include "latency.h"
+#include "kinematics.h"
 #include "gcode.h"
+#include "rt.h"
 #include "unicorn.h"
 #include "eeprom.h"
 #include "test.h"
@@ -893,6 +896,13 @@ int unicorn_init(void)
     board_info_t board_info; 
 
 	printf("unicorn_init...\n");
+
+    /* First, the sub systems log through it */
+    ret = ulog_init();
+    if (ret < 0) {
+        printf("ulog_init failed, logging synchronously\n");
+    }
+
     ret = eeprom_read_board_info(EEPROM_DEV, &board_info);
     if (ret < 0) {
         printf("Read eeprom board info failed\n");
@@ -943,6 +953,11 @@ int unicorn_init(void)
         return ret;
     }
 
+    ret = kinematics_init();
+    if (ret < 0) {
+        printf("kinematics_init failed\n");
+    }
+
     ret = analog_init();
     if (ret < 0) {
         printf("analog_init failed\n");
@@ -1000,6 +1015,12 @@ int unicorn_init(void)
         printf("stepper_init failed\n");
         return ret;
     }
+
+    ret = latency_init();
+    if (ret < 0) {
+        printf("latency_init failed\n");
+        return ret;
+    }
     
     ret = gcode_init();
     if (ret < 0) {
@@ -1055,6 +1076,7 @@ void unicorn_exit(int blocking)
 
     heater_exit();
     gcode_exit();
+    latency_exit();
     stepper_exit(blocking);
     plan_exit();
 
@@ -1084,6 +1106,7 @@ void unicorn_exit(int blocking)
     }
 
     fan_exit(); //???? glibc detected *** /usr/bin/unicorn: corrupted double-linked list: 0x0007e330 
+    ulog_exit();
     printf("unicorn_exit..., done\n");
 }
 /*
@@ -1306,26 +1329,11 @@ static void *test_thread_worker(void *arg)
 
 static void start_test_thread()
 {
-    int ret, i;
-    pthread_attr_t attr;
-    struct sched_param sched;
+    int ret;
 	pthread_t test_thread;
 
-	if (pthread_attr_init(&attr)) {
-		return;
-	}
-
-	if (pthread_attr_setschedpolicy(&attr, PTHREAD_EXPLICIT_SCHED)) {
-		return;
-	}
-	sched.sched_priority = sched_get_priority_max(SCHED_FIFO);
-
-	if (pthread_attr_setschedparam(&attr, &sched)) {
-		return ;
-	}
-
 	printf("--- Creating test_thread..."); 
-	ret = pthread_create(&test_thread, &attr, test_thread_worker, NULL);
+	ret = rt_thread_create(RT_TEST, &test_thread, test_thread_worker, NULL);
 	if (ret) {
 		printf("create gcode thread failed with ret %d\n", ret);
 		return ;